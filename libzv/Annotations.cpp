@@ -24,6 +24,7 @@ struct AnnotationRenderer::Impl
     ImGuiContext* _sharedImguiContext = nullptr;
     ImGuiContext* _prevContext = nullptr;
     ImageSRGBA _downloadBuffer;
+    GLDisplayShader _displayShader;
     int imageWidth = -1;
     int imageHeight = -1;
 };
@@ -70,8 +71,8 @@ void AnnotationRenderer::disableContext ()
 
 void AnnotationRenderer::beginRendering (const ImageItemData& input)
 {
-    const int inW = input.cpuData->width();
-    const int inH = input.cpuData->height();
+    const int inW = input.width();
+    const int inH = input.height();
 
     impl->imageWidth = inW;
     impl->imageHeight = inH;
@@ -87,7 +88,17 @@ void AnnotationRenderer::beginRendering (const ImageItemData& input)
     ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(0,0));
     ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0);
     ImGui::Begin("#empty", nullptr, windowFlagsWithoutAnything());
-    ImGui::Image(reinterpret_cast<void*>(input.textureData->textureId()), ImVec2(inW, inH));
+    if (input.nativeData)
+    {
+        GLDisplayParams displayParams;
+        displayParams.input = input.displayInputRange ();
+        impl->_displayShader.beginImguiFrame ();
+        impl->_displayShader.imguiImage(input.textureData->textureId(), ImVec2(inW, inH), ImVec2(0,0), ImVec2(1,1), displayParams);
+    }
+    else
+    {
+        ImGui::Image(reinterpret_cast<void*>(input.textureData->textureId()), ImVec2(inW, inH));
+    }
     // ImGui::GetWindowDrawList()->AddRectFilled(ImVec2(10, 10), ImVec2(64, 64), IM_COL32(0, 0, 255, 255));
 }
 
@@ -136,8 +147,8 @@ void AnnotationRenderer::endRendering (ImageItemData& output)
 
 void AnnotationModifier::apply (const ImageItemData& inputData, ImageItemData& outputData, AnnotationRenderer& annotationRenderer)
 {   
-    const int w = inputData.cpuData->width();
-    const int h = inputData.cpuData->height();
+    const int w = inputData.width();
+    const int h = inputData.height();
 
     annotationRenderer.beginRendering (inputData);
     renderAnnotation (w, h);
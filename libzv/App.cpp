@@ -9,6 +9,10 @@
 #include <libzv/Viewer.h>
 #include <libzv/Utils.h>
 #include <libzv/Server.h>
+#include <libzv/BatchCli.h>
+#include <libzv/FolderJoin.h>
+#include <libzv/HeadlessBench.h>
+#include <libzv/KernelBench.h>
 
 #include "GeneratedConfig.h"
 
@@ -22,6 +26,44 @@
 namespace zv
 {
 
+namespace
+{
+
+// Adds the files of each tuple consecutively, with one column per folder
+// so each page shows a single tuple. Prints what could not be matched.
+bool addComparedFolders (Viewer& viewer, const std::vector<std::string>& folders, FolderJoinKey key)
+{
+    FolderJoinResult result;
+    if (!joinFolders (folders, key, result))
+    {
+        std::cerr << "Could not list the folders to compare" << std::endl;
+        return false;
+    }
+
+    const int maxUnmatchedToPrint = 10;
+    for (int folderIdx = 0; folderIdx < folders.size(); ++folderIdx)
+    {
+        const auto& unmatched = result.unmatched[folderIdx];
+        std::cerr << folders[folderIdx] << ": " << result.numFiles[folderIdx] << " images, "
+                  << unmatched.size() << " unmatched" << std::endl;
+        for (int i = 0; i < std::min(int(unmatched.size()), maxUnmatchedToPrint); ++i)
+            std::cerr << "    " << unmatched[i] << std::endl;
+        if (unmatched.size() > maxUnmatchedToPrint)
+            std::cerr << "    ..." << std::endl;
+    }
+    std::cerr << result.tuples.size() << " images to compare" << std::endl;
+
+    for (const auto& tuple : result.tuples)
+    for (const auto& path : tuple)
+        viewer.addImageFromFile (path, false /* no need to check for existing */);
+
+    viewer.refreshPrettyFileNames ();
+    viewer.setLayout (1, int(folders.size()));
+    return true;
+}
+
+} // anonymous
+
 struct App::Impl
 {
     Impl (App& that) : that(that) {}
@@ -36,6 +78,13 @@ struct App::Impl
     std::unique_ptr<argparse::ArgumentParser> argsParser;
 
     std::unordered_map<std::string, std::unique_ptr<Viewer>> viewers;
+
+    // Set with --headless-bench, run replaces the event loop.
+    std::unique_ptr<HeadlessBench> headlessBench;
+    bool kernelBench = false;
+
+    // Set with --batch, run processes the files without any window.
+    std::unique_ptr<BatchCliConfig> batchCli;
     
     void updateOnce ()
     {
@@ -115,6 +164,63 @@ bool App::initialize (const std::vector<std::string>& args)
        .default_value(false)
        .implicit_value(true);
 
+    argsParser.add_argument("--headless-bench")
+       .help("Render offscreen without a display, replay a fixed sequence of actions and print the frame times.")
+       .default_value(false)
+       .implicit_value(true);
+
+    argsParser.add_argument("--bench-kernels")
+       .help("Time the CPU image kernels against reference loops and exit.")
+       .default_value(false)
+       .implicit_value(true);
+
+    argsParser.add_argument("--batch")
+       .help("Apply --rotate, --crop and --resize to the images without opening a window, write them to --output and exit.")
+       .default_value(false)
+       .implicit_value(true);
+
+    argsParser.add_argument("--rotate")
+       .help("Batch mode: clockwise rotation, 90, 180 or 270")
+       .scan<'i', int>()
+       .default_value(0);
+
+    argsParser.add_argument("--crop")
+       .help("Batch mode: crop as x,y,w,h in pixels, after the rotation");
+
+    argsParser.add_argument("--resize")
+       .help("Batch mode: output size as WxH, Wx or xH to keep the aspect ratio");
+
+    argsParser.add_argument("--filter")
+       .help("Batch mode: resize filter, box, bilinear, lanczos3 or area")
+       .default_value(std::string("lanczos3"));
+
+    argsParser.add_argument("--output", "-o")
+       .help("Batch mode: output folder, use --overwrite to replace the input files instead");
+
+    argsParser.add_argument("--overwrite")
+       .help("Batch mode: replace the input files")
+       .default_value(false)
+       .implicit_value(true);
+
+    argsParser.add_argument("--compare")
+       .help("Treat the images as folders and show their files side by side, one folder per column, matched by relative path.")
+       .default_value(false)
+       .implicit_value(true);
+
+    argsParser.add_argument("--compare-by-stem")
+       .help("Compare mode: ignore the file extensions when matching the files")
+       .default_value(false)
+       .implicit_value(true);
+
+    argsParser.add_argument("--bench-layouts")
+       .help("Grid layouts used by --headless-bench")
+       .default_value(std::string("1x1,2x2,4x4,8x8"));
+
+    argsParser.add_argument("--bench-frames")
+       .help("Frames rendered after each action of --headless-bench")
+       .scan<'i', int>()
+       .default_value(10);
+
    try
    {
        argsParser.parse_args(args);
@@ -127,23 +233,128 @@ bool App::initialize (const std::vector<std::string>& args)
        return false;
    }
 
-   Viewer *defaultViewer = createViewer("default");
-   defaultViewer->initialize();
+   // No window needed.
+   if (argsParser["--bench-kernels"] == true)
+   {
+       impl->kernelBench = true;
+       return true;
+   }
 
-   try
+   if (argsParser["--batch"] == true)
    {
-       auto images = argsParser.get<std::vector<std::string>>("images");
-       zv_dbg("%d images provided", (int)images.size());
+       auto config = std::make_unique<BatchCliConfig>();
+       try
+       {
+           config->inputPaths = argsParser.get<std::vector<std::string>>("images");
+       }
+       catch (const std::exception &err)
+       {
+           std::cerr << "--batch needs input images" << std::endl;
+           return false;
+       }
+
+       config->rotation = argsParser.get<int>("--rotate");
+       if (config->rotation != 0 && config->rotation != 90 && config->rotation != 180 && config->rotation != 270)
+       {
+           std::cerr << "Invalid --rotate, expected 90, 180 or 270" << std::endl;
+           return false;
+       }
+
+       if (auto crop = argsParser.present<std::string>("--crop"))
+       {
+           config->hasCrop = parseCropRect (*crop, config->cropX, config->cropY, config->cropWidth, config->cropHeight);
+           if (!config->hasCrop)
+           {
+               std::cerr << "Invalid --crop, expected x,y,w,h" << std::endl;
+               return false;
+           }
+       }
+
+       if (auto resize = argsParser.present<std::string>("--resize"))
+       {
+           if (!parseResizeSize (*resize, config->resizeWidth, config->resizeHeight))
+           {
+               std::cerr << "Invalid --resize, expected WxH" << std::endl;
+               return false;
+           }
+       }
+
+       if (!parseResampleFilter (argsParser.get<std::string>("--filter"), config->filter))
+       {
+           std::cerr << "Invalid --filter" << std::endl;
+           return false;
+       }
+
+       if (auto output = argsParser.present<std::string>("--output"))
+           config->outputDir = *output;
+       if (config->outputDir.empty() && argsParser["--overwrite"] == false)
+       {
+           std::cerr << "--batch needs --output or --overwrite" << std::endl;
+           return false;
+       }
+
+       impl->batchCli = std::move(config);
+       return true;
+   }
 
-       for (const auto &im : images)
-           defaultViewer->addImageFromFile(im, false /* no need to check for existing */);
+   const bool headlessBench = argsParser["--headless-bench"] == true;
+   if (headlessBench)
+   {
+       HeadlessBenchConfig config;
+       config.framesPerAction = std::max(argsParser.get<int>("--bench-frames"), 1);
+       if (!parseBenchLayouts (argsParser.get<std::string>("--bench-layouts"), config.layouts))
+       {
+           std::cerr << "Invalid --bench-layouts, expected something like 1x1,2x2" << std::endl;
+           return false;
+       }
+       impl->headlessBench = std::make_unique<HeadlessBench>(config);
+
+       // No window system needed, the GL contexts come from OSMesa.
+       glfwInitHint (GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+   }
 
-        defaultViewer->refreshPrettyFileNames ();
+   Viewer *defaultViewer = createViewer("default");
+   if (!defaultViewer->initialize() && headlessBench)
+   {
+       std::cerr << "Could not create the offscreen window, is OSMesa available?" << std::endl;
+       return false;
    }
-   catch (const std::exception &err)
+
+   if (argsParser["--compare"] == true)
    {
-       zv_dbg("No images provided, using default.");
+       std::vector<std::string> folders;
+       if (auto images = argsParser.present<std::vector<std::string>>("images"))
+           folders = *images;
+       if (folders.size() < 2)
+       {
+           std::cerr << "--compare needs at least 2 folders" << std::endl;
+           return false;
+       }
+
+       const FolderJoinKey key = argsParser["--compare-by-stem"] == true ? FolderJoinKey::Stem : FolderJoinKey::RelativePath;
+       if (!addComparedFolders (*defaultViewer, folders, key))
+           return false;
    }
+   else
+   {
+       try
+       {
+           auto images = argsParser.get<std::vector<std::string>>("images");
+           zv_dbg("%d images provided", (int)images.size());
+
+           for (const auto &im : images)
+               defaultViewer->addImageFromFile(im, false /* no need to check for existing */);
+
+            defaultViewer->refreshPrettyFileNames ();
+       }
+       catch (const std::exception &err)
+       {
+           zv_dbg("No images provided, using default.");
+       }
+   }
+
+   if (headlessBench)
+       return true;
 
    bool couldStart = impl->server.start(argsParser.get<std::string>("--interface"), argsParser.get<int>("--port"));
    if (argsParser["--require-server"] == true && !couldStart)
@@ -154,14 +365,27 @@ bool App::initialize (const std::vector<std::string>& args)
    return true;
 }
 
-void App::run ()
+bool App::run ()
 {
+    if (impl->kernelBench)
+        return runKernelBench ();
+
+    if (impl->batchCli)
+        return runBatchCli (*impl->batchCli);
+
+    if (impl->headlessBench)
+    {
+        Viewer* viewer = getViewer ();
+        return viewer && impl->headlessBench->run (*viewer);
+    }
+
     zv::RateLimit rateLimit;
     while (numViewers() > 0)
     {
         updateOnce();
         rateLimit.sleepIfNecessary(1 / 30.);
     }
+    return true;
 }
 
 void App::shutdown()
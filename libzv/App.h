@@ -37,7 +37,8 @@ public:
 
     void updateOnce (double minDuration = 0.0);
 
-    void run ();
+    // Returns false if a benchmark or a batch failed.
+    bool run ();
    
 private:
     struct Impl;
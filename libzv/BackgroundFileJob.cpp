@@ -0,0 +1,127 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "BackgroundFileJob.h"
+
+#include <libzv/ThreadPool.h>
+#include <libzv/Utils.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace zv
+{
+
+struct BackgroundFileJob::Impl
+{
+    std::thread runner;
+    int numFiles = 0;
+    ProcessFileFunc processFile;
+    FinishedFunc onFinished;
+
+    std::atomic<bool> running {false};
+    std::atomic<bool> cancelRequested {false};
+    std::atomic<int> numProcessed {0};
+    std::atomic<int> numFailed {0};
+    double startTime = 0.;
+    std::atomic<double> endTime {0.};
+
+    mutable std::mutex errorMutex;
+    std::string lastError;
+
+    void join ()
+    {
+        if (runner.joinable())
+            runner.join ();
+    }
+
+    void run ();
+};
+
+void BackgroundFileJob::Impl::run ()
+{
+    // The pool threads run their nested kernels serially, one file per
+    // thread is enough to keep them busy.
+    ThreadPool pool (ThreadPool::instance().numThreads() - 1);
+    pool.parallelFor (numFiles, [this](int i) {
+        if (cancelRequested)
+            return;
+
+        std::string error;
+        if (!processFile (i, error))
+        {
+            std::lock_guard<std::mutex> lock (errorMutex);
+            lastError = error;
+            ++numFailed;
+        }
+        ++numProcessed;
+    });
+
+    if (onFinished)
+        onFinished (cancelRequested);
+    endTime = currentDateInSeconds ();
+    running = false;
+}
+
+BackgroundFileJob::BackgroundFileJob ()
+: impl (new Impl ())
+{}
+
+BackgroundFileJob::~BackgroundFileJob ()
+{
+    cancel ();
+    impl->join ();
+}
+
+bool BackgroundFileJob::start (int numFiles, ProcessFileFunc&& processFile, FinishedFunc&& onFinished)
+{
+    if (impl->running)
+        return false;
+    impl->join ();
+
+    impl->numFiles = numFiles;
+    impl->processFile = std::move(processFile);
+    impl->onFinished = std::move(onFinished);
+    impl->cancelRequested = false;
+    impl->numProcessed = 0;
+    impl->numFailed = 0;
+    impl->lastError.clear ();
+    impl->startTime = currentDateInSeconds ();
+    impl->running = true;
+    impl->runner = std::thread ([this]() { impl->run (); });
+    return true;
+}
+
+void BackgroundFileJob::cancel ()
+{
+    impl->cancelRequested = true;
+}
+
+bool BackgroundFileJob::isRunning () const
+{
+    return impl->running;
+}
+
+BackgroundFileJob::Progress BackgroundFileJob::progress () const
+{
+    Progress progress;
+    progress.running = impl->running;
+    progress.cancelled = impl->cancelRequested;
+    progress.numFiles = impl->numFiles;
+    progress.numProcessed = impl->numProcessed;
+    progress.numFailed = impl->numFailed;
+    if (progress.numFiles > 0)
+    {
+        const double endTime = progress.running ? currentDateInSeconds () : impl->endTime.load();
+        progress.elapsedSeconds = endTime - impl->startTime;
+    }
+    std::lock_guard<std::mutex> lock (impl->errorMutex);
+    progress.lastError = impl->lastError;
+    return progress;
+}
+
+} // zv
@@ -0,0 +1,60 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace zv
+{
+
+// Processes many files in the background, each by a single worker of a
+// dedicated pool, so there is at most one file per worker in memory and
+// the interactive work does not queue behind the job.
+class BackgroundFileJob
+{
+public:
+    struct Progress
+    {
+        bool running = false;
+        bool cancelled = false;
+        int numFiles = 0;
+        // Including the failed ones.
+        int numProcessed = 0;
+        int numFailed = 0;
+        double elapsedSeconds = 0.;
+        std::string lastError;
+    };
+
+    // Returns false if the file failed, with the reason in error.
+    using ProcessFileFunc = std::function<bool(int fileIndex, std::string& error)>;
+
+    // Called by the runner thread once all the files got processed, before
+    // isRunning becomes false.
+    using FinishedFunc = std::function<void(bool cancelled)>;
+
+public:
+    BackgroundFileJob ();
+    // Cancels the current job and waits for it.
+    ~BackgroundFileJob ();
+
+    // Returns false if a job is already running.
+    bool start (int numFiles, ProcessFileFunc&& processFile, FinishedFunc&& onFinished = nullptr);
+
+    // The files already being processed still finish.
+    void cancel ();
+
+    bool isRunning () const;
+    Progress progress () const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // zv
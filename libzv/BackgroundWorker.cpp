@@ -0,0 +1,73 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "BackgroundWorker.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace zv
+{
+
+struct BackgroundWorker::Impl
+{
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable taskCondition;
+    std::deque<std::function<void()>> tasks;
+    bool stopRequested = false;
+
+    void run ()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock (mutex);
+                taskCondition.wait (lock, [this]() { return stopRequested || !tasks.empty(); });
+                if (stopRequested)
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front ();
+            }
+
+            // Also releases the inputs captured by the task, here.
+            task ();
+            task = nullptr;
+        }
+    }
+};
+
+BackgroundWorker::BackgroundWorker ()
+: impl (new Impl())
+{
+    impl->thread = std::thread ([this]() { impl->run (); });
+}
+
+BackgroundWorker::~BackgroundWorker ()
+{
+    {
+        std::lock_guard<std::mutex> lock (impl->mutex);
+        impl->stopRequested = true;
+        impl->tasks.clear ();
+    }
+    impl->taskCondition.notify_all ();
+    impl->thread.join ();
+}
+
+void BackgroundWorker::post (std::function<void()>&& task)
+{
+    {
+        std::lock_guard<std::mutex> lock (impl->mutex);
+        impl->tasks.push_back (std::move(task));
+    }
+    impl->taskCondition.notify_one ();
+}
+
+} // zv
@@ -0,0 +1,80 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Utils.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace zv
+{
+
+// Filled once by a background task, polled by the UI thread.
+template <class T>
+class AsyncResult
+{
+public:
+    bool isReady () const { return _ready.load (std::memory_order_acquire); }
+
+    const T& value () const
+    {
+        zv_assert (isReady(), "The result is not ready");
+        return _value;
+    }
+
+    void publish (T&& value)
+    {
+        _value = std::move(value);
+        _ready.store (true, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> _ready { false };
+    T _value {};
+};
+
+template <class T>
+using AsyncResultPtr = std::shared_ptr<AsyncResult<T>>;
+
+// A thread running the slow computations of the UI one after the other.
+// Unlike a std::async future, dropping a result never waits: a task
+// that has not started yet gets skipped, and a running one publishes
+// into nothing. The kernels inside the tasks still use the ThreadPool.
+class BackgroundWorker
+{
+public:
+    BackgroundWorker ();
+    // Drops the queued tasks and waits for the running one.
+    ~BackgroundWorker ();
+
+    void post (std::function<void()>&& task);
+
+    // Runs compute() on the worker thread, the result is only kept
+    // alive by the caller.
+    template <class T, class Func>
+    AsyncResultPtr<T> compute (Func&& func)
+    {
+        auto result = std::make_shared<AsyncResult<T>>();
+        std::weak_ptr<AsyncResult<T>> weakResult = result;
+        post ([weakResult, func = std::forward<Func>(func)]() mutable {
+            if (weakResult.expired())
+                return;
+            T value = func ();
+            if (auto result = weakResult.lock())
+                result->publish (std::move(value));
+        });
+        return result;
+    }
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // zv
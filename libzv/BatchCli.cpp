@@ -0,0 +1,178 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "BatchCli.h"
+
+#include <libzv/Annotations.h>
+#include <libzv/BatchJob.h>
+#include <libzv/ThreadPool.h>
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace zv
+{
+
+bool parseCropRect (const std::string& str, int& x, int& y, int& width, int& height)
+{
+    char trailing = 0;
+    if (sscanf(str.c_str(), "%d,%d,%d,%d%c", &x, &y, &width, &height, &trailing) != 4)
+        return false;
+    return x >= 0 && y >= 0 && width > 0 && height > 0;
+}
+
+bool parseResizeSize (const std::string& str, int& width, int& height)
+{
+    const size_t sep = str.find ('x');
+    if (sep == std::string::npos)
+        return false;
+
+    auto parseDim = [](const std::string& s, int& value) {
+        if (s.empty())
+        {
+            value = 0;
+            return true;
+        }
+        char trailing = 0;
+        return sscanf(s.c_str(), "%d%c", &value, &trailing) == 1 && value > 0;
+    };
+
+    if (!parseDim (str.substr(0, sep), width) || !parseDim (str.substr(sep+1), height))
+        return false;
+    return width > 0 || height > 0;
+}
+
+bool parseResampleFilter (const std::string& str, ResampleFilter& filter)
+{
+    std::string lowerStr = str;
+    std::transform (lowerStr.begin(), lowerStr.end(), lowerStr.begin(), [](unsigned char c) { return std::tolower(c); });
+    for (int i = 0; i < int(ResampleFilter::NumFilters); ++i)
+    {
+        std::string name = resampleFilterName (ResampleFilter(i));
+        std::transform (name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (name == lowerStr)
+        {
+            filter = ResampleFilter(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace
+{
+
+bool createModifiers (const BatchCliConfig& config,
+                      const ImageSRGBA& input,
+                      std::deque<std::unique_ptr<ImageModifier>>& modifiers)
+{
+    int width = input.width();
+    int height = input.height();
+
+    switch (config.rotation)
+    {
+        case 0: break;
+        case 90: modifiers.push_back (std::make_unique<RotateImageModifier>(RotateImageModifier::Angle_90)); break;
+        case 180: modifiers.push_back (std::make_unique<RotateImageModifier>(RotateImageModifier::Angle_180)); break;
+        case 270: modifiers.push_back (std::make_unique<RotateImageModifier>(RotateImageModifier::Angle_270)); break;
+        default: return false;
+    }
+
+    if (config.rotation == 90 || config.rotation == 270)
+        std::swap (width, height);
+
+    if (config.hasCrop)
+    {
+        if (config.cropX + config.cropWidth > width || config.cropY + config.cropHeight > height)
+            return false;
+
+        // The crop modifier works with ratios, rounded back to the same pixels.
+        CropImageModifier::Params params;
+        params.textureRect = Rect::from_x_y_w_h (config.cropX / double(width),
+                                                 config.cropY / double(height),
+                                                 config.cropWidth / double(width),
+                                                 config.cropHeight / double(height));
+        modifiers.push_back (std::make_unique<CropImageModifier>(params));
+        width = config.cropWidth;
+        height = config.cropHeight;
+    }
+
+    if (config.resizeWidth > 0 || config.resizeHeight > 0)
+    {
+        int targetWidth = config.resizeWidth;
+        int targetHeight = config.resizeHeight;
+        if (targetWidth == 0)
+            targetWidth = std::max (int(double(width) * targetHeight / height + 0.5), 1);
+        if (targetHeight == 0)
+            targetHeight = std::max (int(double(height) * targetWidth / width + 0.5), 1);
+        modifiers.push_back (std::make_unique<ResizeImageModifier>(targetWidth, targetHeight, config.filter));
+    }
+
+    return true;
+}
+
+} // anonymous
+
+bool runBatchCli (const BatchCliConfig& config)
+{
+    if (config.inputPaths.empty())
+    {
+        fprintf (stderr, "No input images.\n");
+        return false;
+    }
+
+    // Never used, the batch modifiers do not draw annotations.
+    AnnotationRenderer annotationRenderer;
+    BatchJob batchJob (annotationRenderer);
+
+    const auto startTime = std::chrono::steady_clock::now();
+    BatchJob::CreateModifiersFunc createModifiersFunc = [&config](const ImageSRGBA& input, std::deque<std::unique_ptr<ImageModifier>>& modifiers) {
+        return createModifiers (config, input, modifiers);
+    };
+    if (!batchJob.start (config.inputPaths, std::move(createModifiersFunc), config.outputDir))
+    {
+        fprintf (stderr, "Could not start the batch, is %s writable and is each input listed once?\n", config.outputDir.c_str());
+        return false;
+    }
+
+    printf ("Processing %d images with %d threads\n", int(config.inputPaths.size()), ThreadPool::instance().numThreads());
+    int lastNumProcessed = -1;
+    while (batchJob.isRunning())
+    {
+        std::this_thread::sleep_for (std::chrono::milliseconds(100));
+        const auto progress = batchJob.progress();
+        if (progress.numProcessed != lastNumProcessed)
+        {
+            printf ("\r%d / %d", progress.numProcessed, progress.numFiles);
+            fflush (stdout);
+            lastNumProcessed = progress.numProcessed;
+        }
+    }
+
+    const double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    const auto progress = batchJob.progress();
+    const int numSucceeded = progress.numProcessed - progress.numFailed;
+    printf ("\r%d / %d\n", progress.numProcessed, progress.numFiles);
+    printf ("%d images in %.2f s: %.2f images/s, %.1f MPixels/s in, %.1f MB written\n",
+            numSucceeded,
+            elapsedSeconds,
+            numSucceeded / elapsedSeconds,
+            progress.numInputPixels / (elapsedSeconds * 1e6),
+            progress.numBytesWritten / (1024.0 * 1024.0));
+
+    if (progress.numFailed > 0)
+    {
+        fprintf (stderr, "%d images failed, last error: %s\n", progress.numFailed, progress.lastError.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // zv
@@ -0,0 +1,52 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Resampler.h>
+
+#include <string>
+#include <vector>
+
+namespace zv
+{
+
+struct BatchCliConfig
+{
+    std::vector<std::string> inputPaths;
+
+    // Empty to overwrite the input files.
+    std::string outputDir;
+
+    // Clockwise, 0, 90, 180 or 270. Applied first.
+    int rotation = 0;
+
+    // In pixels of the rotated image.
+    bool hasCrop = false;
+    int cropX = 0, cropY = 0, cropWidth = 0, cropHeight = 0;
+
+    // Applied last. A zero dimension keeps the aspect ratio, both zero
+    // means no resize.
+    int resizeWidth = 0;
+    int resizeHeight = 0;
+    ResampleFilter filter = ResampleFilter::Lanczos3;
+};
+
+// Parses "x,y,w,h". Returns false on invalid input.
+bool parseCropRect (const std::string& str, int& x, int& y, int& width, int& height);
+
+// Parses "WxH", "Wx" or "xH". Returns false on invalid input.
+bool parseResizeSize (const std::string& str, int& width, int& height);
+
+// Case insensitive, "box", "bilinear", "lanczos3" or "area".
+bool parseResampleFilter (const std::string& str, ResampleFilter& filter);
+
+// Runs the batch without any window, printing the progress and the
+// throughput at the end, so it also works as a benchmark of the whole
+// read / modify / encode pipeline. Returns false if any file failed.
+bool runBatchCli (const BatchCliConfig& config);
+
+} // zv
@@ -0,0 +1,241 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "BatchJob.h"
+
+#include <libzv/BackgroundFileJob.h>
+#include <libzv/Utils.h>
+
+#include <atomic>
+#include <filesystem>
+#include <set>
+
+namespace fs = std::filesystem;
+
+namespace zv
+{
+
+namespace
+{
+
+// Deepest folder containing all the inputs, empty when they do not share
+// a root (e.g. different Windows drives).
+fs::path commonParent (const std::vector<fs::path>& absolutePaths)
+{
+    if (absolutePaths.empty())
+        return fs::path();
+
+    fs::path common = absolutePaths[0].parent_path();
+    for (const auto& path : absolutePaths)
+    {
+        fs::path prefix;
+        const fs::path parent = path.parent_path();
+        auto commonIt = common.begin();
+        auto parentIt = parent.begin();
+        for (; commonIt != common.end() && parentIt != parent.end() && *commonIt == *parentIt; ++commonIt, ++parentIt)
+            prefix /= *commonIt;
+        common = prefix;
+    }
+    return common;
+}
+
+// Mirrors the input folders below outputDir, so files with the same name
+// in different folders do not overwrite each other. Returns false if two
+// inputs are the same file.
+bool computeOutputPaths (const std::vector<std::string>& inputPaths,
+                         const std::string& outputDir,
+                         std::vector<std::string>& outputPaths)
+{
+    std::vector<fs::path> absolutePaths;
+    for (const auto& inputPath : inputPaths)
+    {
+        std::error_code ec;
+        fs::path absolutePath = fs::absolute (inputPath, ec);
+        absolutePaths.push_back ((ec ? fs::path(inputPath) : absolutePath).lexically_normal());
+    }
+
+    const fs::path parent = commonParent (absolutePaths);
+    outputPaths.clear ();
+    std::set<std::string> uniquePaths;
+    for (const auto& path : absolutePaths)
+    {
+        const fs::path relativePath = parent.empty() ? path.relative_path() : path.lexically_relative (parent);
+        const std::string outputPath = outputDir.empty() ? path.string() : (fs::path(outputDir) / relativePath).string();
+        if (!uniquePaths.insert (outputPath).second)
+        {
+            zv_dbg ("%s is listed twice", path.string().c_str());
+            return false;
+        }
+        outputPaths.push_back (outputPath);
+    }
+    return true;
+}
+
+} // anonymous
+
+struct BatchJob::Impl
+{
+    Impl (AnnotationRenderer& annotationRenderer) : annotationRenderer (annotationRenderer)
+    {}
+
+    AnnotationRenderer& annotationRenderer;
+
+    std::vector<std::string> inputPaths;
+    std::vector<std::string> outputPaths;
+    CreateModifiersFunc createModifiers;
+    std::string outputDir;
+
+    std::atomic<int64_t> numInputPixels {0};
+    std::atomic<int64_t> numBytesWritten {0};
+
+    // Last, so it gets destroyed first and its runner stops using the rest.
+    BackgroundFileJob job;
+
+    bool processFile (const std::string& inputPath, const std::string& outputPath, std::string& error);
+};
+
+bool BatchJob::Impl::processFile (const std::string& inputPath, const std::string& outputPathString, std::string& error)
+{
+    auto input = std::make_shared<ImageItemData>();
+    input->cpuData = std::make_shared<ImageSRGBA>();
+    if (!readImageFile (inputPath, *input->cpuData))
+    {
+        error = "could not read " + inputPath;
+        return false;
+    }
+    input->status = ImageItemData::Status::Ready;
+
+    numInputPixels += int64_t(input->width()) * input->height();
+
+    std::deque<std::unique_ptr<ImageModifier>> fileModifiers;
+    if (!createModifiers (*input->cpuData, fileModifiers))
+    {
+        error = "invalid modifiers for " + inputPath;
+        return false;
+    }
+    ImageItemDataPtr output = ModifiedImage::applyModifiers (input, fileModifiers, annotationRenderer);
+
+    // Overwrite through a temporary file, so a failed write does not lose
+    // the original. The extension is kept since it selects the encoder.
+    const fs::path inPath = inputPath;
+    const bool inPlace = outputDir.empty();
+    const fs::path outputPath = inPlace ? inPath : fs::path(outputPathString);
+    const fs::path writePath = inPlace
+        ? inPath.parent_path() / (inPath.stem().string() + ".zv_batch_tmp" + inPath.extension().string())
+        : outputPath;
+
+    if (!inPlace)
+    {
+        std::error_code ec;
+        fs::create_directories (outputPath.parent_path(), ec);
+        if (ec)
+        {
+            error = "could not create " + outputPath.parent_path().string();
+            return false;
+        }
+    }
+
+    ImageWriteStats writeStats;
+    if (!writeImageFile (writePath.string(), output->srgbaData(), &writeStats))
+    {
+        error = "could not write " + writePath.string();
+        return false;
+    }
+    numBytesWritten += int64_t(writeStats.numBytes);
+
+    if (inPlace)
+    {
+        std::error_code ec;
+        fs::rename (writePath, outputPath, ec);
+        if (ec)
+        {
+            fs::remove (writePath, ec);
+            error = "could not replace " + outputPath.string();
+            return false;
+        }
+    }
+    return true;
+}
+
+BatchJob::BatchJob (AnnotationRenderer& annotationRenderer)
+: impl (new Impl (annotationRenderer))
+{}
+
+BatchJob::~BatchJob () = default;
+
+bool BatchJob::start (const std::vector<std::string>& inputPaths,
+                      std::deque<std::unique_ptr<ImageModifier>>&& modifiers,
+                      const std::string& outputDir)
+{
+    auto templates = std::make_shared<std::deque<std::unique_ptr<ImageModifier>>>(std::move(modifiers));
+    return start (inputPaths, [templates](const ImageSRGBA&, std::deque<std::unique_ptr<ImageModifier>>& fileModifiers) {
+        for (const auto& modifier : *templates)
+            fileModifiers.push_back (modifier->clone());
+        return true;
+    }, outputDir);
+}
+
+bool BatchJob::start (const std::vector<std::string>& inputPaths,
+                      CreateModifiersFunc&& createModifiers,
+                      const std::string& outputDir)
+{
+    if (impl->job.isRunning())
+        return false;
+
+    if (!outputDir.empty())
+    {
+        std::error_code ec;
+        fs::create_directories (outputDir, ec);
+        if (ec)
+        {
+            zv_dbg ("Could not create %s", outputDir.c_str());
+            return false;
+        }
+    }
+
+    if (!computeOutputPaths (inputPaths, outputDir, impl->outputPaths))
+        return false;
+
+    impl->inputPaths = inputPaths;
+    impl->createModifiers = std::move(createModifiers);
+    impl->outputDir = outputDir;
+    impl->numInputPixels = 0;
+    impl->numBytesWritten = 0;
+    Impl* implPtr = impl.get();
+    return impl->job.start (int(inputPaths.size()), [implPtr](int i, std::string& error) {
+        if (implPtr->processFile (implPtr->inputPaths[i], implPtr->outputPaths[i], error))
+            return true;
+        zv_dbg ("Batch: %s", error.c_str());
+        return false;
+    });
+}
+
+void BatchJob::cancel ()
+{
+    impl->job.cancel ();
+}
+
+bool BatchJob::isRunning () const
+{
+    return impl->job.isRunning ();
+}
+
+BatchJob::Progress BatchJob::progress () const
+{
+    const BackgroundFileJob::Progress jobProgress = impl->job.progress();
+    Progress progress;
+    progress.running = jobProgress.running;
+    progress.cancelled = jobProgress.cancelled;
+    progress.numFiles = jobProgress.numFiles;
+    progress.numProcessed = jobProgress.numProcessed;
+    progress.numFailed = jobProgress.numFailed;
+    progress.numInputPixels = impl->numInputPixels;
+    progress.numBytesWritten = impl->numBytesWritten;
+    progress.lastError = jobProgress.lastError;
+    return progress;
+}
+
+} // zv
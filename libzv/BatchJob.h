@@ -0,0 +1,74 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Modifiers.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace zv
+{
+
+class AnnotationRenderer;
+
+// Applies a stack of modifiers to many image files in the background,
+// with a BackgroundFileJob.
+class BatchJob
+{
+public:
+    struct Progress
+    {
+        bool running = false;
+        bool cancelled = false;
+        int numFiles = 0;
+        // Including the failed ones.
+        int numProcessed = 0;
+        int numFailed = 0;
+        int64_t numInputPixels = 0;
+        int64_t numBytesWritten = 0;
+        std::string lastError;
+    };
+
+    // Modifiers for one input image. Returning false fails the file, for
+    // example when a crop does not fit in the image.
+    using CreateModifiersFunc = std::function<bool(const ImageSRGBA& input, std::deque<std::unique_ptr<ImageModifier>>& modifiers)>;
+
+public:
+    // Passed to the modifiers, none of the cloneable ones actually uses it.
+    BatchJob (AnnotationRenderer& annotationRenderer);
+    // Cancels the current job and waits for it.
+    ~BatchJob ();
+
+    // The modifiers are templates, each file gets its own clones. The
+    // outputs keep the input paths relative to their common folder, an
+    // empty outputDir overwrites the input files. Returns false if a job
+    // is already running or if an input is listed twice.
+    bool start (const std::vector<std::string>& inputPaths,
+                std::deque<std::unique_ptr<ImageModifier>>&& modifiers,
+                const std::string& outputDir);
+
+    // Same, when the modifiers depend on the input image.
+    bool start (const std::vector<std::string>& inputPaths,
+                CreateModifiersFunc&& createModifiers,
+                const std::string& outputDir);
+
+    // The files already being processed still get written.
+    void cancel ();
+
+    bool isRunning () const;
+    Progress progress () const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // zv
@@ -6,7 +6,23 @@
 
 #include "ColorConversion.h"
 
+#include <libzv/ThreadPool.h>
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define ZV_COLOR_SSE2 1
+#else
+#  define ZV_COLOR_SSE2 0
+#endif
 
 namespace zv
 {
@@ -20,7 +36,7 @@ namespace zv
     }
 
     // From https://www.nayuki.io/res/srgb-transform-library
-    double srgbToLinear (double x)
+    static double srgbToLinear (double x)
     {
         if (x <= 0.0)
             return 0.0;
@@ -32,49 +48,90 @@ namespace zv
             return std::pow((x + 0.055) / 1.055, 2.4);
     }
 
-    // From https://www.nayuki.io/res/srgb-transform-library
-    double linearToSrgb(double x)
+    SrgbTables::SrgbTables ()
     {
-        if (x <= 0.0)
-            return 0.0;
-        else if (x >= 1.0)
-            return 1.0;
-        else if (x < 0.0031308)
-            return x * 12.92;
-        else
-            return std::pow(x, 1.0 / 2.4) * 1.055 - 0.055;
+        for (int i = 0; i < 256; ++i)
+            toLinear[i] = float(srgbToLinear(i / 255.0));
+
+        // Smallest float that rounds to the next level, the last one is
+        // never reached.
+        for (int i = 0; i < 255; ++i)
+        {
+            const double midpoint = srgbToLinear((i + 0.5) / 255.0);
+            float v = float(midpoint);
+            if (v < midpoint)
+                v = std::nextafter(v, 2.f);
+            roundingMidpoints[i] = v;
+        }
+        roundingMidpoints[255] = 2.f;
+
+        int value = 0;
+        for (int i = 0; i < int(toSrgbBase.size()); ++i)
+        {
+            const float binStart = i / 4096.f;
+            while (binStart >= roundingMidpoints[value])
+                ++value;
+            toSrgbBase[i] = value;
+            zv_assert ((i + 1) / 4096.f < roundingMidpoints[std::min(value + 1, 255)],
+                       "More than one midpoint in a bin");
+        }
+    }
+
+    const SrgbTables& srgbTables ()
+    {
+        static SrgbTables tables;
+        return tables;
     }
 
     PixelLinearRGB convertToLinearRGB(const PixelSRGBA& srgb)
     {
-        return PixelLinearRGB(srgbToLinear(srgb.r/255.0), srgbToLinear(srgb.g/255.0), srgbToLinear(srgb.b/255.0));
+        const auto& toLinear = srgbTables().toLinear;
+        return PixelLinearRGB(toLinear[srgb.r], toLinear[srgb.g], toLinear[srgb.b]);
     }
 
     PixelSRGBA convertToSRGBA(const PixelLinearRGB& rgb)
     {
-        return PixelSRGBA(roundAndSaturateToUint8(linearToSrgb(rgb.r)*255.0),
-                          roundAndSaturateToUint8(linearToSrgb(rgb.g)*255.0),
-                          roundAndSaturateToUint8(linearToSrgb(rgb.b)*255.0),
+        const auto& tables = srgbTables();
+        return PixelSRGBA(tables.linearToSrgb8(rgb.r),
+                          tables.linearToSrgb8(rgb.g),
+                          tables.linearToSrgb8(rgb.b),
                           255);
     }
 
+    void convertRowToLinearRGB (const PixelSRGBA* inRowPtr, int width, PixelLinearRGB* outRowPtr)
+    {
+        const auto& toLinear = srgbTables().toLinear;
+        for (int c = 0; c < width; ++c)
+        {
+            const PixelSRGBA p = inRowPtr[c];
+            outRowPtr[c] = PixelLinearRGB(toLinear[p.r], toLinear[p.g], toLinear[p.b]);
+        }
+    }
+
+    void convertRowToSRGBA (const PixelLinearRGB* inRowPtr, int width, PixelSRGBA* outRowPtr)
+    {
+        const auto& tables = srgbTables();
+        // Scalar on purpose, computing the table indices with SSE2 was
+        // slower because of the round trip through memory for the lookups.
+        for (int c = 0; c < width; ++c)
+        {
+            const PixelLinearRGB& p = inRowPtr[c];
+            outRowPtr[c] = PixelSRGBA(tables.linearToSrgb8(p.r),
+                                      tables.linearToSrgb8(p.g),
+                                      tables.linearToSrgb8(p.b),
+                                      255);
+        }
+    }
+
     ImageSRGBA convertToSRGBA(const ImageLinearRGB& rgb)
     {
         const int w = rgb.width();
         const int h = rgb.height();
         ImageSRGBA outImg(w, h);
-        for (int r = 0; r < h; ++r)
-        {
-            const auto* inPtr = rgb.atRowPtr(r);
-            const auto* lastInPtr = rgb.atRowPtr(r+1);
-            auto* outPtr = outImg.atRowPtr(r);
-            while (inPtr != lastInPtr)
-            {
-                *outPtr = convertToSRGBA(*inPtr);
-                ++inPtr;
-                ++outPtr;
-            }
-        }
+        parallel_for_rows (h, [&](int firstRow, int lastRow) {
+            for (int r = firstRow; r < lastRow; ++r)
+                convertRowToSRGBA (rgb.atRowPtr(r), w, outImg.atRowPtr(r));
+        });
         return outImg;
     }
 
@@ -83,120 +140,324 @@ namespace zv
         const int w = srgb.width();
         const int h = srgb.height();
         ImageLinearRGB outImg(w, h);
-        for (int r = 0; r < h; ++r)
+        parallel_for_rows (h, [&](int firstRow, int lastRow) {
+            for (int r = firstRow; r < lastRow; ++r)
+                convertRowToLinearRGB (srgb.atRowPtr(r), w, outImg.atRowPtr(r));
+        });
+        return outImg;
+    }
+
+    const char* colorVisionDeficiencyName (ColorVisionDeficiency deficiency)
+    {
+        switch (deficiency)
         {
-            const auto* inPtr = srgb.atRowPtr(r);
-            const auto* lastInPtr = srgb.atRowPtr(r+1);
-            auto* outPtr = outImg.atRowPtr(r);
-            while (inPtr != lastInPtr)
+            case ColorVisionDeficiency::Protan: return "Protan";
+            case ColorVisionDeficiency::Deutan: return "Deutan";
+            case ColorVisionDeficiency::Tritan: return "Tritan";
+            default: return "Invalid";
+        }
+    }
+
+    const CvdSimulationParams& cvdSimulationParams (ColorVisionDeficiency deficiency)
+    {
+        // Published Brettel 1997 parameters of DaltonLens, with the Viénot
+        // 1999 LMS model. The separation plane goes through white and the
+        // missing cone axis, its normal is given in linear RGB.
+        static const CvdSimulationParams params[] = {
+            // Protan
             {
-                *outPtr = convertToLinearRGB(*inPtr);
-                ++inPtr;
-                ++outPtr;
-            }
+                {
+                    ColMajorMatrix3f (0.14980f, 1.19548f, -0.34528f,
+                                      0.10764f, 0.84864f, 0.04372f,
+                                      0.00384f, -0.00540f, 1.00156f),
+                    ColMajorMatrix3f (0.14570f, 1.16172f, -0.30742f,
+                                      0.10816f, 0.85175f, 0.04009f,
+                                      0.00386f, -0.00531f, 1.00145f),
+                },
+                { 0.00048f, 0.00393f, -0.00441f },
+            },
+            // Deutan
+            {
+                {
+                    ColMajorMatrix3f (0.36477f, 0.86381f, -0.22858f,
+                                      0.26294f, 0.64245f, 0.09462f,
+                                      -0.02006f, 0.02728f, 0.99278f),
+                    ColMajorMatrix3f (0.37298f, 0.88166f, -0.25464f,
+                                      0.25954f, 0.63506f, 0.10540f,
+                                      -0.01980f, 0.02784f, 0.99196f),
+                },
+                { -0.00281f, -0.00611f, 0.00892f },
+            },
+            // Tritan
+            {
+                {
+                    ColMajorMatrix3f (1.01277f, 0.13548f, -0.14826f,
+                                      -0.01243f, 0.86812f, 0.14431f,
+                                      0.07589f, 0.80500f, 0.11911f),
+                    ColMajorMatrix3f (0.93678f, 0.18979f, -0.12657f,
+                                      0.06154f, 0.81526f, 0.12320f,
+                                      -0.37562f, 1.12767f, 0.24796f),
+                },
+                { 0.03901f, -0.02788f, -0.01113f },
+            },
+        };
+        zv_assert (int(deficiency) >= 0 && int(deficiency) < int(ColorVisionDeficiency::NumDeficiencies), "Invalid deficiency");
+        return params[int(deficiency)];
+    }
+
+    static inline void applyCvdToPixel (const CvdSimulationParams& params, float severity, bool daltonize,
+                                        float& r, float& g, float& b)
+    {
+        const float* n = params.separationPlaneNormal;
+        const ColMajorMatrix3f& m = params.rgbCvdFromRgb[r*n[0] + g*n[1] + b*n[2] >= 0.f ? 0 : 1];
+        const float simR = r + severity*(m.m00*r + m.m01*g + m.m02*b - r);
+        const float simG = g + severity*(m.m10*r + m.m11*g + m.m12*b - g);
+        const float simB = b + severity*(m.m20*r + m.m21*g + m.m22*b - b);
+        if (daltonize)
+        {
+            const float errR = r - simR;
+            g += 0.7f*errR + (g - simG);
+            b += 0.7f*errR + (b - simB);
+        }
+        else
+        {
+            r = simR;
+            g = simG;
+            b = simB;
         }
-        return outImg;
     }
 
-    ImageSRGBA srgbaFromSrgb (uint8_t* rgb_buffer, int w, int h, int bytesPerRow)
+    // In place on planar linear RGB, so SSE2 can process 4 pixels at once.
+    static void applyCvdToRow (const CvdSimulationParams& params, float severity, bool daltonize,
+                               float* rPtr, float* gPtr, float* bPtr, int width)
     {
-        ImageSRGBA outImg(w, h);
-        for (int r = 0; r < h; ++r)
+        int c = 0;
+#if ZV_COLOR_SSE2
+        const float* n = params.separationPlaneNormal;
+        const ColMajorMatrix3f& m0 = params.rgbCvdFromRgb[0];
+        const ColMajorMatrix3f& m1 = params.rgbCvdFromRgb[1];
+        const __m128 zero = _mm_setzero_ps ();
+        const __m128 vSeverity = _mm_set1_ps (severity);
+        const __m128 vErrorScale = _mm_set1_ps (0.7f);
+
+        // Both projections get computed, then selected per lane.
+        auto row = [](const __m128& r, const __m128& g, const __m128& b, float c0, float c1, float c2) {
+            return _mm_add_ps (_mm_add_ps (_mm_mul_ps (r, _mm_set1_ps(c0)), _mm_mul_ps (g, _mm_set1_ps(c1))),
+                               _mm_mul_ps (b, _mm_set1_ps(c2)));
+        };
+        auto select = [](const __m128& mask, const __m128& ifTrue, const __m128& ifFalse) {
+            return _mm_or_ps (_mm_and_ps (mask, ifTrue), _mm_andnot_ps (mask, ifFalse));
+        };
+
+        for (; c + 4 <= width; c += 4)
         {
-            const uint8_t* inRowPtr = rgb_buffer + r*bytesPerRow;
-            auto* outPtr = outImg.atRowPtr(r);
-            for (int c = 0; c < w; ++c)
+            const __m128 r = _mm_loadu_ps (rPtr + c);
+            const __m128 g = _mm_loadu_ps (gPtr + c);
+            const __m128 b = _mm_loadu_ps (bPtr + c);
+            const __m128 side = _mm_cmpge_ps (row (r, g, b, n[0], n[1], n[2]), zero);
+            const __m128 projR = select (side, row (r, g, b, m0.m00, m0.m01, m0.m02), row (r, g, b, m1.m00, m1.m01, m1.m02));
+            const __m128 projG = select (side, row (r, g, b, m0.m10, m0.m11, m0.m12), row (r, g, b, m1.m10, m1.m11, m1.m12));
+            const __m128 projB = select (side, row (r, g, b, m0.m20, m0.m21, m0.m22), row (r, g, b, m1.m20, m1.m21, m1.m22));
+            const __m128 simR = _mm_add_ps (r, _mm_mul_ps (vSeverity, _mm_sub_ps (projR, r)));
+            const __m128 simG = _mm_add_ps (g, _mm_mul_ps (vSeverity, _mm_sub_ps (projG, g)));
+            const __m128 simB = _mm_add_ps (b, _mm_mul_ps (vSeverity, _mm_sub_ps (projB, b)));
+            if (daltonize)
             {
-                PixelSRGBA p;
-                p.r = inRowPtr[c*3 + 0];
-                p.g = inRowPtr[c*3 + 1];
-                p.b = inRowPtr[c*3 + 2];
-                p.a = 255;
-                outPtr[c] = p;
+                const __m128 scaledErrR = _mm_mul_ps (vErrorScale, _mm_sub_ps (r, simR));
+                _mm_storeu_ps (gPtr + c, _mm_add_ps (g, _mm_add_ps (scaledErrR, _mm_sub_ps (g, simG))));
+                _mm_storeu_ps (bPtr + c, _mm_add_ps (b, _mm_add_ps (scaledErrR, _mm_sub_ps (b, simB))));
+            }
+            else
+            {
+                _mm_storeu_ps (rPtr + c, simR);
+                _mm_storeu_ps (gPtr + c, simG);
+                _mm_storeu_ps (bPtr + c, simB);
             }
         }
-        return outImg;
+#endif
+        for (; c < width; ++c)
+            applyCvdToPixel (params, severity, daltonize, rPtr[c], gPtr[c], bPtr[c]);
     }
 
-    ImageSRGBA srgbaFromGray (uint8_t* rgb_buffer, int w, int h, int bytesPerRow)
+    static void applyCvd (const ImageSRGBA& input, ColorVisionDeficiency deficiency, float severity, bool daltonize, ImageSRGBA& output)
     {
-        ImageSRGBA outImg(w, h);
-        for (int r = 0; r < h; ++r)
-        {
-            const uint8_t* inRowPtr = rgb_buffer + r*bytesPerRow;
-            auto* outPtr = outImg.atRowPtr(r);
-            for (int c = 0; c < w; ++c)
+        const CvdSimulationParams& params = cvdSimulationParams (deficiency);
+        const SrgbTables& tables = srgbTables();
+        const int w = input.width();
+        const int h = input.height();
+        output.ensureAllocatedBufferForSize (w, h);
+        severity = std::min (std::max (severity, 0.f), 1.f);
+        parallel_for_rows (h, [&](int firstRow, int lastRow) {
+            std::vector<float> planes (3*w);
+            float* rPtr = planes.data();
+            float* gPtr = rPtr + w;
+            float* bPtr = gPtr + w;
+            for (int r = firstRow; r < lastRow; ++r)
             {
-                PixelSRGBA p;
-                uint8_t v = inRowPtr[c + 0];
-                p.r = v;
-                p.g = v;
-                p.b = v;
-                p.a = 255;
-                outPtr[c] = p;
+                // Can be the same image, each row is read before being written.
+                const PixelSRGBA* inPtr = input.atRowPtr(r);
+                for (int c = 0; c < w; ++c)
+                {
+                    rPtr[c] = tables.toLinear[inPtr[c].r];
+                    gPtr[c] = tables.toLinear[inPtr[c].g];
+                    bPtr[c] = tables.toLinear[inPtr[c].b];
+                }
+
+                applyCvdToRow (params, severity, daltonize, rPtr, gPtr, bPtr, w);
+
+                PixelSRGBA* outPtr = output.atRowPtr(r);
+                for (int c = 0; c < w; ++c)
+                {
+                    outPtr[c] = PixelSRGBA(tables.linearToSrgb8(rPtr[c]),
+                                           tables.linearToSrgb8(gPtr[c]),
+                                           tables.linearToSrgb8(bPtr[c]),
+                                           inPtr[c].a);
+                }
             }
+        });
+    }
+
+    void simulateColorVisionDeficiency (const ImageSRGBA& input, ColorVisionDeficiency deficiency, float severity, ImageSRGBA& output)
+    {
+        applyCvd (input, deficiency, severity, false /* daltonize */, output);
+    }
+
+    void daltonize (const ImageSRGBA& input, ColorVisionDeficiency deficiency, float severity, ImageSRGBA& output)
+    {
+        applyCvd (input, deficiency, severity, true /* daltonize */, output);
+    }
+
+    // Clamped, NaN gives 0. Same scale as before the clamping was added,
+    // so the values in [0,1] do not change.
+    static inline uint8_t floatToUint8 (float v)
+    {
+        v *= 255.99f;
+        return uint8_t(v > 0.f ? std::min(v, 255.f) : 0.f);
+    }
+
+    static void convertFloatsToUint8 (const float* inPtr, int count, uint8_t* outPtr)
+    {
+        int i = 0;
+#if ZV_COLOR_SSE2
+        const __m128 scale = _mm_set1_ps (255.99f);
+        const __m128 zero = _mm_setzero_ps ();
+        const __m128 maxValue = _mm_set1_ps (255.f);
+        auto convert4 = [&](const float* p) {
+            // max first, it returns zero for NaN.
+            const __m128 v = _mm_min_ps (_mm_max_ps (_mm_mul_ps (_mm_loadu_ps (p), scale), zero), maxValue);
+            return _mm_cvttps_epi32 (v);
+        };
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m128i v01 = _mm_packs_epi32 (convert4 (inPtr + i), convert4 (inPtr + i + 4));
+            const __m128i v23 = _mm_packs_epi32 (convert4 (inPtr + i + 8), convert4 (inPtr + i + 12));
+            _mm_storeu_si128 ((__m128i*)(outPtr + i), _mm_packus_epi16 (v01, v23));
+        }
+#endif
+        for (; i < count; ++i)
+            outPtr[i] = floatToUint8 (inPtr[i]);
+    }
+
+    static void expandRgbToRgba (const uint8_t* inPtr, int width, PixelSRGBA* outPtr)
+    {
+        // Copy 4 bytes and overwrite the 4th with the alpha, except for the
+        // last pixel that would read past the row.
+        const PixelSRGBA opaqueBlack (0, 0, 0, 255);
+        uint32_t alphaMask;
+        memcpy (&alphaMask, &opaqueBlack, 4);
+        for (int c = 0; c < width - 1; ++c)
+        {
+            uint32_t v;
+            memcpy (&v, inPtr + 3*c, 4);
+            v |= alphaMask;
+            memcpy (outPtr + c, &v, 4);
         }
+        if (width > 0)
+        {
+            const uint8_t* p = inPtr + 3*(width-1);
+            outPtr[width-1] = PixelSRGBA(p[0], p[1], p[2], 255);
+        }
+    }
+
+    static void expandGrayToRgba (const uint8_t* inPtr, int width, PixelSRGBA* outPtr)
+    {
+        int c = 0;
+#if ZV_COLOR_SSE2
+        const __m128i opaque = _mm_set1_epi8 (char(0xff));
+        for (; c + 16 <= width; c += 16)
+        {
+            const __m128i v = _mm_loadu_si128 ((const __m128i*)(inPtr + c));
+            // (v,v) and (v,255) pairs, interleaved again to (v,v,v,255).
+            const __m128i vv_lo = _mm_unpacklo_epi8 (v, v);
+            const __m128i vv_hi = _mm_unpackhi_epi8 (v, v);
+            const __m128i va_lo = _mm_unpacklo_epi8 (v, opaque);
+            const __m128i va_hi = _mm_unpackhi_epi8 (v, opaque);
+            __m128i* out = (__m128i*)(outPtr + c);
+            _mm_storeu_si128 (out + 0, _mm_unpacklo_epi16 (vv_lo, va_lo));
+            _mm_storeu_si128 (out + 1, _mm_unpackhi_epi16 (vv_lo, va_lo));
+            _mm_storeu_si128 (out + 2, _mm_unpacklo_epi16 (vv_hi, va_hi));
+            _mm_storeu_si128 (out + 3, _mm_unpackhi_epi16 (vv_hi, va_hi));
+        }
+#endif
+        for (; c < width; ++c)
+            outPtr[c] = PixelSRGBA(inPtr[c], inPtr[c], inPtr[c], 255);
+    }
+
+    ImageSRGBA srgbaFromSrgb (uint8_t* rgb_buffer, int w, int h, int bytesPerRow)
+    {
+        ImageSRGBA outImg(w, h);
+        parallel_for_rows (h, [&](int firstRow, int lastRow) {
+            for (int r = firstRow; r < lastRow; ++r)
+                expandRgbToRgba (rgb_buffer + r*size_t(bytesPerRow), w, outImg.atRowPtr(r));
+        });
+        return outImg;
+    }
+
+    ImageSRGBA srgbaFromGray (uint8_t* rgb_buffer, int w, int h, int bytesPerRow)
+    {
+        ImageSRGBA outImg(w, h);
+        parallel_for_rows (h, [&](int firstRow, int lastRow) {
+            for (int r = firstRow; r < lastRow; ++r)
+                expandGrayToRgba (rgb_buffer + r*size_t(bytesPerRow), w, outImg.atRowPtr(r));
+        });
         return outImg;
     }
 
     ImageSRGBA srgbaFromFloatGray (uint8_t* rgb_buffer, int w, int h, int bytesPerRow)
     {
         ImageSRGBA outImg(w, h);
-        for (int r = 0; r < h; ++r)
-        {
-            const float* inRowPtr = (float*)(rgb_buffer + r*bytesPerRow);
-            auto* outPtr = outImg.atRowPtr(r);
-            for (int c = 0; c < w; ++c)
+        parallel_for_rows (h, [&](int firstRow, int lastRow) {
+            std::vector<uint8_t> grayRow (w);
+            for (int r = firstRow; r < lastRow; ++r)
             {
-                PixelSRGBA p;
-                uint8_t v = inRowPtr[c + 0] * 255.99f;
-                p.r = v;
-                p.g = v;
-                p.b = v;
-                p.a = 255;
-                outPtr[c] = p;
+                convertFloatsToUint8 ((const float*)(rgb_buffer + r*size_t(bytesPerRow)), w, grayRow.data());
+                expandGrayToRgba (grayRow.data(), w, outImg.atRowPtr(r));
             }
-        }
+        });
         return outImg;
     }
     
     ImageSRGBA srgbaFromFloatSrgb (uint8_t* srgb_buffer, int w, int h, int bytesPerRow)
     {
         ImageSRGBA outImg(w, h);
-        for (int r = 0; r < h; ++r)
-        {
-            const float* inRowPtr = (float*) (srgb_buffer + r*bytesPerRow);
-            auto* outPtr = outImg.atRowPtr(r);
-            for (int c = 0; c < w; ++c)
+        parallel_for_rows (h, [&](int firstRow, int lastRow) {
+            std::vector<uint8_t> rgbRow (3*w);
+            for (int r = firstRow; r < lastRow; ++r)
             {
-                PixelSRGBA p;
-                p.r = int(255.99f * inRowPtr[c*3 + 0]);
-                p.g = int(255.99f * inRowPtr[c*3 + 1]);
-                p.b = int(255.99f * inRowPtr[c*3 + 2]);
-                p.a = 255;
-                outPtr[c] = p;
+                convertFloatsToUint8 ((const float*)(srgb_buffer + r*size_t(bytesPerRow)), 3*w, rgbRow.data());
+                expandRgbToRgba (rgbRow.data(), w, outImg.atRowPtr(r));
             }
-        }
+        });
         return outImg;
     }
 
     ImageSRGBA srgbaFromFloatSrgba (uint8_t* srgba_buffer, int w, int h, int bytesPerRow)
     {
         ImageSRGBA outImg(w, h);
-        for (int r = 0; r < h; ++r)
-        {
-            const float* inRowPtr = (float*) (srgba_buffer + r*bytesPerRow);
-            auto* outPtr = outImg.atRowPtr(r);
-            for (int c = 0; c < w; ++c)
-            {
-                PixelSRGBA p;
-                p.r = int(255.99f * inRowPtr[c*4 + 0]);
-                p.g = int(255.99f * inRowPtr[c*4 + 1]);
-                p.b = int(255.99f * inRowPtr[c*4 + 2]);
-                p.a = int(255.99f * inRowPtr[c*4 + 3]);
-                outPtr[c] = p;
-            }
-        }
+        parallel_for_rows (h, [&](int firstRow, int lastRow) {
+            for (int r = firstRow; r < lastRow; ++r)
+                convertFloatsToUint8 ((const float*)(srgba_buffer + r*size_t(bytesPerRow)), 4*w, (uint8_t*)outImg.atRowPtr(r));
+        });
         return outImg;
     }
 
@@ -278,14 +539,10 @@ namespace zv
 
     PixelXYZ convertToXYZ(const PixelSRGBA& srgb)
     {
-        // PixelLinearRGB rgb = convertToLinearRGB(srgb);
-        double r = srgb.r/255.0;
-        double g = srgb.g/255.0;
-        double b = srgb.b/255.0;
-
-        r = ((r > 0.04045) ? pow((r + 0.055) / 1.055, 2.4) : (r / 12.92)) * 100.0;
-        g = ((g > 0.04045) ? pow((g + 0.055) / 1.055, 2.4) : (g / 12.92)) * 100.0;
-        b = ((b > 0.04045) ? pow((b + 0.055) / 1.055, 2.4) : (b / 12.92)) * 100.0;
+        const auto& toLinear = srgbTables().toLinear;
+        const double r = toLinear[srgb.r] * 100.0;
+        const double g = toLinear[srgb.g] * 100.0;
+        const double b = toLinear[srgb.b] * 100.0;
 
         PixelXYZ xyz;
         xyz.x = r*0.4124564 + g*0.3575761 + b*0.1804375;
@@ -610,42 +867,342 @@ void closestColorName (const PixelSRGBA& rgba, const char** className, const cha
     *colorName = colorEntries[bestIndex].colorName;
 }
 
+namespace
+{
+
+constexpr int NumColorEntries = sizeof(colorEntries) / sizeof(ColorEntry);
+static_assert (NumColorEntries < 256, "The memo stores the indices on 8 bits.");
+
+// Everything about the table entries that does not depend on the queried
+// color, plus a memo of the CIE2000 results.
+struct ColorEntriesIndex
+{
+    ColorEntriesIndex ()
+    : memo (new std::atomic<uint64_t>[MemoSize])
+    {
+        for (int i = 0; i < NumColorEntries; ++i)
+        {
+            labs[i] = convertToLab(PixelSRGBA(colorEntries[i].r, colorEntries[i].g, colorEntries[i].b, 255));
+            chromas[i] = std::sqrt(sqr(labs[i].a) + sqr(labs[i].b));
+        }
+
+        for (int i = 0; i < MemoSize; ++i)
+            memo[i].store (0, std::memory_order_relaxed);
+    }
+
+    // Lower bound of colorDistance_CIE2000 without any trigonometry. The
+    // hue difference comes from |a'b|^2 = C'^2 + H'^2, T is at most 1.93,
+    // and the rotation term can cancel at most RC sin(60) / 2 of the
+    // chroma and hue terms.
+    double lowerBound (const PixelLab& lab, double chroma, int i) const
+    {
+        const PixelLab& entryLab = labs[i];
+        const double meanC = (chroma + chromas[i]) / 2.0;
+        const double meanC7 = pow7(meanC);
+        const double g = 0.5*(1 - sqrt(meanC7 / (meanC7 + 6103515625.)));
+        const double a1p = lab.a * (1 + g);
+        const double a2p = entryLab.a * (1 + g);
+        const double c1 = sqrt(sqr(a1p) + sqr(lab.b));
+        const double c2 = sqrt(sqr(a2p) + sqr(entryLab.b));
+        const double deltaC = c2 - c1;
+        const double deltaH2 = std::max(sqr(a2p - a1p) + sqr(entryLab.b - lab.b) - sqr(deltaC), 0.0);
+
+        const double meanL = (lab.l + entryLab.l) / 2;
+        const double meanCp = (c1 + c2) / 2.0;
+        const double meanCp7 = pow7(meanCp);
+        const double sl = 1 + (0.015*sqr(meanL - 50)) / sqrt(20 + sqr(meanL - 50));
+        const double sc = 1 + 0.045*meanCp;
+        const double maxSh = 1 + 0.015*meanCp*1.93;
+        const double maxRt = 2 * sqrt(meanCp7 / (meanCp7 + 6103515625.)) * 0.8661;
+
+        const double bound2 = sqr((entryLab.l - lab.l) / sl)
+                            + (1.0 - maxRt / 2.0) * (sqr(deltaC / sc) + deltaH2 / sqr(maxSh));
+        // Margin for the rounding differences with the full formula.
+        return sqrt(bound2) * (1.0 - 1e-6) - 1e-9;
+    }
+
+    // Same result as evaluating CIE2000 on all the entries.
+    void closestEntries (const PixelSRGBA& srgba, int& first, int& second) const
+    {
+        const uint32_t rgb = (uint32_t(srgba.r) << 16) | (uint32_t(srgba.g) << 8) | srgba.b;
+        std::atomic<uint64_t>& memoEntry = memo[(rgb * 2654435761u) >> (32 - MemoBits)];
+        const uint64_t cached = memoEntry.load (std::memory_order_relaxed);
+        if ((cached >> 63) && uint32_t((cached >> 16) & 0xffffff) == rgb)
+        {
+            first = int((cached >> 8) & 0xff);
+            second = int(cached & 0xff);
+            return;
+        }
+
+        const PixelLab lab = convertToLab(srgba);
+        const double chroma = std::sqrt(sqr(lab.a) + sqr(lab.b));
+
+        // Ordered by distance then index, like a linear scan.
+        double bestDist[2] = { INFINITY, INFINITY };
+        int bestIndex[2] = { NumColorEntries, NumColorEntries };
+        auto insert = [&](double dist, int i) {
+            if (dist < bestDist[0] || (dist == bestDist[0] && i < bestIndex[0]))
+            {
+                bestDist[1] = bestDist[0]; bestIndex[1] = bestIndex[0];
+                bestDist[0] = dist; bestIndex[0] = i;
+            }
+            else if (dist < bestDist[1] || (dist == bestDist[1] && i < bestIndex[1]))
+            {
+                bestDist[1] = dist; bestIndex[1] = i;
+            }
+        };
+
+        // The two closest in Lab are usually the answer, starting with them
+        // lets the bound skip most of the others.
+        int labClosest[2] = { 0, 1 };
+        float labDist[2] = { INFINITY, INFINITY };
+        for (int i = 0; i < NumColorEntries; ++i)
+        {
+            const float d = sqr(labs[i].l - lab.l) + sqr(labs[i].a - lab.a) + sqr(labs[i].b - lab.b);
+            if (d < labDist[0]) { labDist[1] = labDist[0]; labClosest[1] = labClosest[0]; labDist[0] = d; labClosest[0] = i; }
+            else if (d < labDist[1]) { labDist[1] = d; labClosest[1] = i; }
+        }
+        insert (colorDistance_CIE2000(lab, labs[labClosest[0]]), labClosest[0]);
+        insert (colorDistance_CIE2000(lab, labs[labClosest[1]]), labClosest[1]);
+
+        for (int i = 0; i < NumColorEntries; ++i)
+        {
+            if (i == labClosest[0] || i == labClosest[1])
+                continue;
+            // SL is at most 1.75, a first bound without any sqrt.
+            if (std::abs(labs[i].l - lab.l) * (1.0 / 1.75) > bestDist[1])
+                continue;
+            if (lowerBound (lab, chroma, i) > bestDist[1])
+                continue;
+            insert (colorDistance_CIE2000(lab, labs[i]), i);
+        }
+
+        first = bestIndex[0];
+        second = bestIndex[1];
+        memoEntry.store ((uint64_t(1) << 63) | (uint64_t(rgb) << 16) | (uint64_t(first) << 8) | uint64_t(second),
+                         std::memory_order_relaxed);
+    }
+
+    std::array<PixelLab, NumColorEntries> labs;
+    std::array<double, NumColorEntries> chromas;
+
+    // Direct mapped, each slot packs a valid bit, the color and the two
+    // indices, so it can be shared between threads without locking.
+    static constexpr int MemoBits = 16;
+    static constexpr int MemoSize = 1 << MemoBits;
+    std::unique_ptr<std::atomic<uint64_t>[]> memo;
+};
+
+const ColorEntriesIndex& colorEntriesIndex ()
+{
+    static ColorEntriesIndex index;
+    return index;
+}
+
+} // anonymous
+
 std::array<ColorMatchingResult,2> closestColorEntries (const PixelSRGBA& srgba, ColorDistance distance)
 {
     std::array<ColorMatchingResult,2> closestColors;
     closestColors[0].distance = std::numeric_limits<double>::max();
     closestColors[1].distance = std::numeric_limits<double>::max();
-    
-    const int numColors = sizeof(colorEntries) / sizeof(ColorEntry);
-    PixelLab targetLab = convertToLab(srgba);
-    for (int i = 0; i < numColors; ++i)
+
+    switch (distance)
     {
-        const auto& colorEntry = colorEntries[i];
-        double dist;
-        switch (distance)
+        case ColorDistance::RGB_L1:
         {
-            case ColorDistance::RGB_L1: dist = colorDistance_RGBL1(srgba, PixelSRGBA(colorEntry.r, colorEntry.g, colorEntry.b, 255)); break;
-            case ColorDistance::CIE2000: dist = colorDistance_CIE2000(targetLab,
-                                                                      convertToLab(PixelSRGBA(colorEntry.r, colorEntry.g, colorEntry.b, 255))); break;
-        }
-        
-        if (dist < closestColors[0].distance)
-        {
-            closestColors[1] = closestColors[0];
-            closestColors[0].distance = dist;
-            closestColors[0].indexInTable = i;
+            for (int i = 0; i < NumColorEntries; ++i)
+            {
+                const auto& colorEntry = colorEntries[i];
+                const double dist = colorDistance_RGBL1(srgba, PixelSRGBA(colorEntry.r, colorEntry.g, colorEntry.b, 255));
+                if (dist < closestColors[0].distance)
+                {
+                    closestColors[1] = closestColors[0];
+                    closestColors[0].distance = dist;
+                    closestColors[0].indexInTable = i;
+                }
+                else if (dist < closestColors[1].distance)
+                {
+                    closestColors[1].distance = dist;
+                    closestColors[1].indexInTable = i;
+                }
+            }
+            break;
         }
-        else if (dist < closestColors[1].distance)
+
+        case ColorDistance::CIE2000:
         {
-            closestColors[1].distance = dist;
-            closestColors[1].indexInTable = i;
+            const auto& index = colorEntriesIndex();
+            index.closestEntries (srgba, closestColors[0].indexInTable, closestColors[1].indexInTable);
+            const PixelLab lab = convertToLab(srgba);
+            for (auto& result : closestColors)
+                result.distance = colorDistance_CIE2000(lab, index.labs[result.indexInTable]);
+            break;
         }
     }
-    
+
     closestColors[0].entry = &colorEntries[closestColors[0].indexInTable];
     closestColors[1].entry = &colorEntries[closestColors[1].indexInTable];
     
     return closestColors;
 }
 
+std::vector<ColorEntryCount> dominantColorEntries (const ImageSRGBA& image, int x0, int y0, int width, int height, int maxEntries)
+{
+    const auto& index = colorEntriesIndex();
+    std::array<int, NumColorEntries> counts {};
+    std::mutex countsMutex;
+    parallel_for_rows (height, [&](int firstRow, int lastRow) {
+        std::array<int, NumColorEntries> bandCounts {};
+        // Neighbors often have the same color, skip the memo for them.
+        PixelSRGBA lastColor (0, 0, 0, 0);
+        int lastIndex = -1;
+        for (int r = firstRow; r < lastRow; ++r)
+        {
+            const PixelSRGBA* rowPtr = image.atRowPtr(y0 + r) + x0;
+            for (int c = 0; c < width; ++c)
+            {
+                const PixelSRGBA p (rowPtr[c].r, rowPtr[c].g, rowPtr[c].b, 255);
+                if (lastIndex < 0 || !(p == lastColor))
+                {
+                    int second;
+                    index.closestEntries (p, lastIndex, second);
+                    lastColor = p;
+                }
+                ++bandCounts[lastIndex];
+            }
+        }
+
+        std::lock_guard<std::mutex> lock (countsMutex);
+        for (int i = 0; i < NumColorEntries; ++i)
+            counts[i] += bandCounts[i];
+    });
+
+    std::vector<ColorEntryCount> entries;
+    for (int i = 0; i < NumColorEntries; ++i)
+    {
+        if (counts[i] > 0)
+            entries.push_back ({ &colorEntries[i], counts[i] });
+    }
+    std::stable_sort (entries.begin(), entries.end(), [](const ColorEntryCount& lhs, const ColorEntryCount& rhs) {
+        return lhs.count > rhs.count;
+    });
+    if (int(entries.size()) > maxEntries)
+        entries.resize (maxEntries);
+    return entries;
+}
+
+} // zv
+
+namespace zv
+{
+
+    const char* colormapName (Colormap colormap)
+    {
+        switch (colormap)
+        {
+            case Colormap::None: return "None";
+            case Colormap::Viridis: return "Viridis";
+            case Colormap::Turbo: return "Turbo";
+            case Colormap::Jet: return "Jet";
+            case Colormap::CoolWarm: return "CoolWarm";
+            default: return "Invalid";
+        }
+    }
+
+    // Polynomial approximations of the reference colormaps, close enough for display.
+    // Viridis: https://www.shadertoy.com/view/WlfXRN
+    // Turbo: https://ai.googleblog.com/2019/08/turbo-improved-rainbow-colormap-for.html
+    // CoolWarm: linear interpolation of Moreland's diverging map control points.
+    static std::array<double,3> colormapValue (Colormap colormap, double t)
+    {
+        switch (colormap)
+        {
+            case Colormap::Viridis:
+            {
+                static const double c[7][3] = {
+                    { 0.2777273272234177,  0.005407344544966578,  0.3340998053353061 },
+                    { 0.1050930431085774,  1.404613529898575,     1.384590162594685 },
+                    {-0.3308618287255563,  0.214847559468213,     0.09509516302823659 },
+                    {-4.634230498983486,  -5.799100973351585,   -19.33244095627987 },
+                    { 6.228269936347081,  14.17993336680509,     56.69055260068105 },
+                    { 4.776384997670288, -13.74514537774601,    -65.35303263337234 },
+                    {-5.435455855934631,   4.645852612178535,    26.3124352495832 },
+                };
+                double v[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    v[k] = c[6][k];
+                    for (int i = 5; i >= 0; --i)
+                        v[k] = v[k]*t + c[i][k];
+                }
+                return { v[0], v[1], v[2] };
+            }
+
+            case Colormap::Turbo:
+            {
+                static const double c[3][6] = {
+                    { 0.13572138, 4.61539260, -42.66032258, 132.13108234, -152.94239396, 59.28637943 },
+                    { 0.09140261, 2.19418839,   4.84296658, -14.18503333,    4.27729857,  2.82956604 },
+                    { 0.10667330, 12.64194608, -60.58204836, 110.36276771, -89.90310912, 27.34824973 },
+                };
+                double v[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    v[k] = c[k][5];
+                    for (int i = 4; i >= 0; --i)
+                        v[k] = v[k]*t + c[k][i];
+                }
+                return { v[0], v[1], v[2] };
+            }
+
+            case Colormap::Jet:
+            {
+                return { 1.5 - std::abs(4.0*t - 3.0),
+                         1.5 - std::abs(4.0*t - 2.0),
+                         1.5 - std::abs(4.0*t - 1.0) };
+            }
+
+            case Colormap::CoolWarm:
+            {
+                static const double c[5][3] = {
+                    {  59,  76, 192 },
+                    { 141, 176, 254 },
+                    { 221, 221, 221 },
+                    { 244, 154, 123 },
+                    { 180,   4,  38 },
+                };
+                const double x = keepInRange(t, 0.0, 1.0) * 4.0;
+                const int i = std::min(int(x), 3);
+                const double a = x - i;
+                return { ((1.0-a)*c[i][0] + a*c[i+1][0]) / 255.0,
+                         ((1.0-a)*c[i][1] + a*c[i+1][1]) / 255.0,
+                         ((1.0-a)*c[i][2] + a*c[i+1][2]) / 255.0 };
+            }
+
+            default:
+                return { t, t, t };
+        }
+    }
+
+    const std::array<PixelSRGBA,256>& colormapLUT (Colormap colormap)
+    {
+        using LUTs = std::array<std::array<PixelSRGBA,256>, (int)Colormap::NumColormaps>;
+        static const LUTs luts = []() {
+            LUTs luts;
+            for (int m = 0; m < (int)Colormap::NumColormaps; ++m)
+            for (int i = 0; i < 256; ++i)
+            {
+                // The fits directly give sRGB values.
+                const auto v = colormapValue (Colormap(m), i / 255.0);
+                luts[m][i] = PixelSRGBA(keepInRange(int(v[0]*255.0 + 0.5), 0, 255),
+                                        keepInRange(int(v[1]*255.0 + 0.5), 0, 255),
+                                        keepInRange(int(v[2]*255.0 + 0.5), 0, 255),
+                                        255);
+            }
+            return luts;
+        }();
+        return luts[(int)colormap];
+    }
+
 } // zv
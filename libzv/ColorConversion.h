@@ -9,8 +9,10 @@
 #include "Image.h"
 #include "MathUtils.h"
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <vector>
 
 namespace zv
 {
@@ -28,6 +30,37 @@ namespace zv
         ColMajorMatrix3f _lmsToLinearRgbMatrix;
     };
 
+    // Lookup tables for the sRGB transfer function, so the conversions
+    // never call pow per channel.
+    struct SrgbTables
+    {
+        SrgbTables ();
+
+        // 8 bits sRGB to linear [0,1].
+        std::array<float,256> toLinear;
+
+        // Linear to 8 bits sRGB. The 12 most significant bits give a value
+        // that is at most one level too low, since the rounding midpoints
+        // are more than 1/4096 apart, and comparing with the next midpoint
+        // fixes it. The result is always the closest 8 bits value.
+        std::array<uint8_t,4096> toSrgbBase;
+        std::array<float,256> roundingMidpoints;
+
+        uint8_t linearToSrgb8 (float v) const
+        {
+            // Also maps NaN to 0.
+            v = v > 0.f ? std::min(v, 1.f) : 0.f;
+            const uint8_t base = toSrgbBase[std::min(int(v * 4096.f), 4095)];
+            return base + (v >= roundingMidpoints[base]);
+        }
+    };
+
+    const SrgbTables& srgbTables ();
+
+    // Alpha is ignored on input and set to 255 on output.
+    void convertRowToLinearRGB (const PixelSRGBA* inRowPtr, int width, PixelLinearRGB* outRowPtr);
+    void convertRowToSRGBA (const PixelLinearRGB* inRowPtr, int width, PixelSRGBA* outRowPtr);
+
     ImageSRGBA convertToSRGBA(const ImageLinearRGB& rgb);
     ImageLinearRGB convertToLinearRGB(const ImageSRGBA& srgb);
     
@@ -37,6 +70,40 @@ namespace zv
     PixelSRGBA convertToSRGBA(const PixelLinearRGB& rgb);
     PixelLinearRGB convertToLinearRGB(const PixelSRGBA& srgb);
 
+    // Color vision deficiencies
+    enum class ColorVisionDeficiency
+    {
+        Protan = 0,
+        Deutan,
+        Tritan,
+
+        NumDeficiencies,
+    };
+
+    const char* colorVisionDeficiencyName (ColorVisionDeficiency deficiency);
+
+    // Brettel, Viénot and Mollon 1997, on linear RGB with the sRGB
+    // primaries. The color space gets split in two half-spaces by a plane
+    // through black and white, each projected with its own matrix. The
+    // display shader uses the same parameters.
+    struct CvdSimulationParams
+    {
+        // Index 0 when dot(rgb, separationPlaneNormal) >= 0.
+        ColMajorMatrix3f rgbCvdFromRgb[2];
+        float separationPlaneNormal[3];
+    };
+
+    const CvdSimulationParams& cvdSimulationParams (ColorVisionDeficiency deficiency);
+
+    // Severity goes from 0 (normal vision) to 1 (dichromacy), interpolating
+    // linearly in between. The alpha channel is kept. Both are the CPU
+    // references of the viewer modes, used to save what is displayed.
+    void simulateColorVisionDeficiency (const ImageSRGBA& input, ColorVisionDeficiency deficiency, float severity, ImageSRGBA& output);
+
+    // Fidaner et al. 2005: the simulation error is moved to the green and
+    // blue channels, where it remains visible.
+    void daltonize (const ImageSRGBA& input, ColorVisionDeficiency deficiency, float severity, ImageSRGBA& output);
+
     // HSV
     PixelHSV convertToHSV(const PixelSRGBA& p);
     PixelSRGBA convertToSRGBA(const PixelHSV& p);
@@ -49,6 +116,8 @@ namespace zv
     PixelLab convertToLab(const PixelSRGBA& p);
     PixelSRGBA convertToSRGBA(const PixelLab& p);
 
+    // Conversions of the Python arrays. The float ones map [0,1] to
+    // [0,255] and clamp the values outside of it, NaN gives 0.
     ImageSRGBA srgbaFromSrgb (uint8_t* rgb_buffer, int width, int height, int bytesPerRow);
     ImageSRGBA srgbaFromGray (uint8_t* rgb_buffer, int width, int height, int bytesPerRow);
     
@@ -56,6 +125,24 @@ namespace zv
     ImageSRGBA srgbaFromFloatSrgba (uint8_t* srgba_buffer, int width, int height, int bytesPerRow);
     ImageSRGBA srgbaFromFloatGray (uint8_t* rgb_buffer, int width, int height, int bytesPerRow);
 
+    // False colors for single channel images.
+    enum class Colormap
+    {
+        None = 0,
+        Viridis,
+        Turbo,
+        Jet,
+        // Diverging, meant for signed values centered on 0.5.
+        CoolWarm,
+
+        NumColormaps,
+    };
+
+    const char* colormapName (Colormap colormap);
+
+    // 256 entries, index 0 for the lowest value.
+    const std::array<PixelSRGBA,256>& colormapLUT (Colormap colormap);
+
     struct ColorEntry
     {
         const char* className;
@@ -86,6 +173,18 @@ namespace zv
     double colorDistance_RGBL1(const PixelSRGBA& p1, const PixelSRGBA& p2);
 
     // Index 0 will have the closest one. Index 1 the second closest.
+    // CIE2000 skips the entries that cannot be closer according to a
+    // cheap lower bound, and memoizes the results per color.
     std::array<ColorMatchingResult,2> closestColorEntries (const PixelSRGBA& rgba, ColorDistance distance);
+
+    struct ColorEntryCount
+    {
+        const ColorEntry* entry = nullptr;
+        int count = 0;
+    };
+
+    // Closest entry (CIE2000) of every pixel in the rect, the most frequent
+    // ones first. Alpha is ignored.
+    std::vector<ColorEntryCount> dominantColorEntries (const ImageSRGBA& image, int x0, int y0, int width, int height, int maxEntries);
     
 } // zv
@@ -10,6 +10,8 @@
 #include <libzv/ImguiGLFWWindow.h>
 #include <libzv/ImageWindow.h>
 #include <libzv/ImageWindowState.h>
+#include <libzv/ImageWriter.h>
+#include <libzv/ImageBufferPool.h>
 #include <libzv/GLFWUtils.h>
 #include <libzv/ImageCursorOverlay.h>
 #include <libzv/PlatformSpecific.h>
@@ -82,6 +84,19 @@ struct ControlsWindow::Impl
         }
     } windowSize;
 
+    struct {
+        bool selectionOnly = true;
+        char outputDir[1024] = "";
+        bool overwriteOriginals = false;
+    } batch;
+
+    struct {
+        int maxDistance = 6;
+        // Computed on demand, for groupsMaxDistance.
+        std::vector<std::vector<int>> groups;
+        int groupsMaxDistance = -1;
+    } duplicates;
+
     bool saveAllChanges = false;
     bool askToConfirmPendingChanges = false;
 
@@ -100,6 +115,10 @@ struct ControlsWindow::Impl
     void renderActiveTool (const ModifiedImagePtr& firstModIm);
     void renderImageList (float cursorOverlayHeight);
     void renderModifiersTab (float cursorOverlayHeight);
+    void renderBatchJob ();
+    void renderDisplayTab ();
+    void renderStatisticsTab (float footerHeight);
+    void renderDuplicatesTab (float footerHeight);
     void renderCursorInfo (const CursorOverlayInfo& cursorOverlayInfo, float footerHeight, float overlayHeight);
 };
 
@@ -221,7 +240,7 @@ void ControlsWindow::Impl::maybeRenderConfirmPendingChanges ()
 
 void ControlsWindow::Impl::renderActiveTool (const ModifiedImagePtr& firstModIm)
 {    
-    const auto& firstIm = *(firstModIm->data()->cpuData);
+    const auto& firstIm = *firstModIm->data();
 
     auto* imageWindow = this->viewer->imageWindow();
     auto& state = imageWindow->mutableState();
@@ -238,6 +257,13 @@ void ControlsWindow::Impl::renderActiveTool (const ModifiedImagePtr& firstModIm)
 
         activeTool->renderControls(firstIm);
 
+        if (activeTool->kind() == InteractiveTool::Kind::Measurement)
+        {
+            if (ImGui::Button("Close"))
+                imageWindow->setActiveTool (ActiveToolState::Kind::None);
+            return;
+        }
+
         if (ImGui::Button("Apply"))
         {
             imageWindow->addCommand(ImageWindow::actionCommand(ImageWindowAction::Kind::ApplyCurrentTool));
@@ -309,12 +335,441 @@ void ControlsWindow::Impl::renderModifiersTab (float cursorOverlayHeight)
         imageWindow->setActiveTool (ActiveToolState::Kind::Annotate_Line);
     helpMarker ("Add Text", contentSize.x * 0.8, false /* no extra question mark */);
 
+    ImGui::SetNextItemWidth (contentSize.x * 0.4f);
+    if (ImGui::BeginCombo("Resize filter", resampleFilterName(state.resizeFilter)))
+    {
+        for (int i = 0; i < (int)ResampleFilter::NumFilters; ++i)
+        {
+            if (ImGui::Selectable(resampleFilterName(ResampleFilter(i)), state.resizeFilter == ResampleFilter(i)))
+                state.resizeFilter = ResampleFilter(i);
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::SameLine();
+    helpMarker ("Filter used when resizing images. Area gives the best results when downscaling a lot.", ImGui::GetFontSize() * 20);
+
+    const ModifierCache::Stats cacheStats = ModifierCache::instance().stats();
+    ImGui::TextDisabled ("Cache: %lld hits, %lld misses, %d entries (%.0f MB)",
+                         (long long)cacheStats.hits, (long long)cacheStats.misses,
+                         cacheStats.numEntries, cacheStats.numBytes / (1024.0*1024.0));
+
+    int pngLevel = pngCompressionLevel ();
+    ImGui::SetNextItemWidth (contentSize.x * 0.4f);
+    if (ImGui::SliderInt ("PNG compression", &pngLevel, 0, 9))
+        setPngCompressionLevel (pngLevel);
+    ImGui::SameLine();
+    helpMarker ("Higher levels give smaller files but take longer to save. Used by the saves and the batch jobs.", ImGui::GetFontSize() * 20);
+
+    const int numPendingWrites = ImageWriter::instance().numPendingWrites();
+    const ImageWriter::Result lastWrite = ImageWriter::instance().lastResult();
+    if (numPendingWrites > 0)
+    {
+        ImGui::TextDisabled ("Saving %d image(s)...", numPendingWrites);
+    }
+    else if (!lastWrite.filePath.empty() && lastWrite.success)
+    {
+        ImGui::TextDisabled ("Saved %s: %.1f KB, encoded in %.0f ms",
+                             lastWrite.filePath.c_str(),
+                             lastWrite.stats.numBytes / 1024.0, lastWrite.stats.encodeTimeMs);
+    }
+
+    // Each failure stays listed until dismissed, the edits of these
+    // images were kept so they can be saved again.
+    const std::vector<ImageWriter::Result> failedWrites = ImageWriter::instance().failedWrites();
+    if (!failedWrites.empty())
+    {
+        for (const auto& failedWrite : failedWrites)
+            ImGui::TextColored (ImVec4(1.f, 0.4f, 0.4f, 1.f), "Could not save %s", failedWrite.filePath.c_str());
+        if (ImGui::SmallButton ("Dismiss"))
+            ImageWriter::instance().clearFailedWrites ();
+    }
+
+    renderBatchJob ();
+
     if (!firstModIm->hasValidData())
         return;
     
     renderActiveTool (firstModIm);
 }
 
+void ControlsWindow::Impl::renderBatchJob ()
+{
+    auto* imageWindow = this->viewer->imageWindow();
+    BatchJob& batchJob = imageWindow->batchJob();
+    const BatchJob::Progress progress = batchJob.progress();
+    const float contentWidth = ImGui::GetContentRegionAvail().x;
+
+    ImGui::Separator();
+
+    if (progress.running)
+    {
+        const std::string label = formatted("%d / %d", progress.numProcessed, progress.numFiles);
+        const float fraction = progress.numFiles > 0 ? progress.numProcessed / float(progress.numFiles) : 0.f;
+        ImGui::ProgressBar (fraction, ImVec2(contentWidth * 0.6f, 0.f), label.c_str());
+        ImGui::SameLine();
+        if (progress.cancelled)
+            ImGui::BeginDisabled ();
+        if (ImGui::Button("Cancel"))
+            batchJob.cancel ();
+        if (progress.cancelled)
+            ImGui::EndDisabled ();
+        return;
+    }
+
+    if (ImGui::RadioButton ("Selection", batch.selectionOnly))
+        batch.selectionOnly = true;
+    ImGui::SameLine();
+    if (ImGui::RadioButton ("All filtered images", !batch.selectionOnly))
+        batch.selectionOnly = false;
+
+    ImGui::SetNextItemWidth (contentWidth * 0.6f);
+    ImGui::InputText ("Output folder", batch.outputDir, sizeof(batch.outputDir));
+    ImGui::SameLine();
+    helpMarker ("The outputs keep the original file names, in subfolders when the images come from different folders. Leave it empty to overwrite the original files.", ImGui::GetFontSize() * 20);
+
+    const bool inPlace = batch.outputDir[0] == '\0';
+    if (inPlace)
+        ImGui::Checkbox ("Overwrite the original files", &batch.overwriteOriginals);
+
+    const bool canStart = imageWindow->getFirstValidImage(true /* modified only */) && (!inPlace || batch.overwriteOriginals);
+    if (!canStart)
+        ImGui::BeginDisabled ();
+    if (ImGui::Button("Apply Modifiers to Files"))
+    {
+        if (!imageWindow->startBatchJob (batch.selectionOnly, batch.outputDir))
+            zv_dbg ("Could not start the batch job, annotations can't be applied to other files.");
+        batch.overwriteOriginals = false;
+    }
+    if (!canStart)
+        ImGui::EndDisabled ();
+    ImGui::SameLine();
+    helpMarker ("Applies the modifiers of the current image to the image files in the background.", ImGui::GetFontSize() * 20);
+
+    if (progress.numFiles > 0)
+    {
+        ImGui::TextDisabled ("Last batch: %d / %d files, %d failed%s",
+                             progress.numProcessed, progress.numFiles, progress.numFailed,
+                             progress.cancelled ? " (cancelled)" : "");
+        if (!progress.lastError.empty())
+            ImGui::TextDisabled ("%s", progress.lastError.c_str());
+    }
+}
+
+void ControlsWindow::Impl::renderDisplayTab ()
+{
+    auto* imageWindow = this->viewer->imageWindow();
+    auto& state = imageWindow->mutableState();
+    auto& settings = state.displaySettings;
+
+    ImGui::Spacing();
+
+    if (ImGui::BeginCombo("Mode", viewerModeName(state.activeMode).c_str()))
+    {
+        for (int i = (int)ViewerMode::Original; i < (int)ViewerMode::NumModes; ++i)
+        {
+            const ViewerMode mode = ViewerMode(i);
+            if (ImGui::Selectable(viewerModeName(mode).c_str(), state.activeMode == mode))
+                state.activeMode = mode;
+        }
+        ImGui::EndCombo();
+    }
+
+    bool changed = false;
+    changed |= ImGui::SliderFloat("Min level", &settings.minLevel, 0.f, 1.f, "%.3f");
+    changed |= ImGui::SliderFloat("Max level", &settings.maxLevel, 0.f, 1.f, "%.3f");
+    changed |= ImGui::SliderFloat("Exposure", &settings.exposure, -8.f, 8.f, "%.2f stops");
+    changed |= ImGui::SliderFloat("Gamma", &settings.gamma, 0.1f, 4.f, "%.2f");
+
+    if (ImGui::BeginCombo("Colormap", colormapName(settings.colormap)))
+    {
+        for (int i = 0; i < (int)Colormap::NumColormaps; ++i)
+        {
+            if (ImGui::Selectable(colormapName(Colormap(i)), settings.colormap == Colormap(i)))
+            {
+                settings.colormap = Colormap(i);
+                changed = true;
+            }
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::SameLine();
+    helpMarker ("Applied to single channel images and in the channel modes. The range follows the min and max levels.", ImGui::GetFontSize() * 20);
+
+    // Adjusting a slider would not do anything on the original image.
+    if (changed && state.activeMode == ViewerMode::Original)
+        state.activeMode = ViewerMode::Levels;
+
+    ImGui::Checkbox("Similarity overlay", &settings.similarityOverlay);
+    ImGui::SameLine();
+    helpMarker ("Shows the max error, PSNR and SSIM between each grid image and the reference cell, for every page. Always on in the diff modes. SSIM is computed on the luma.", ImGui::GetFontSize() * 20);
+
+    const bool diffMode = state.activeMode == ViewerMode::Diff_Absolute || state.activeMode == ViewerMode::Diff_Signed;
+    if (diffMode || settings.similarityOverlay)
+    {
+        const int maxCell = std::max(state.layoutConfig.numImages() - 1, 0);
+        ImGui::SliderInt("Reference cell", &settings.diffReferenceCell, 0, maxCell);
+        ImGui::SliderFloat("Diff threshold", &settings.diffThreshold, 0.f, 0.1f, "%.4f");
+        ImGui::SameLine();
+        helpMarker ("Pixels with a larger difference in any channel are counted as different. The max level sets the full scale of the difference.", ImGui::GetFontSize() * 20);
+    }
+
+    if (viewerModeIsColorVisionDeficiency (state.activeMode))
+    {
+        if (state.activeMode == ViewerMode::Daltonize
+            && ImGui::BeginCombo("Deficiency", colorVisionDeficiencyName(settings.daltonizeDeficiency)))
+        {
+            for (int i = 0; i < (int)ColorVisionDeficiency::NumDeficiencies; ++i)
+            {
+                const ColorVisionDeficiency deficiency = ColorVisionDeficiency(i);
+                if (ImGui::Selectable(colorVisionDeficiencyName(deficiency), settings.daltonizeDeficiency == deficiency))
+                    settings.daltonizeDeficiency = deficiency;
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::SliderFloat("Severity", &settings.cvdSeverity, 0.f, 1.f, "%.2f");
+        ImGui::SameLine();
+        helpMarker ("0 is normal vision and 1 a complete dichromacy. Brettel, Viénot and Mollon 1997 simulation, the daltonization moves the error to the visible channels.", ImGui::GetFontSize() * 20);
+
+        if (ImGui::Button("Save Images in This Mode"))
+        {
+            if (!imageWindow->saveImagesInCvdMode ())
+                zv_dbg ("No image file to save in this mode.");
+        }
+        ImGui::SameLine();
+        helpMarker ("Writes <name>_<mode>.png next to each image file, as displayed with the current levels, exposure and gamma.", ImGui::GetFontSize() * 20);
+    }
+
+    if (ImGui::Button("Reset"))
+        settings = {};
+    
+    ImGui::SameLine();
+    ImGui::TextDisabled("Hold shift to show the original image.");
+}
+
+void ControlsWindow::Impl::renderStatisticsTab (float footerHeight)
+{
+    auto* imageWindow = this->viewer->imageWindow();
+    ModifiedImagePtr firstModIm = imageWindow->getFirstValidImage(false /* not only modified */);
+
+    ImGui::Spacing();
+    if (!firstModIm || !firstModIm->hasValidData() || !firstModIm->data()->hasData())
+    {
+        ImGui::TextDisabled ("No image.");
+        return;
+    }
+
+    // Only the visible region is there until the modifiers complete.
+    if (firstModIm->partialOutput())
+    {
+        ImGui::TextDisabled ("Applying the modifiers...");
+        return;
+    }
+
+    const ImageItemData& data = *firstModIm->data();
+    const ImageStatistics& stats = data.statistics();
+    ImGui::TextDisabled ("%s, %dx%d, computed in %.1f ms",
+                         firstModIm->item()->prettyName.c_str(), data.width(), data.height(), stats.computeTimeMs);
+
+    auto& state = imageWindow->mutableState();
+    if (state.activeToolState.kind == ActiveToolState::Kind::Measure_Roi)
+    {
+        renderActiveTool (firstModIm);
+        ImGui::Separator();
+    }
+    else if (ImGui::Button("Measure Region"))
+    {
+        imageWindow->setActiveTool (ActiveToolState::Kind::Measure_Roi);
+    }
+
+    const ImVec2 contentSize = ImGui::GetContentRegionAvail();
+    ImGui::BeginChild ("Statistics", ImVec2(0, contentSize.y - footerHeight));
+
+    const char* channelNames[] = { "R", "G", "B", "A" };
+    auto channelName = [&](int k) { return stats.numChannels == 1 ? "Gray" : channelNames[k]; };
+    // Integer values for 8 bits images.
+    const char* valueFormat = stats.oneBinPerValue ? "%.0f" : "%.4g";
+
+    const ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingStretchSame;
+    if (ImGui::BeginTable("ChannelStats", 8, flags))
+    {
+        for (const char* column : { "", "Min", "Max", "Mean", "Std", "P1", "P50", "P99" })
+            ImGui::TableSetupColumn (column);
+        ImGui::TableHeadersRow ();
+        for (int k = 0; k < stats.numChannels; ++k)
+        {
+            const ImageStatistics::Channel& channel = stats.channels[k];
+            ImGui::TableNextRow ();
+            ImGui::TableNextColumn (); ImGui::TextUnformatted (channelName(k));
+            ImGui::TableNextColumn (); ImGui::Text (valueFormat, channel.minValue);
+            ImGui::TableNextColumn (); ImGui::Text (valueFormat, channel.maxValue);
+            ImGui::TableNextColumn (); ImGui::Text ("%.4g", channel.mean);
+            ImGui::TableNextColumn (); ImGui::Text ("%.4g", channel.stddev);
+            ImGui::TableNextColumn (); ImGui::Text (valueFormat, stats.percentile(k, 0.01));
+            ImGui::TableNextColumn (); ImGui::Text (valueFormat, stats.percentile(k, 0.5));
+            ImGui::TableNextColumn (); ImGui::Text (valueFormat, stats.percentile(k, 0.99));
+        }
+        ImGui::EndTable ();
+    }
+
+    ImGui::Spacing();
+    ImGui::TextDisabled ("Histograms over [%.4g, %.4g]", stats.histogramMin, stats.histogramMax);
+    for (int k = 0; k < stats.numChannels; ++k)
+    {
+        const ImageStatistics::Channel& channel = stats.channels[k];
+        ImGui::PlotHistogram (formatted("##Histogram%d", k).c_str(),
+                              [](void* data, int idx) { return float(((const int64_t*)data)[idx]); },
+                              (void*)channel.histogram.data(),
+                              ImageStatistics::NumBins,
+                              0,
+                              channelName(k),
+                              0.f,
+                              FLT_MAX,
+                              ImVec2(ImGui::GetContentRegionAvail().x, ImGui::GetFontSize() * 3.f));
+    }
+
+    ImGui::EndChild ();
+}
+
+void ControlsWindow::Impl::renderDuplicatesTab (float footerHeight)
+{
+    auto* imageWindow = this->viewer->imageWindow();
+    PerceptualHashIndex& index = imageWindow->perceptualHashIndex();
+    const PerceptualHashIndex::Progress progress = index.progress();
+    const float contentWidth = ImGui::GetContentRegionAvail().x;
+
+    ImGui::Spacing();
+    const ImageBufferPool::Stats bufferStats = ImageBufferPool::instance().stats();
+    if (bufferStats.numReferences > 0)
+    {
+        ImGui::TextDisabled ("Pushed images: %d buffers for %d images, %.1f MB, dedup ratio %.2fx (%.1f MB saved)",
+                             bufferStats.numBuffers, bufferStats.numReferences,
+                             bufferStats.numBytes / (1024. * 1024.),
+                             bufferStats.dedupRatio(),
+                             (bufferStats.numReferencedBytes - bufferStats.numBytes) / (1024. * 1024.));
+        ImGui::SameLine();
+        helpMarker ("The images pushed with identical pixels share a single buffer.", ImGui::GetFontSize() * 20);
+    }
+
+    if (progress.running)
+    {
+        const std::string label = formatted("%d / %d, %.0f images/s", progress.numProcessed, progress.numFiles, progress.imagesPerSecond);
+        const float fraction = progress.numFiles > 0 ? progress.numProcessed / float(progress.numFiles) : 0.f;
+        ImGui::ProgressBar (fraction, ImVec2(contentWidth * 0.6f, 0.f), label.c_str());
+        ImGui::SameLine();
+        if (progress.cancelled)
+            ImGui::BeginDisabled ();
+        if (ImGui::Button("Cancel"))
+            index.cancel ();
+        if (progress.cancelled)
+            ImGui::EndDisabled ();
+        return;
+    }
+
+    if (ImGui::Button("Index Image Files"))
+    {
+        if (!imageWindow->startPerceptualHashIndex ())
+            zv_dbg ("No image file to index.");
+        duplicates.groups.clear ();
+        duplicates.groupsMaxDistance = -1;
+    }
+    ImGui::SameLine();
+    helpMarker ("Computes a perceptual hash of each enabled image file in the background. JPEG files get decoded at a reduced size.", ImGui::GetFontSize() * 20);
+
+    if (progress.numFiles > 0)
+    {
+        ImGui::TextDisabled ("%d / %d files in %.1f s, %.0f images/s, %d failed%s",
+                             progress.numProcessed, progress.numFiles, progress.elapsedSeconds,
+                             progress.imagesPerSecond, progress.numFailed,
+                             progress.cancelled ? " (cancelled)" : "");
+    }
+
+    if (!index.isReady())
+        return;
+
+    ImGui::SetNextItemWidth (contentWidth * 0.4f);
+    ImGui::SliderInt ("Max distance", &duplicates.maxDistance, 0, PerceptualHashIndex::MaxDistance);
+    ImGui::SameLine();
+    helpMarker ("Number of different bits out of 64. Up to 6 is usually the same picture after resizing or compression.", ImGui::GetFontSize() * 20);
+
+    const std::vector<std::string>& filePaths = index.filePaths();
+    auto fileName = [](const std::string& path) {
+        const size_t lastSeparator = path.find_last_of ("/\\");
+        return lastSeparator == std::string::npos ? path : path.substr (lastSeparator + 1);
+    };
+
+    // The list may have changed since the indexing.
+    ImageList& imageList = this->viewer->imageList();
+    auto selectableFile = [&](int fileIndex, const std::string& label) {
+        ImGui::PushID (fileIndex);
+        if (ImGui::Selectable (label.c_str()))
+        {
+            for (int idx = 0; idx < imageList.numImages(); ++idx)
+            {
+                const ImageItemPtr& item = imageList.imageItemFromIndex (idx);
+                if (item->source == ImageItem::Source::FilePath && item->sourceImagePath == filePaths[fileIndex])
+                {
+                    auto paramsPtr = std::make_shared<ImageWindowAction::Params>();
+                    paramsPtr->intParams[0] = idx;
+                    imageWindow->addCommand (ImageWindow::actionCommand(ImageWindowAction::Kind::View_SelectImage, paramsPtr));
+                    break;
+                }
+            }
+        }
+        if (zv::IsItemHovered(ImGuiHoveredFlags_RectOnly, 0.5))
+            ImGui::SetTooltip ("%s", filePaths[fileIndex].c_str());
+        ImGui::PopID ();
+    };
+
+    const ImVec2 contentSize = ImGui::GetContentRegionAvail();
+    ImGui::BeginChild ("Duplicates", ImVec2(0, contentSize.y - footerHeight));
+
+    ModifiedImagePtr firstModIm = imageWindow->getFirstValidImage(false /* not only modified */);
+    const int currentFileIndex = firstModIm && firstModIm->item()->source == ImageItem::Source::FilePath
+                                 ? index.fileIndex (firstModIm->item()->sourceImagePath) : -1;
+    if (ImGui::CollapsingHeader ("Duplicates of the current image", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        if (currentFileIndex < 0)
+        {
+            ImGui::TextDisabled ("The current image was not indexed.");
+        }
+        else
+        {
+            const auto matches = index.findNearDuplicates (currentFileIndex, duplicates.maxDistance);
+            if (matches.empty())
+                ImGui::TextDisabled ("None.");
+            for (const auto& match : matches)
+                selectableFile (match.fileIndex, formatted("%s (distance %d)", fileName(filePaths[match.fileIndex]).c_str(), match.distance));
+        }
+    }
+
+    if (ImGui::CollapsingHeader ("All near-duplicates", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        if (ImGui::Button ("Group"))
+        {
+            duplicates.groups = index.groupNearDuplicates (duplicates.maxDistance);
+            duplicates.groupsMaxDistance = duplicates.maxDistance;
+        }
+
+        if (duplicates.groupsMaxDistance >= 0)
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled ("%d groups within %d bits", int(duplicates.groups.size()), duplicates.groupsMaxDistance);
+            for (int g = 0; g < int(duplicates.groups.size()); ++g)
+            {
+                const auto& group = duplicates.groups[g];
+                if (ImGui::TreeNode ((void*)(intptr_t)g, "%s and %d more", fileName(filePaths[group[0]]).c_str(), int(group.size()) - 1))
+                {
+                    for (int fileIndex : group)
+                        selectableFile (fileIndex, fileName(filePaths[fileIndex]));
+                    ImGui::TreePop ();
+                }
+            }
+        }
+    }
+
+    ImGui::EndChild ();
+}
+
 void ControlsWindow::Impl::renderImageList (float cursorOverlayHeight)
 {
     auto* imageWindow = this->viewer->imageWindow();
@@ -529,9 +984,17 @@ void ControlsWindow::Impl::renderMenu ()
                 {
                     imageWindow->addCommand (ImageWindow::actionCommand(ImageWindowAction::Kind::Modify_Rotate180));
                 }
+                if (ImGui::MenuItem("Flip Horizontally", "", false))
+                {
+                    imageWindow->addCommand (ImageWindow::actionCommand(ImageWindowAction::Kind::Modify_FlipHorizontal));
+                }
+                if (ImGui::MenuItem("Flip Vertically", "", false))
+                {
+                    imageWindow->addCommand (ImageWindow::actionCommand(ImageWindowAction::Kind::Modify_FlipVertical));
+                }
                 if (ImGui::MenuItem("Crop Image", "", false))
                 {
-                    imageWindowState.activeToolState.kind = ActiveToolState::Kind::Transform_Crop;
+                    imageWindow->setActiveTool (ActiveToolState::Kind::Transform_Crop);
                 }
                 if (ImGui::MenuItem("Resize Image to Window", "", false, !imageWindow->imageWidgetHasExactImageSize()))
                 {
@@ -544,11 +1007,16 @@ void ControlsWindow::Impl::renderMenu ()
             {
                 if (ImGui::MenuItem("Add Line", "", false))
                 {
-                    imageWindowState.activeToolState.kind = ActiveToolState::Kind::Annotate_Line;
+                    imageWindow->setActiveTool (ActiveToolState::Kind::Annotate_Line);
                 }
                 ImGui::EndMenu();
             }
 
+            if (ImGui::MenuItem("Measure Region", "", false))
+            {
+                imageWindow->setActiveTool (ActiveToolState::Kind::Measure_Roi);
+            }
+
             ImGui::EndMenu();
         }
         
@@ -894,6 +1362,21 @@ void ControlsWindow::renderFrame ()
                 impl->renderModifiersTab (footerHeight);
                 ImGui::EndTabItem();
             }
+            if (ImGui::BeginTabItem("Display"))
+            {
+                impl->renderDisplayTab ();
+                ImGui::EndTabItem();
+            }
+            if (ImGui::BeginTabItem("Statistics"))
+            {
+                impl->renderStatisticsTab (footerHeight);
+                ImGui::EndTabItem();
+            }
+            if (ImGui::BeginTabItem("Duplicates"))
+            {
+                impl->renderDuplicatesTab (footerHeight);
+                ImGui::EndTabItem();
+            }
             ImGui::EndTabBar();
         }        
                         
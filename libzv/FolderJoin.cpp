@@ -0,0 +1,199 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "FolderJoin.h"
+
+#include <libzv/ThreadPool.h>
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <string_view>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace zv
+{
+
+namespace
+{
+
+bool hasImageExtension (const std::string& extension)
+{
+    static const char* imageExtensions[] = { ".png", ".jpg", ".jpeg", ".bmp", ".gif", ".pnm", ".pgm", ".ppm", ".tga", ".psd", ".hdr" };
+    std::string lowerExtension = extension;
+    std::transform (lowerExtension.begin(), lowerExtension.end(), lowerExtension.begin(), [](unsigned char c) { return std::tolower(c); });
+    for (const char* imageExtension : imageExtensions)
+    {
+        if (lowerExtension == imageExtension)
+            return true;
+    }
+    return false;
+}
+
+struct FolderListing
+{
+    struct File
+    {
+        // Relative to the root, with forward slashes.
+        std::string relativePath;
+        // The key is a prefix of the relative path, no need for a copy.
+        size_t keyLength = 0;
+
+        std::string_view key () const { return std::string_view(relativePath).substr(0, keyLength); }
+    };
+
+    fs::path root;
+    // Sorted by key, so the duplicate stems always resolve the same way.
+    std::vector<File> files;
+};
+
+bool listImageFiles (const fs::path& root, FolderJoinKey key, FolderListing& listing)
+{
+    listing.root = root;
+    std::error_code err;
+    if (!fs::is_directory (root, err))
+        return false;
+
+    // The entries are root / relativePath, strip the root with its separator.
+    const size_t rootLength = (root / "").generic_string().size();
+
+    fs::recursive_directory_iterator it (root, fs::directory_options::skip_permission_denied, err);
+    for (; !err && it != fs::recursive_directory_iterator(); it.increment (err))
+    {
+        const fs::directory_entry& entry = *it;
+        if (!entry.is_regular_file (err))
+            continue;
+
+        const std::string extension = entry.path().extension().string();
+        if (!hasImageExtension (extension))
+            continue;
+
+        FolderListing::File file;
+        file.relativePath = entry.path().generic_string().substr (rootLength);
+        file.keyLength = file.relativePath.size();
+        if (key == FolderJoinKey::Stem)
+            file.keyLength -= extension.size();
+        listing.files.push_back (std::move(file));
+    }
+
+    if (err)
+    {
+        zv_dbg ("Could not list %s: %s", root.string().c_str(), err.message().c_str());
+        return false;
+    }
+
+    std::sort (listing.files.begin(), listing.files.end(), [](const FolderListing::File& lhs, const FolderListing::File& rhs) {
+        const int keyOrder = lhs.key().compare (rhs.key());
+        return keyOrder != 0 ? keyOrder < 0 : lhs.relativePath < rhs.relativePath;
+    });
+    return true;
+}
+
+} // anonymous
+
+bool joinFolders (const std::vector<std::string>& folders,
+                  FolderJoinKey key,
+                  FolderJoinResult& result)
+{
+    result = {};
+    const int numFolders = int(folders.size());
+    if (numFolders == 0)
+        return false;
+
+    // Mostly waiting on the filesystem, but it overlaps the folders.
+    std::vector<FolderListing> listings (numFolders);
+    std::vector<char> listed (numFolders, false);
+    ThreadPool::instance().parallelFor (numFolders, [&](int folderIdx) {
+        listed[folderIdx] = listImageFiles (folders[folderIdx], key, listings[folderIdx]);
+    });
+
+    for (int folderIdx = 0; folderIdx < numFolders; ++folderIdx)
+    {
+        if (!listed[folderIdx])
+        {
+            zv_dbg ("Could not read the folder %s", folders[folderIdx].c_str());
+            return false;
+        }
+        result.numFiles.push_back (int(listings[folderIdx].files.size()));
+    }
+
+    // Build on the smallest folder, each key gets a slot.
+    const int buildFolder = int(std::min_element (result.numFiles.begin(), result.numFiles.end()) - result.numFiles.begin());
+    const std::vector<FolderListing::File>& buildFiles = listings[buildFolder].files;
+    std::unordered_map<std::string_view, int> slotFromKey;
+    slotFromKey.reserve (buildFiles.size());
+
+    // Per slot, the index of its file in each folder, -1 if missing.
+    std::vector<int> slotFiles;
+    slotFiles.reserve (buildFiles.size() * numFolders);
+    for (int fileIdx = 0; fileIdx < buildFiles.size(); ++fileIdx)
+    {
+        const int numSlots = int(slotFromKey.size());
+        if (!slotFromKey.emplace (buildFiles[fileIdx].key(), numSlots).second)
+            continue;
+        slotFiles.resize (slotFiles.size() + numFolders, -1);
+        slotFiles[size_t(numSlots) * numFolders + buildFolder] = fileIdx;
+    }
+
+    // Then probe with the others. The files are sorted, so the first one
+    // of a duplicate stem wins.
+    for (int folderIdx = 0; folderIdx < numFolders; ++folderIdx)
+    {
+        if (folderIdx == buildFolder)
+            continue;
+
+        const std::vector<FolderListing::File>& files = listings[folderIdx].files;
+        for (int fileIdx = 0; fileIdx < files.size(); ++fileIdx)
+        {
+            const auto slotIt = slotFromKey.find (files[fileIdx].key());
+            if (slotIt == slotFromKey.end())
+                continue;
+            int& slotFile = slotFiles[size_t(slotIt->second) * numFolders + folderIdx];
+            if (slotFile < 0)
+                slotFile = fileIdx;
+        }
+    }
+
+    // The slots follow the sorted build files, so the tuples come out sorted.
+    std::vector<std::vector<char>> inTuple (numFolders);
+    for (int folderIdx = 0; folderIdx < numFolders; ++folderIdx)
+        inTuple[folderIdx].resize (listings[folderIdx].files.size(), false);
+
+    const int numSlots = int(slotFromKey.size());
+    for (int slotIdx = 0; slotIdx < numSlots; ++slotIdx)
+    {
+        const int* fileIndices = &slotFiles[size_t(slotIdx) * numFolders];
+        if (std::any_of (fileIndices, fileIndices + numFolders, [](int fileIdx) { return fileIdx < 0; }))
+            continue;
+
+        std::vector<std::string> tuple (numFolders);
+        for (int folderIdx = 0; folderIdx < numFolders; ++folderIdx)
+        {
+            const FolderListing& listing = listings[folderIdx];
+            tuple[folderIdx] = (listing.root / listing.files[fileIndices[folderIdx]].relativePath).string();
+            inTuple[folderIdx][fileIndices[folderIdx]] = true;
+        }
+        result.tuples.push_back (std::move(tuple));
+    }
+
+    result.unmatched.resize (numFolders);
+    for (int folderIdx = 0; folderIdx < numFolders; ++folderIdx)
+    {
+        const FolderListing& listing = listings[folderIdx];
+        for (int fileIdx = 0; fileIdx < listing.files.size(); ++fileIdx)
+        {
+            if (!inTuple[folderIdx][fileIdx])
+                result.unmatched[folderIdx].push_back ((listing.root / listing.files[fileIdx].relativePath).string());
+        }
+    }
+
+    return true;
+}
+
+} // zv
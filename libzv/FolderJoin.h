@@ -0,0 +1,44 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace zv
+{
+
+enum class FolderJoinKey
+{
+    // "sub/a.png" only matches "sub/a.png".
+    RelativePath,
+    // The extension is ignored, "sub/a.png" matches "sub/a.jpg".
+    Stem,
+};
+
+struct FolderJoinResult
+{
+    // One path per folder, in the order of the folders, sorted by key.
+    std::vector<std::vector<std::string>> tuples;
+
+    // Per folder, the files missing from at least one other folder, and
+    // the extra files sharing a stem with another one.
+    std::vector<std::vector<std::string>> unmatched;
+
+    // Per folder, the image files found.
+    std::vector<int> numFiles;
+};
+
+// Recursively lists the image files of each folder, then joins them with
+// a hash table built on the smallest folder and probed with the other
+// ones. The folders are listed in parallel. Returns false if one of them
+// cannot be read.
+bool joinFolders (const std::vector<std::string>& folders,
+                  FolderJoinKey key,
+                  FolderJoinResult& result);
+
+} // zv
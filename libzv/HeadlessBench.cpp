@@ -0,0 +1,174 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "HeadlessBench.h"
+
+#include <libzv/Viewer.h>
+#include <libzv/ImageWindowState.h>
+#include <libzv/Utils.h>
+
+#include <GL/gl3w.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+
+namespace zv
+{
+
+bool parseBenchLayouts (const std::string& str, std::vector<std::pair<int,int>>& layouts)
+{
+    layouts.clear ();
+    std::istringstream stream (str);
+    std::string token;
+    while (std::getline(stream, token, ','))
+    {
+        int numRows = 0, numCols = 0;
+        if (sscanf(token.c_str(), "%dx%d", &numRows, &numCols) != 2)
+            return false;
+        if (numRows < 1 || numCols < 1)
+            return false;
+        layouts.push_back ({numRows, numCols});
+    }
+    return !layouts.empty();
+}
+
+namespace
+{
+
+struct BenchStep
+{
+    const char* name;
+    std::function<void(Viewer&)> apply;
+};
+
+std::vector<BenchStep> benchScript ()
+{
+    auto actionStep = [](const char* name, ImageWindowAction::Kind kind) {
+        return BenchStep { name, [kind](Viewer& viewer) {
+            viewer.runAction (ImageWindowAction(kind));
+        }};
+    };
+
+    auto modeStep = [](const char* name, ViewerMode mode) {
+        return BenchStep { name, [mode](Viewer& viewer) {
+            viewer.setViewerMode (mode);
+        }};
+    };
+
+    return {
+        { "initial", [](Viewer&) {} },
+        actionStep ("next page", ImageWindowAction::Kind::View_NextPageOfImage),
+        actionStep ("prev page", ImageWindowAction::Kind::View_PrevPageOfImage),
+        actionStep ("zoom x2", ImageWindowAction::Kind::Zoom_x2),
+        actionStep ("zoom /2", ImageWindowAction::Kind::Zoom_div2),
+        modeStep ("levels", ViewerMode::Levels),
+        modeStep ("red channel", ViewerMode::Channel_Red),
+        modeStep ("protan", ViewerMode::Cvd_Protan),
+        modeStep ("daltonized", ViewerMode::Daltonize),
+        modeStep ("original", ViewerMode::Original),
+        { "name filter", [](Viewer& viewer) { viewer.setNameFilter ("1"); } },
+        { "no filter", [](Viewer& viewer) { viewer.setNameFilter (""); } },
+    };
+}
+
+ImageSRGBA syntheticImage (int width, int height, int index)
+{
+    ImageSRGBA im (width, height);
+    for (int r = 0; r < height; ++r)
+    {
+        PixelSRGBA* rowPtr = im.atRowPtr(r);
+        for (int c = 0; c < width; ++c)
+        {
+            rowPtr[c] = PixelSRGBA((c*255/width + 37*index) & 0xff,
+                                   (r*255/height + 91*index) & 0xff,
+                                   ((c ^ r) + 13*index) & 0xff,
+                                   255);
+        }
+    }
+    return im;
+}
+
+// Nearest rank, the input gets sorted.
+double percentile (std::vector<double>& values, double p)
+{
+    if (values.empty())
+        return NAN;
+    std::sort (values.begin(), values.end());
+    const int rank = std::min(int(p * values.size()), int(values.size()) - 1);
+    return values[rank];
+}
+
+void printStats (const std::string& layout, const char* stepName, std::vector<double> frameTimesMs)
+{
+    const int numFrames = int(frameTimesMs.size());
+    const double p50 = percentile (frameTimesMs, 0.5);
+    const double p90 = percentile (frameTimesMs, 0.9);
+    const double p99 = percentile (frameTimesMs, 0.99);
+    const double maxTime = frameTimesMs.empty() ? NAN : frameTimesMs.back();
+    printf ("%-8s %-12s %6d %8.2f %8.2f %8.2f %8.2f\n", layout.c_str(), stepName, numFrames, p50, p90, p99, maxTime);
+}
+
+} // anonymous
+
+HeadlessBench::HeadlessBench (const HeadlessBenchConfig& config)
+: _config (config)
+{}
+
+bool HeadlessBench::run (Viewer& viewer)
+{
+    if (viewer.numImages() <= 1)
+    {
+        // Two pages of the largest layout.
+        int maxCells = 1;
+        for (const auto& layout : _config.layouts)
+            maxCells = std::max(maxCells, layout.first * layout.second);
+        for (int i = 0; i < 2*maxCells; ++i)
+        {
+            viewer.addImageData (syntheticImage(_config.syntheticImageWidth, _config.syntheticImageHeight, i),
+                                 formatted("synthetic_%03d", i),
+                                 -1,
+                                 false /* no need to check for existing */);
+        }
+    }
+
+    const auto script = benchScript ();
+
+    printf ("%d images, %d frames per action\n", viewer.numImages(), _config.framesPerAction);
+    printf ("%-8s %-12s %6s %8s %8s %8s %8s\n", "layout", "step", "frames", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    for (const auto& layout : _config.layouts)
+    {
+        const std::string layoutName = formatted("%dx%d", layout.first, layout.second);
+        viewer.selectImageIndex (0);
+        viewer.setLayout (layout.first, layout.second);
+
+        std::vector<double> allFrameTimesMs;
+        for (const auto& step : script)
+        {
+            step.apply (viewer);
+
+            std::vector<double> frameTimesMs;
+            for (int i = 0; i < _config.framesPerAction; ++i)
+            {
+                // glFinish to include the rendering itself, not just
+                // the submission of the commands.
+                const double startTime = currentDateInSeconds();
+                viewer.renderFrame ();
+                glFinish ();
+                frameTimesMs.push_back ((currentDateInSeconds() - startTime) * 1e3);
+            }
+
+            allFrameTimesMs.insert (allFrameTimesMs.end(), frameTimesMs.begin(), frameTimesMs.end());
+            printStats (layoutName, step.name, std::move(frameTimesMs));
+        }
+        printStats (layoutName, "all", std::move(allFrameTimesMs));
+    }
+
+    return true;
+}
+
+} // zv
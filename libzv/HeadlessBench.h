@@ -0,0 +1,49 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace zv
+{
+
+class Viewer;
+
+struct HeadlessBenchConfig
+{
+    // Grid layouts to go through, as rows x cols.
+    std::vector<std::pair<int,int>> layouts = { {1,1}, {2,2}, {4,4}, {8,8} };
+
+    // Frames rendered after each scripted action.
+    int framesPerAction = 10;
+
+    // Synthetic images are generated when the viewer does not have any.
+    int syntheticImageWidth = 1024;
+    int syntheticImageHeight = 768;
+};
+
+// Parses "1x1,2x2,8x8". Returns false on invalid input.
+bool parseBenchLayouts (const std::string& str, std::vector<std::pair<int,int>>& layouts);
+
+// Replays a fixed sequence of actions (page changes, zoom, display modes,
+// name filter) on the image window for each layout and prints the
+// percentiles of the frame times. Meant to run with the GLFW null
+// platform, so it works without a display or a GPU.
+class HeadlessBench
+{
+public:
+    HeadlessBench (const HeadlessBenchConfig& config);
+
+    bool run (Viewer& viewer);
+
+private:
+    HeadlessBenchConfig _config;
+};
+
+} // zv
@@ -48,6 +48,13 @@ namespace zv
         inline size_t bytesPerRow () const { return _bytesPerRow; }
         
         bool contains(int c, int r) const { return c >= 0 && c < _width && r >= 0 && r < _height; }
+        
+        // True if the pixels belong to another image, see makeView.
+        bool isView () const { return _viewOwner != nullptr; }
+
+        // Bytes kept alive by the image, the whole buffer of the parent
+        // for a view.
+        size_t retainedBytes () const { return isView() ? _viewOwnerBytes : sizeInBytes(); }
      
     public:
         using ReleaseFuncType = std::function<void(uint8_t** ptr)>;
@@ -104,6 +111,23 @@ namespace zv
             _releaseFunc = releaseFunc;
         }
         
+        // Sub-rectangle of parent sharing its pixels, in O(1). The buffer
+        // is kept alive by the view, so the parent must not be modified in
+        // place while views exist. Copies of a view own their buffer, and
+        // a view that gets reallocated for writing stops sharing
+        // (copy-on-write).
+        static std::shared_ptr<Image> makeView (const std::shared_ptr<Image>& parent,
+                                                int x0, int y0, int width, int height)
+        {
+            assert (x0 >= 0 && y0 >= 0 && x0 + width <= parent->width() && y0 + height <= parent->height());
+            uint8_t* viewData = reinterpret_cast<uint8_t*>(parent->atRowPtr(y0) + x0);
+            auto view = std::make_shared<Image>(viewData, width, height, parent->_bytesPerRow, noopReleaseFunc());
+            // Views of views keep the original buffer owner.
+            view->_viewOwner = parent->_viewOwner ? parent->_viewOwner : parent;
+            view->_viewOwnerBytes = parent->retainedBytes();
+            return view;
+        }
+        
         // Move assignment operator
         Image& operator= (Image&& rhs)
         {
@@ -114,6 +138,8 @@ namespace zv
             _bytesPerRow = rhs._bytesPerRow;
             _releaseFunc = rhs._releaseFunc;
             _allocatedBytes = rhs._allocatedBytes;
+            _viewOwner = std::move(rhs._viewOwner);
+            _viewOwnerBytes = rhs._viewOwnerBytes;
 
             rhs._data = nullptr;
             rhs._width = 0;
@@ -121,6 +147,7 @@ namespace zv
             rhs._bytesPerRow = 0;
             rhs._releaseFunc = nullptr;
             rhs._allocatedBytes = 0;
+            rhs._viewOwner.reset ();
             
             return *this;
         }
@@ -139,7 +166,7 @@ namespace zv
         
         void ensureAllocatedBufferForSize (int width, int height)
         {
-            if (_width == width && _height == height)
+            if (_width == width && _height == height && !isView())
                 return;
             
             auto requiredBytes = computeRequiredAllocatedBytesForSize (width, height);
@@ -164,6 +191,8 @@ namespace zv
             std::swap(_bytesPerRow, rhs._bytesPerRow);
             std::swap(_releaseFunc, rhs._releaseFunc);
             std::swap(_allocatedBytes, rhs._allocatedBytes);
+            std::swap(_viewOwner, rhs._viewOwner);
+            std::swap(_viewOwnerBytes, rhs._viewOwnerBytes);
         }
         
         // Warning: does not allocate any data.
@@ -275,6 +304,7 @@ namespace zv
             _height = 0;
             _bytesPerRow = 0;
             _allocatedBytes = 0;
+            _viewOwner.reset ();
         }
     
     private:
@@ -286,6 +316,10 @@ namespace zv
         
         // bytes that we allocated ourselves. Can be different from actual size if we used ensureAllocatedBufferForSize
         size_t _allocatedBytes = 0;
+        
+        // Set for views, see makeView.
+        std::shared_ptr<const void> _viewOwner;
+        size_t _viewOwnerBytes = 0;
     };
     
     struct PixelSRGBA
@@ -368,10 +402,27 @@ namespace zv
     using ImageLMS = Image<PixelLMS>;
     
     bool readImageFile (const std::string& inputFileName, ImageSRGBA& outputImage);
+
+    // JPEG files get decoded with the smallest DCT scaling, down to 1/8,
+    // that keeps both dimensions at least minSize. Much faster when only
+    // a small version is needed. Other formats are read at full size.
+    bool readImageFileReduced (const std::string& inputFileName, int minSize, ImageSRGBA& outputImage);
     
-    bool readJpegFile (const std::string& inputFilename, ImageSRGBA& outputImage);
+    // minSize as in readImageFileReduced, 0 for the full size.
+    bool readJpegFile (const std::string& inputFilename, ImageSRGBA& outputImage, int minSize = 0);
+
+    struct ImageWriteStats
+    {
+        double encodeTimeMs = 0.;
+        size_t numBytes = 0;
+    };
+
+    // JPEG for the .jpg and .jpeg extensions, PNG otherwise. The stats are optional.
+    bool writeImageFile (const std::string& filePath, const ImageSRGBA& image, ImageWriteStats* stats = nullptr);
 
-    bool writeImageFile (const std::string& filePath, const ImageSRGBA& image);
+    // From 0 (no compression) to 9, for the PNG files.
+    void setPngCompressionLevel (int level);
+    int pngCompressionLevel ();
 
     template <class T>
     Image<T> crop (const Image<T>& input, const zv::Rect& rawRoi)
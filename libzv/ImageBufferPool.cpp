@@ -0,0 +1,371 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "ImageBufferPool.h"
+
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define ZV_HASH_SSE2 1
+#else
+#  define ZV_HASH_SSE2 0
+#endif
+
+namespace zv
+{
+
+namespace
+{
+
+constexpr uint64_t Prime32_1 = 0x9E3779B1U;
+constexpr uint64_t Prime64_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t Prime64_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t Prime64_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t Prime64_5 = 0x27D4EB2F165667C5ULL;
+
+constexpr int StripeBytes = 64;
+constexpr int NumLanes = StripeBytes / 8;
+// Each stripe of a block uses the key 8 bytes further, then the
+// accumulators get scrambled with the last 64 bytes.
+constexpr int KeyBytes = 192;
+constexpr int StripesPerBlock = (KeyBytes - StripeBytes) / 8;
+
+struct HashKey
+{
+    HashKey ()
+    {
+        // Any fixed pseudo-random bytes do, splitmix64 fills them.
+        uint64_t state = Prime64_5;
+        for (int i = 0; i < KeyBytes / 8; ++i)
+        {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            z ^= z >> 31;
+            memcpy (bytes + i * 8, &z, 8);
+        }
+    }
+
+    alignas(16) uint8_t bytes[KeyBytes];
+};
+
+const HashKey& hashKey ()
+{
+    static const HashKey key;
+    return key;
+}
+
+inline uint64_t read64 (const uint8_t* ptr)
+{
+    uint64_t v;
+    memcpy (&v, ptr, 8);
+    return v;
+}
+
+inline uint64_t rotl64 (uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t round64 (uint64_t acc, uint64_t input)
+{
+    acc += input * Prime64_2;
+    return rotl64 (acc, 31) * Prime64_1;
+}
+
+class ContentHasher
+{
+public:
+    ContentHasher ()
+    {
+        const uint64_t initialAcc[NumLanes] = { Prime32_1, Prime64_1, Prime64_2, Prime64_3,
+                                                Prime64_4, Prime32_1, Prime64_2, Prime64_5 };
+        memcpy (_acc, initialAcc, sizeof(_acc));
+    }
+
+    void update (const uint8_t* data, size_t size)
+    {
+        _totalBytes += size;
+
+        if (_numPending > 0)
+        {
+            const size_t toCopy = std::min(size, size_t(StripeBytes - _numPending));
+            memcpy (_pending + _numPending, data, toCopy);
+            _numPending += toCopy;
+            data += toCopy;
+            size -= toCopy;
+            if (_numPending < StripeBytes)
+                return;
+            accumulateStripes (_pending, 1);
+            _numPending = 0;
+        }
+
+        const size_t numStripes = size / StripeBytes;
+        accumulateStripes (data, numStripes);
+        data += numStripes * StripeBytes;
+        size -= numStripes * StripeBytes;
+
+        memcpy (_pending, data, size);
+        _numPending = size;
+    }
+
+    uint64_t digest () const
+    {
+        const uint8_t* key = hashKey().bytes;
+        uint64_t h = _totalBytes * Prime64_1;
+        for (int i = 0; i < NumLanes; ++i)
+        {
+            h ^= round64 (0, _acc[i] ^ read64 (key + i * 8));
+            h = h * Prime64_1 + Prime64_4;
+        }
+
+        // The tail of less than a stripe, the XXH64 way.
+        const uint8_t* ptr = _pending;
+        const uint8_t* end = _pending + _numPending;
+        for (; ptr + 8 <= end; ptr += 8)
+        {
+            h ^= round64 (0, read64 (ptr));
+            h = rotl64 (h, 27) * Prime64_1 + Prime64_4;
+        }
+        for (; ptr < end; ++ptr)
+        {
+            h ^= *ptr * Prime64_5;
+            h = rotl64 (h, 11) * Prime64_1;
+        }
+
+        h ^= h >> 33;
+        h *= Prime64_2;
+        h ^= h >> 29;
+        h *= Prime64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    // acc[i ^ 1] += data[i] and acc[i] += lo32(data[i] ^ key[i]) * hi32(data[i] ^ key[i]).
+    // The scrambling is acc = (acc ^ (acc >> 47) ^ key) * Prime32_1.
+    void accumulateStripes (const uint8_t* data, size_t numStripes)
+    {
+        const uint8_t* key = hashKey().bytes;
+        const uint8_t* scrambleKey = key + KeyBytes - StripeBytes;
+
+        for (size_t s = 0; s < numStripes; ++s, data += StripeBytes)
+        {
+            const uint8_t* stripeKey = key + _stripeInBlock * 8;
+#if ZV_HASH_SSE2
+            __m128i* acc = reinterpret_cast<__m128i*>(_acc);
+            for (int i = 0; i < NumLanes / 2; ++i)
+            {
+                const __m128i d = _mm_loadu_si128 (reinterpret_cast<const __m128i*>(data) + i);
+                const __m128i dk = _mm_xor_si128 (d, _mm_loadu_si128 (reinterpret_cast<const __m128i*>(stripeKey) + i));
+                const __m128i product = _mm_mul_epu32 (dk, _mm_shuffle_epi32 (dk, _MM_SHUFFLE(0, 3, 0, 1)));
+                const __m128i swapped = _mm_shuffle_epi32 (d, _MM_SHUFFLE(1, 0, 3, 2));
+                acc[i] = _mm_add_epi64 (_mm_add_epi64 (acc[i], swapped), product);
+            }
+#else
+            for (int i = 0; i < NumLanes; ++i)
+            {
+                const uint64_t d = read64 (data + i * 8);
+                const uint64_t dk = d ^ read64 (stripeKey + i * 8);
+                _acc[i ^ 1] += d;
+                _acc[i] += (dk & 0xFFFFFFFFULL) * (dk >> 32);
+            }
+#endif
+
+            if (++_stripeInBlock < StripesPerBlock)
+                continue;
+            _stripeInBlock = 0;
+
+#if ZV_HASH_SSE2
+            const __m128i prime = _mm_set1_epi32 (int(Prime32_1));
+            for (int i = 0; i < NumLanes / 2; ++i)
+            {
+                __m128i a = _mm_xor_si128 (acc[i], _mm_srli_epi64 (acc[i], 47));
+                a = _mm_xor_si128 (a, _mm_loadu_si128 (reinterpret_cast<const __m128i*>(scrambleKey) + i));
+                const __m128i lo = _mm_mul_epu32 (a, prime);
+                const __m128i hi = _mm_mul_epu32 (_mm_shuffle_epi32 (a, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+                acc[i] = _mm_add_epi64 (lo, _mm_slli_epi64 (hi, 32));
+            }
+#else
+            for (int i = 0; i < NumLanes; ++i)
+            {
+                uint64_t a = _acc[i];
+                a ^= a >> 47;
+                a ^= read64 (scrambleKey + i * 8);
+                _acc[i] = a * Prime32_1;
+            }
+#endif
+        }
+    }
+
+private:
+    alignas(16) uint64_t _acc[NumLanes];
+    uint8_t _pending[StripeBytes];
+    size_t _numPending = 0;
+    int _stripeInBlock = 0;
+    uint64_t _totalBytes = 0;
+};
+
+bool sameContent (const ImageSRGBA& lhs, const ImageSRGBA& rhs)
+{
+    if (lhs.width() != rhs.width() || lhs.height() != rhs.height())
+        return false;
+
+    const size_t rowBytes = lhs.width() * sizeof(PixelSRGBA);
+    for (int r = 0; r < lhs.height(); ++r)
+    {
+        if (memcmp (lhs.atRowPtr(r), rhs.atRowPtr(r), rowBytes) != 0)
+            return false;
+    }
+    return true;
+}
+
+} // anonymous
+
+uint64_t computeContentHash (const ImageSRGBA& image)
+{
+    ContentHasher hasher;
+    const uint32_t size[2] = { uint32_t(image.width()), uint32_t(image.height()) };
+    hasher.update (reinterpret_cast<const uint8_t*>(size), sizeof(size));
+
+    const size_t rowBytes = image.width() * sizeof(PixelSRGBA);
+    for (int r = 0; r < image.height(); ++r)
+        hasher.update (reinterpret_cast<const uint8_t*>(image.atRowPtr(r)), rowBytes);
+    return hasher.digest ();
+}
+
+struct ImageBufferPool::Impl
+{
+    struct Entry
+    {
+        std::weak_ptr<ImageSRGBA> buffer;
+        std::atomic<int> numReferences { 0 };
+        size_t numBytes = 0;
+    };
+    using EntryPtr = std::shared_ptr<Entry>;
+
+    mutable std::mutex mutex;
+    // Several entries for a hash only on a collision.
+    mutable std::unordered_multimap<uint64_t, EntryPtr> entries;
+    // The expired entries are dropped when the map doubles.
+    mutable size_t sizeAfterLastPruning = 0;
+
+    // The deleter of each reference keeps the shared buffer alive.
+    static std::shared_ptr<ImageSRGBA> makeReference (const EntryPtr& entry, const std::shared_ptr<ImageSRGBA>& buffer)
+    {
+        ++entry->numReferences;
+        return std::shared_ptr<ImageSRGBA> (buffer.get(), [entry, buffer](ImageSRGBA*) {
+            --entry->numReferences;
+        });
+    }
+
+    std::shared_ptr<ImageSRGBA> findReference (uint64_t hash, const ImageSRGBA& image)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        auto range = entries.equal_range (hash);
+        for (auto it = range.first; it != range.second;)
+        {
+            std::shared_ptr<ImageSRGBA> buffer = it->second->buffer.lock();
+            if (!buffer)
+            {
+                it = entries.erase (it);
+                continue;
+            }
+
+            if (sameContent (*buffer, image))
+                return makeReference (it->second, buffer);
+            ++it;
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<ImageSRGBA> addBuffer (uint64_t hash, std::shared_ptr<ImageSRGBA> buffer)
+    {
+        auto entry = std::make_shared<Entry>();
+        entry->buffer = buffer;
+        entry->numBytes = buffer->sizeInBytes();
+
+        std::lock_guard<std::mutex> lock (mutex);
+        if (entries.size() >= 2 * sizeAfterLastPruning + 64)
+            pruneExpired ();
+        entries.emplace (hash, entry);
+        return makeReference (entry, buffer);
+    }
+
+    void pruneExpired () const
+    {
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            if (it->second->buffer.expired())
+                it = entries.erase (it);
+            else
+                ++it;
+        }
+        sizeAfterLastPruning = entries.size();
+    }
+};
+
+ImageBufferPool& ImageBufferPool::instance ()
+{
+    static ImageBufferPool pool;
+    return pool;
+}
+
+ImageBufferPool::ImageBufferPool ()
+: impl (new Impl())
+{}
+
+ImageBufferPool::~ImageBufferPool () = default;
+
+std::shared_ptr<ImageSRGBA> ImageBufferPool::share (const ImageSRGBA& image)
+{
+    if (!image.hasData())
+        return std::make_shared<ImageSRGBA>();
+
+    const uint64_t hash = computeContentHash (image);
+    if (auto reference = impl->findReference (hash, image))
+        return reference;
+    return impl->addBuffer (hash, std::make_shared<ImageSRGBA>(image));
+}
+
+std::shared_ptr<ImageSRGBA> ImageBufferPool::share (ImageSRGBA&& image)
+{
+    if (!image.hasData())
+        return std::make_shared<ImageSRGBA>();
+
+    const uint64_t hash = computeContentHash (image);
+    if (auto reference = impl->findReference (hash, image))
+        return reference;
+    return impl->addBuffer (hash, std::make_shared<ImageSRGBA>(std::move(image)));
+}
+
+ImageBufferPool::Stats ImageBufferPool::stats () const
+{
+    Stats stats;
+    std::lock_guard<std::mutex> lock (impl->mutex);
+    impl->pruneExpired ();
+    for (const auto& it : impl->entries)
+    {
+        const int numReferences = it.second->numReferences;
+        if (numReferences <= 0)
+            continue;
+        ++stats.numBuffers;
+        stats.numReferences += numReferences;
+        stats.numBytes += it.second->numBytes;
+        stats.numReferencedBytes += it.second->numBytes * numReferences;
+    }
+    return stats;
+}
+
+} // zv
@@ -0,0 +1,63 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Image.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace zv
+{
+
+// 64 bits hash of the size and the pixel values, the row padding is
+// ignored. 64 bytes stripes go into 8 accumulators like XXH3 does, two
+// of them per SSE2 register. Only meant to be stable within a process.
+uint64_t computeContentHash (const ImageSRGBA& image);
+
+// Pixel buffers of the images pushed as data, shared between the items
+// with the same content. Each push gets its own reference to the shared
+// buffer, and the buffer goes away with the last reference. Identical
+// hashes are compared byte by byte before sharing anything.
+class ImageBufferPool
+{
+public:
+    struct Stats
+    {
+        // Distinct buffers still referenced.
+        int numBuffers = 0;
+        // Pushes still referencing them.
+        int numReferences = 0;
+        size_t numBytes = 0;
+        // What the pushes would take without the sharing.
+        size_t numReferencedBytes = 0;
+
+        double dedupRatio () const { return numBytes > 0 ? double(numReferencedBytes) / numBytes : 1.; }
+    };
+
+public:
+    static ImageBufferPool& instance ();
+
+public:
+    ImageBufferPool ();
+    ~ImageBufferPool ();
+
+    // Thread-safe. The returned buffers are shared, they must never be
+    // modified in place. The copy, or the move, only happens for a new
+    // content.
+    std::shared_ptr<ImageSRGBA> share (const ImageSRGBA& image);
+    std::shared_ptr<ImageSRGBA> share (ImageSRGBA&& image);
+
+    Stats stats () const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // zv
@@ -0,0 +1,361 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "ImageComparison.h"
+
+#include <libzv/NativeImage.h>
+#include <libzv/ThreadPool.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define ZV_COMPARISON_SSE2 1
+#else
+#  define ZV_COMPARISON_SSE2 0
+#endif
+
+namespace zv
+{
+
+namespace
+{
+
+// Fills 3 normalized floats per pixel.
+void normalizedRgbRow (const ImageItemData& im, int r, std::vector<float>& rgb)
+{
+    const int width = im.width();
+    rgb.resize (width*3);
+    float* outPtr = rgb.data();
+
+    if (!im.nativeData)
+    {
+        const PixelSRGBA* rowPtr = im.srgbaData().atRowPtr(r);
+        for (int c = 0; c < width; ++c)
+        {
+            outPtr[c*3+0] = rowPtr[c].r * (1.f/255.f);
+            outPtr[c*3+1] = rowPtr[c].g * (1.f/255.f);
+            outPtr[c*3+2] = rowPtr[c].b * (1.f/255.f);
+        }
+        return;
+    }
+
+    const NativeImage& native = *im.nativeData;
+    const float scale = native.isFloat() ? 1.f : 1.f / native.maxIntegerValue();
+    const bool gray = native.numChannels() == 1;
+    float values[4];
+    for (int c = 0; c < width; ++c)
+    {
+        native.getPixel (c, r, values);
+        for (int k = 0; k < 3; ++k)
+            outPtr[c*3+k] = values[gray ? 0 : k] * scale;
+    }
+}
+
+struct PartialStats
+{
+    float maxAbsDiff = 0.f;
+    int64_t numDifferentPixels = 0;
+    double sumSquaredDiff = 0.;
+};
+
+void accumulateRows (const ImageItemData& image, const ImageItemData& reference,
+                     int width, float threshold, int firstRow, int lastRow, PartialStats& stats)
+{
+    // 8-bit inputs get compared as integers, it's a tight loop the
+    // compiler can vectorize.
+    if (!image.nativeData && !reference.nativeData)
+    {
+        const int intThreshold = int(std::floor(threshold * 255.f));
+        int maxAbsDiff = 0;
+        int64_t sumSquaredDiff = 0;
+        for (int r = firstRow; r < lastRow; ++r)
+        {
+            const uint8_t* imPtr = reinterpret_cast<const uint8_t*>(image.srgbaData().atRowPtr(r));
+            const uint8_t* refPtr = reinterpret_cast<const uint8_t*>(reference.srgbaData().atRowPtr(r));
+            int64_t rowSumSquaredDiff = 0;
+            for (int c = 0; c < width; ++c)
+            {
+                int pixelMaxAbsDiff = 0;
+                for (int k = 0; k < 3; ++k)
+                {
+                    const int d = int(imPtr[c*4+k]) - int(refPtr[c*4+k]);
+                    const int absD = d < 0 ? -d : d;
+                    pixelMaxAbsDiff = std::max(pixelMaxAbsDiff, absD);
+                    rowSumSquaredDiff += d*d;
+                }
+                maxAbsDiff = std::max(maxAbsDiff, pixelMaxAbsDiff);
+                stats.numDifferentPixels += pixelMaxAbsDiff > intThreshold;
+            }
+            sumSquaredDiff += rowSumSquaredDiff;
+        }
+        stats.maxAbsDiff = maxAbsDiff / 255.f;
+        stats.sumSquaredDiff = sumSquaredDiff / (255. * 255.);
+        return;
+    }
+
+    std::vector<float> imRow, refRow;
+    for (int r = firstRow; r < lastRow; ++r)
+    {
+        normalizedRgbRow (image, r, imRow);
+        normalizedRgbRow (reference, r, refRow);
+        double rowSumSquaredDiff = 0.;
+        for (int c = 0; c < width; ++c)
+        {
+            float pixelMaxAbsDiff = 0.f;
+            for (int k = 0; k < 3; ++k)
+            {
+                const float d = imRow[c*3+k] - refRow[c*3+k];
+                pixelMaxAbsDiff = std::max(pixelMaxAbsDiff, std::abs(d));
+                rowSumSquaredDiff += d*d;
+            }
+            stats.maxAbsDiff = std::max(stats.maxAbsDiff, pixelMaxAbsDiff);
+            stats.numDifferentPixels += pixelMaxAbsDiff > threshold;
+        }
+        stats.sumSquaredDiff += rowSumSquaredDiff;
+    }
+}
+
+constexpr int SsimRadius = 5;
+constexpr int SsimWindowSize = 2*SsimRadius + 1;
+
+// Normalized Gaussian of sigma 1.5.
+struct SsimWeights
+{
+    SsimWeights ()
+    {
+        float sum = 0.f;
+        for (int k = 0; k < SsimWindowSize; ++k)
+        {
+            const float d = float(k - SsimRadius);
+            w[k] = std::exp (-d*d / (2.f * 1.5f * 1.5f));
+            sum += w[k];
+        }
+        for (int k = 0; k < SsimWindowSize; ++k)
+            w[k] /= sum;
+    }
+
+    float w[SsimWindowSize];
+};
+
+// Rec. 709 luma of the encoded values, like most SSIM tools, with
+// SsimRadius replicated pixels on each side.
+void paddedLumaRow (const ImageItemData& im, int r, int width, std::vector<float>& rgb, float* luma)
+{
+    float* outPtr = luma + SsimRadius;
+    if (!im.nativeData)
+    {
+        const PixelSRGBA* rowPtr = im.srgbaData().atRowPtr(r);
+        for (int c = 0; c < width; ++c)
+            outPtr[c] = (0.2126f/255.f) * rowPtr[c].r + (0.7152f/255.f) * rowPtr[c].g + (0.0722f/255.f) * rowPtr[c].b;
+    }
+    else
+    {
+        normalizedRgbRow (im, r, rgb);
+        for (int c = 0; c < width; ++c)
+            outPtr[c] = 0.2126f * rgb[c*3+0] + 0.7152f * rgb[c*3+1] + 0.0722f * rgb[c*3+2];
+    }
+
+    for (int k = 1; k <= SsimRadius; ++k)
+    {
+        outPtr[-k] = outPtr[0];
+        outPtr[width - 1 + k] = outPtr[width - 1];
+    }
+}
+
+// dst[c] = sum_k w[k] * src[c+k], src has the padding.
+void horizontalWindow (const SsimWeights& weights, const float* src, int width, float* dst)
+{
+    int c = 0;
+#if ZV_COMPARISON_SSE2
+    for (; c + 4 <= width; c += 4)
+    {
+        __m128 acc = _mm_setzero_ps ();
+        for (int k = 0; k < SsimWindowSize; ++k)
+            acc = _mm_add_ps (acc, _mm_mul_ps (_mm_set1_ps (weights.w[k]), _mm_loadu_ps (src + c + k)));
+        _mm_storeu_ps (dst + c, acc);
+    }
+#endif
+    for (; c < width; ++c)
+    {
+        float acc = 0.f;
+        for (int k = 0; k < SsimWindowSize; ++k)
+            acc += weights.w[k] * src[c + k];
+        dst[c] = acc;
+    }
+}
+
+// The 5 moments needed by SSIM, after the horizontal window.
+enum SsimMoment { MomentX, MomentY, MomentXX, MomentYY, MomentXY, NumMoments };
+
+double accumulateSsimRows (const ImageItemData& image, const ImageItemData& reference,
+                           int width, int height, int firstRow, int lastRow)
+{
+    static const SsimWeights weights;
+    const float C1 = 0.01f * 0.01f;
+    const float C2 = 0.03f * 0.03f;
+
+    const int paddedWidth = width + 2*SsimRadius;
+    std::vector<float> padded (paddedWidth * NumMoments);
+    std::vector<float> rgb;
+
+    // Ring of the rows after the horizontal window, one slot per row of
+    // the vertical window.
+    std::vector<float> ring (size_t(SsimWindowSize) * NumMoments * width);
+    auto slotPtr = [&](int inputRow, int moment) {
+        const int slot = (inputRow + SsimWindowSize * 2) % SsimWindowSize;
+        return ring.data() + (size_t(slot) * NumMoments + moment) * width;
+    };
+
+    auto addInputRow = [&](int inputRow) {
+        const int r = std::min(std::max(inputRow, 0), height - 1);
+        float* x = padded.data() + MomentX * paddedWidth;
+        float* y = padded.data() + MomentY * paddedWidth;
+        float* xx = padded.data() + MomentXX * paddedWidth;
+        float* yy = padded.data() + MomentYY * paddedWidth;
+        float* xy = padded.data() + MomentXY * paddedWidth;
+        paddedLumaRow (image, r, width, rgb, x);
+        paddedLumaRow (reference, r, width, rgb, y);
+        for (int c = 0; c < paddedWidth; ++c)
+        {
+            xx[c] = x[c] * x[c];
+            yy[c] = y[c] * y[c];
+            xy[c] = x[c] * y[c];
+        }
+        for (int m = 0; m < NumMoments; ++m)
+            horizontalWindow (weights, padded.data() + m * paddedWidth, width, slotPtr(inputRow, m));
+    };
+
+    for (int i = firstRow - SsimRadius; i < firstRow + SsimRadius; ++i)
+        addInputRow (i);
+
+    double sumSsim = 0.;
+    const float* rows[NumMoments][SsimWindowSize];
+    for (int r = firstRow; r < lastRow; ++r)
+    {
+        addInputRow (r + SsimRadius);
+        for (int m = 0; m < NumMoments; ++m)
+        for (int k = 0; k < SsimWindowSize; ++k)
+            rows[m][k] = slotPtr(r - SsimRadius + k, m);
+
+        float mu[NumMoments];
+        auto scalarSsim = [&](int c) {
+            for (int m = 0; m < NumMoments; ++m)
+            {
+                float acc = 0.f;
+                for (int k = 0; k < SsimWindowSize; ++k)
+                    acc += weights.w[k] * rows[m][k][c];
+                mu[m] = acc;
+            }
+            const float muXY = mu[MomentX] * mu[MomentY];
+            const float muXX = mu[MomentX] * mu[MomentX];
+            const float muYY = mu[MomentY] * mu[MomentY];
+            const float num = (2.f * muXY + C1) * (2.f * (mu[MomentXY] - muXY) + C2);
+            const float den = (muXX + muYY + C1) * ((mu[MomentXX] - muXX) + (mu[MomentYY] - muYY) + C2);
+            return num / den;
+        };
+
+        float rowSum = 0.f;
+        int c = 0;
+#if ZV_COMPARISON_SSE2
+        __m128 rowSum4 = _mm_setzero_ps ();
+        for (; c + 4 <= width; c += 4)
+        {
+            __m128 mu4[NumMoments];
+            for (int m = 0; m < NumMoments; ++m)
+            {
+                __m128 acc = _mm_setzero_ps ();
+                for (int k = 0; k < SsimWindowSize; ++k)
+                    acc = _mm_add_ps (acc, _mm_mul_ps (_mm_set1_ps (weights.w[k]), _mm_loadu_ps (rows[m][k] + c)));
+                mu4[m] = acc;
+            }
+            const __m128 two = _mm_set1_ps (2.f);
+            const __m128 muXY = _mm_mul_ps (mu4[MomentX], mu4[MomentY]);
+            const __m128 muXX = _mm_mul_ps (mu4[MomentX], mu4[MomentX]);
+            const __m128 muYY = _mm_mul_ps (mu4[MomentY], mu4[MomentY]);
+            const __m128 num = _mm_mul_ps (_mm_add_ps (_mm_mul_ps (two, muXY), _mm_set1_ps (C1)),
+                                           _mm_add_ps (_mm_mul_ps (two, _mm_sub_ps (mu4[MomentXY], muXY)), _mm_set1_ps (C2)));
+            const __m128 variances = _mm_add_ps (_mm_sub_ps (mu4[MomentXX], muXX), _mm_sub_ps (mu4[MomentYY], muYY));
+            const __m128 den = _mm_mul_ps (_mm_add_ps (_mm_add_ps (muXX, muYY), _mm_set1_ps (C1)),
+                                           _mm_add_ps (variances, _mm_set1_ps (C2)));
+            rowSum4 = _mm_add_ps (rowSum4, _mm_div_ps (num, den));
+        }
+        float lanes[4];
+        _mm_storeu_ps (lanes, rowSum4);
+        rowSum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+        for (; c < width; ++c)
+            rowSum += scalarSsim (c);
+        sumSsim += rowSum;
+    }
+    return sumSsim;
+}
+
+} // anonymous
+
+ImageDiffStats computeImageDiffStats (const ImageItemData& image,
+                                      const ImageItemData& reference,
+                                      float threshold)
+{
+    ImageDiffStats stats;
+    stats.sizeMismatch = image.width() != reference.width() || image.height() != reference.height();
+    stats.comparedWidth = std::min(image.width(), reference.width());
+    stats.comparedHeight = std::min(image.height(), reference.height());
+
+    const int width = stats.comparedWidth;
+    const int height = stats.comparedHeight;
+    stats.numPixels = int64_t(width) * height;
+    if (stats.numPixels == 0)
+        return stats;
+
+    // One partial result per band, reduced at the end.
+    const int numBands = std::max(1, std::min(height / 16, ThreadPool::instance().numThreads() * 4));
+    std::vector<PartialStats> partials (numBands);
+    ThreadPool::instance().parallelFor (numBands, [&](int band) {
+        const int firstRow = int((int64_t(height) * band) / numBands);
+        const int lastRow = int((int64_t(height) * (band + 1)) / numBands);
+        accumulateRows (image, reference, width, threshold, firstRow, lastRow, partials[band]);
+    });
+
+    double sumSquaredDiff = 0.;
+    for (int i = 0; i < numBands; ++i)
+    {
+        stats.maxAbsDiff = std::max(stats.maxAbsDiff, partials[i].maxAbsDiff);
+        stats.numDifferentPixels += partials[i].numDifferentPixels;
+        sumSquaredDiff += partials[i].sumSquaredDiff;
+    }
+
+    stats.mse = sumSquaredDiff / (stats.numPixels * 3.);
+    if (stats.mse > 0.)
+        stats.psnr = 10. * std::log10 (1. / stats.mse);
+    return stats;
+}
+
+double computeImageSsim (const ImageItemData& image, const ImageItemData& reference)
+{
+    const int width = std::min(image.width(), reference.width());
+    const int height = std::min(image.height(), reference.height());
+    if (width <= 0 || height <= 0)
+        return 1.;
+
+    // Each band recomputes the SsimRadius rows above and below it, so
+    // not too many bands.
+    const int numBands = std::max(1, std::min(height / 64, ThreadPool::instance().numThreads() * 2));
+    std::vector<double> partials (numBands);
+    ThreadPool::instance().parallelFor (numBands, [&](int band) {
+        const int firstRow = int((int64_t(height) * band) / numBands);
+        const int lastRow = int((int64_t(height) * (band + 1)) / numBands);
+        partials[band] = accumulateSsimRows (image, reference, width, height, firstRow, lastRow);
+    });
+
+    double sumSsim = 0.;
+    for (double partial : partials)
+        sumSsim += partial;
+    return sumSsim / (int64_t(width) * height);
+}
+
+} // zv
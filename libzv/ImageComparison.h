@@ -0,0 +1,49 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/ImageList.h>
+
+#include <cmath>
+#include <cstdint>
+
+namespace zv
+{
+
+// Pixel differences between two images, computed on values normalized
+// to [0,1] like in the display shader. Alpha is ignored. When the sizes
+// differ, only the common top-left region gets compared.
+struct ImageDiffStats
+{
+    bool sizeMismatch = false;
+    int comparedWidth = 0;
+    int comparedHeight = 0;
+    int64_t numPixels = 0;
+
+    // Largest absolute difference over all the channels.
+    float maxAbsDiff = 0.f;
+
+    // Pixels where at least one channel differs by more than the threshold.
+    int64_t numDifferentPixels = 0;
+
+    double mse = 0.;
+    // In dB for a peak value of 1, infinity if the images are identical.
+    double psnr = INFINITY;
+};
+
+// Bands of rows are processed in parallel, then reduced.
+ImageDiffStats computeImageDiffStats (const ImageItemData& image,
+                                      const ImageItemData& reference,
+                                      float threshold = 0.f);
+
+// Mean SSIM of the luma, with the usual 11x11 Gaussian window of sigma
+// 1.5 and borders replicated. 1 for identical images. Compares the common
+// top-left region like computeImageDiffStats. The windows are separable,
+// bands of rows get processed in parallel with their own margins.
+double computeImageSsim (const ImageItemData& image, const ImageItemData& reference);
+
+} // zv
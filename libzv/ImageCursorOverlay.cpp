@@ -32,8 +32,10 @@ void ImageCursorOverlay::showTooltip(const CursorOverlayInfo& d, bool showAsTool
         return;
     }
     
+    _displayShader.beginImguiFrame ();
+
     auto& io = ImGui::GetIO();
-    const auto& image = *d.modImagePtr->data()->cpuData;
+    const auto& image = *d.modImagePtr->data();
     const auto& imageTexture = *d.modImagePtr->data()->textureData;
     
     const float monoFontSize = ImguiGLFWWindow::monoFontSize(io);
@@ -59,7 +61,7 @@ void ImageCursorOverlay::showTooltip(const CursorOverlayInfo& d, bool showAsTool
             ImGui::BeginTooltip();
         }
         
-        const auto sRgb = image((int)mousePosInImage.x, (int)mousePosInImage.y);
+        const auto sRgb = image.srgbaPixel((int)mousePosInImage.x, (int)mousePosInImage.y);
         
         const int squareSize = 10*monoFontSize;
 
@@ -74,7 +76,10 @@ void ImageCursorOverlay::showTooltip(const CursorOverlayInfo& d, bool showAsTool
             ImVec2 zoom_uv1 = mousePosInOriginalTexture + zoomLen_uv*0.5f;
             
             ImVec2 zoomImageTopLeft = ImGui::GetCursorScreenPos();
-            ImGui::Image(reinterpret_cast<ImTextureID>(imageTexture.textureId()), zoomItemSize, zoom_uv0, zoom_uv1);
+            if (d.useDisplayShader)
+                _displayShader.imguiImage(imageTexture.textureId(), zoomItemSize, zoom_uv0, zoom_uv1, d.displayParams);
+            else
+                ImGui::Image(reinterpret_cast<ImTextureID>(imageTexture.textureId()), zoomItemSize, zoom_uv0, zoom_uv1);
             
             auto* drawList = ImGui::GetWindowDrawList();
             ImVec2 p1 = pixelSizeInZoom * (zoomLenInPixels / 2) + zoomImageTopLeft;
@@ -107,8 +112,10 @@ void ImageCursorOverlay::showTooltip(const CursorOverlayInfo& d, bool showAsTool
 
             const auto hsv = zv::convertToHSV(sRgb);
             
-            // This is a pretty expensive way to do it, but well, overall still very cheap.
-            if (colorDistance_CIE2000(sRgb, PixelSRGBA(255,255,255,255)) < colorDistance_CIE2000(sRgb, PixelSRGBA(0,0,0,255)))
+            static const PixelLab whiteLab = convertToLab(PixelSRGBA(255,255,255,255));
+            static const PixelLab blackLab = convertToLab(PixelSRGBA(0,0,0,255));
+            const PixelLab sRgbLab = convertToLab(sRgb);
+            if (colorDistance_CIE2000(sRgbLab, whiteLab) < colorDistance_CIE2000(sRgbLab, blackLab))
             {
                 // White won't be visible on bright colors, so switch to a black
                 // background if œthe contrast is higher.
@@ -119,15 +126,18 @@ void ImageCursorOverlay::showTooltip(const CursorOverlayInfo& d, bool showAsTool
             ImGui::PushStyleColor(ImGuiCol_ChildBg, ImVec4(0,0,0,0));
             ImGui::BeginChild("ColorInfo", ImVec2(squareSize - padding - monoFontSize*0.5f, zoomItemSize.y));
             
-            ImGui::Text ("HTML #%02x%02x%02x", sRgb.r, sRgb.g, sRgb.b);
+            // Show the original value instead of the HTML code for native data.
+            if (image.nativeData)
+                ImGui::Text ("Val %s", image.nativeData->formattedPixel((int)mousePosInImage.x, (int)mousePosInImage.y).c_str());
+            else
+                ImGui::Text ("HTML #%02x%02x%02x", sRgb.r, sRgb.g, sRgb.b);
             
             ImGui::Text("sRGB %3d %3d %3d", sRgb.r, sRgb.g, sRgb.b);
 
             PixelLinearRGB lrgb = zv::convertToLinearRGB(sRgb);
             ImGui::Text(" RGB %3d %3d %3d", int(lrgb.r*255.0), int(lrgb.g*255.0), int(lrgb.b*255.0));
             
-            PixelLab lab = zv::convertToLab(sRgb);
-            ImGui::Text(" Lab %3d %3d %3d", intRnd(lab.l), intRnd(lab.a), intRnd(lab.b));
+            ImGui::Text(" Lab %3d %3d %3d", intRnd(sRgbLab.l), intRnd(sRgbLab.a), intRnd(sRgbLab.b));
             
             PixelXYZ xyz = convertToXYZ(sRgb);
             ImGui::Text(" XYZ %3d %3d %3d", intRnd(xyz.x), intRnd(xyz.y), intRnd(xyz.z));
@@ -31,16 +31,13 @@ struct CursorOverlayInfo
 
     ImVec2 mousePosInImage() const
     {
-        const auto& image = *modImagePtr->data()->cpuData;
+        const auto& image = *modImagePtr->data();
         ImVec2 imageSize (image.width(), image.height());
         return mousePosInOriginalTexture() * imageSize;
     }
 
     ImVec2 mousePosInOriginalTexture() const
     {
-        const auto& image = *modImagePtr->data()->cpuData;
-        ImVec2 imageSize (image.width(), image.height());
-
         // This 0.5 offset is important since the mouse coordinate is an integer.
         // So when we are in the center of a pixel we'll return 0,0 instead of
         // 0.5,0.5.
@@ -60,12 +57,19 @@ struct CursorOverlayInfo
     // Might be zoomed in, not the same as mousePosInOriginalTexture()
     ImVec2 mousePosInTexture = ImVec2(0,0); // normalized to 0,1
     double timeOfLastCopyToClipboard = NAN;
+    
+    // Same display transforms as the image widget.
+    bool useDisplayShader = false;
+    GLDisplayParams displayParams;
 };
 
 class ImageCursorOverlay
 {
 public:
     void showTooltip(const CursorOverlayInfo& info, bool showAsTooltip = true);
+
+private:
+    GLDisplayShader _displayShader;
 };
 
 } // zv
@@ -6,10 +6,12 @@
 
 #include "ImageList.h"
 
+#include <libzv/ImageBufferPool.h>
 #include <libzv/Utils.h>
 #include <libzv/lrucache.hpp>
 
 #include <unordered_map>
+#include <atomic>
 
 #include <filesystem>
 namespace fs = std::filesystem;
@@ -19,7 +21,8 @@ namespace zv
 
 int64_t UniqueId::newId()
 {
-    static uint64_t lastId = 0;
+    // Modifier outputs get created from the worker threads.
+    static std::atomic<int64_t> lastId (0);
     return lastId++;
 }
 
@@ -28,6 +31,94 @@ ImageItem::~ImageItem ()
     // fprintf (stderr, "ImageItem destructor, sourceImagePath=%s\n", sourceImagePath.c_str());
 }
 
+int ImageItemData::width () const
+{
+    if (nativeData)
+        return nativeData->width();
+    return cpuData ? cpuData->width() : 0;
+}
+
+int ImageItemData::height () const
+{
+    if (nativeData)
+        return nativeData->height();
+    return cpuData ? cpuData->height() : 0;
+}
+
+bool ImageItemData::hasData () const
+{
+    return width() > 0 && height() > 0;
+}
+
+std::shared_ptr<const ImageSRGBA> ImageItemData::srgbaDataPtr () const
+{
+    // The worker threads of the modifiers and comparisons can get here
+    // at the same time as the UI thread.
+    std::lock_guard<std::mutex> lock (srgbaConversionMutex.mutex);
+    if (!cpuData)
+        cpuData = std::make_shared<ImageSRGBA>();
+
+    if (nativeData && !cpuData->hasData())
+    {
+        Profiler p ("Native to sRGBA");
+        *cpuData = nativeData->toSRGBA();
+    }
+
+    return cpuData;
+}
+
+std::shared_ptr<ImageItemData> ImageItemData::pixelDataCopy () const
+{
+    auto copy = std::make_shared<ImageItemData>();
+    copy->status = status;
+    copy->nativeData = nativeData;
+    copy->contentId = contentId;
+    copy->statisticsData = statisticsData;
+    copy->statisticsContentId = statisticsContentId;
+    std::lock_guard<std::mutex> lock (srgbaConversionMutex.mutex);
+    copy->cpuData = cpuData;
+    return copy;
+}
+
+const ImageSRGBA& ImageItemData::srgbaData () const
+{
+    // Still owned by cpuData.
+    return *srgbaDataPtr ();
+}
+
+PixelSRGBA ImageItemData::srgbaPixel (int c, int r) const
+{
+    if (nativeData)
+        return nativeData->srgbaPixel (c, r);
+    return (*cpuData)(c, r);
+}
+
+GLDisplayParams::InputRange ImageItemData::displayInputRange () const
+{
+    GLDisplayParams::InputRange range;
+    if (!nativeData)
+        return range;
+
+    const float textureScale = nativeData->isFloat() ? 1.f : 1.f / nativeData->maxIntegerValue();
+    range.min = nativeData->minValue() * textureScale;
+    range.max = nativeData->maxValue() * textureScale;
+    range.singleChannel = nativeData->numChannels() == 1;
+    return range;
+}
+
+const ImageStatistics& ImageItemData::statistics () const
+{
+    if (!statisticsData || statisticsContentId != contentId)
+    {
+        auto stats = std::make_shared<ImageStatistics>(nativeData
+                                                       ? computeImageStatistics (*nativeData)
+                                                       : computeImageStatistics (srgbaData()));
+        statisticsData = stats;
+        statisticsContentId = contentId;
+    }
+    return *statisticsData;
+}
+
 void ImageItem::fillFromFilePath (const std::string& imagePath)
 {
     source = ImageItem::Source::FilePath;
@@ -40,7 +131,18 @@ std::unique_ptr<ImageItem> imageItemFromData (const ImageSRGBA& im, const std::s
     auto entry = std::make_unique<ImageItem>();
     entry->uniqueId = UniqueId::newId();
     entry->source = ImageItem::Source::Data;
-    entry->sourceData = std::make_shared<ImageSRGBA>(im);
+    // Logging jobs often push the same image under several names.
+    entry->sourceData = ImageBufferPool::instance().share (im);
+    entry->prettyName = name;
+    return entry;
+}
+
+std::unique_ptr<ImageItem> imageItemFromData (const NativeImagePtr& im, const std::string& name)
+{
+    auto entry = std::make_unique<ImageItem>();
+    entry->uniqueId = UniqueId::newId();
+    entry->source = ImageItem::Source::Data;
+    entry->sourceNativeData = im;
     entry->prettyName = name;
     return entry;
 }
@@ -99,6 +201,7 @@ std::unique_ptr<ImageItemData> loadImageData(ImageItem& input)
             auto* staticData = new ImageItemData();
             staticData->status = ImageItemData::Status::Ready;
             staticData->cpuData = input.sourceData;
+            staticData->nativeData = input.sourceNativeData;
             output.reset (staticData);
             break;
         }
@@ -133,10 +236,10 @@ std::unique_ptr<ImageItemData> loadImageData(ImageItem& input)
             break;
     }
 
-    if (output && output->cpuData && output->cpuData->hasData())
+    if (output && output->hasData())
     {
-        input.metadata.width = output->cpuData->width();
-        input.metadata.height = output->cpuData->height();
+        input.metadata.width = output->width();
+        input.metadata.height = output->height();
     }
 
     return output;
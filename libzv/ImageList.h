@@ -7,9 +7,12 @@
 #pragma once
 
 #include <libzv/Image.h>
+#include <libzv/ImageStatistics.h>
 #include <libzv/OpenGL.h>
+#include <libzv/NativeImage.h>
 
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace zv
@@ -41,6 +44,22 @@ struct ImageItemData
     // Default is a static item data.
     virtual bool update () { return false; };
 
+    int width () const;
+    int height () const;
+    bool hasData () const;
+    bool contains (int c, int r) const { return c >= 0 && c < width() && r >= 0 && r < height(); }
+
+    // 8-bit sRGB version of the data. With native data it only gets
+    // computed the first time a CPU consumer needs it, from any thread.
+    const ImageSRGBA& srgbaData () const;
+    // Same, sharing the buffer.
+    std::shared_ptr<const ImageSRGBA> srgbaDataPtr () const;
+    PixelSRGBA srgbaPixel (int c, int r) const;
+
+    // Shares the pixel buffers, without the GL texture, so the copy can
+    // be kept or released by any thread.
+    std::shared_ptr<ImageItemData> pixelDataCopy () const;
+
     void ensureUploadedToGPU () const
     {
         if (textureData)
@@ -48,12 +67,46 @@ struct ImageItemData
         
         textureData = std::make_unique<GLTexture>();
         textureData->initialize();
-        textureData->upload(*cpuData);
+        if (nativeData)
+            textureData->upload(*nativeData);
+        else
+            textureData->upload(*cpuData);
     }
+
+    // Normalization needed to display the texture.
+    GLDisplayParams::InputRange displayInputRange () const;
+
+    // Of the native data when there is one. Computed on the first call,
+    // and again after the content changed.
+    const ImageStatistics& statistics () const;
     
+    // Can be null when nativeData is set, see srgbaData().
+    mutable std::shared_ptr<ImageSRGBA> cpuData;
+
+    // Optional, high bit-depth or float data kept in its original format.
+    NativeImagePtr nativeData;
+
     // In a context compatible with ImageWindowContext
-    std::shared_ptr<ImageSRGBA> cpuData;
     mutable GLTexturePtr textureData;
+
+    // Guards the conversion of srgbaData(). Copies get their own.
+    struct ConversionMutex
+    {
+        ConversionMutex () = default;
+        ConversionMutex (const ConversionMutex&) {}
+        ConversionMutex& operator= (const ConversionMutex&) { return *this; }
+        std::mutex mutex;
+    };
+    mutable ConversionMutex srgbaConversionMutex;
+
+    // See statistics().
+    mutable std::shared_ptr<const ImageStatistics> statisticsData;
+    mutable int64_t statisticsContentId = -1;
+
+    // Identifies the pixel content, it changes whenever the content does.
+    // Modifier outputs derive it from their input and parameters, see
+    // ModifierCache.
+    int64_t contentId = UniqueId::newId();
 };
 using ImageItemDataPtr = std::shared_ptr<ImageItemData>;
 using ImageItemDataUniquePtr = std::unique_ptr<ImageItemData>;
@@ -80,6 +133,7 @@ struct ImageItem
     std::string prettyName;
     std::string viewerName = "default";
     std::shared_ptr<ImageSRGBA> sourceData;
+    NativeImagePtr sourceNativeData;
     std::function<ImageItemDataUniquePtr()> loadDataCallback;
 
     using EventCallbackType = std::function<void(ImageId, float, float, void* userData)>;
@@ -107,6 +161,7 @@ using ImageItemUniquePtr = std::unique_ptr<ImageItem>;
 
 std::unique_ptr<ImageItem> imageItemFromPath (const std::string& imagePath);
 std::unique_ptr<ImageItem> imageItemFromData (const ImageSRGBA& im, const std::string& name);
+std::unique_ptr<ImageItem> imageItemFromData (const NativeImagePtr& im, const std::string& name);
 
 std::unique_ptr<ImageItem> defaultImageItem ();
 
@@ -0,0 +1,464 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "ImageStatistics.h"
+
+#include <libzv/MathUtils.h>
+#include <libzv/NativeImage.h>
+#include <libzv/ThreadPool.h>
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define ZV_STATS_SSE2 1
+#else
+#  define ZV_STATS_SSE2 0
+#endif
+
+namespace zv
+{
+
+namespace
+{
+
+constexpr int NumBins = ImageStatistics::NumBins;
+
+int numBandsForHeight (int height)
+{
+    return std::max(1, std::min(height / 16, ThreadPool::instance().numThreads() * 4));
+}
+
+template <class Func>
+void forEachBand (int height, int numBands, const Func& func)
+{
+    ThreadPool::instance().parallelFor (numBands, [&](int band) {
+        const int firstRow = int((int64_t(height) * band) / numBands);
+        const int lastRow = int((int64_t(height) * (band + 1)) / numBands);
+        func (band, firstRow, lastRow);
+    });
+}
+
+// 8 bits values
+
+// Two copies per channel, consecutive increments of the same bin would
+// wait on each other otherwise. RGBA uses one copy for the even pixels
+// and one for the odd ones, gray uses the 8 copies for its single channel.
+struct Partial8
+{
+    uint32_t counts[8][NumBins] = {};
+};
+
+void accumulateRgbaRow (const PixelSRGBA* rowPtr, int width, Partial8& partial)
+{
+    int c = 0;
+    for (; c + 2 <= width; c += 2)
+    {
+        const PixelSRGBA p0 = rowPtr[c];
+        const PixelSRGBA p1 = rowPtr[c+1];
+        ++partial.counts[0][p0.r]; ++partial.counts[1][p0.g]; ++partial.counts[2][p0.b]; ++partial.counts[3][p0.a];
+        ++partial.counts[4][p1.r]; ++partial.counts[5][p1.g]; ++partial.counts[6][p1.b]; ++partial.counts[7][p1.a];
+    }
+    for (; c < width; ++c)
+    {
+        const PixelSRGBA p = rowPtr[c];
+        ++partial.counts[0][p.r]; ++partial.counts[1][p.g]; ++partial.counts[2][p.b]; ++partial.counts[3][p.a];
+    }
+}
+
+void accumulateGrayRow (const uint8_t* rowPtr, int width, Partial8& partial)
+{
+    int c = 0;
+    for (; c + 8 <= width; c += 8)
+    {
+        for (int k = 0; k < 8; ++k)
+            ++partial.counts[k][rowPtr[c+k]];
+    }
+    for (; c < width; ++c)
+        ++partial.counts[0][rowPtr[c]];
+}
+
+// Everything else gets derived from the histograms.
+void finalizeFromHistograms (ImageStatistics& stats)
+{
+    stats.histogramMin = 0.;
+    stats.histogramMax = NumBins - 1;
+    stats.oneBinPerValue = true;
+    for (int k = 0; k < stats.numChannels; ++k)
+    {
+        ImageStatistics::Channel& channel = stats.channels[k];
+        double sum = 0., sumSq = 0.;
+        int minValue = -1, maxValue = -1;
+        for (int v = 0; v < NumBins; ++v)
+        {
+            const int64_t count = channel.histogram[v];
+            if (count == 0)
+                continue;
+            if (minValue < 0)
+                minValue = v;
+            maxValue = v;
+            channel.numValues += count;
+            sum += double(v) * count;
+            sumSq += double(v) * v * count;
+        }
+        if (channel.numValues == 0)
+            continue;
+        channel.minValue = minValue;
+        channel.maxValue = maxValue;
+        channel.mean = sum / channel.numValues;
+        channel.stddev = std::sqrt (std::max(sumSq / channel.numValues - channel.mean * channel.mean, 0.));
+    }
+}
+
+template <class AccumulateRowFunc>
+void compute8BitsStatistics (int height, int numChannels, const AccumulateRowFunc& accumulateRow, ImageStatistics& stats)
+{
+    const int numBands = numBandsForHeight (height);
+    std::vector<Partial8> partials (numBands);
+    forEachBand (height, numBands, [&](int band, int firstRow, int lastRow) {
+        for (int r = firstRow; r < lastRow; ++r)
+            accumulateRow (r, partials[band]);
+    });
+
+    stats.numChannels = numChannels;
+    for (const auto& partial : partials)
+    for (int copy = 0; copy < 8; ++copy)
+    {
+        auto& histogram = stats.channels[numChannels == 1 ? 0 : copy % 4].histogram;
+        for (int v = 0; v < NumBins; ++v)
+            histogram[v] += partial.counts[copy][v];
+    }
+    finalizeFromHistograms (stats);
+}
+
+// Float values, also used for 16 bits.
+
+// The values of a row are processed 4 at a time, lane k gets the channel
+// k of RGBA images, and every 4th pixel of gray images. The sums are in
+// double and relative to the first finite value of the lane in the band,
+// 16 bits and float data often have a large offset compared to their
+// spread.
+struct PartialFloat
+{
+    float shift[4] = {};
+    bool hasShift[4] = {};
+    double sum[4] = {};
+    double sumSq[4] = {};
+    int64_t count[4] = {};
+    float minValue[4] = { INFINITY, INFINITY, INFINITY, INFINITY };
+    float maxValue[4] = { -INFINITY, -INFINITY, -INFINITY, -INFINITY };
+
+    // The last bin counts the NaN and infinite values.
+    uint32_t counts[4][NumBins+1] = {};
+};
+
+void accumulateFloatRow (const float* values, int numValues, PartialFloat& partial)
+{
+    // Nothing was accumulated for a lane until it gets its shift.
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        for (int i = lane; !partial.hasShift[lane] && i < numValues; i += 4)
+        {
+            if (std::isfinite(values[i]))
+            {
+                partial.shift[lane] = values[i];
+                partial.hasShift[lane] = true;
+            }
+        }
+    }
+
+    int i = 0;
+#if ZV_STATS_SSE2
+    const __m128 absMask = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
+    const __m128 maxFinite = _mm_set1_ps (FLT_MAX);
+    const __m128 plusInf = _mm_set1_ps (INFINITY);
+    const __m128 minusInf = _mm_set1_ps (-INFINITY);
+    const __m128 vShift = _mm_loadu_ps (partial.shift);
+    // Lanes 0-1 and 2-3.
+    __m128d vSum01 = _mm_setzero_pd (), vSum23 = _mm_setzero_pd ();
+    __m128d vSumSq01 = _mm_setzero_pd (), vSumSq23 = _mm_setzero_pd ();
+    __m128i vCount = _mm_setzero_si128 ();
+    __m128 vMin = _mm_loadu_ps (partial.minValue);
+    __m128 vMax = _mm_loadu_ps (partial.maxValue);
+    for (; i + 4 <= numValues; i += 4)
+    {
+        const __m128 v = _mm_loadu_ps (values + i);
+        // False for NaN too.
+        const __m128 finite = _mm_cmple_ps (_mm_and_ps (v, absMask), maxFinite);
+        const __m128 valid = _mm_and_ps (finite, v);
+        const __m128 shifted = _mm_and_ps (finite, _mm_sub_ps (v, vShift));
+        const __m128d shifted01 = _mm_cvtps_pd (shifted);
+        const __m128d shifted23 = _mm_cvtps_pd (_mm_movehl_ps (shifted, shifted));
+        vSum01 = _mm_add_pd (vSum01, shifted01);
+        vSum23 = _mm_add_pd (vSum23, shifted23);
+        vSumSq01 = _mm_add_pd (vSumSq01, _mm_mul_pd (shifted01, shifted01));
+        vSumSq23 = _mm_add_pd (vSumSq23, _mm_mul_pd (shifted23, shifted23));
+        // The mask is -1 for the finite values.
+        vCount = _mm_sub_epi32 (vCount, _mm_castps_si128 (finite));
+        vMin = _mm_min_ps (vMin, _mm_or_ps (valid, _mm_andnot_ps (finite, plusInf)));
+        vMax = _mm_max_ps (vMax, _mm_or_ps (valid, _mm_andnot_ps (finite, minusInf)));
+    }
+    double rowSum[4], rowSumSq[4];
+    alignas(16) int32_t rowCount[4];
+    _mm_storeu_pd (rowSum, vSum01);
+    _mm_storeu_pd (rowSum + 2, vSum23);
+    _mm_storeu_pd (rowSumSq, vSumSq01);
+    _mm_storeu_pd (rowSumSq + 2, vSumSq23);
+    _mm_store_si128 ((__m128i*)rowCount, vCount);
+    _mm_storeu_ps (partial.minValue, vMin);
+    _mm_storeu_ps (partial.maxValue, vMax);
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        partial.sum[lane] += rowSum[lane];
+        partial.sumSq[lane] += rowSumSq[lane];
+        partial.count[lane] += rowCount[lane];
+    }
+#endif
+    for (; i < numValues; ++i)
+    {
+        const float v = values[i];
+        if (!std::isfinite(v))
+            continue;
+        const int lane = i & 3;
+        const double shifted = double(v - partial.shift[lane]);
+        partial.sum[lane] += shifted;
+        partial.sumSq[lane] += shifted * shifted;
+        ++partial.count[lane];
+        partial.minValue[lane] = std::min(partial.minValue[lane], v);
+        partial.maxValue[lane] = std::max(partial.maxValue[lane], v);
+    }
+}
+
+// Count, mean and sum of the squared deviations, merged with Chan et al.
+struct RunningMoments
+{
+    int64_t count = 0;
+    double mean = 0.;
+    double m2 = 0.;
+
+    void merge (int64_t otherCount, double otherMean, double otherM2)
+    {
+        if (otherCount == 0)
+            return;
+        const int64_t total = count + otherCount;
+        const double delta = otherMean - mean;
+        mean += delta * otherCount / total;
+        m2 += otherM2 + delta * delta * (double(count) * otherCount / total);
+        count = total;
+    }
+};
+
+void histogramFloatRow (const float* values, int numValues, float binMin, float binScale, PartialFloat& partial)
+{
+    int i = 0;
+#if ZV_STATS_SSE2
+    const __m128 absMask = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
+    const __m128 maxFinite = _mm_set1_ps (FLT_MAX);
+    const __m128 vMin = _mm_set1_ps (binMin);
+    const __m128 vScale = _mm_set1_ps (binScale);
+    const __m128 zero = _mm_setzero_ps ();
+    const __m128 lastBin = _mm_set1_ps (float(NumBins - 1));
+    const __m128i invalidBin = _mm_set1_epi32 (NumBins);
+    alignas(16) int32_t bins[4];
+    for (; i + 4 <= numValues; i += 4)
+    {
+        const __m128 v = _mm_loadu_ps (values + i);
+        const __m128i finite = _mm_castps_si128 (_mm_cmple_ps (_mm_and_ps (v, absMask), maxFinite));
+        const __m128 x = _mm_min_ps (_mm_max_ps (_mm_mul_ps (_mm_sub_ps (v, vMin), vScale), zero), lastBin);
+        const __m128i bin = _mm_cvttps_epi32 (x);
+        _mm_store_si128 ((__m128i*)bins, _mm_or_si128 (_mm_and_si128 (finite, bin), _mm_andnot_si128 (finite, invalidBin)));
+        ++partial.counts[0][bins[0]];
+        ++partial.counts[1][bins[1]];
+        ++partial.counts[2][bins[2]];
+        ++partial.counts[3][bins[3]];
+    }
+#endif
+    for (; i < numValues; ++i)
+    {
+        const float v = values[i];
+        const int bin = std::isfinite(v) ? std::min(int(std::max((v - binMin) * binScale, 0.f)), NumBins - 1) : NumBins;
+        ++partial.counts[i & 3][bin];
+    }
+}
+
+template <class RowValuesFunc>
+void computeFloatStatistics (int height, int numChannels, const RowValuesFunc& rowValues, ImageStatistics& stats)
+{
+    const int numBands = numBandsForHeight (height);
+    std::vector<PartialFloat> partials (numBands);
+    forEachBand (height, numBands, [&](int band, int firstRow, int lastRow) {
+        std::vector<float> buffer;
+        for (int r = firstRow; r < lastRow; ++r)
+        {
+            int numValues = 0;
+            const float* values = rowValues (r, buffer, numValues);
+            accumulateFloatRow (values, numValues, partials[band]);
+        }
+    });
+
+    stats.numChannels = numChannels;
+    auto channelOfLane = [numChannels](int lane) { return numChannels == 1 ? 0 : lane; };
+    std::array<RunningMoments,4> moments;
+    for (int k = 0; k < 4; ++k)
+    {
+        stats.channels[k].minValue = INFINITY;
+        stats.channels[k].maxValue = -INFINITY;
+    }
+    for (const auto& partial : partials)
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        const int64_t count = partial.count[lane];
+        if (count == 0)
+            continue;
+        ImageStatistics::Channel& channel = stats.channels[channelOfLane(lane)];
+        const double shiftedMean = partial.sum[lane] / count;
+        moments[channelOfLane(lane)].merge (count,
+                                            partial.shift[lane] + shiftedMean,
+                                            std::max(partial.sumSq[lane] - partial.sum[lane] * shiftedMean, 0.));
+        channel.numValues += count;
+        channel.minValue = std::min(channel.minValue, double(partial.minValue[lane]));
+        channel.maxValue = std::max(channel.maxValue, double(partial.maxValue[lane]));
+    }
+
+    stats.oneBinPerValue = false;
+    stats.histogramMin = INFINITY;
+    stats.histogramMax = -INFINITY;
+    for (int k = 0; k < numChannels; ++k)
+    {
+        ImageStatistics::Channel& channel = stats.channels[k];
+        if (channel.numValues == 0)
+        {
+            channel = {};
+            continue;
+        }
+        channel.mean = moments[k].mean;
+        channel.stddev = std::sqrt (moments[k].m2 / channel.numValues);
+        stats.histogramMin = std::min(stats.histogramMin, channel.minValue);
+        stats.histogramMax = std::max(stats.histogramMax, channel.maxValue);
+    }
+    for (int k = numChannels; k < 4; ++k)
+        stats.channels[k] = {};
+
+    // Nothing valid.
+    if (stats.histogramMin > stats.histogramMax)
+    {
+        stats.histogramMin = stats.histogramMax = 0.;
+        return;
+    }
+
+    // Second pass for the histograms, now that the range is known.
+    const double range = stats.histogramMax - stats.histogramMin;
+    const float binScale = range > 0. ? float(NumBins / range) : 0.f;
+    forEachBand (height, numBands, [&](int band, int firstRow, int lastRow) {
+        std::vector<float> buffer;
+        for (int r = firstRow; r < lastRow; ++r)
+        {
+            int numValues = 0;
+            const float* values = rowValues (r, buffer, numValues);
+            histogramFloatRow (values, numValues, float(stats.histogramMin), binScale, partials[band]);
+        }
+    });
+
+    for (const auto& partial : partials)
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        auto& histogram = stats.channels[channelOfLane(lane)].histogram;
+        for (int b = 0; b < NumBins; ++b)
+            histogram[b] += partial.counts[lane][b];
+    }
+}
+
+} // anonymous
+
+double ImageStatistics::percentile (int channelIdx, double p) const
+{
+    const Channel& channel = channels[channelIdx];
+    if (channel.numValues == 0)
+        return NAN;
+
+    // 1-based rank of the value.
+    const int64_t rank = std::max(int64_t(1), int64_t(std::ceil(keepInRange(p, 0., 1.) * channel.numValues)));
+    int64_t cumulative = 0;
+    for (int b = 0; b < NumBins; ++b)
+    {
+        const int64_t count = channel.histogram[b];
+        if (cumulative + count >= rank)
+        {
+            if (oneBinPerValue)
+                return histogramMin + b;
+            const double binWidth = (histogramMax - histogramMin) / NumBins;
+            const double fraction = double(rank - cumulative) / count;
+            return keepInRange (histogramMin + (b + fraction) * binWidth, channel.minValue, channel.maxValue);
+        }
+        cumulative += count;
+    }
+    return channel.maxValue;
+}
+
+ImageStatistics computeImageStatistics (const ImageSRGBA& image)
+{
+    const double startTime = currentDateInSeconds ();
+    ImageStatistics stats;
+    const int width = image.width();
+    compute8BitsStatistics (image.height(), 4, [&](int r, Partial8& partial) {
+        accumulateRgbaRow (image.atRowPtr(r), width, partial);
+    }, stats);
+    stats.computeTimeMs = (currentDateInSeconds() - startTime) * 1e3;
+    return stats;
+}
+
+ImageStatistics computeImageStatistics (const NativeImage& image)
+{
+    const double startTime = currentDateInSeconds ();
+    ImageStatistics stats;
+    const int width = image.width();
+    const int numChannels = image.numChannels();
+    switch (image.format())
+    {
+        case NativeImage::Format::Gray8:
+        {
+            compute8BitsStatistics (image.height(), 1, [&](int r, Partial8& partial) {
+                accumulateGrayRow (image.atRowPtr(r), width, partial);
+            }, stats);
+            break;
+        }
+
+        case NativeImage::Format::GrayFloat:
+        case NativeImage::Format::RGBAFloat:
+        {
+            computeFloatStatistics (image.height(), numChannels, [&](int r, std::vector<float>&, int& numValues) {
+                numValues = width * numChannels;
+                return reinterpret_cast<const float*>(image.atRowPtr(r));
+            }, stats);
+            break;
+        }
+
+        case NativeImage::Format::Gray16:
+        case NativeImage::Format::RGBA16:
+        {
+            computeFloatStatistics (image.height(), numChannels, [&](int r, std::vector<float>& buffer, int& numValues) {
+                numValues = width * numChannels;
+                buffer.resize (numValues);
+                const uint16_t* rowPtr = reinterpret_cast<const uint16_t*>(image.atRowPtr(r));
+                for (int i = 0; i < numValues; ++i)
+                    buffer[i] = rowPtr[i];
+                return static_cast<const float*>(buffer.data());
+            }, stats);
+            break;
+        }
+
+        default:
+            break;
+    }
+    stats.computeTimeMs = (currentDateInSeconds() - startTime) * 1e3;
+    return stats;
+}
+
+} // zv
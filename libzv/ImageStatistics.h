@@ -0,0 +1,58 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Image.h>
+
+#include <array>
+#include <cstdint>
+
+namespace zv
+{
+
+class NativeImage;
+
+// Per channel statistics, in the original units of the image: [0,255]
+// for 8 bits, [0,65535] for 16 bits and the raw values for float. NaN
+// and infinite values are ignored.
+struct ImageStatistics
+{
+    static constexpr int NumBins = 256;
+
+    struct Channel
+    {
+        int64_t numValues = 0;
+        double minValue = 0.;
+        double maxValue = 0.;
+        double mean = 0.;
+        double stddev = 0.;
+        std::array<int64_t,NumBins> histogram = {};
+    };
+
+    // 1 for gray images, 4 for RGBA.
+    int numChannels = 0;
+    std::array<Channel,4> channels;
+
+    // Shared by all the channels. One bin per value for 8 bits images,
+    // the range of the data over all the channels otherwise.
+    double histogramMin = 0.;
+    double histogramMax = 255.;
+    bool oneBinPerValue = true;
+
+    double computeTimeMs = 0.;
+
+    // p in [0,1], nearest rank. Exact with one bin per value, otherwise
+    // interpolated inside the bin.
+    double percentile (int channel, double p) const;
+};
+
+// The 8 bits statistics come from the histograms, filled in a single
+// pass. Bands of rows are processed in parallel, then reduced.
+ImageStatistics computeImageStatistics (const ImageSRGBA& image);
+ImageStatistics computeImageStatistics (const NativeImage& image);
+
+} // zv
@@ -0,0 +1,270 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "ImageTransforms.h"
+
+#include <libzv/ThreadPool.h>
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define ZV_TRANSFORMS_SSE2 1
+#else
+#  define ZV_TRANSFORMS_SSE2 0
+#endif
+
+namespace zv
+{
+
+namespace
+{
+
+// Tiles of 32x32 pixels fit in L1 for both the input and the output.
+constexpr int BlockSize = 32;
+
+#if ZV_TRANSFORMS_SSE2
+inline void transpose4x4 (__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+    const __m128i t0 = _mm_unpacklo_epi32 (r0, r1);
+    const __m128i t1 = _mm_unpacklo_epi32 (r2, r3);
+    const __m128i t2 = _mm_unpackhi_epi32 (r0, r1);
+    const __m128i t3 = _mm_unpackhi_epi32 (r2, r3);
+    r0 = _mm_unpacklo_epi64 (t0, t1);
+    r1 = _mm_unpackhi_epi64 (t0, t1);
+    r2 = _mm_unpacklo_epi64 (t2, t3);
+    r3 = _mm_unpackhi_epi64 (t2, t3);
+}
+
+inline __m128i reversePixels (__m128i v)
+{
+    return _mm_shuffle_epi32 (v, _MM_SHUFFLE(0,1,2,3));
+}
+#endif
+
+// Transposed remap: output row r is the input column remap.xr*r + remap.x0,
+// and along the row the input rows are remap.yc*c + remap.y0. This covers
+// the 90/270 rotations and the transposes, with or without crop.
+void transposedRemapBand (const ImageSRGBA& input, const PixelRemap& remap, ImageSRGBA& output,
+                          int firstOutRow, int lastOutRow)
+{
+    const int outW = output.width();
+    auto inputColumn = [&](int outRow) { return remap.xr*outRow + remap.x0; };
+    auto inputRow = [&](int outCol) { return remap.yc*outCol + remap.y0; };
+
+    for (int outRowBlock = firstOutRow; outRowBlock < lastOutRow; outRowBlock += BlockSize)
+    for (int outColBlock = 0; outColBlock < outW; outColBlock += BlockSize)
+    {
+        const int outRowBlockEnd = std::min(outRowBlock + BlockSize, lastOutRow);
+        const int outColBlockEnd = std::min(outColBlock + BlockSize, outW);
+
+        int outRow = outRowBlock;
+#if ZV_TRANSFORMS_SSE2
+        // 4x4 tiles. When the input columns (resp. rows) go backwards,
+        // the 4 loaded together are the ones of outRow+3 .. outRow
+        // (resp. outCol+3 .. outCol).
+        for (; outRow + 4 <= outRowBlockEnd; outRow += 4)
+        {
+            const int inCol = std::min(inputColumn(outRow), inputColumn(outRow + 3));
+            int outCol = outColBlock;
+            for (; outCol + 4 <= outColBlockEnd; outCol += 4)
+            {
+                const int inRow = std::min(inputRow(outCol), inputRow(outCol + 3));
+                __m128i r[4];
+                for (int k = 0; k < 4; ++k)
+                    r[k] = _mm_loadu_si128 (reinterpret_cast<const __m128i*>(input.atRowPtr(inRow+k) + inCol));
+                transpose4x4 (r[0], r[1], r[2], r[3]);
+                // Now r[K] holds the 4 input rows of the input column inCol+K.
+                for (int k = 0; k < 4; ++k)
+                {
+                    const int kOutRow = remap.xr > 0 ? outRow + k : outRow + 3 - k;
+                    const __m128i v = remap.yc > 0 ? r[k] : reversePixels(r[k]);
+                    _mm_storeu_si128 (reinterpret_cast<__m128i*>(output.atRowPtr(kOutRow) + outCol), v);
+                }
+            }
+
+            for (int k = 0; k < 4; ++k)
+            {
+                PixelSRGBA* outRowPtr = output.atRowPtr(outRow + k);
+                const int inCol = inputColumn(outRow + k);
+                for (int c = outCol; c < outColBlockEnd; ++c)
+                    outRowPtr[c] = input(inCol, inputRow(c));
+            }
+        }
+#endif
+        for (; outRow < outRowBlockEnd; ++outRow)
+        {
+            PixelSRGBA* outRowPtr = output.atRowPtr(outRow);
+            const int inCol = inputColumn(outRow);
+            for (int c = outColBlock; c < outColBlockEnd; ++c)
+                outRowPtr[c] = input(inCol, inputRow(c));
+        }
+    }
+}
+
+inline void reverseRow (const PixelSRGBA* inRowPtr, PixelSRGBA* outRowPtr, int width)
+{
+    int c = 0;
+#if ZV_TRANSFORMS_SSE2
+    for (; c + 4 <= width; c += 4)
+    {
+        const __m128i v = _mm_loadu_si128 (reinterpret_cast<const __m128i*>(inRowPtr + width - c - 4));
+        _mm_storeu_si128 (reinterpret_cast<__m128i*>(outRowPtr + c), reversePixels(v));
+    }
+#endif
+    for (; c < width; ++c)
+        outRowPtr[c] = inRowPtr[width - c - 1];
+}
+
+} // anonymous
+
+PixelRemap PixelRemap::identity (int width, int height)
+{
+    PixelRemap m;
+    m.outWidth = width;
+    m.outHeight = height;
+    return m;
+}
+
+PixelRemap PixelRemap::rotate90 (int width, int height)
+{
+    PixelRemap m;
+    m.outWidth = height;
+    m.outHeight = width;
+    m.xc = 0; m.xr = 1; m.x0 = 0;
+    m.yc = -1; m.yr = 0; m.y0 = height - 1;
+    return m;
+}
+
+PixelRemap PixelRemap::rotate180 (int width, int height)
+{
+    PixelRemap m;
+    m.outWidth = width;
+    m.outHeight = height;
+    m.xc = -1; m.x0 = width - 1;
+    m.yr = -1; m.y0 = height - 1;
+    return m;
+}
+
+PixelRemap PixelRemap::rotate270 (int width, int height)
+{
+    PixelRemap m;
+    m.outWidth = height;
+    m.outHeight = width;
+    m.xc = 0; m.xr = -1; m.x0 = width - 1;
+    m.yc = 1; m.yr = 0; m.y0 = 0;
+    return m;
+}
+
+PixelRemap PixelRemap::flipHorizontal (int width, int height)
+{
+    PixelRemap m;
+    m.outWidth = width;
+    m.outHeight = height;
+    m.xc = -1; m.x0 = width - 1;
+    return m;
+}
+
+PixelRemap PixelRemap::flipVertical (int width, int height)
+{
+    PixelRemap m;
+    m.outWidth = width;
+    m.outHeight = height;
+    m.yr = -1; m.y0 = height - 1;
+    return m;
+}
+
+PixelRemap PixelRemap::crop (int x0, int y0, int width, int height)
+{
+    PixelRemap m;
+    m.outWidth = width;
+    m.outHeight = height;
+    m.x0 = x0;
+    m.y0 = y0;
+    return m;
+}
+
+PixelRemap PixelRemap::then (const PixelRemap& next) const
+{
+    // The output pixel of next reads (x1,y1) in our output, which reads
+    // (x,y) in our input.
+    PixelRemap m;
+    m.outWidth = next.outWidth;
+    m.outHeight = next.outHeight;
+    m.xc = xc*next.xc + xr*next.yc;
+    m.xr = xc*next.xr + xr*next.yr;
+    m.x0 = xc*next.x0 + xr*next.y0 + x0;
+    m.yc = yc*next.xc + yr*next.yc;
+    m.yr = yc*next.xr + yr*next.yr;
+    m.y0 = yc*next.x0 + yr*next.y0 + y0;
+    return m;
+}
+
+bool PixelRemap::isCrop () const
+{
+    return xc == 1 && xr == 0 && yc == 0 && yr == 1;
+}
+
+void remapPixels (const ImageSRGBA& input, const PixelRemap& remap, ImageSRGBA& output)
+{
+    zv_assert (std::abs(remap.xc) + std::abs(remap.xr) == 1
+               && std::abs(remap.yc) + std::abs(remap.yr) == 1
+               && remap.xc*remap.yc == 0,
+               "Only the lossless remaps are supported");
+
+    output = ImageSRGBA (remap.outWidth, remap.outHeight);
+
+    if (remap.xr == 0)
+    {
+        // Output rows are input rows, maybe reversed.
+        const int outW = remap.outWidth;
+        parallel_for_rows (output.height(), [&](int firstRow, int lastRow) {
+            for (int r = firstRow; r < lastRow; ++r)
+            {
+                const PixelSRGBA* inRowPtr = input.atRowPtr(remap.yr*r + remap.y0);
+                if (remap.xc > 0)
+                    memcpy (output.atRowPtr(r), inRowPtr + remap.x0, outW * sizeof(PixelSRGBA));
+                else
+                    reverseRow (inRowPtr + remap.x0 - outW + 1, output.atRowPtr(r), outW);
+            }
+        });
+        return;
+    }
+
+    parallel_for_rows (output.height(), [&](int firstRow, int lastRow) {
+        transposedRemapBand (input, remap, output, firstRow, lastRow);
+    });
+}
+
+void rotate90 (const ImageSRGBA& input, ImageSRGBA& output)
+{
+    remapPixels (input, PixelRemap::rotate90 (input.width(), input.height()), output);
+}
+
+void rotate270 (const ImageSRGBA& input, ImageSRGBA& output)
+{
+    remapPixels (input, PixelRemap::rotate270 (input.width(), input.height()), output);
+}
+
+void rotate180 (const ImageSRGBA& input, ImageSRGBA& output)
+{
+    remapPixels (input, PixelRemap::rotate180 (input.width(), input.height()), output);
+}
+
+void flipHorizontal (const ImageSRGBA& input, ImageSRGBA& output)
+{
+    remapPixels (input, PixelRemap::flipHorizontal (input.width(), input.height()), output);
+}
+
+void flipVertical (const ImageSRGBA& input, ImageSRGBA& output)
+{
+    remapPixels (input, PixelRemap::flipVertical (input.width(), input.height()), output);
+}
+
+} // zv
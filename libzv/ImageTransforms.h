@@ -0,0 +1,59 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Image.h>
+
+namespace zv
+{
+
+// Lossless index remap, composition of crops, rotations by multiples of
+// 90 degrees and flips. The output pixel (c,r) is the input pixel
+//   x = xc*c + xr*r + x0
+//   y = yc*c + yr*r + y0
+// Consecutive remaps compose into a single one, so a chain of geometric
+// modifiers can be evaluated in one pass without intermediate images.
+struct PixelRemap
+{
+    int outWidth = 0;
+    int outHeight = 0;
+    int xc = 1, xr = 0, x0 = 0;
+    int yc = 0, yr = 1, y0 = 0;
+
+    // The width and height are the ones of the input.
+    static PixelRemap identity (int width, int height);
+    static PixelRemap rotate90 (int width, int height);
+    static PixelRemap rotate180 (int width, int height);
+    static PixelRemap rotate270 (int width, int height);
+    static PixelRemap flipHorizontal (int width, int height);
+    static PixelRemap flipVertical (int width, int height);
+    static PixelRemap crop (int x0, int y0, int width, int height);
+
+    // Remap equivalent to applying this one, then next.
+    PixelRemap then (const PixelRemap& next) const;
+
+    // True if it only extracts a sub-rectangle of the input.
+    bool isCrop () const;
+};
+
+void remapPixels (const ImageSRGBA& input, const PixelRemap& remap, ImageSRGBA& output);
+
+// Lossless geometric transforms. The output gets allocated, and the
+// bands of output rows are processed by the shared ThreadPool.
+
+// Clockwise.
+void rotate90 (const ImageSRGBA& input, ImageSRGBA& output);
+void rotate180 (const ImageSRGBA& input, ImageSRGBA& output);
+// Counter-clockwise.
+void rotate270 (const ImageSRGBA& input, ImageSRGBA& output);
+
+// Mirror around the vertical axis.
+void flipHorizontal (const ImageSRGBA& input, ImageSRGBA& output);
+// Mirror around the horizontal axis.
+void flipVertical (const ImageSRGBA& input, ImageSRGBA& output);
+
+} // zv
@@ -11,7 +11,12 @@
 
 #include <libzv/Viewer.h>
 #include <libzv/ImageList.h>
+#include <libzv/OpenGL.h>
 #include <libzv/ImageCursorOverlay.h>
+#include <libzv/BackgroundWorker.h>
+#include <libzv/ImageComparison.h>
+#include <libzv/ImageWriter.h>
+#include <libzv/ThreadPool.h>
 #include <libzv/ImguiUtils.h>
 #include <libzv/PlatformSpecific.h>
 #include <libzv/ImguiGLFWWindow.h>
@@ -57,6 +62,17 @@ std::string viewerModeName (ViewerMode mode)
     {
         case ViewerMode::None: return "None";
         case ViewerMode::Original: return "Original Image";
+        case ViewerMode::Levels: return "Adjusted Levels";
+        case ViewerMode::Channel_Red: return "Red Channel";
+        case ViewerMode::Channel_Green: return "Green Channel";
+        case ViewerMode::Channel_Blue: return "Blue Channel";
+        case ViewerMode::Channel_Alpha: return "Alpha Channel";
+        case ViewerMode::Diff_Absolute: return "Absolute Difference";
+        case ViewerMode::Diff_Signed: return "Signed Difference";
+        case ViewerMode::Cvd_Protan: return "Protan Simulation";
+        case ViewerMode::Cvd_Deutan: return "Deutan Simulation";
+        case ViewerMode::Cvd_Tritan: return "Tritan Simulation";
+        case ViewerMode::Daltonize: return "Daltonized";
         default: return "Invalid";
     }
 }
@@ -67,10 +83,72 @@ std::string viewerModeFileName (ViewerMode mode)
     {
         case ViewerMode::None: return "original";
         case ViewerMode::Original: return "original";
+        case ViewerMode::Levels: return "levels";
+        case ViewerMode::Channel_Red: return "red";
+        case ViewerMode::Channel_Green: return "green";
+        case ViewerMode::Channel_Blue: return "blue";
+        case ViewerMode::Channel_Alpha: return "alpha";
+        case ViewerMode::Diff_Absolute: return "absdiff";
+        case ViewerMode::Diff_Signed: return "signeddiff";
+        case ViewerMode::Cvd_Protan: return "protan";
+        case ViewerMode::Cvd_Deutan: return "deutan";
+        case ViewerMode::Cvd_Tritan: return "tritan";
+        case ViewerMode::Daltonize: return "daltonized";
         default: return "Invalid";
     }
 }
 
+bool viewerModeIsColorVisionDeficiency (ViewerMode mode)
+{
+    return mode >= ViewerMode::Cvd_Protan && mode <= ViewerMode::Daltonize;
+}
+
+static bool modeUsesDisplayShader (ViewerMode mode)
+{
+    return mode >= ViewerMode::Levels && mode < ViewerMode::NumModes;
+}
+
+static GLDisplayParams displayParamsForMode (ViewerMode mode, const DisplaySettings& settings)
+{
+    GLDisplayParams params;
+    params.minLevel = settings.minLevel;
+    params.maxLevel = settings.maxLevel;
+    params.exposure = settings.exposure;
+    params.gamma = settings.gamma;
+    params.colormap = settings.colormap;
+    params.cvdSeverity = settings.cvdSeverity;
+    switch (mode)
+    {
+        case ViewerMode::Channel_Red: params.channel = 0; break;
+        case ViewerMode::Channel_Green: params.channel = 1; break;
+        case ViewerMode::Channel_Blue: params.channel = 2; break;
+        case ViewerMode::Channel_Alpha: params.channel = 3; break;
+        case ViewerMode::Diff_Absolute: params.diffMode = GLDisplayParams::DiffMode::Absolute; break;
+        case ViewerMode::Diff_Signed:
+            params.diffMode = GLDisplayParams::DiffMode::Signed;
+            params.colormap = Colormap::CoolWarm;
+            break;
+        case ViewerMode::Cvd_Protan:
+            params.cvdMode = GLDisplayParams::CvdMode::Simulate;
+            params.cvdDeficiency = ColorVisionDeficiency::Protan;
+            break;
+        case ViewerMode::Cvd_Deutan:
+            params.cvdMode = GLDisplayParams::CvdMode::Simulate;
+            params.cvdDeficiency = ColorVisionDeficiency::Deutan;
+            break;
+        case ViewerMode::Cvd_Tritan:
+            params.cvdMode = GLDisplayParams::CvdMode::Simulate;
+            params.cvdDeficiency = ColorVisionDeficiency::Tritan;
+            break;
+        case ViewerMode::Daltonize:
+            params.cvdMode = GLDisplayParams::CvdMode::Daltonize;
+            params.cvdDeficiency = settings.daltonizeDeficiency;
+            break;
+        default: break;
+    }
+    return params;
+}
+
 struct ImageLayout
 {
     LayoutConfig config;
@@ -144,6 +222,8 @@ struct ImageWindow::Impl
     std::vector<ModifiedImagePtr> currentImages;
     ImageLayout currentLayout;
     AnnotationRenderer annotationRenderer;
+    BatchJob batchJob {annotationRenderer};
+    PerceptualHashIndex perceptualHashIndex;
     
     ImageWindowState mutableState;
 
@@ -152,6 +232,26 @@ struct ImageWindow::Impl
     ImageCursorOverlay inlineCursorOverlay;
     CursorOverlayInfo cursorOverlayInfo;
 
+    GLDisplayShader displayShader;
+
+    // Reference image of the diff modes, updated on every frame.
+    ModifiedImagePtr diffReference;
+
+    // One entry per grid cell, only recomputed when the inputs change.
+    // Both get computed in the background, SSIM on its own worker since
+    // it is slower. A superseded result is just dropped.
+    struct DiffStatsCacheEntry
+    {
+        std::weak_ptr<ImageItemData> image;
+        std::weak_ptr<ImageItemData> reference;
+        float threshold = NAN;
+        AsyncResultPtr<ImageDiffStats> stats;
+        AsyncResultPtr<double> ssim;
+    };
+    BackgroundWorker diffStatsWorker;
+    BackgroundWorker ssimWorker;
+    std::vector<DiffStatsCacheEntry> diffStatsCache;
+
     std::deque<Command> pendingCommands;
 
     struct {
@@ -329,6 +429,8 @@ struct ImageWindow::Impl
                                    CursorOverlayInfo *overlayInfo);
 
     void removeCurrentImageOnDisk ();
+
+    std::string diffStatsCaption (int cellIdx);
 };
 
 bool ImageWindow::Impl::runAfterCheckingPendingChanges (std::function<void(void)>&& func)
@@ -402,7 +504,7 @@ void ImageWindow::Impl::adjustForNewSelection ()
     bool layoutChanged = this->currentLayout.adjustForConfig(this->mutableState.layoutConfig);
         
     // The first image will decide for all the other sizes.
-    const auto& firstIm = *this->currentImages[firstValidSelectionIndex]->data()->cpuData;
+    const auto& firstIm = *this->currentImages[firstValidSelectionIndex];
 
     if (!this->imageWidgetRect.normal.origin.isValid())
     {
@@ -415,7 +517,9 @@ void ImageWindow::Impl::adjustForNewSelection ()
     int firstImHeight = firstIm.height() > 0 ? firstIm.height() : 256;
     this->imageWidgetRect.normal.size = this->currentLayout.widgetRectForImageSize(Point(firstImWidth, firstImHeight), gridPadding);
 
-    this->mutableState.activeMode = ViewerMode::Original;
+    // Keep the current display mode when switching images.
+    if (this->mutableState.activeMode == ViewerMode::None)
+        this->mutableState.activeMode = ViewerMode::Original;
 
     // Special case when it's the first time, don't try to restore anything.
     if (!this->imageWidgetRect.current.origin.isValid())
@@ -477,13 +581,21 @@ void ImageWindow::Impl::adjustForNewSelection ()
 
 void ImageWindow::Impl::addModifier(const CreateModifierFunc& createModifier)
 {
+    std::vector<ModifiedImage*> images;
     for (const auto& modImPtr : this->currentImages)
     {
-        if (!modImPtr)
-            continue;
-
-        modImPtr->addModifier (createModifier());
+        if (modImPtr)
+            images.push_back (modImPtr.get());
     }
+
+    // Only used for the CPU modifiers, so the grid images can be processed
+    // in parallel. The row loops inside each modifier then run serially.
+    std::vector<std::unique_ptr<ImageModifier>> modifiers (images.size());
+    for (auto& modifier : modifiers)
+        modifier = createModifier();
+    ThreadPool::instance().parallelFor (int(images.size()), [&](int i) {
+        images[i]->addModifier (std::move(modifiers[i]));
+    });
 }
 
 void ImageWindow::Impl::applyCurrentTool()
@@ -538,10 +650,15 @@ void ImageWindow::shutdown()
 {
     impl->imguiGlfwWindow.enableContexts();
     
+    // Files being processed still get written by the destructor.
+    impl->batchJob.cancel ();
+    impl->perceptualHashIndex.cancel ();
+
     // Make sure that we release any GL stuff here with the context set.
     impl->currentImages.clear();
     impl->cursorOverlayInfo.clear ();
     impl->annotationRenderer.shutdown();
+    impl->displayShader.releaseGL ();
 
     impl->imguiGlfwWindow.shutdown ();
 }
@@ -810,6 +927,20 @@ ImageWidgetRoi ImageWindow::Impl::renderImageItem(const ModifiedImagePtr &modIma
     uv0 += deltaToAdd;
     uv1 += deltaToAdd;
 
+    modImagePtr->setVisibleRegion (Rect::from_x_y_w_h (uv0.x, uv0.y, uv1.x - uv0.x, uv1.y - uv0.y));
+
+    // The partial output only covers a region of the full image.
+    const ModifiedImage::PartialOutput* partialOutput = modImagePtr->partialOutput();
+    ImVec2 textureUv0 = uv0;
+    ImVec2 textureUv1 = uv1;
+    if (partialOutput)
+    {
+        const ImVec2 partialOrigin (partialOutput->uvRect.origin.x, partialOutput->uvRect.origin.y);
+        const ImVec2 partialSize (partialOutput->uvRect.size.x, partialOutput->uvRect.size.y);
+        textureUv0 = (uv0 - partialOrigin) / partialSize;
+        textureUv1 = (uv1 - partialOrigin) / partialSize;
+    }
+
     GLTexture* imageTexture = modImagePtr->data()->textureData.get();
 
     const bool hasZoom = zoom.zoomFactor != 1;
@@ -825,10 +956,36 @@ ImageWidgetRoi ImageWindow::Impl::renderImageItem(const ModifiedImagePtr &modIma
                                                 imageTexture);
     }
 
-    ImGui::Image(reinterpret_cast<ImTextureID>(imageTexture->textureId()),
-                 imageWidgetSize,
-                 uv0,
-                 uv1);
+    // Textures in their native format always need the shader for the normalization.
+    const ImageItemData& imageData = *modImagePtr->data();
+    const bool useDisplayShader = modeUsesDisplayShader(mutableState.modeForCurrentFrame) || imageData.nativeData;
+    GLDisplayParams displayParams;
+    if (useDisplayShader)
+    {
+        displayParams = displayParamsForMode(mutableState.modeForCurrentFrame, mutableState.displaySettings);
+        if (displayParams.diffMode != GLDisplayParams::DiffMode::None)
+        {
+            // The reference itself is shown as is.
+            if (diffReference && diffReference != modImagePtr)
+            {
+                displayParams.referenceTextureId = diffReference->data()->textureData->textureId();
+                displayParams.referenceInput = diffReference->data()->displayInputRange();
+            }
+            else
+            {
+                displayParams = GLDisplayParams();
+            }
+        }
+        displayParams.input = imageData.displayInputRange();
+        displayShader.imguiImage(imageTexture->textureId(), imageWidgetSize, textureUv0, textureUv1, displayParams);
+    }
+    else
+    {
+        ImGui::Image(reinterpret_cast<ImTextureID>(imageTexture->textureId()),
+                     imageWidgetSize,
+                     textureUv0,
+                     textureUv1);
+    }
     
     if (useLinearFiltering)
     {
@@ -840,7 +997,8 @@ ImageWidgetRoi ImageWindow::Impl::renderImageItem(const ModifiedImagePtr &modIma
                                                 imageTexture);
     }
 
-    const auto& currentIm = *modImagePtr->data()->cpuData;
+    const int fullWidth = modImagePtr->width();
+    const int fullHeight = modImagePtr->height();
 
     ImVec2 mousePosInImage (0,0);
     ImVec2 mousePosInTexture (0,0);
@@ -851,11 +1009,13 @@ ImageWidgetRoi ImageWindow::Impl::renderImageItem(const ModifiedImagePtr &modIma
         ImVec2 widgetPos = (io.MousePos + ImVec2(0.5f,0.5f)) - imageWidgetTopLeft;
         ImVec2 uv_window = widgetPos / imageWidgetSize;
         mousePosInTexture = (uv1-uv0)*uv_window + uv0;
-        mousePosInImage = mousePosInTexture * ImVec2(currentIm.width(), currentIm.height());
+        mousePosInImage = mousePosInTexture * ImVec2(fullWidth, fullHeight);
     }
     
     bool showCursorOverlay = false;
-    const bool pointerOverTheImage = ImGui::IsItemHovered() && currentIm.contains(mousePosInImage.x, mousePosInImage.y);
+    const bool pointerOverTheImage = ImGui::IsItemHovered()
+                                     && mousePosInImage.x >= 0 && mousePosInImage.x < fullWidth
+                                     && mousePosInImage.y >= 0 && mousePosInImage.y < fullHeight;
 
     if (pointerOverTheImage)
     {
@@ -865,7 +1025,8 @@ ImageWidgetRoi ImageWindow::Impl::renderImageItem(const ModifiedImagePtr &modIma
         }
     }
 
-    if (pointerOverTheImage && overlayInfo)
+    // The pixel values are not all there yet with a partial output.
+    if (pointerOverTheImage && overlayInfo && !partialOutput)
     {
         overlayInfo->modImagePtr = modImagePtr;
         overlayInfo->showHelp = false;
@@ -876,12 +1037,14 @@ ImageWidgetRoi ImageWindow::Impl::renderImageItem(const ModifiedImagePtr &modIma
         overlayInfo->roiWindowSize = ImVec2(15, 15);
         overlayInfo->mousePos = io.MousePos;
         overlayInfo->mousePosInTexture = mousePosInTexture;
+        overlayInfo->useDisplayShader = useDisplayShader;
+        overlayInfo->displayParams = displayParams;
     }
 
     if (ImGui::IsItemClicked(ImGuiMouseButton_Left) && io.KeyCtrl)
     {
-        if ((currentIm.width() / float(zoom.zoomFactor)) > 16.f
-             && (currentIm.height() / float(zoom.zoomFactor)) > 16.f)
+        if ((fullWidth / float(zoom.zoomFactor)) > 16.f
+             && (fullHeight / float(zoom.zoomFactor)) > 16.f)
         {
             zoom.zoomFactor *= 2;
             zoom.uvCenter = mousePosInTexture;
@@ -900,12 +1063,72 @@ ImageWidgetRoi ImageWindow::Impl::renderImageItem(const ModifiedImagePtr &modIma
     return roi;
 }
 
+std::string ImageWindow::Impl::diffStatsCaption (int cellIdx)
+{
+    const ImageItemDataPtr& image = currentImages[cellIdx]->data();
+    const ImageItemDataPtr& reference = diffReference->data();
+    if (image == reference)
+        return "Reference";
+
+    // Only the visible region is there until the modifiers complete.
+    if (currentImages[cellIdx]->partialOutput() || diffReference->partialOutput())
+        return "Applying the modifiers...";
+
+    diffStatsCache.resize (currentImages.size());
+    auto& entry = diffStatsCache[cellIdx];
+    const float threshold = mutableState.displaySettings.diffThreshold;
+    const bool inputsChanged = entry.image.lock() != image || entry.reference.lock() != reference;
+    if (inputsChanged || entry.threshold != threshold)
+    {
+        entry.image = image;
+        entry.reference = reference;
+        entry.threshold = threshold;
+        // The items own GL textures that must be released on this thread.
+        std::shared_ptr<const ImageItemData> imagePixels = image->pixelDataCopy ();
+        std::shared_ptr<const ImageItemData> referencePixels = reference->pixelDataCopy ();
+        entry.stats = diffStatsWorker.compute<ImageDiffStats> ([imagePixels, referencePixels, threshold]() {
+            return computeImageDiffStats (*imagePixels, *referencePixels, threshold);
+        });
+    }
+
+    if (inputsChanged)
+    {
+        std::shared_ptr<const ImageItemData> imagePixels = image->pixelDataCopy ();
+        std::shared_ptr<const ImageItemData> referencePixels = reference->pixelDataCopy ();
+        entry.ssim = ssimWorker.compute<double> ([imagePixels, referencePixels]() {
+            return computeImageSsim (*imagePixels, *referencePixels);
+        });
+    }
+
+    if (!entry.stats->isReady())
+        return "Comparing...";
+
+    const ImageDiffStats& stats = entry.stats->value();
+    std::string caption;
+    if (stats.sizeMismatch)
+        caption = formatted("Size differs, top-left %dx%d: ", stats.comparedWidth, stats.comparedHeight);
+
+    caption += formatted("max |diff| %.4g, %lld different pixels (%.2f%%), PSNR %.2f dB",
+                         stats.maxAbsDiff,
+                         (long long)stats.numDifferentPixels,
+                         100.0 * stats.numDifferentPixels / std::max(stats.numPixels, int64_t(1)),
+                         stats.psnr);
+
+    if (entry.ssim->isReady())
+        caption += formatted(", SSIM %.4f", entry.ssim->value());
+    else
+        caption += ", SSIM ...";
+    return caption;
+}
+
 void ImageWindow::renderFrame ()
 {    
     for (Command& command : impl->pendingCommands)
         command.execFunc (*this);
     impl->pendingCommands.clear ();
 
+    impl->displayShader.beginImguiFrame ();
+
     ImageList& imageList = impl->viewer->imageList();
 
     bool contentChanged = (impl->mutableState.layoutConfig != impl->currentLayout.config);
@@ -1008,6 +1231,13 @@ void ImageWindow::renderFrame ()
     impl->cursorOverlayInfo.clear ();
     
     impl->mutableState.modeForCurrentFrame = impl->mutableState.activeMode;
+    
+    // Hold shift to compare with the original image.
+    if (modeUsesDisplayShader(impl->mutableState.activeMode)
+        && (impl->mutableState.inputState.shiftIsPressed || controlsWindowState.shiftIsPressed))
+    {
+        impl->mutableState.modeForCurrentFrame = ViewerMode::Original;
+    }
 
     if (impl->shouldUpdateWindowSize)
     {
@@ -1086,12 +1316,22 @@ void ImageWindow::renderFrame ()
             // }
         }
 
+        const int diffReferenceCell = impl->mutableState.displaySettings.diffReferenceCell;
+        impl->diffReference = {};
+        if (diffReferenceCell >= 0 && diffReferenceCell < impl->currentImages.size()
+            && impl->currentImages[diffReferenceCell]
+            && impl->currentImages[diffReferenceCell]->hasValidData()
+            && impl->currentImages[diffReferenceCell]->data()->textureData)
+        {
+            impl->diffReference = impl->currentImages[diffReferenceCell];
+        }
+
         for (int idx = 0; idx < impl->currentImages.size(); ++idx)
         {
             if (!impl->currentImages[idx])
                 continue;
             
-            if (!impl->currentImages[idx]->data()->cpuData->hasData())
+            if (!impl->currentImages[idx]->data()->hasData())
             {
                 ImGui::SetCursorScreenPos (imVec2(widgetGeometries[idx].topLeft()));
                 switch (impl->currentImages[idx]->data()->status)
@@ -1128,15 +1368,40 @@ void ImageWindow::renderFrame ()
                 {
                     InteractiveToolRenderingContext context;
                     context.widgetToImageTransform = transform;
-                    const auto &im = *impl->currentImages[idx]->data()->cpuData;
+                    const auto &im = *impl->currentImages[idx];
                     context.imageWidth = im.width();
                     context.imageHeight = im.height();
                     context.firstValidImageIndex = (idx == firstValidImageIndex);
+                    if (im.hasValidData() && !im.partialOutput())
+                        context.imageData = im.data();
                     impl->mutableState.activeToolState.activeTool()->renderAsActiveTool (context);
                 }
             }
         }
 
+        const bool diffMode = impl->mutableState.modeForCurrentFrame == ViewerMode::Diff_Absolute
+                              || impl->mutableState.modeForCurrentFrame == ViewerMode::Diff_Signed;
+        const bool showSimilarity = diffMode || impl->mutableState.displaySettings.similarityOverlay;
+        if (showSimilarity && impl->diffReference)
+        {
+            impl->imguiGlfwWindow.PushMonoSpaceFont(io);
+            auto* drawList = ImGui::GetWindowDrawList();
+            for (int idx = 0; idx < impl->currentImages.size(); ++idx)
+            {
+                if (!impl->currentImages[idx] || !impl->currentImages[idx]->hasValidData())
+                    continue;
+
+                const std::string caption = impl->diffStatsCaption (idx);
+                const ImVec2 textAreaStart = imPos(widgetGeometries[idx]);
+                const ImVec2 textAreaEnd = textAreaStart + ImVec2(widgetGeometries[idx].size.x, monoFontSize*1.2);
+                const ImVec2 textStart = textAreaStart + ImVec2(monoFontSize*0.5, monoFontSize*0.1);
+                ImVec4 clip_rect(textAreaStart.x, textAreaStart.y, textAreaEnd.x, textAreaEnd.y);
+                drawList->AddRectFilled(textAreaStart, textAreaEnd, IM_COL32(0,0,0,127));
+                drawList->AddText(ImGui::GetFont(), ImGui::GetFontSize(), textStart, IM_COL32_WHITE, caption.c_str(), NULL, 0.0f, &clip_rect);
+            }
+            ImGui::PopFont();
+        }
+
         if (impl->cursorOverlayInfo.valid())
         {            
             for (int idx = 0; idx < impl->currentImages.size(); ++idx)
@@ -1166,22 +1431,36 @@ void ImageWindow::renderFrame ()
 
                 for (int idx = 0; idx < impl->currentImages.size(); ++idx)
                 {
-                    if (!impl->currentImages[idx] || !impl->currentImages[idx]->hasValidData())
+                    if (!impl->currentImages[idx] || !impl->currentImages[idx]->hasValidData()
+                        || impl->currentImages[idx]->partialOutput())
                         continue;
                     
-                    const auto& im = *impl->currentImages[idx]->data()->cpuData;
+                    const auto& im = *impl->currentImages[idx]->data();
                     const ImVec2 imSize (im.width(), im.height());
                     ImVec2 mousePosInImage = impl->cursorOverlayInfo.mousePosInTexture * imSize;
                     const int cInImage = int(mousePosInImage.x);
                     const int rInImage = int(mousePosInImage.y);
+                    if (!im.contains(cInImage, rInImage))
+                        continue;
 
-                    PixelSRGBA sRgba = im(cInImage, rInImage);
-                    const auto hsv = zv::convertToHSV(sRgba);
-                    std::string caption = formatted("%s\n%4d, %4d (sRGBA %3d %3d %3d %3d) (HSV %3d %3d %3d)",
-                                                    impl->currentImages[idx]->item()->prettyName.c_str(),
-                                                    cInImage, rInImage,
-                                                    sRgba.r, sRgba.g, sRgba.b, sRgba.a,
-                                                    intRnd(hsv.x*360.f), intRnd(hsv.y*100.f), intRnd(hsv.z*100.f/255.f));
+                    std::string caption;
+                    if (im.nativeData)
+                    {
+                        caption = formatted("%s\n%4d, %4d (value %s)",
+                                            impl->currentImages[idx]->item()->prettyName.c_str(),
+                                            cInImage, rInImage,
+                                            im.nativeData->formattedPixel(cInImage, rInImage).c_str());
+                    }
+                    else
+                    {
+                        PixelSRGBA sRgba = im.srgbaPixel(cInImage, rInImage);
+                        const auto hsv = zv::convertToHSV(sRgba);
+                        caption = formatted("%s\n%4d, %4d (sRGBA %3d %3d %3d %3d) (HSV %3d %3d %3d)",
+                                            impl->currentImages[idx]->item()->prettyName.c_str(),
+                                            cInImage, rInImage,
+                                            sRgba.r, sRgba.g, sRgba.b, sRgba.a,
+                                            intRnd(hsv.x*360.f), intRnd(hsv.y*100.f), intRnd(hsv.z*100.f/255.f));
+                    }
 
                     ImVec2 textStart, textAreaStart, textAreaEnd;
 
@@ -1517,7 +1796,7 @@ void ImageWindow::runAction (const ImageWindowAction& action)
             {
                 if (impl->currentImages[i] && impl->currentImages[i]->hasValidData())
                 {                    
-                    copyToClipboard (*impl->currentImages[i]->data()->cpuData);
+                    copyToClipboard (impl->currentImages[i]->data()->srgbaData());
                     break;
                 }
             }
@@ -1528,16 +1807,18 @@ void ImageWindow::runAction (const ImageWindowAction& action)
             if (!impl->cursorOverlayInfo.valid())
                 break;
             
-            const auto& image = *impl->cursorOverlayInfo.modImagePtr->data()->cpuData;
+            const auto& image = *impl->cursorOverlayInfo.modImagePtr->data();
             ImVec2 mousePosInImage = impl->cursorOverlayInfo.mousePosInImage();
 
             if (!image.contains(mousePosInImage.x, mousePosInImage.y))
                 break;
 
-            const auto sRgb = image((int)mousePosInImage.x, (int)mousePosInImage.y);
+            const auto sRgb = image.srgbaPixel((int)mousePosInImage.x, (int)mousePosInImage.y);
 
             std::string clipboardText;
             clipboardText += formatted("[%d, %d]\n", (int)mousePosInImage.x, (int)mousePosInImage.y);
+            if (image.nativeData)
+                clipboardText += formatted("value %s\n", image.nativeData->formattedPixel((int)mousePosInImage.x, (int)mousePosInImage.y).c_str());
             clipboardText += formatted("sRGB %d %d %d\n", sRgb.r, sRgb.g, sRgb.b);
 
             const PixelLinearRGB lrgb = zv::convertToLinearRGB(sRgb);
@@ -1567,8 +1848,9 @@ void ImageWindow::runAction (const ImageWindowAction& action)
                 break;
             }
             
-            impl->addModifier ([targetSize]() { 
-                return std::make_unique<ResizeImageModifier>((int)targetSize.x, (int)targetSize.y); 
+            const ResampleFilter filter = impl->mutableState.resizeFilter;
+            impl->addModifier ([targetSize, filter]() { 
+                return std::make_unique<ResizeImageModifier>((int)targetSize.x, (int)targetSize.y, filter); 
             });
             break;
         }
@@ -1588,6 +1870,15 @@ void ImageWindow::runAction (const ImageWindowAction& action)
             impl->addModifier ([angle]() { return std::make_unique<RotateImageModifier>(angle); });
             break;
         }
+
+        case ImageWindowAction::Kind::Modify_FlipHorizontal:
+        case ImageWindowAction::Kind::Modify_FlipVertical: {
+            const auto direction = action.kind == ImageWindowAction::Kind::Modify_FlipHorizontal
+                                 ? FlipImageModifier::Direction::Horizontal
+                                 : FlipImageModifier::Direction::Vertical;
+            impl->addModifier ([direction]() { return std::make_unique<FlipImageModifier>(direction); });
+            break;
+        }
             
         case ImageWindowAction::Kind::ApplyCurrentTool: {
             impl->applyCurrentTool ();
@@ -1655,6 +1946,130 @@ void ImageWindow::applyOverValidImages(bool modifiedOnly, const std::function<vo
     }
 }
 
+// CPU version of the levels, exposure and gamma of the display shader.
+// The input is 8 bits, so a table is enough.
+static void applyDisplayLevels (const GLDisplayParams& params, ImageSRGBA& image)
+{
+    auto toLinear = [](double v) { return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4); };
+    auto toSrgb = [](double v) { return v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055; };
+    const double exposureScale = std::exp2 (params.exposure);
+    const double invGamma = 1.0 / std::max (params.gamma, 1e-3f);
+
+    std::array<uint8_t,256> table;
+    for (int i = 0; i < 256; ++i)
+    {
+        double v = keepInRange ((i / 255.0 - params.minLevel) / std::max (params.maxLevel - params.minLevel, 1e-5f), 0.0, 1.0);
+        if (exposureScale != 1.0)
+            v = keepInRange (toSrgb (toLinear (v) * exposureScale), 0.0, 1.0);
+        v = std::pow (v, invGamma);
+        table[i] = uint8_t(v * 255.0 + 0.5);
+    }
+
+    parallel_for_rows (image, [&](int firstRow, int lastRow) {
+        for (int r = firstRow; r < lastRow; ++r)
+        {
+            PixelSRGBA* rowPtr = image.atRowPtr(r);
+            for (int c = 0; c < image.width(); ++c)
+            {
+                rowPtr[c].r = table[rowPtr[c].r];
+                rowPtr[c].g = table[rowPtr[c].g];
+                rowPtr[c].b = table[rowPtr[c].b];
+            }
+        }
+    });
+}
+
+bool ImageWindow::saveImagesInCvdMode ()
+{
+    const ViewerMode mode = impl->mutableState.activeMode;
+    if (!viewerModeIsColorVisionDeficiency (mode))
+        return false;
+
+    const GLDisplayParams params = displayParamsForMode (mode, impl->mutableState.displaySettings);
+    bool saved = false;
+    applyOverValidImages (false /* modified only */, [&](const ModifiedImagePtr& modIm) {
+        if (modIm->item()->source != ImageItem::Source::FilePath)
+            return;
+        modIm->completePendingOutput ();
+        if (!modIm->hasValidData())
+            return;
+
+        // Same order as the shader, the deficiency is applied last in place.
+        auto output = std::make_shared<ImageSRGBA>(modIm->data()->srgbaData());
+        applyDisplayLevels (params, *output);
+        if (params.cvdMode == GLDisplayParams::CvdMode::Daltonize)
+            daltonize (*output, params.cvdDeficiency, params.cvdSeverity, *output);
+        else
+            simulateColorVisionDeficiency (*output, params.cvdDeficiency, params.cvdSeverity, *output);
+
+        const fs::path inputPath = modIm->item()->sourceImagePath;
+        const fs::path outputPath = inputPath.parent_path() / (inputPath.stem().string() + "_" + viewerModeFileName(mode) + ".png");
+        // Failures are reported by the controls window.
+        ImageWriter::instance().write (outputPath.string(), output, nullptr);
+        saved = true;
+    });
+    return saved;
+}
+
+bool ImageWindow::startBatchJob (bool selectionOnly, const std::string& outputDir)
+{
+    ModifiedImagePtr modIm = getFirstValidImage (true /* modified only */);
+    std::deque<std::unique_ptr<ImageModifier>> modifiers;
+    if (!modIm || !modIm->cloneModifiers (modifiers))
+        return false;
+
+    ImageList& imageList = impl->viewer->imageList();
+    std::vector<std::string> inputPaths;
+    auto addItem = [&](int idx) {
+        if (idx < 0 || idx >= imageList.numImages())
+            return;
+        const ImageItemPtr& item = imageList.imageItemFromIndex (idx);
+        if (item && !item->disabled && item->source == ImageItem::Source::FilePath)
+            inputPaths.push_back (item->sourceImagePath);
+    };
+
+    if (selectionOnly)
+    {
+        for (int idx : imageList.selectedRange().indices)
+            addItem (idx);
+    }
+    else
+    {
+        for (int idx = 0; idx < imageList.numImages(); ++idx)
+            addItem (idx);
+    }
+
+    if (inputPaths.empty())
+        return false;
+    return impl->batchJob.start (inputPaths, std::move(modifiers), outputDir);
+}
+
+BatchJob& ImageWindow::batchJob ()
+{
+    return impl->batchJob;
+}
+
+bool ImageWindow::startPerceptualHashIndex ()
+{
+    ImageList& imageList = impl->viewer->imageList();
+    std::vector<std::string> filePaths;
+    for (int idx = 0; idx < imageList.numImages(); ++idx)
+    {
+        const ImageItemPtr& item = imageList.imageItemFromIndex (idx);
+        if (item && !item->disabled && item->source == ImageItem::Source::FilePath)
+            filePaths.push_back (item->sourceImagePath);
+    }
+
+    if (filePaths.empty())
+        return false;
+    return impl->perceptualHashIndex.start (filePaths);
+}
+
+PerceptualHashIndex& ImageWindow::perceptualHashIndex ()
+{
+    return impl->perceptualHashIndex;
+}
+
 bool ImageWindow::canUndo() const
 {
     for (auto& it : impl->currentImages)
@@ -1670,6 +2085,8 @@ void ImageWindow::setActiveTool (ActiveToolState::Kind kind)
     if (kind == impl->mutableState.activeToolState.kind)
         return;
 
+    if (InteractiveTool* previousTool = impl->mutableState.activeToolState.activeTool())
+        previousTool->releaseResources ();
     impl->mutableState.activeToolState.kind = kind;
 }
 
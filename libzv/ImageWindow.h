@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <libzv/BatchJob.h>
+#include <libzv/PerceptualHash.h>
 #include <libzv/MathUtils.h>
 #include <libzv/Image.h>
 #include <libzv/ImageWindowActions.h>
@@ -81,6 +83,24 @@ public:
     
     void applyOverValidImages(bool modifiedOnly, const std::function<void(const ModifiedImagePtr&)>& onImage);
 
+    // Applies the modifiers of the first modified image to the files of the
+    // selection, or of all the enabled images, in the background. Returns
+    // false if there is nothing to apply or a job is already running.
+    bool startBatchJob (bool selectionOnly, const std::string& outputDir);
+    BatchJob& batchJob ();
+
+    // Hashes the files of all the enabled images in the background, to
+    // find the near-duplicates. Returns false if there is no file or the
+    // indexing is already running.
+    bool startPerceptualHashIndex ();
+    PerceptualHashIndex& perceptualHashIndex ();
+
+    // Writes the images as shown by the active color vision deficiency
+    // mode, next to their files as <name>_<mode>.png. The CPU version of
+    // the shader is used, with the levels, exposure and gamma. Returns
+    // false if nothing got saved.
+    bool saveImagesInCvdMode ();
+
 public:
     static Command actionCommand (ImageWindowAction::Kind actionKind, ImageWindowAction::ParamsPtr params = nullptr)
     { return actionCommand(ImageWindowAction(actionKind, params));}
@@ -58,6 +58,8 @@ struct ImageWindowAction
         Modify_Rotate90,
         Modify_Rotate180,
         Modify_Rotate270,
+        Modify_FlipHorizontal,
+        Modify_FlipVertical,
         
         ApplyCurrentTool,
         CancelCurrentTool,
@@ -16,6 +16,7 @@ InteractiveTool* ActiveToolState::activeTool ()
         case Kind::None: return nullptr;
         case Kind::Annotate_Line: return &lineTool;
         case Kind::Transform_Crop: return &cropTool;
+        case Kind::Measure_Roi: return &measureTool;
     }
     return nullptr;
 }
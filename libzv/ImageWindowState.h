@@ -17,10 +17,54 @@ enum class ViewerMode {
     None = -2,
     Original = -1,
 
+    // Applied by the display shader, the image data is left untouched.
+    Levels = 0,
+    Channel_Red,
+    Channel_Green,
+    Channel_Blue,
+    Channel_Alpha,
+
+    // Difference with the reference cell of the grid.
+    Diff_Absolute,
+    Diff_Signed,
+
+    // Color vision deficiency simulations, and the daltonization for
+    // DisplaySettings::daltonizeDeficiency.
+    Cvd_Protan,
+    Cvd_Deutan,
+    Cvd_Tritan,
+    Daltonize,
+
     NumModes,
 };
 
 std::string viewerModeName (ViewerMode mode);
+// Short name for the saved files.
+std::string viewerModeFileName (ViewerMode mode);
+bool viewerModeIsColorVisionDeficiency (ViewerMode mode);
+
+// Display transforms shared by the shader-based modes.
+struct DisplaySettings
+{
+    float minLevel = 0.f;
+    float maxLevel = 1.f;
+    float exposure = 0.f;
+    float gamma = 1.f;
+    // For single channel images and the channel modes.
+    Colormap colormap = Colormap::None;
+
+    // Grid cell used as the reference in the diff modes.
+    int diffReferenceCell = 0;
+    // Normalized value above which a pixel gets counted as different.
+    float diffThreshold = 0.f;
+    // Shows the PSNR and SSIM to the reference cell in every mode, not
+    // only in the diff modes.
+    bool similarityOverlay = false;
+
+    // For the color vision deficiency modes, 1 for a dichromacy.
+    float cvdSeverity = 1.f;
+    ColorVisionDeficiency daltonizeDeficiency = ColorVisionDeficiency::Protan;
+};
 
 struct LayoutConfig
 {
@@ -43,6 +87,8 @@ struct ActiveToolState
         Transform_Crop,
         
         Annotate_Line,
+
+        Measure_Roi,
     };
     
     Kind kind = Kind::None;
@@ -51,6 +97,7 @@ struct ActiveToolState
 
     CropTool cropTool;
     LineTool lineTool;
+    MeasureTool measureTool;
 };
 
 struct ImageWindowState
@@ -61,6 +108,8 @@ struct ImageWindowState
     // if the user presses the SHIFT key.
     ViewerMode modeForCurrentFrame = ViewerMode::None;    
 
+    DisplaySettings displaySettings;
+
     struct InputState
     {
         bool shiftIsPressed = false;
@@ -70,6 +119,9 @@ struct ImageWindowState
     InputState inputState;
     
     ActiveToolState activeToolState;
+
+    // Used by the resize modifiers.
+    ResampleFilter resizeFilter = ResampleFilter::Lanczos3;
     
     LayoutConfig layoutConfig;
 
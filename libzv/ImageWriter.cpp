@@ -0,0 +1,189 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "ImageWriter.h"
+
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace zv
+{
+
+struct ImageWriter::Impl
+{
+    struct Request
+    {
+        std::string filePath;
+        std::shared_ptr<const ImageSRGBA> image;
+        DoneCallback onDone;
+    };
+
+    struct Completed
+    {
+        Result result;
+        DoneCallback onDone;
+    };
+
+    std::vector<std::thread> workers;
+
+    mutable std::mutex mutex;
+    std::condition_variable requestCondition;
+    std::condition_variable completedCondition;
+    std::deque<Request> requests;
+    std::deque<Completed> completed;
+    int numInProgress = 0;
+    // The writes to the same file run one after the other, in order.
+    std::set<std::string> pathsInProgress;
+    bool stopRequested = false;
+    Result lastResult;
+    std::vector<Result> failedWrites;
+
+    void workerLoop ()
+    {
+        while (true)
+        {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock (mutex);
+                auto firstRunnable = requests.end();
+                requestCondition.wait (lock, [&]() {
+                    firstRunnable = std::find_if (requests.begin(), requests.end(), [this](const Request& r) {
+                        return pathsInProgress.count (r.filePath) == 0;
+                    });
+                    return firstRunnable != requests.end() || (stopRequested && requests.empty());
+                });
+                if (firstRunnable == requests.end())
+                    return;
+                request = std::move(*firstRunnable);
+                requests.erase (firstRunnable);
+                pathsInProgress.insert (request.filePath);
+                ++numInProgress;
+            }
+
+            Result result;
+            result.filePath = request.filePath;
+            result.success = writeImageFile (request.filePath, *request.image, &result.stats);
+            zv_dbg ("Wrote %s (%s): %.1f KB, encoded in %.1f ms",
+                    result.filePath.c_str(), result.success ? "ok" : "failed",
+                    result.stats.numBytes / 1024.0, result.stats.encodeTimeMs);
+
+            // Release the image before the callback runs, it can be big.
+            request.image.reset ();
+
+            std::lock_guard<std::mutex> lock (mutex);
+            pathsInProgress.erase (result.filePath);
+            completed.push_back ({ std::move(result), std::move(request.onDone) });
+            --numInProgress;
+            completedCondition.notify_all ();
+            // A write to the same file may be waiting.
+            requestCondition.notify_all ();
+        }
+    }
+};
+
+ImageWriter& ImageWriter::instance ()
+{
+    // The PNG encoder is already parallel, a couple of writers are enough
+    // to overlap the disk writes and the JPEG encodes.
+    static ImageWriter writer (2);
+    return writer;
+}
+
+ImageWriter::ImageWriter (int numThreads)
+: impl (new Impl())
+{
+    for (int i = 0; i < numThreads; ++i)
+        impl->workers.emplace_back ([this]() { impl->workerLoop (); });
+}
+
+ImageWriter::~ImageWriter ()
+{
+    // The workers finish the queued requests before leaving.
+    {
+        std::lock_guard<std::mutex> lock (impl->mutex);
+        impl->stopRequested = true;
+    }
+    impl->requestCondition.notify_all ();
+    for (auto& t : impl->workers)
+        t.join ();
+}
+
+void ImageWriter::write (const std::string& filePath,
+                         const std::shared_ptr<const ImageSRGBA>& image,
+                         DoneCallback&& onDone)
+{
+    {
+        std::lock_guard<std::mutex> lock (impl->mutex);
+        impl->requests.push_back ({ filePath, image, std::move(onDone) });
+    }
+    impl->requestCondition.notify_one ();
+}
+
+void ImageWriter::processCompletedWrites ()
+{
+    std::deque<Impl::Completed> completed;
+    {
+        std::lock_guard<std::mutex> lock (impl->mutex);
+        completed.swap (impl->completed);
+        if (!completed.empty())
+            impl->lastResult = completed.back().result;
+        for (const auto& it : completed)
+        {
+            if (!it.result.success)
+                impl->failedWrites.push_back (it.result);
+        }
+    }
+
+    for (auto& it : completed)
+    {
+        if (it.onDone)
+            it.onDone (it.result);
+    }
+}
+
+int ImageWriter::numPendingWrites () const
+{
+    std::lock_guard<std::mutex> lock (impl->mutex);
+    return int(impl->requests.size() + impl->completed.size()) + impl->numInProgress;
+}
+
+void ImageWriter::waitForAll ()
+{
+    {
+        std::unique_lock<std::mutex> lock (impl->mutex);
+        impl->completedCondition.wait (lock, [this]() {
+            return impl->requests.empty() && impl->numInProgress == 0;
+        });
+    }
+    processCompletedWrites ();
+}
+
+ImageWriter::Result ImageWriter::lastResult () const
+{
+    std::lock_guard<std::mutex> lock (impl->mutex);
+    return impl->lastResult;
+}
+
+std::vector<ImageWriter::Result> ImageWriter::failedWrites () const
+{
+    std::lock_guard<std::mutex> lock (impl->mutex);
+    return impl->failedWrites;
+}
+
+void ImageWriter::clearFailedWrites ()
+{
+    std::lock_guard<std::mutex> lock (impl->mutex);
+    impl->failedWrites.clear ();
+}
+
+} // zv
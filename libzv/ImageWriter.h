@@ -0,0 +1,69 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Image.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace zv
+{
+
+// Writes image files from a few background threads, so saving does not
+// block the UI and several images get encoded at the same time. The
+// completion callbacks run on the thread calling processCompletedWrites.
+class ImageWriter
+{
+public:
+    struct Result
+    {
+        std::string filePath;
+        bool success = false;
+        ImageWriteStats stats;
+    };
+
+    using DoneCallback = std::function<void(const Result&)>;
+
+public:
+    static ImageWriter& instance ();
+
+public:
+    ImageWriter (int numThreads);
+    // Waits for the pending writes, without calling their callbacks.
+    ~ImageWriter ();
+
+    // The image must not change until the write is done, the image data
+    // buffers are never modified in place so sharing them is enough.
+    // The writes to the same path never overlap and complete in order.
+    void write (const std::string& filePath,
+                const std::shared_ptr<const ImageSRGBA>& image,
+                DoneCallback&& onDone);
+
+    void processCompletedWrites ();
+
+    // Including the ones whose callback did not run yet.
+    int numPendingWrites () const;
+
+    // Also runs the callbacks.
+    void waitForAll ();
+
+    // Result of the last completed write, for display.
+    Result lastResult () const;
+
+    // Every failed write since the last call to clearFailedWrites.
+    std::vector<Result> failedWrites () const;
+    void clearFailedWrites ();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // zv
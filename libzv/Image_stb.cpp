@@ -7,11 +7,15 @@
 #include "Image.h"
 #include "Utils.h"
 
+#include <libzv/MathUtils.h>
+#include <libzv/PngEncoder.h>
+
 #include <stb_image.h>
-#include <stb_image_write.h>
 
 #include <turbojpeg.h>
 
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <vector>
 
@@ -52,7 +56,16 @@ namespace zv
         return true;
     }
 
-    bool readJpegFile (const std::string& inputFilename, ImageSRGBA& outputImage)
+    bool readImageFileReduced (const std::string& inputFileName, int minSize, ImageSRGBA& outputImage)
+    {
+        if (fileHasJpegExtension(inputFileName))
+        {
+            return readJpegFile (inputFileName, outputImage, minSize);
+        }
+        return readImageFile (inputFileName, outputImage);
+    }
+
+    bool readJpegFile (const std::string& inputFilename, ImageSRGBA& outputImage, int minSize)
     {
         static thread_local tjhandle tjdecompressor = nullptr;
         if (!tjdecompressor)
@@ -81,6 +94,31 @@ namespace zv
             return false;
         }
 
+        if (minSize > 0)
+        {
+            int numScalingFactors = 0;
+            const tjscalingfactor* scalingFactors = tjGetScalingFactors (&numScalingFactors);
+            int scaledWidth = width;
+            int scaledHeight = height;
+            for (int i = 0; i < numScalingFactors; ++i)
+            {
+                const tjscalingfactor& factor = scalingFactors[i];
+                if (factor.num > factor.denom)
+                    continue;
+                const int w = TJSCALED(width, factor);
+                const int h = TJSCALED(height, factor);
+                if (w < minSize || h < minSize)
+                    continue;
+                if (w < scaledWidth)
+                {
+                    scaledWidth = w;
+                    scaledHeight = h;
+                }
+            }
+            width = scaledWidth;
+            height = scaledHeight;
+        }
+
         outputImage.ensureAllocatedBufferForSize (width, height);
         ret = tjDecompress2 (tjdecompressor, (unsigned char*)buffer.data(), buffer.size(), outputImage.rawBytes(), width, outputImage.bytesPerRow(), height, TJPF_RGBA, /*flags=*/ 0);
         if (ret < 0)
@@ -92,9 +130,22 @@ namespace zv
         return true;
     }
 
-    bool writeJpegFile (const std::string& filePath, const ImageSRGBA& image)
+    // Faster than the default level of zlib, and still much smaller than
+    // the stb encoder.
+    static std::atomic<int> currentPngCompressionLevel (3);
+
+    void setPngCompressionLevel (int level)
+    {
+        currentPngCompressionLevel = keepInRange (level, 0, 9);
+    }
+
+    int pngCompressionLevel ()
+    {
+        return currentPngCompressionLevel;
+    }
+
+    static bool encodeJpeg (const ImageSRGBA& image, std::vector<uint8_t>& output)
     {
-        // Save image with turbojpeg
         static thread_local tjhandle tjcompressor = nullptr;
         if (!tjcompressor)
         {
@@ -110,30 +161,45 @@ namespace zv
         if (ret < 0)
         {
             zv_dbg ("Failed to compress");
+            tjFree (jpegBuf);
             return false;
         }
 
-        // Save to disk
+        output.assign (jpegBuf, jpegBuf + jpegSize);
+        tjFree (jpegBuf);
+        return true;
+    }
+
+    static bool writeFileContent (const std::string& filePath, const std::vector<uint8_t>& content)
+    {
         std::ofstream file (filePath, std::ios::binary | std::ios::trunc);
         if (!file.good())
         {
-            zv_dbg ("Failed to open file for writing");
+            zv_dbg ("Failed to open %s for writing", filePath.c_str());
             return false;
         }
-        file.write ((char*)jpegBuf, jpegSize);
-
-        tjFree (jpegBuf);
-        return true;
+        file.write (reinterpret_cast<const char*>(content.data()), content.size());
+        return file.good();
     }
     
-    bool writeImageFile (const std::string& filePath, const ImageSRGBA& image)
+    bool writeImageFile (const std::string& filePath, const ImageSRGBA& image, ImageWriteStats* stats)
     {
-        if (fileHasJpegExtension(filePath))
+        const auto startTime = std::chrono::steady_clock::now();
+
+        std::vector<uint8_t> content;
+        const bool encoded = fileHasJpegExtension(filePath)
+            ? encodeJpeg (image, content)
+            : encodePng (image, pngCompressionLevel(), content);
+        if (!encoded)
+            return false;
+
+        if (stats)
         {
-            return writeJpegFile (filePath, image);
+            stats->encodeTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+            stats->numBytes = content.size();
         }
-        
-        return stbi_write_png(filePath.c_str(), image.width(), image.height(), 4, image.data(), image.bytesPerRow());
+
+        return writeFileContent (filePath, content);
     }
     
 } // zv
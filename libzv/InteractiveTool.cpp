@@ -6,6 +6,8 @@
 
 #include "InteractiveTool.h"
 
+#include <libzv/Utils.h>
+
 namespace zv
 {
     
@@ -46,7 +48,7 @@ void CropTool::renderAsActiveTool (const InteractiveToolRenderingContext& contex
     }
 }
 
-void CropTool::renderControls (const ImageSRGBA& firstIm)
+void CropTool::renderControls (const ImageItemData& firstIm)
 {
     ImGui::Text("Cropping Tool");
     
@@ -76,6 +78,189 @@ void CropTool::renderControls (const ImageSRGBA& firstIm)
     }
 }
 
+void MeasureTool::renderAsActiveTool (const InteractiveToolRenderingContext& context)
+{
+    auto *drawList = ImGui::GetWindowDrawList();
+    Rect textureRoi = _params.imageAlignedTextureRect(context.imageWidth, context.imageHeight);
+    Rect widgetRoi = context.widgetToImageTransform.textureToWidget(textureRoi);
+
+    drawList->AddRect(imVec2(widgetRoi.topLeft()),
+                      imVec2(widgetRoi.bottomRight()),
+                      IM_COL32(0, 191, 255, 255),
+                      0.0f /* rounding */,
+                      0 /* ImDrawFlags */,
+                      2.0f /* thickness */);
+
+    if (context.firstValidImageIndex)
+    {
+        if (_controlPoints.empty())
+        {
+            for (int i = 0; i < _params.numControlPoints(); ++i)
+            {
+                _controlPoints.push_back(ControlPoint(_params.controlPointPos(i, textureRoi)));
+            }
+        }
+
+        for (int i = 0; i < _params.numControlPoints(); ++i)
+        {
+            const auto widgetPos = context.widgetToImageTransform.textureToWidget(_params.controlPointPos(i, textureRoi));
+            _controlPoints[i].update(widgetPos, [&](Point updatedWidgetPos) {
+                Point updatedTexturePos = context.widgetToImageTransform.widgetToTexture(updatedWidgetPos);
+                _params.updateControlPoint(i, updatedTexturePos, context.imageWidth, context.imageHeight); 
+            });
+        }
+
+        for (const auto &cp : _controlPoints)
+            cp.render();
+    }
+
+    if (!context.imageData || !context.imageData->hasData())
+        return;
+
+    if (ImGui::GetFrameCount() != _lastFrameCount)
+    {
+        _cache.releaseUnused ();
+        _lastFrameCount = ImGui::GetFrameCount();
+    }
+
+    std::string label;
+    RoiStatisticsIndexPtr index = _cache.index (context.imageData);
+    if (index)
+    {
+        const Rect pixelRect = _params.validImageRectForSize(index->width(), index->height());
+        const RoiStats stats = index->query (int(pixelRect.origin.x), int(pixelRect.origin.y),
+                                             int(pixelRect.size.x), int(pixelRect.size.y));
+        const char* channelNames[] = { "R", "G", "B" };
+        label = formatted("%dx%d", int(pixelRect.size.x), int(pixelRect.size.y));
+        for (int k = 0; k < 3; ++k)
+        {
+            label += formatted("\n%s %.1f ± %.1f [%d, %d]",
+                               channelNames[k], stats.mean[k], stats.stddev[k], stats.minValue[k], stats.maxValue[k]);
+        }
+    }
+    else if (_cache.isPending (*context.imageData))
+    {
+        label = "Indexing...";
+    }
+    else
+    {
+        label = "Not enough memory.";
+    }
+
+    const ImVec2 textSize = ImGui::CalcTextSize(label.c_str());
+    const ImVec2 padding (4.f, 2.f);
+    const ImVec2 textPos (widgetRoi.origin.x + 4.f, widgetRoi.origin.y + 4.f);
+    drawList->AddRectFilled(ImVec2(textPos.x - padding.x, textPos.y - padding.y),
+                            ImVec2(textPos.x + textSize.x + padding.x, textPos.y + textSize.y + padding.y),
+                            IM_COL32(0, 0, 0, 180));
+    drawList->AddText(textPos, IM_COL32(255, 255, 255, 255), label.c_str());
+}
+
+void MeasureTool::renderControls (const ImageItemData& firstIm)
+{
+    ImGui::Text("Measure Region");
+
+    auto& textureRect = _params.textureRect;
+    int leftInPixels = textureRect.origin.x * firstIm.width() + 0.5f;
+    if (ImGui::SliderInt("Left", &leftInPixels, 0, firstIm.width()))
+    {
+        textureRect.origin.x = leftInPixels / float(firstIm.width());
+    }
+
+    int topInPixels = textureRect.origin.y * firstIm.height() + 0.5f;
+    if (ImGui::SliderInt("Top", &topInPixels, 0, firstIm.height()))
+    {
+        textureRect.origin.y = topInPixels / float(firstIm.height());
+    }
+
+    int widthInPixels = textureRect.size.x * firstIm.width() + 0.5f;
+    if (ImGui::SliderInt("Width", &widthInPixels, 0, firstIm.width()))
+    {
+        textureRect.size.x = widthInPixels / float(firstIm.width());
+    }
+
+    int heightInPixels = textureRect.size.y * firstIm.height() + 0.5f;
+    if (ImGui::SliderInt("Height", &heightInPixels, 0, firstIm.height()))
+    {
+        textureRect.size.y = heightInPixels / float(firstIm.height());
+    }
+
+    RoiStatisticsIndexPtr index = _cache.readyIndex (firstIm);
+    if (!index)
+    {
+        ImGui::TextDisabled (_cache.isPending (firstIm) ? "Indexing..." : "No statistics.");
+        return;
+    }
+
+    const Rect pixelRect = _params.validImageRectForSize(index->width(), index->height());
+    const RoiStats stats = index->query (int(pixelRect.origin.x), int(pixelRect.origin.y),
+                                         int(pixelRect.size.x), int(pixelRect.size.y));
+    const ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingStretchSame;
+    if (ImGui::BeginTable("RoiStats", 5, flags))
+    {
+        for (const char* column : { "", "Min", "Max", "Mean", "Std" })
+            ImGui::TableSetupColumn (column);
+        ImGui::TableHeadersRow ();
+        const char* channelNames[] = { "R", "G", "B" };
+        for (int k = 0; k < 3; ++k)
+        {
+            ImGui::TableNextRow ();
+            ImGui::TableNextColumn (); ImGui::TextUnformatted (channelNames[k]);
+            ImGui::TableNextColumn (); ImGui::Text ("%d", stats.minValue[k]);
+            ImGui::TableNextColumn (); ImGui::Text ("%d", stats.maxValue[k]);
+            ImGui::TableNextColumn (); ImGui::Text ("%.2f", stats.mean[k]);
+            ImGui::TableNextColumn (); ImGui::Text ("%.2f", stats.stddev[k]);
+        }
+        ImGui::EndTable ();
+    }
+
+    renderDominantColors (firstIm, pixelRect);
+}
+
+void MeasureTool::renderDominantColors (const ImageItemData& firstIm, const Rect& pixelRect)
+{
+    const int x0 = int(pixelRect.origin.x);
+    const int y0 = int(pixelRect.origin.y);
+    const int width = int(pixelRect.size.x);
+    const int height = int(pixelRect.size.y);
+    if (width <= 0 || height <= 0)
+        return;
+
+    DominantColorsRequest request { firstIm.contentId, x0, y0, width, height };
+    if (!_dominantColors || !(request == _dominantColorsRequest))
+    {
+        // The index is ready, so the sRGB data is already there. The
+        // previous request gets skipped if it did not start yet.
+        std::shared_ptr<const ImageSRGBA> image = firstIm.srgbaDataPtr ();
+        _dominantColors = _worker.compute<std::vector<ColorEntryCount>> ([image, request]() {
+            return dominantColorEntries (*image, request.x0, request.y0, request.width, request.height, 5 /* maxEntries */);
+        });
+        _dominantColorsRequest = request;
+    }
+
+    ImGui::Text ("Dominant Colors");
+    if (!_dominantColors->isReady())
+    {
+        ImGui::TextDisabled ("Naming the colors...");
+        return;
+    }
+
+    const double numPixels = double(width) * height;
+    for (const ColorEntryCount& entryCount : _dominantColors->value())
+    {
+        const ColorEntry& entry = *entryCount.entry;
+        const float swatchSize = ImGui::GetTextLineHeight();
+        ImGui::PushID (&entry);
+        ImGui::ColorButton ("##swatch",
+                            ImVec4(entry.r / 255.f, entry.g / 255.f, entry.b / 255.f, 1.f),
+                            ImGuiColorEditFlags_NoTooltip,
+                            ImVec2(swatchSize, swatchSize));
+        ImGui::PopID ();
+        ImGui::SameLine ();
+        ImGui::Text ("%.1f%% %s (%s)", 100.0 * entryCount.count / numPixels, entry.className, entry.colorName);
+    }
+}
+
 void LineTool::renderAsActiveTool (const InteractiveToolRenderingContext& context)
 {
     auto *drawList = ImGui::GetWindowDrawList();
@@ -115,7 +300,7 @@ void LineTool::renderAsActiveTool (const InteractiveToolRenderingContext& contex
     }
 }
 
-void LineTool::renderControls (const ImageSRGBA& firstIm)
+void LineTool::renderControls (const ImageItemData& firstIm)
 {
     ImGui::Text("Add Line");
 
@@ -8,8 +8,11 @@
 
 #include <libzv/Modifiers.h>
 #include <libzv/Annotations.h>
+#include <libzv/BackgroundWorker.h>
+#include <libzv/ColorConversion.h>
 #include <libzv/ImguiUtils.h>
 #include <libzv/Image.h>
+#include <libzv/RoiStatistics.h>
 
 namespace zv
 {
@@ -20,6 +23,8 @@ struct InteractiveToolRenderingContext
     int imageWidth = -1;
     int imageHeight = -1;
     bool firstValidImageIndex = false;
+    // Null while only a partial output is available.
+    ImageItemDataPtr imageData;
 };
 
 class InteractiveTool
@@ -28,7 +33,9 @@ public:
     enum class Kind
     {
         Modifier,
-        Annotation
+        Annotation,
+        // Does not change the images, nothing to apply.
+        Measurement
     };
 
 public:
@@ -38,8 +45,11 @@ public:
     Kind kind() const { return _kind; }
 
     virtual void renderAsActiveTool (const InteractiveToolRenderingContext& context) = 0;
-    virtual void renderControls (const ImageSRGBA& firstIm) = 0;
+    virtual void renderControls (const ImageItemData& firstIm) = 0;
     virtual void addToImage (ModifiedImage& image) = 0;
+
+    // Called when the tool gets deactivated.
+    virtual void releaseResources () {}
     
 private:
     const Kind _kind;
@@ -54,7 +64,7 @@ public:
 
     virtual void renderAsActiveTool(const InteractiveToolRenderingContext &context) override;
 
-    virtual void renderControls(const ImageSRGBA& firstIm) override;
+    virtual void renderControls(const ImageItemData& firstIm) override;
 
     virtual void addToImage(ModifiedImage& image) override
     {
@@ -73,7 +83,7 @@ public:
 
     virtual void renderAsActiveTool(const InteractiveToolRenderingContext &context) override;
 
-    virtual void renderControls(const ImageSRGBA& firstIm) override;
+    virtual void renderControls(const ImageItemData& firstIm) override;
 
     virtual void addToImage(ModifiedImage& image) override
     {
@@ -85,4 +95,49 @@ private:
     std::vector<ControlPoint> _controlPoints;
 };
 
+// Mean, standard deviation, min and max of the RGB values inside a
+// rectangle, shown live on every image of the grid. The controls also
+// list the dominant named colors of the first image.
+class MeasureTool : public InteractiveTool
+{
+public:
+    MeasureTool() : InteractiveTool (Kind::Measurement) {}
+
+    virtual void renderAsActiveTool(const InteractiveToolRenderingContext &context) override;
+
+    virtual void renderControls(const ImageItemData& firstIm) override;
+
+    virtual void addToImage(ModifiedImage& image) override {}
+
+    // The summed-area tables take 48 bytes per pixel.
+    virtual void releaseResources() override { _cache.clear(); _dominantColors.reset(); }
+
+private:
+    // Named colors covering most of the rectangle of the first image,
+    // computed in the background whenever the rectangle changes.
+    void renderDominantColors (const ImageItemData& firstIm, const Rect& pixelRect);
+
+private:
+    // Only the rectangle is used.
+    CropImageModifier::Params _params;
+    std::vector<ControlPoint> _controlPoints;
+    RoiStatisticsCache _cache;
+    // To release the indices of the images no longer shown.
+    int _lastFrameCount = -1;
+
+    struct DominantColorsRequest
+    {
+        int64_t contentId = -1;
+        int x0 = 0, y0 = 0, width = 0, height = 0;
+
+        bool operator== (const DominantColorsRequest& rhs) const
+        {
+            return contentId == rhs.contentId && x0 == rhs.x0 && y0 == rhs.y0 && width == rhs.width && height == rhs.height;
+        }
+    };
+    BackgroundWorker _worker;
+    DominantColorsRequest _dominantColorsRequest;
+    AsyncResultPtr<std::vector<ColorEntryCount>> _dominantColors;
+};
+
 } // zv
@@ -0,0 +1,840 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "KernelBench.h"
+
+#include <libzv/ColorConversion.h>
+#include <libzv/Image.h>
+#include <libzv/ImageBufferPool.h>
+#include <libzv/ImageComparison.h>
+#include <libzv/ImageStatistics.h>
+#include <libzv/ImageTransforms.h>
+#include <libzv/NativeImage.h>
+#include <libzv/PngEncoder.h>
+#include <libzv/Resampler.h>
+#include <libzv/Utils.h>
+
+#include <stb_image.h>
+#include <stb_image_resize.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace zv
+{
+
+namespace
+{
+
+// The per-pixel loops that the modifiers used before the tiled kernels.
+void referenceRotate90 (const ImageSRGBA& inIm, ImageSRGBA& outIm)
+{
+    const int inH = inIm.height();
+    outIm = ImageSRGBA (inH, inIm.width());
+    for (int r = 0; r < outIm.height(); ++r)
+    {
+        PixelSRGBA* rowPtr = outIm.atRowPtr(r);
+        for (int c = 0; c < outIm.width(); ++c)
+            rowPtr[c] = inIm(r, inH-c-1);
+    }
+}
+
+void referenceRotate270 (const ImageSRGBA& inIm, ImageSRGBA& outIm)
+{
+    const int inW = inIm.width();
+    outIm = ImageSRGBA (inIm.height(), inW);
+    for (int r = 0; r < outIm.height(); ++r)
+    {
+        PixelSRGBA* rowPtr = outIm.atRowPtr(r);
+        for (int c = 0; c < outIm.width(); ++c)
+            rowPtr[c] = inIm(inW-r-1, c);
+    }
+}
+
+void referenceRotate180 (const ImageSRGBA& inIm, ImageSRGBA& outIm)
+{
+    const int inW = inIm.width();
+    const int inH = inIm.height();
+    outIm = ImageSRGBA (inW, inH);
+    for (int r = 0; r < inH; ++r)
+    {
+        PixelSRGBA* outRowPtr = outIm.atRowPtr(r);
+        const PixelSRGBA* inRowPtr = inIm.atRowPtr(inH-r-1);
+        for (int c = 0; c < inW; ++c)
+            outRowPtr[c] = inRowPtr[inW-c-1];
+    }
+}
+
+void referenceFlipHorizontal (const ImageSRGBA& inIm, ImageSRGBA& outIm)
+{
+    const int inW = inIm.width();
+    outIm = ImageSRGBA (inW, inIm.height());
+    for (int r = 0; r < inIm.height(); ++r)
+    for (int c = 0; c < inW; ++c)
+        outIm(c, r) = inIm(inW-c-1, r);
+}
+
+void referenceFlipVertical (const ImageSRGBA& inIm, ImageSRGBA& outIm)
+{
+    const int inH = inIm.height();
+    outIm = ImageSRGBA (inIm.width(), inH);
+    for (int r = 0; r < inH; ++r)
+    for (int c = 0; c < inIm.width(); ++c)
+        outIm(c, r) = inIm(c, inH-r-1);
+}
+
+// The per-channel pow conversions that ColorConversion used before the tables.
+double referenceSrgbToLinear (double x)
+{
+    return x < 0.04045 ? x / 12.92 : std::pow((x + 0.055) / 1.055, 2.4);
+}
+
+double referenceLinearToSrgb (double x)
+{
+    x = keepInRange (x, 0.0, 1.0);
+    return x < 0.0031308 ? x * 12.92 : std::pow(x, 1.0 / 2.4) * 1.055 - 0.055;
+}
+
+void referenceToLinear (const ImageSRGBA& inIm, ImageLinearRGB& outIm)
+{
+    outIm = ImageLinearRGB (inIm.width(), inIm.height());
+    for (int r = 0; r < inIm.height(); ++r)
+    for (int c = 0; c < inIm.width(); ++c)
+    {
+        const PixelSRGBA p = inIm(c, r);
+        outIm(c, r) = PixelLinearRGB(referenceSrgbToLinear(p.r / 255.0),
+                                     referenceSrgbToLinear(p.g / 255.0),
+                                     referenceSrgbToLinear(p.b / 255.0));
+    }
+}
+
+void referenceToSrgb (const ImageLinearRGB& inIm, ImageSRGBA& outIm)
+{
+    outIm = ImageSRGBA (inIm.width(), inIm.height());
+    for (int r = 0; r < inIm.height(); ++r)
+    for (int c = 0; c < inIm.width(); ++c)
+    {
+        const PixelLinearRGB p = inIm(c, r);
+        outIm(c, r) = PixelSRGBA(uint8_t(std::floor(referenceLinearToSrgb(p.r) * 255.0 + 0.5)),
+                                 uint8_t(std::floor(referenceLinearToSrgb(p.g) * 255.0 + 0.5)),
+                                 uint8_t(std::floor(referenceLinearToSrgb(p.b) * 255.0 + 0.5)),
+                                 255);
+    }
+}
+
+// The per-pixel ingestion loops of the Python arrays, with the clamping
+// of the float values added so the outputs can be compared.
+ImageSRGBA referenceFromArray (const uint8_t* buffer, int w, int h, int bytesPerRow, int numChannels, bool isFloat)
+{
+    auto toUint8 = [](float v) {
+        v *= 255.99f;
+        return uint8_t(v > 0.f ? std::min(v, 255.f) : 0.f);
+    };
+
+    ImageSRGBA outIm (w, h);
+    for (int r = 0; r < h; ++r)
+    {
+        const uint8_t* inRowPtr = buffer + r*size_t(bytesPerRow);
+        const float* inFloatRowPtr = (const float*)inRowPtr;
+        PixelSRGBA* outRowPtr = outIm.atRowPtr(r);
+        for (int c = 0; c < w; ++c)
+        {
+            uint8_t v[4] = { 0, 0, 0, 255 };
+            for (int i = 0; i < numChannels; ++i)
+                v[i] = isFloat ? toUint8(inFloatRowPtr[c*numChannels + i]) : inRowPtr[c*numChannels + i];
+            if (numChannels == 1)
+                v[1] = v[2] = v[0];
+            outRowPtr[c] = PixelSRGBA(v[0], v[1], v[2], v[3]);
+        }
+    }
+    return outIm;
+}
+
+// Per pixel in double precision, with pow for the transfer function.
+void referenceCvd (const ImageSRGBA& inIm, ColorVisionDeficiency deficiency, bool daltonize, ImageSRGBA& outIm)
+{
+    const CvdSimulationParams& params = cvdSimulationParams (deficiency);
+    outIm = ImageSRGBA (inIm.width(), inIm.height());
+    for (int r = 0; r < inIm.height(); ++r)
+    for (int c = 0; c < inIm.width(); ++c)
+    {
+        const PixelSRGBA p = inIm(c, r);
+        const double rgb[3] = { referenceSrgbToLinear(p.r / 255.0),
+                                referenceSrgbToLinear(p.g / 255.0),
+                                referenceSrgbToLinear(p.b / 255.0) };
+        const float* n = params.separationPlaneNormal;
+        const ColMajorMatrix3f& m = params.rgbCvdFromRgb[rgb[0]*n[0] + rgb[1]*n[1] + rgb[2]*n[2] >= 0.0 ? 0 : 1];
+        double out[3];
+        for (int i = 0; i < 3; ++i)
+            out[i] = m.v[i]*rgb[0] + m.v[3+i]*rgb[1] + m.v[6+i]*rgb[2];
+        if (daltonize)
+        {
+            const double errR = rgb[0] - out[0];
+            out[1] = rgb[1] + 0.7*errR + (rgb[1] - out[1]);
+            out[2] = rgb[2] + 0.7*errR + (rgb[2] - out[2]);
+            out[0] = rgb[0];
+        }
+        outIm(c, r) = PixelSRGBA(uint8_t(std::floor(referenceLinearToSrgb(out[0]) * 255.0 + 0.5)),
+                                 uint8_t(std::floor(referenceLinearToSrgb(out[1]) * 255.0 + 0.5)),
+                                 uint8_t(std::floor(referenceLinearToSrgb(out[2]) * 255.0 + 0.5)),
+                                 p.a);
+    }
+}
+
+// Straightforward per-pixel accumulation of the 8 bits statistics.
+ImageStatistics referenceStatistics (const ImageSRGBA& inIm)
+{
+    ImageStatistics stats;
+    stats.numChannels = 4;
+    double sum[4] = {}, sumSq[4] = {};
+    for (auto& channel : stats.channels)
+    {
+        channel.minValue = 255.;
+        channel.maxValue = 0.;
+    }
+    for (int r = 0; r < inIm.height(); ++r)
+    for (int c = 0; c < inIm.width(); ++c)
+    {
+        const PixelSRGBA p = inIm(c, r);
+        const uint8_t values[4] = { p.r, p.g, p.b, p.a };
+        for (int k = 0; k < 4; ++k)
+        {
+            auto& channel = stats.channels[k];
+            ++channel.histogram[values[k]];
+            channel.minValue = std::min(channel.minValue, double(values[k]));
+            channel.maxValue = std::max(channel.maxValue, double(values[k]));
+            sum[k] += values[k];
+            sumSq[k] += double(values[k]) * values[k];
+        }
+    }
+    const int64_t numValues = int64_t(inIm.width()) * inIm.height();
+    for (int k = 0; k < 4; ++k)
+    {
+        auto& channel = stats.channels[k];
+        channel.numValues = numValues;
+        channel.mean = sum[k] / numValues;
+        channel.stddev = std::sqrt (std::max(sumSq[k] / numValues - channel.mean * channel.mean, 0.));
+    }
+    return stats;
+}
+
+bool sameStatistics (const ImageStatistics& lhs, const ImageStatistics& rhs)
+{
+    if (lhs.numChannels != rhs.numChannels)
+        return false;
+    for (int k = 0; k < lhs.numChannels; ++k)
+    {
+        const auto& l = lhs.channels[k];
+        const auto& r = rhs.channels[k];
+        if (l.numValues != r.numValues || l.minValue != r.minValue || l.maxValue != r.maxValue
+            || l.histogram != r.histogram
+            || std::abs(l.mean - r.mean) > 1e-9 * (1. + std::abs(r.mean))
+            || std::abs(l.stddev - r.stddev) > 1e-6 * (1. + r.stddev))
+            return false;
+    }
+    return true;
+}
+
+// Two passes in double over the raw values of a native image, for the
+// moments only. The histogram bins depend on the float rounding.
+ImageStatistics referenceNativeStatistics (const NativeImage& image)
+{
+    ImageStatistics stats;
+    const int numChannels = image.numChannels();
+    stats.numChannels = numChannels;
+    float values[4];
+    double sum[4] = {}, sumSqDev[4] = {};
+    for (int k = 0; k < numChannels; ++k)
+    {
+        stats.channels[k].minValue = INFINITY;
+        stats.channels[k].maxValue = -INFINITY;
+    }
+    for (int r = 0; r < image.height(); ++r)
+    for (int c = 0; c < image.width(); ++c)
+    {
+        image.getPixel (c, r, values);
+        for (int k = 0; k < numChannels; ++k)
+        {
+            auto& channel = stats.channels[k];
+            ++channel.numValues;
+            channel.minValue = std::min(channel.minValue, double(values[k]));
+            channel.maxValue = std::max(channel.maxValue, double(values[k]));
+            sum[k] += values[k];
+        }
+    }
+    for (int k = 0; k < numChannels; ++k)
+        stats.channels[k].mean = sum[k] / stats.channels[k].numValues;
+    for (int r = 0; r < image.height(); ++r)
+    for (int c = 0; c < image.width(); ++c)
+    {
+        image.getPixel (c, r, values);
+        for (int k = 0; k < numChannels; ++k)
+            sumSqDev[k] += (values[k] - stats.channels[k].mean) * (values[k] - stats.channels[k].mean);
+    }
+    for (int k = 0; k < numChannels; ++k)
+        stats.channels[k].stddev = std::sqrt (sumSqDev[k] / stats.channels[k].numValues);
+    return stats;
+}
+
+bool sameNativeStatistics (const ImageStatistics& lhs, const ImageStatistics& rhs)
+{
+    if (lhs.numChannels != rhs.numChannels)
+        return false;
+    for (int k = 0; k < lhs.numChannels; ++k)
+    {
+        const auto& l = lhs.channels[k];
+        const auto& r = rhs.channels[k];
+        if (l.numValues != r.numValues || l.minValue != r.minValue || l.maxValue != r.maxValue
+            || std::abs(l.mean - r.mean) > 1e-6 * (std::abs(r.mean) + r.stddev) + 1e-9
+            || std::abs(l.stddev - r.stddev) > 1e-6 * (1. + r.stddev))
+            return false;
+    }
+    return true;
+}
+
+// Direct 11x11 windows in double, with the same luma and borders.
+double referenceSsim (const ImageSRGBA& image, const ImageSRGBA& reference)
+{
+    const int width = image.width();
+    const int height = image.height();
+    auto luma = [](const PixelSRGBA& p) { return (0.2126 * p.r + 0.7152 * p.g + 0.0722 * p.b) / 255.; };
+
+    double weights[11];
+    double sumWeights = 0.;
+    for (int k = 0; k < 11; ++k)
+    {
+        weights[k] = std::exp (-(k - 5.) * (k - 5.) / (2. * 1.5 * 1.5));
+        sumWeights += weights[k];
+    }
+
+    const double C1 = 0.01 * 0.01;
+    const double C2 = 0.03 * 0.03;
+    double sumSsim = 0.;
+    for (int r = 0; r < height; ++r)
+    for (int c = 0; c < width; ++c)
+    {
+        double muX = 0., muY = 0., muXX = 0., muYY = 0., muXY = 0.;
+        for (int dr = -5; dr <= 5; ++dr)
+        for (int dc = -5; dc <= 5; ++dc)
+        {
+            const int rr = std::min(std::max(r + dr, 0), height - 1);
+            const int cc = std::min(std::max(c + dc, 0), width - 1);
+            const double w = weights[dr + 5] * weights[dc + 5] / (sumWeights * sumWeights);
+            const double x = luma (image(cc, rr));
+            const double y = luma (reference(cc, rr));
+            muX += w * x;
+            muY += w * y;
+            muXX += w * x * x;
+            muYY += w * y * y;
+            muXY += w * x * y;
+        }
+        const double num = (2. * muX * muY + C1) * (2. * (muXY - muX * muY) + C2);
+        const double den = (muX * muX + muY * muY + C1) * ((muXX - muX * muX) + (muYY - muY * muY) + C2);
+        sumSsim += num / den;
+    }
+    return sumSsim / (int64_t(width) * height);
+}
+
+template <class Func>
+double bestTimeMs (const Func& func, int numRuns = 3)
+{
+    double bestTime = INFINITY;
+    for (int i = 0; i < numRuns; ++i)
+    {
+        const double startTime = currentDateInSeconds();
+        func ();
+        bestTime = std::min(bestTime, currentDateInSeconds() - startTime);
+    }
+    return bestTime * 1e3;
+}
+
+bool sameContent (const ImageSRGBA& lhs, const ImageSRGBA& rhs)
+{
+    if (lhs.width() != rhs.width() || lhs.height() != rhs.height())
+        return false;
+    for (int r = 0; r < lhs.height(); ++r)
+        if (memcmp (lhs.atRowPtr(r), rhs.atRowPtr(r), lhs.width() * sizeof(PixelSRGBA)) != 0)
+            return false;
+    return true;
+}
+
+// Largest difference over the RGB channels, or 255 if the sizes differ.
+int maxColorDifference (const ImageSRGBA& lhs, const ImageSRGBA& rhs)
+{
+    if (lhs.width() != rhs.width() || lhs.height() != rhs.height())
+        return 255;
+    int maxDiff = 0;
+    for (int r = 0; r < lhs.height(); ++r)
+    for (int c = 0; c < lhs.width(); ++c)
+    {
+        const PixelSRGBA p = lhs(c, r);
+        const PixelSRGBA q = rhs(c, r);
+        maxDiff = std::max (maxDiff, std::abs (int(p.r) - int(q.r)));
+        maxDiff = std::max (maxDiff, std::abs (int(p.g) - int(q.g)));
+        maxDiff = std::max (maxDiff, std::abs (int(p.b) - int(q.b)));
+    }
+    return maxDiff;
+}
+
+using TransformFunc = std::function<void(const ImageSRGBA&, ImageSRGBA&)>;
+
+// Best of a few runs, in milliseconds.
+double bestTimeMs (const TransformFunc& func, const ImageSRGBA& input, ImageSRGBA& output, int numRuns = 3)
+{
+    double bestTime = INFINITY;
+    for (int i = 0; i < numRuns; ++i)
+    {
+        const double startTime = currentDateInSeconds();
+        func (input, output);
+        bestTime = std::min(bestTime, currentDateInSeconds() - startTime);
+    }
+    return bestTime * 1e3;
+}
+
+} // anonymous
+
+bool runKernelBench ()
+{
+    struct Kernel
+    {
+        const char* name;
+        TransformFunc reference;
+        TransformFunc optimized;
+    };
+
+    const std::vector<Kernel> kernels = {
+        { "rotate90", referenceRotate90, rotate90 },
+        { "rotate180", referenceRotate180, rotate180 },
+        { "rotate270", referenceRotate270, rotate270 },
+        { "flipH", referenceFlipHorizontal, flipHorizontal },
+        { "flipV", referenceFlipVertical, flipVertical },
+    };
+
+    // 1, 12 and 50 MP.
+    const std::vector<std::pair<int,int>> sizes = { {1024, 1024}, {4000, 3000}, {8660, 5774} };
+
+    bool allSame = true;
+    printf ("%-12s %-12s %12s %12s %8s\n", "kernel", "size", "reference ms", "kernel ms", "speedup");
+    for (const auto& size : sizes)
+    {
+        ImageSRGBA input (size.first, size.second);
+        input.apply ([](int c, int r, PixelSRGBA& p) {
+            p = PixelSRGBA(c & 0xff, r & 0xff, (c ^ r) & 0xff, 255);
+        });
+
+        for (const auto& kernel : kernels)
+        {
+            ImageSRGBA referenceOutput, kernelOutput;
+            const double referenceMs = bestTimeMs (kernel.reference, input, referenceOutput);
+            const double kernelMs = bestTimeMs (kernel.optimized, input, kernelOutput);
+            const bool same = sameContent (referenceOutput, kernelOutput);
+            allSame &= same;
+            printf ("%-12s %-12s %12.2f %12.2f %7.1fx%s\n",
+                    kernel.name,
+                    formatted("%dx%d", size.first, size.second).c_str(),
+                    referenceMs,
+                    kernelMs,
+                    referenceMs / std::max(kernelMs, 1e-6),
+                    same ? "" : " OUTPUT DIFFERS");
+        }
+    }
+    // Resampling, compared to the single threaded stb version.
+    struct ResizeCase
+    {
+        const char* name;
+        int inW, inH, outW, outH;
+    };
+    const std::vector<ResizeCase> resizeCases = {
+        { "4K->1080p", 3840, 2160, 1920, 1080 },
+        { "50MP->4K", 8660, 5774, 3840, 2560 },
+    };
+
+    printf ("\n%-12s %-12s %12s %12s %8s\n", "resize", "filter", "stb ms", "resampler ms", "speedup");
+    for (const auto& resizeCase : resizeCases)
+    {
+        ImageSRGBA input (resizeCase.inW, resizeCase.inH);
+        input.apply ([](int c, int r, PixelSRGBA& p) {
+            p = PixelSRGBA(c & 0xff, r & 0xff, (c ^ r) & 0xff, 255);
+        });
+
+        ImageSRGBA output (resizeCase.outW, resizeCase.outH);
+        const double stbMs = bestTimeMs ([](const ImageSRGBA& in, ImageSRGBA& out) {
+            stbir_resize_uint8_srgb (in.rawBytes(), in.width(), in.height(), int(in.bytesPerRow()),
+                                     out.rawBytes(), out.width(), out.height(), int(out.bytesPerRow()),
+                                     4, 3, 0);
+        }, input, output);
+
+        for (int i = 0; i < int(ResampleFilter::NumFilters); ++i)
+        {
+            const ResampleFilter filter = ResampleFilter(i);
+            const double resamplerMs = bestTimeMs ([filter](const ImageSRGBA& in, ImageSRGBA& out) {
+                resampleImage (in, out, filter);
+            }, input, output);
+            printf ("%-12s %-12s %12.2f %12.2f %7.1fx\n",
+                    resizeCase.name,
+                    resampleFilterName(filter),
+                    stbMs,
+                    resamplerMs,
+                    stbMs / std::max(resamplerMs, 1e-6));
+        }
+    }
+
+    // sRGB transfer function. The linear input covers many values between
+    // the 8 bits levels, the tables must still round like pow.
+    printf ("\n%-12s %-12s %12s %12s %8s\n", "color", "size", "pow ms", "tables ms", "speedup");
+    for (const auto& size : sizes)
+    {
+        ImageSRGBA input (size.first, size.second);
+        input.apply ([](int c, int r, PixelSRGBA& p) {
+            p = PixelSRGBA(c & 0xff, r & 0xff, (c ^ r) & 0xff, 255);
+        });
+
+        ImageLinearRGB referenceLinear, linear;
+        const double referenceToLinearMs = bestTimeMs ([&]() { referenceToLinear (input, referenceLinear); });
+        const double toLinearMs = bestTimeMs ([&]() { linear = convertToLinearRGB (input); });
+        bool same = true;
+        for (int r = 0; r < input.height() && same; ++r)
+            same = memcmp (referenceLinear.atRowPtr(r), linear.atRowPtr(r), input.width() * sizeof(PixelLinearRGB)) == 0;
+        allSame &= same;
+        printf ("%-12s %-12s %12.2f %12.2f %7.1fx%s\n",
+                "toLinear",
+                formatted("%dx%d", size.first, size.second).c_str(),
+                referenceToLinearMs,
+                toLinearMs,
+                referenceToLinearMs / std::max(toLinearMs, 1e-6),
+                same ? "" : " OUTPUT DIFFERS");
+
+        linear.apply ([](int c, int r, PixelLinearRGB& p) {
+            p = PixelLinearRGB(((c * 7919 + r * 104729) & 0xffff) / 65535.f,
+                               ((c * 104729 + r) & 0xffff) / 65535.f,
+                               ((c + r * 7919) & 0xffff) / 65535.f);
+        });
+        ImageSRGBA referenceSrgb, srgb;
+        const double referenceToSrgbMs = bestTimeMs ([&]() { referenceToSrgb (linear, referenceSrgb); });
+        const double toSrgbMs = bestTimeMs ([&]() { srgb = convertToSRGBA (linear); });
+        same = sameContent (referenceSrgb, srgb);
+        allSame &= same;
+        printf ("%-12s %-12s %12.2f %12.2f %7.1fx%s\n",
+                "toSrgb",
+                formatted("%dx%d", size.first, size.second).c_str(),
+                referenceToSrgbMs,
+                toSrgbMs,
+                referenceToSrgbMs / std::max(toSrgbMs, 1e-6),
+                same ? "" : " OUTPUT DIFFERS");
+    }
+
+    // Python array ingestion, the float values go a bit outside of [0,1]
+    // to check the clamping.
+    struct IngestCase
+    {
+        const char* name;
+        int numChannels;
+        bool isFloat;
+        std::function<ImageSRGBA(uint8_t*, int, int, int)> convert;
+    };
+    const std::vector<IngestCase> ingestCases = {
+        { "gray8", 1, false, srgbaFromGray },
+        { "rgb8", 3, false, srgbaFromSrgb },
+        { "grayF", 1, true, srgbaFromFloatGray },
+        { "rgbF", 3, true, srgbaFromFloatSrgb },
+        { "rgbaF", 4, true, srgbaFromFloatSrgba },
+    };
+
+    printf ("\n%-12s %-12s %12s %12s %8s\n", "ingest", "size", "scalar ms", "kernel ms", "speedup");
+    const auto& ingestSize = sizes[1];
+    for (const auto& ingestCase : ingestCases)
+    {
+        const int w = ingestSize.first;
+        const int h = ingestSize.second;
+        const int bytesPerRow = w * ingestCase.numChannels * (ingestCase.isFloat ? 4 : 1);
+        std::vector<uint8_t> buffer (size_t(bytesPerRow) * h);
+        for (int r = 0; r < h; ++r)
+        for (int i = 0; i < w * ingestCase.numChannels; ++i)
+        {
+            const int v = (i * 7919 + r * 104729) & 0xffff;
+            if (ingestCase.isFloat)
+                ((float*)(buffer.data() + r*size_t(bytesPerRow)))[i] = v / 60000.f - 0.05f;
+            else
+                buffer[r*size_t(bytesPerRow) + i] = uint8_t(v);
+        }
+
+        ImageSRGBA referenceOutput, kernelOutput;
+        const double referenceMs = bestTimeMs ([&]() {
+            referenceOutput = referenceFromArray (buffer.data(), w, h, bytesPerRow, ingestCase.numChannels, ingestCase.isFloat);
+        });
+        const double kernelMs = bestTimeMs ([&]() {
+            kernelOutput = ingestCase.convert (buffer.data(), w, h, bytesPerRow);
+        });
+        const bool same = sameContent (referenceOutput, kernelOutput);
+        allSame &= same;
+        printf ("%-12s %-12s %12.2f %12.2f %7.1fx%s\n",
+                ingestCase.name,
+                formatted("%dx%d", w, h).c_str(),
+                referenceMs,
+                kernelMs,
+                referenceMs / std::max(kernelMs, 1e-6),
+                same ? "" : " OUTPUT DIFFERS");
+    }
+
+    // Statistics of 8 bits images.
+    printf ("\n%-12s %-12s %12s %12s %8s\n", "statistics", "size", "scalar ms", "kernel ms", "speedup");
+    for (const auto& size : sizes)
+    {
+        ImageSRGBA input (size.first, size.second);
+        input.apply ([](int c, int r, PixelSRGBA& p) {
+            p = PixelSRGBA(c & 0xff, (r * 3) & 0xff, (c ^ r) & 0xff, (c * r) & 0xff);
+        });
+
+        ImageStatistics referenceStats, kernelStats;
+        const double referenceMs = bestTimeMs ([&]() { referenceStats = referenceStatistics (input); });
+        const double kernelMs = bestTimeMs ([&]() { kernelStats = computeImageStatistics (input); });
+        const bool same = sameStatistics (referenceStats, kernelStats);
+        allSame &= same;
+        printf ("%-12s %-12s %12.2f %12.2f %7.1fx%s\n",
+                "rgba8",
+                formatted("%dx%d", size.first, size.second).c_str(),
+                referenceMs,
+                kernelMs,
+                referenceMs / std::max(kernelMs, 1e-6),
+                same ? "" : " OUTPUT DIFFERS");
+    }
+
+    // Statistics of the 16 bits and float images, with a large offset
+    // compared to the spread like depth maps often have.
+    {
+        const auto& size = sizes[1];
+        const int w = size.first;
+        const int h = size.second;
+        const NativeImage::Format formats[] = { NativeImage::Format::Gray16, NativeImage::Format::RGBA16,
+                                                NativeImage::Format::GrayFloat, NativeImage::Format::RGBAFloat };
+        const char* formatNames[] = { "gray16", "rgba16", "grayfloat", "rgbafloat" };
+        for (int formatIdx = 0; formatIdx < 4; ++formatIdx)
+        {
+            const NativeImage::Format format = formats[formatIdx];
+            const int numValuesPerRow = w * NativeImage::numChannels(format);
+            const int bytesPerRow = numValuesPerRow * NativeImage::bytesPerChannel(format);
+            std::vector<uint8_t> bytes (size_t(bytesPerRow) * h);
+            for (int r = 0; r < h; ++r)
+            for (int i = 0; i < numValuesPerRow; ++i)
+            {
+                const int value = 50000 + (i + r) % 5;
+                uint8_t* elementPtr = bytes.data() + size_t(r) * bytesPerRow + i * NativeImage::bytesPerChannel(format);
+                if (NativeImage::bytesPerChannel(format) == 2)
+                {
+                    const uint16_t v16 = uint16_t(value);
+                    memcpy (elementPtr, &v16, 2);
+                }
+                else
+                {
+                    const float vFloat = value + 0.25f * (i % 3);
+                    memcpy (elementPtr, &vFloat, 4);
+                }
+            }
+            const NativeImage input (format, bytes.data(), w, h, bytesPerRow);
+
+            ImageStatistics referenceStats, kernelStats;
+            const double referenceMs = bestTimeMs ([&]() { referenceStats = referenceNativeStatistics (input); }, 1);
+            const double kernelMs = bestTimeMs ([&]() { kernelStats = computeImageStatistics (input); });
+            const bool same = sameNativeStatistics (referenceStats, kernelStats);
+            allSame &= same;
+            printf ("%-12s %-12s %12.2f %12.2f %7.1fx%s\n",
+                    formatNames[formatIdx],
+                    formatted("%dx%d", w, h).c_str(),
+                    referenceMs,
+                    kernelMs,
+                    referenceMs / std::max(kernelMs, 1e-6),
+                    same ? "" : " OUTPUT DIFFERS");
+            if (!same)
+                printf ("%-12s mean %.4f std %.4f, expected mean %.4f std %.4f\n", "",
+                        kernelStats.channels[0].mean, kernelStats.channels[0].stddev,
+                        referenceStats.channels[0].mean, referenceStats.channels[0].stddev);
+        }
+    }
+
+    // SSIM. The direct reference is too slow for the larger sizes.
+    printf ("\n%-12s %-12s %12s %12s %8s\n", "ssim", "size", "direct ms", "kernel ms", "speedup");
+    for (const auto& size : sizes)
+    {
+        ImageItemData image, reference;
+        image.cpuData = std::make_shared<ImageSRGBA>(size.first, size.second);
+        reference.cpuData = std::make_shared<ImageSRGBA>(size.first, size.second);
+        image.cpuData->apply ([](int c, int r, PixelSRGBA& p) {
+            p = PixelSRGBA(c & 0xff, (r * 3) & 0xff, ((c / 8) ^ (r / 8)) & 0xff, 255);
+        });
+        reference.cpuData->apply ([&](int c, int r, PixelSRGBA& p) {
+            const PixelSRGBA in = (*image.cpuData)(c, r);
+            const int noise = (c * 7 + r * 13) % 21 - 10;
+            auto noisy = [noise](uint8_t v) { return uint8_t(std::min(std::max(v + noise, 0), 255)); };
+            p = PixelSRGBA(noisy(in.r), noisy(in.g), noisy(in.b), 255);
+        });
+
+        double kernelSsim = 0.;
+        const double kernelMs = bestTimeMs ([&]() { kernelSsim = computeImageSsim (image, reference); });
+        if (&size != &sizes[0])
+        {
+            printf ("%-12s %-12s %12s %12.2f %8s\n",
+                    "luma",
+                    formatted("%dx%d", size.first, size.second).c_str(),
+                    "-",
+                    kernelMs,
+                    "-");
+            continue;
+        }
+
+        double directSsim = 0.;
+        const double directMs = bestTimeMs ([&]() { directSsim = referenceSsim (*image.cpuData, *reference.cpuData); }, 1);
+        const bool same = std::abs(kernelSsim - directSsim) < 1e-4;
+        allSame &= same;
+        printf ("%-12s %-12s %12.2f %12.2f %7.1fx%s\n",
+                "luma",
+                formatted("%dx%d", size.first, size.second).c_str(),
+                directMs,
+                kernelMs,
+                directMs / std::max(kernelMs, 1e-6),
+                same ? "" : " OUTPUT DIFFERS");
+        printf ("%-12s ssim %.6f, direct %.6f\n", "", kernelSsim, directSsim);
+    }
+
+    // Color vision deficiencies. The float kernel can differ by one level
+    // from the double reference when a value is right on a rounding edge.
+    struct CvdCase
+    {
+        const char* name;
+        ColorVisionDeficiency deficiency;
+        bool daltonize;
+        // Expected output for tests/rgbgrid.png, generated by DaltonLens.
+        const char* referenceFile;
+    };
+    const std::vector<CvdCase> cvdCases = {
+        { "protan", ColorVisionDeficiency::Protan, false, "tests/brettel1997_protan_wn_1.0.png" },
+        { "deutan", ColorVisionDeficiency::Deutan, false, "tests/brettel1997_deutan_wn_1.0.png" },
+        { "tritan", ColorVisionDeficiency::Tritan, false, "tests/brettel1997_tritan_wn_1.0.png" },
+        { "daltonizeT", ColorVisionDeficiency::Tritan, true, "tests/daltonize_tritan_1.0.png" },
+    };
+
+    printf ("\n%-12s %-12s %12s %12s %8s\n", "cvd", "size", "double ms", "kernel ms", "speedup");
+    const auto& cvdSize = sizes[1];
+    ImageSRGBA cvdInput (cvdSize.first, cvdSize.second);
+    cvdInput.apply ([](int c, int r, PixelSRGBA& p) {
+        p = PixelSRGBA(c & 0xff, r & 0xff, (c ^ r) & 0xff, 255);
+    });
+    for (const auto& cvdCase : cvdCases)
+    {
+        auto kernel = [&](const ImageSRGBA& input, ImageSRGBA& output) {
+            if (cvdCase.daltonize)
+                daltonize (input, cvdCase.deficiency, 1.f, output);
+            else
+                simulateColorVisionDeficiency (input, cvdCase.deficiency, 1.f, output);
+        };
+
+        ImageSRGBA referenceOutput, kernelOutput;
+        const double referenceMs = bestTimeMs ([&]() { referenceCvd (cvdInput, cvdCase.deficiency, cvdCase.daltonize, referenceOutput); });
+        const double kernelMs = bestTimeMs ([&]() { kernel (cvdInput, kernelOutput); });
+        const bool same = maxColorDifference (referenceOutput, kernelOutput) <= 1;
+        allSame &= same;
+        printf ("%-12s %-12s %12.2f %12.2f %7.1fx%s\n",
+                cvdCase.name,
+                formatted("%dx%d", cvdSize.first, cvdSize.second).c_str(),
+                referenceMs,
+                kernelMs,
+                referenceMs / std::max(kernelMs, 1e-6),
+                same ? "" : " OUTPUT DIFFERS");
+
+        // The reference images were saved with a truncation instead of a
+        // rounding, hence the tolerance of 2.
+        ImageSRGBA gridImage, expectedImage;
+        if (!readImageFile ("tests/rgbgrid.png", gridImage) || !readImageFile (cvdCase.referenceFile, expectedImage))
+        {
+            printf ("%-12s skipped, run from the source folder to compare with %s\n", "", cvdCase.referenceFile);
+            continue;
+        }
+        kernel (gridImage, kernelOutput);
+        const int maxDiff = maxColorDifference (expectedImage, kernelOutput);
+        allSame &= maxDiff <= 2;
+        printf ("%-12s max difference with %s: %d%s\n", "", cvdCase.referenceFile, maxDiff, maxDiff <= 2 ? "" : " OUTPUT DIFFERS");
+    }
+
+    // Content hash of the pushed images, against the copy it saves for
+    // each duplicate.
+    printf ("\n%-12s %-12s %12s %12s %8s\n", "dedup", "size", "copy ms", "hash ms", "speedup");
+    for (const auto& size : sizes)
+    {
+        ImageSRGBA input (size.first, size.second);
+        input.apply ([](int c, int r, PixelSRGBA& p) {
+            p = PixelSRGBA(c & 0xff, (r * 3) & 0xff, (c ^ r) & 0xff, 255);
+        });
+
+        ImageSRGBA copy;
+        const double copyMs = bestTimeMs ([&]() { copy = input; });
+        uint64_t hash = 0;
+        const double hashMs = bestTimeMs ([&]() { hash = computeContentHash (input); });
+
+        // One different bit must be enough to get a separate buffer.
+        copy(size.first / 2, size.second / 2).g ^= 1;
+        ImageBufferPool pool;
+        const auto first = pool.share (input);
+        const auto second = pool.share (input);
+        const auto modified = pool.share (copy);
+        const bool same = computeContentHash (copy) != hash
+                          && first == second
+                          && modified != first
+                          && pool.stats().numBuffers == 2;
+        allSame &= same;
+        printf ("%-12s %-12s %12.2f %12.2f %7.1fx%s\n",
+                "hash",
+                formatted("%dx%d", size.first, size.second).c_str(),
+                copyMs,
+                hashMs,
+                copyMs / std::max(hashMs, 1e-6),
+                same ? "" : " OUTPUT DIFFERS");
+    }
+
+    // PNG round trips of small images, where the fixed Huffman blocks
+    // get picked, at every level.
+    printf ("\n%-12s %-12s %s\n", "png", "size", "decoded by stb_image at levels 0-9");
+    const std::vector<std::pair<int,int>> pngSizes = { {1, 1}, {16, 16}, {37, 23}, {256, 64} };
+    uint32_t randomState = 42;
+    auto nextRandom = [&]() { randomState = randomState * 1664525u + 1013904223u; return uint8_t(randomState >> 24); };
+    for (const auto& size : pngSizes)
+    {
+        std::vector<ImageSRGBA> inputs (3, ImageSRGBA(size.first, size.second));
+        inputs[0].apply ([&](int c, int r, PixelSRGBA& p) { p = PixelSRGBA(nextRandom(), nextRandom(), nextRandom(), 255); });
+        inputs[1].apply ([&](int c, int r, PixelSRGBA& p) { p = ((c / 4 + r / 4) % 2) ? PixelSRGBA(250, 200, 150, 255) : PixelSRGBA(10, 20, 30, 255); });
+        inputs[2].apply ([&](int c, int r, PixelSRGBA& p) { p = PixelSRGBA(nextRandom(), c & 0xff, r & 0xff, nextRandom()); });
+
+        std::string failedLevels;
+        for (int level = 0; level <= 9; ++level)
+        for (const auto& input : inputs)
+        {
+            std::vector<uint8_t> encoded;
+            bool same = encodePng (input, level, encoded);
+            int w = 0, h = 0, n = 0;
+            uint8_t* decoded = same ? stbi_load_from_memory (encoded.data(), int(encoded.size()), &w, &h, &n, 4) : nullptr;
+            same = decoded && w == input.width() && h == input.height();
+            for (int r = 0; same && r < h; ++r)
+                same = memcmp (decoded + size_t(r) * w * 4, input.atRowPtr(r), w * 4) == 0;
+            stbi_image_free (decoded);
+            if (!same)
+            {
+                failedLevels += formatted(" %d", level);
+                break;
+            }
+        }
+
+        allSame &= failedLevels.empty();
+        printf ("%-12s %-12s %s\n",
+                "roundtrip",
+                formatted("%dx%d", size.first, size.second).c_str(),
+                failedLevels.empty() ? "ok" : ("OUTPUT DIFFERS at levels" + failedLevels).c_str());
+    }
+
+    return allSame;
+}
+
+} // zv
@@ -0,0 +1,17 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+namespace zv
+{
+
+// Times the CPU image kernels against straightforward reference loops
+// at a few image sizes, and checks that they give the same output.
+// Returns false if any of them differs.
+bool runKernelBench ();
+
+} // zv
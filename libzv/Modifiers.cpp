@@ -9,33 +9,207 @@
 #include <libzv/ImguiUtils.h>
 #include <libzv/Utils.h>
 #include <libzv/MathUtils.h>
+#include <libzv/ImageTransforms.h>
+#include <libzv/ImageWriter.h>
+#include <libzv/lrucache.hpp>
 
-#include <stb_image_resize.h>
+#include <cmath>
+#include <cstring>
+#include <mutex>
 
 namespace zv
 {
 
-bool ModifiedImage::saveChanges (const std::string& outputPath)
+// Below that the full output is fast enough to be computed right away.
+static const int64_t MinPixelsForPartialEvaluation = 4*1024*1024;
+
+// Budget for the cached modifier outputs.
+static const size_t DefaultModifierCacheBytes = size_t(1024)*1024*1024;
+
+static uint64_t hashCombine (uint64_t seed, uint64_t value)
 {
-    ImageItemDataPtr maybeModifiedData = data();
-    
-    if (!writeImageFile (outputPath, *(maybeModifiedData->cpuData)))
+    // From boost::hash_combine, 64-bit version.
+    seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 12) + (seed >> 4);
+    return seed;
+}
+
+static uint64_t hashDouble (double v)
+{
+    uint64_t bits = 0;
+    memcpy (&bits, &v, sizeof(double));
+    return bits;
+}
+
+struct ModifierCache::Impl
+{
+    struct Entry
+    {
+        ImageItemDataPtr data;
+        size_t numBytes = 0;
+    };
+
+    Impl (size_t maxBytes) : maxBytes (maxBytes) {}
+
+    void evictIfNeeded ()
+    {
+        Entry evicted;
+        while (stats.numBytes > maxBytes && entries.pop_back (&evicted))
+        {
+            stats.numBytes -= evicted.numBytes;
+            ++stats.evictions;
+        }
+        stats.numEntries = int(entries.size());
+    }
+
+    // The budget is what limits the number of entries.
+    lru_cache<uint64_t, Entry> entries { size_t(-1) };
+    size_t maxBytes = 0;
+    Stats stats;
+    mutable std::mutex mutex;
+};
+
+ModifierCache& ModifierCache::instance ()
+{
+    static ModifierCache cache (DefaultModifierCacheBytes);
+    return cache;
+}
+
+bool ModifierCache::computeKey (int64_t inputContentId, const ImageModifier& modifier, uint64_t& key)
+{
+    uint64_t paramsHash = 0;
+    if (!modifier.hashParams (paramsHash))
         return false;
+    key = hashCombine (uint64_t(inputContentId), paramsHash);
+    return true;
+}
+
+ModifierCache::ModifierCache (size_t maxBytes)
+: impl (new Impl (maxBytes))
+{}
 
-    _item->fillFromFilePath (outputPath);
-    _item->alreadyModifiedAndSaved = true;
+ModifierCache::~ModifierCache () = default;
 
-    if (maybeModifiedData != _originalData)
+ImageItemDataPtr ModifierCache::find (uint64_t key)
+{
+    std::lock_guard<std::mutex> _ (impl->mutex);
+    const Impl::Entry* entry = impl->entries.get (key);
+    if (!entry)
     {
-        *_originalData = *maybeModifiedData;
-        _modifiers.clear ();
+        ++impl->stats.misses;
+        return nullptr;
     }
+    ++impl->stats.hits;
+    // The caller may display it, the texture must stay out of the cache.
+    return entry->data->pixelDataCopy ();
+}
+
+void ModifierCache::insert (uint64_t key, const ImageItemDataPtr& data)
+{
+    // Only the pixels get cached. The evictions can happen on the pool
+    // threads, and the GL textures can only be released on the UI one.
+    Impl::Entry entry;
+    entry.data = data->pixelDataCopy ();
+    // Views count for the whole buffer they keep alive.
+    entry.numBytes = data->cpuData ? data->cpuData->retainedBytes() : size_t(data->width()) * data->height() * sizeof(PixelSRGBA);
+
+    std::lock_guard<std::mutex> _ (impl->mutex);
+    if (entry.numBytes > impl->maxBytes)
+        return;
 
+    if (const Impl::Entry* previous = impl->entries.get (key))
+    {
+        impl->stats.numBytes -= previous->numBytes;
+        impl->entries.remove (key);
+    }
+    impl->entries.put (key, entry);
+    impl->stats.numBytes += entry.numBytes;
+    impl->evictIfNeeded ();
+}
+
+void ModifierCache::setMaxBytes (size_t maxBytes)
+{
+    std::lock_guard<std::mutex> _ (impl->mutex);
+    impl->maxBytes = maxBytes;
+    impl->evictIfNeeded ();
+}
+
+void ModifierCache::clear ()
+{
+    std::lock_guard<std::mutex> _ (impl->mutex);
+    impl->entries.clear ();
+    impl->stats.numBytes = 0;
+    impl->stats.numEntries = 0;
+}
+
+ModifierCache::Stats ModifierCache::stats () const
+{
+    std::lock_guard<std::mutex> _ (impl->mutex);
+    return impl->stats;
+}
+
+// Computes the full outputs of the partial evaluations. Shared by all
+// the images, a dropped result does not keep it busy for long since the
+// tasks that did not start yet get skipped.
+static BackgroundWorker& modifierWorker ()
+{
+    static BackgroundWorker worker;
+    return worker;
+}
+
+bool ModifiedImage::saveChanges (const std::string& outputPath)
+{
+    completePendingOutput ();
+    if (!hasValidData())
+        return false;
+
+    // The file gets written in the background. The item only points to
+    // it once complete, it could get reloaded otherwise. The modifiers
+    // are kept until then, so a failed write can be retried.
+    const ImageItemDataPtr savedData = data();
+    const size_t numSavedModifiers = _modifiers.size();
+    const ImageModifier* lastSavedModifier = _modifiers.empty() ? nullptr : _modifiers.back().get();
+    std::weak_ptr<ModifiedImage> weakThis = weak_from_this();
+    ImageItemPtr item = _item;
+    ImageWriter::instance().write (outputPath, savedData->srgbaDataPtr(),
+                                   [item, weakThis, savedData, numSavedModifiers, lastSavedModifier](const ImageWriter::Result& result) {
+        // Failures are reported by the controls window.
+        if (!result.success)
+            return;
+        item->fillFromFilePath (result.filePath);
+        item->alreadyModifiedAndSaved = true;
+        if (auto modIm = weakThis.lock())
+            modIm->foldSavedModifiers (savedData, numSavedModifiers, lastSavedModifier);
+    });
     return true;
 }
 
+// The saved output becomes the original data. The modifiers added since
+// the save stay on top of it.
+void ModifiedImage::foldSavedModifiers (const ImageItemDataPtr& savedData, size_t numSavedModifiers,
+                                        const ImageModifier* lastSavedModifier)
+{
+    if (numSavedModifiers == 0 || _modifiers.size() < numSavedModifiers)
+        return;
+
+    // Undone or replaced since the save.
+    const auto& lastModifier = _modifiers[numSavedModifiers - 1];
+    if (lastModifier.get() != lastSavedModifier || lastModifier->output() != savedData)
+        return;
+
+    // Only modifiers added after the save can be pending.
+    if (_pendingOutput)
+        _pendingModifierIdx -= numSavedModifiers;
+    *_originalData = *savedData;
+    // Don't keep the whole previous image alive behind a crop view.
+    if (_originalData->cpuData && _originalData->cpuData->isView())
+        _originalData->cpuData = std::make_shared<ImageSRGBA>(*_originalData->cpuData);
+    _modifiers.erase (_modifiers.begin(), _modifiers.begin() + numSavedModifiers);
+    _modifiersChangedSinceLastUpdate = true;
+}
+
 void ModifiedImage::discardChanges ()
 {
+    dropPendingOutput ();
     if (_modifiers.empty ())
         return;
     _modifiers.clear ();
@@ -49,30 +223,33 @@ bool ModifiedImage::update ()
     
     bool originalChanged = _originalData->update();
 
-    if (!originalChanged && !_modifiersChangedSinceLastUpdate)
+    // The modifiers get reapplied on the new content below.
+    if (originalChanged)
+        dropPendingOutput ();
+
+    const bool pendingOutputFinished = finishPendingOutput ();
+
+    if (!originalChanged && !_modifiersChangedSinceLastUpdate && !pendingOutputFinished)
     {
         return false;
     }
 
     // Reapply the modification pipeline if needed.
-    if (originalChanged && _originalData->cpuData->hasData())
+    if (originalChanged && _originalData->hasData())
     {
-        ImageItemDataPtr input = _originalData;
-        for (auto& modifier : _modifiers)
-        {
-            modifier->apply (input, _annotationRenderer);
-            input = modifier->output ();
-        }
+        // New content, the previous cache entries don't apply anymore.
+        _originalData->contentId = UniqueId::newId();
+        reapplyModifiers ();
     }
     
     clearIntermediateModifiersData ();
     _modifiersChangedSinceLastUpdate = false;
 
     const ImageItemDataPtr& currentData = data();
-    if (currentData->cpuData->hasData())
+    if (currentData->hasData())
     {
-        _item->metadata.width = currentData->cpuData->width();
-        _item->metadata.height = currentData->cpuData->height();
+        _item->metadata.width = width();
+        _item->metadata.height = height();
     }
 
     return true;
@@ -80,11 +257,11 @@ bool ModifiedImage::update ()
 
 void ModifiedImage::addModifier (std::unique_ptr<ImageModifier> modifier)
 {
-    if (hasValidData())
-    {
-        modifier->apply (data(), _annotationRenderer);
-    }
+    // Otherwise it waits for the pending output, or for the original data.
+    const bool canEvaluate = !_pendingOutput && hasValidData();
     _modifiers.push_back (std::move(modifier));
+    if (canEvaluate)
+        evaluateModifier (_modifiers.size() - 1);
     _modifiersChangedSinceLastUpdate = true;
     
     _actions.push_back(ImageAction([this]() {
@@ -96,8 +273,15 @@ void ModifiedImage::removeLastModifier()
 {
     if (_modifiers.empty())
         return;
+    if (_pendingOutput && _pendingModifierIdx + 1 == _modifiers.size())
+        dropPendingOutput ();
     _modifiers.pop_back();
     _modifiersChangedSinceLastUpdate = true;
+
+    // The new last one might have been skipped by a fused pass. Without
+    // an output because of a pending one is fine, it comes next.
+    if (!_pendingOutput && !_modifiers.empty() && !_modifiers.back()->output() && _originalData->hasData())
+        reapplyModifiers ();
 }
 
 void ModifiedImage::undoLastChange ()
@@ -108,6 +292,273 @@ void ModifiedImage::undoLastChange ()
     _actions.pop_back();
 }
 
+void ModifiedImage::reapplyModifiers ()
+{
+    ImageItemDataPtr input = _originalData;
+    size_t i = 0;
+
+    // Start from the last output that is still in the cache.
+    {
+        std::vector<uint64_t> keys;
+        uint64_t key = uint64_t(_originalData->contentId);
+        for (const auto& modifier : _modifiers)
+        {
+            if (!ModifierCache::computeKey (int64_t(key), *modifier, key))
+                break;
+            keys.push_back (key);
+        }
+
+        for (size_t k = keys.size(); k > 0; --k)
+        {
+            ImageItemDataPtr cachedOutput = ModifierCache::instance().find (keys[k-1]);
+            if (!cachedOutput)
+                continue;
+            for (size_t j = 0; j + 1 < k; ++j)
+                _modifiers[j]->_outputData = nullptr;
+            _modifiers[k-1]->_outputData = cachedOutput;
+            input = cachedOutput;
+            i = k;
+            break;
+        }
+    }
+
+    evaluateModifiers (_modifiers, i, input, _annotationRenderer, true /* use cache */);
+}
+
+bool ModifiedImage::cloneModifiers (std::deque<std::unique_ptr<ImageModifier>>& modifiers) const
+{
+    modifiers.clear ();
+    for (const auto& modifier : _modifiers)
+    {
+        std::unique_ptr<ImageModifier> copy = modifier->clone ();
+        if (!copy)
+            return false;
+        modifiers.push_back (std::move(copy));
+    }
+    return true;
+}
+
+ImageItemDataPtr ModifiedImage::applyModifiers (const ImageItemDataPtr& input,
+                                                std::deque<std::unique_ptr<ImageModifier>>& modifiers,
+                                                AnnotationRenderer& annotationRenderer)
+{
+    if (modifiers.empty())
+        return input;
+    evaluateModifiers (modifiers, 0, input, annotationRenderer, false /* no cache */);
+    return modifiers.back()->output();
+}
+
+// Runs of lossless geometric modifiers are composed into a single remap
+// and evaluated in one pass. Only the last modifier of a run gets its
+// output, the intermediate ones are left empty. A run that reduces to a
+// crop becomes a view, or is read directly by a following resize.
+void ModifiedImage::evaluateModifiers (std::deque<std::unique_ptr<ImageModifier>>& modifiers, size_t firstModifier,
+                                       ImageItemDataPtr input, AnnotationRenderer& annotationRenderer, bool useCache)
+{
+    size_t i = firstModifier;
+    while (i < modifiers.size())
+    {
+        const ImageSRGBA& inIm = input->srgbaData();
+        PixelRemap remap = PixelRemap::identity (inIm.width(), inIm.height());
+        size_t runEnd = i;
+        PixelRemap step;
+        while (runEnd < modifiers.size() && modifiers[runEnd]->pixelRemap (remap.outWidth, remap.outHeight, step))
+        {
+            remap = remap.then (step);
+            ++runEnd;
+        }
+
+        if (runEnd == i)
+        {
+            modifiers[i]->apply (input, annotationRenderer);
+            if (useCache)
+                cacheModifierOutput (input->contentId, *modifiers[i]);
+            input = modifiers[i]->output ();
+            ++i;
+            continue;
+        }
+
+        for (size_t k = i; k < runEnd; ++k)
+            modifiers[k]->_outputData = nullptr;
+
+        auto output = std::make_shared<ImageItemData>();
+        if (remap.isCrop() && runEnd < modifiers.size()
+            && modifiers[runEnd]->applyOnInputRect (inIm, remap.x0, remap.y0, remap.outWidth, remap.outHeight, *output))
+        {
+            ++runEnd;
+        }
+        else
+        {
+            if (remap.isCrop())
+            {
+                output->cpuData = ImageSRGBA::makeView (input->cpuData, remap.x0, remap.y0, remap.outWidth, remap.outHeight);
+            }
+            else
+            {
+                output->cpuData = std::make_shared<ImageSRGBA>();
+                remapPixels (inIm, remap, *output->cpuData);
+            }
+            output->status = ImageItemData::Status::Ready;
+        }
+
+        // The intermediate keys of the run chain up without their outputs.
+        int64_t runInputContentId = input->contentId;
+        for (size_t k = i; k + 1 < runEnd; ++k)
+        {
+            uint64_t key = 0;
+            if (!ModifierCache::computeKey (runInputContentId, *modifiers[k], key))
+                break;
+            runInputContentId = int64_t(key);
+        }
+        modifiers[runEnd - 1]->_outputData = output;
+        if (useCache)
+            cacheModifierOutput (runInputContentId, *modifiers[runEnd - 1]);
+        i = runEnd;
+        input = output;
+    }
+}
+
+// Input of the given modifier, can be null when skipped by a fused pass.
+const ImageItemDataPtr& ModifiedImage::modifierInput (size_t modifierIdx) const
+{
+    if (modifierIdx == 0)
+        return _originalData;
+    return _modifiers[modifierIdx - 1]->output();
+}
+
+// The output contentId becomes the cache key, so the following modifiers
+// can get cached too.
+void ModifiedImage::cacheModifierOutput (int64_t inputContentId, ImageModifier& modifier)
+{
+    uint64_t key = 0;
+    if (!modifier._outputData || !ModifierCache::computeKey (inputContentId, modifier, key))
+        return;
+    modifier._outputData->contentId = int64_t(key);
+    ModifierCache::instance().insert (key, modifier._outputData);
+}
+
+// Output of a newly added modifier, from the cache, partially or right
+// away. Returns true if the full output is left to the background.
+bool ModifiedImage::evaluateModifier (size_t modifierIdx)
+{
+    ImageModifier& modifier = *_modifiers[modifierIdx];
+    const ImageItemDataPtr input = modifierInput (modifierIdx);
+
+    uint64_t cacheKey = 0;
+    ImageItemDataPtr cachedOutput;
+    if (ModifierCache::computeKey (input->contentId, modifier, cacheKey))
+        cachedOutput = ModifierCache::instance().find (cacheKey);
+
+    if (cachedOutput)
+    {
+        modifier._outputData = cachedOutput;
+        return false;
+    }
+
+    if (startPartialEvaluation (modifierIdx))
+        return true;
+
+    modifier.apply (input, _annotationRenderer);
+    cacheModifierOutput (input->contentId, modifier);
+    return false;
+}
+
+// When zoomed on a large image, first computes only the visible region
+// of the new output and leaves the rest to the background worker.
+bool ModifiedImage::startPartialEvaluation (size_t modifierIdx)
+{
+    const double visibleArea = _visibleRegion.size.x * _visibleRegion.size.y;
+    if (visibleArea > 0.99)
+        return false;
+
+    ImageModifier& modifier = *_modifiers[modifierIdx];
+    const ImageItemDataPtr input = modifierInput (modifierIdx);
+    int fullW = 0, fullH = 0;
+    if (!modifier.outputSize (input->width(), input->height(), fullW, fullH))
+        return false;
+
+    if (int64_t(fullW)*fullH < MinPixelsForPartialEvaluation)
+        return false;
+
+    // Round the visible region outwards, with a margin for small pans.
+    const int margin = 16;
+    const int x0 = std::max(int(std::floor(_visibleRegion.origin.x * fullW)) - margin, 0);
+    const int y0 = std::max(int(std::floor(_visibleRegion.origin.y * fullH)) - margin, 0);
+    const int x1 = std::min(int(std::ceil((_visibleRegion.origin.x + _visibleRegion.size.x) * fullW)) + margin, fullW);
+    const int y1 = std::min(int(std::ceil((_visibleRegion.origin.y + _visibleRegion.size.y) * fullH)) + margin, fullH);
+    if (x1 <= x0 || y1 <= y0)
+        return false;
+
+    // The task works on its own copies, so dropping it never waits. Only
+    // the annotations use the renderer, and they can't be cloned.
+    std::shared_ptr<ImageModifier> modifierCopy = modifier.clone ();
+    if (!modifierCopy)
+        return false;
+
+    auto partialData = std::make_shared<ImageItemData>();
+    if (!modifier.applyOnOutputRect (*input, x0, y0, x1 - x0, y1 - y0, *partialData))
+        return false;
+
+    modifier._outputData = partialData;
+    _partialOutput.uvRect = Rect::from_x_y_w_h (x0 / double(fullW), y0 / double(fullH),
+                                                (x1 - x0) / double(fullW), (y1 - y0) / double(fullH));
+    _partialOutput.fullWidth = fullW;
+    _partialOutput.fullHeight = fullH;
+
+    const ImageItemDataPtr inputPixels = input->pixelDataCopy ();
+    AnnotationRenderer* renderer = &_annotationRenderer;
+    _pendingOutput = modifierWorker().compute<ImageItemDataPtr> ([modifierCopy, inputPixels, renderer]() {
+        auto output = std::make_shared<ImageItemData>();
+        modifierCopy->apply (*inputPixels, *output, *renderer);
+        return ImageItemDataPtr(output);
+    });
+    _pendingModifierIdx = modifierIdx;
+    return true;
+}
+
+// Takes the full output once computed, then evaluates the modifiers
+// added in the meantime. These can start a new partial evaluation.
+bool ModifiedImage::finishPendingOutput ()
+{
+    if (!_pendingOutput || !_pendingOutput->isReady())
+        return false;
+
+    const size_t modifierIdx = _pendingModifierIdx;
+    ImageModifier& modifier = *_modifiers[modifierIdx];
+    modifier._outputData = _pendingOutput->value();
+    dropPendingOutput ();
+    cacheModifierOutput (modifierInput (modifierIdx)->contentId, modifier);
+
+    for (size_t i = modifierIdx + 1; i < _modifiers.size(); ++i)
+    {
+        if (evaluateModifier (i))
+            break;
+    }
+    return true;
+}
+
+// The superseded outputs are not waited for, the worker skips them or
+// publishes into nothing.
+void ModifiedImage::dropPendingOutput ()
+{
+    _pendingOutput.reset ();
+    _partialOutput = {};
+}
+
+void ModifiedImage::completePendingOutput ()
+{
+    if (!_pendingOutput)
+        return;
+
+    if (!finishPendingOutput () || _pendingOutput)
+    {
+        const size_t modifierIdx = _pendingModifierIdx;
+        dropPendingOutput ();
+        evaluateModifiers (_modifiers, modifierIdx, modifierInput (modifierIdx), _annotationRenderer, true /* use cache */);
+    }
+    _modifiersChangedSinceLastUpdate = true;
+}
+
 void ModifiedImage::clearIntermediateModifiersData ()
 {
     if (_modifiers.size() < 2)
@@ -128,77 +579,120 @@ namespace zv
 
 void RotateImageModifier::apply (const ImageItemData& input, ImageItemData& output, AnnotationRenderer&)
 {
-    const auto& inIm = (*input.cpuData);
-    const int inW = inIm.width();
-    const int inH = inIm.height();
-
-    if (_angle == Angle::Angle_90) // Rotate Right
-    {
-        output.cpuData = std::make_shared<ImageSRGBA>(inH, inW);
-        auto& outIm = *output.cpuData;
-        const int outW = outIm.width();
-        const int outH = outIm.height();
-        for (int r = 0; r < outH; ++r)
-        {
-            PixelSRGBA* rowPtr = outIm.atRowPtr(r);
-            for (int c = 0; c < outW; ++c)
-            {
-                const int rowInIn = inH-c-1;
-                const int colInIn = r;
-                rowPtr[c] = inIm(colInIn, rowInIn);
-            }
-        }
-    }
-    else if (_angle == Angle::Angle_270) // Rotate Left
+    const auto& inIm = input.srgbaData();
+    output.cpuData = std::make_shared<ImageSRGBA>();
+    switch (_angle)
     {
-        output.cpuData = std::make_shared<ImageSRGBA>(inH, inW);
-        auto& outIm = *output.cpuData;
-        const int outW = outIm.width();
-        const int outH = outIm.height();
-        for (int r = 0; r < outH; ++r)
-        {
-            PixelSRGBA* rowPtr = outIm.atRowPtr(r);
-            for (int c = 0; c < outW; ++c)
-            {
-                const int rowInIn = c;
-                const int colInIn = inW-r-1;
-                rowPtr[c] = inIm(colInIn, rowInIn);
-            }
-        }
+        case Angle::Angle_90: rotate90 (inIm, *output.cpuData); break; // Rotate Right
+        case Angle::Angle_180: rotate180 (inIm, *output.cpuData); break; // Upside down
+        case Angle::Angle_270: rotate270 (inIm, *output.cpuData); break; // Rotate Left
     }
-    else if (_angle == Angle::Angle_180) // Upside down
+
+    output.textureData = {};
+    output.status = ImageItemData::Status::Ready;
+}
+
+bool ImageModifier::outputSize (int inputWidth, int inputHeight, int& outputWidth, int& outputHeight) const
+{
+    PixelRemap remap;
+    if (!pixelRemap (inputWidth, inputHeight, remap))
+        return false;
+    outputWidth = remap.outWidth;
+    outputHeight = remap.outHeight;
+    return true;
+}
+
+bool ImageModifier::applyOnOutputRect (const ImageItemData& input, int x0, int y0, int width, int height,
+                                       ImageItemData& output)
+{
+    const auto& inIm = input.srgbaData();
+    PixelRemap remap;
+    if (!pixelRemap (inIm.width(), inIm.height(), remap))
+        return false;
+
+    output.cpuData = std::make_shared<ImageSRGBA>();
+    remapPixels (inIm, remap.then (PixelRemap::crop (x0, y0, width, height)), *output.cpuData);
+    output.textureData = {};
+    output.status = ImageItemData::Status::Ready;
+    return true;
+}
+
+bool RotateImageModifier::pixelRemap (int inputWidth, int inputHeight, PixelRemap& remap) const
+{
+    switch (_angle)
     {
-        output.cpuData = std::make_shared<ImageSRGBA>(inW, inH);
-        auto& outIm = *output.cpuData;
-        for (int r = 0; r < inH; ++r)
-        {
-            PixelSRGBA* outRowPtr = outIm.atRowPtr(r);
-            const PixelSRGBA* inRowPtr = inIm.atRowPtr(inH-r-1);
-            for (int c = 0; c < inW; ++c)
-            {
-                outRowPtr[c] = inRowPtr[inW-c-1];
-            }
-        }
+        case Angle::Angle_90: remap = PixelRemap::rotate90 (inputWidth, inputHeight); break;
+        case Angle::Angle_180: remap = PixelRemap::rotate180 (inputWidth, inputHeight); break;
+        case Angle::Angle_270: remap = PixelRemap::rotate270 (inputWidth, inputHeight); break;
     }
+    return true;
+}
+
+bool RotateImageModifier::hashParams (uint64_t& hash) const
+{
+    hash = hashCombine (1 /* kind */, uint64_t(_angle));
+    return true;
+}
+
+void FlipImageModifier::apply (const ImageItemData& input, ImageItemData& output, AnnotationRenderer&)
+{
+    const auto& inIm = input.srgbaData();
+    output.cpuData = std::make_shared<ImageSRGBA>();
+    if (_direction == Direction::Horizontal)
+        flipHorizontal (inIm, *output.cpuData);
+    else
+        flipVertical (inIm, *output.cpuData);
 
     output.textureData = {};
     output.status = ImageItemData::Status::Ready;
 }
 
+bool FlipImageModifier::pixelRemap (int inputWidth, int inputHeight, PixelRemap& remap) const
+{
+    if (_direction == Direction::Horizontal)
+        remap = PixelRemap::flipHorizontal (inputWidth, inputHeight);
+    else
+        remap = PixelRemap::flipVertical (inputWidth, inputHeight);
+    return true;
+}
+
+bool FlipImageModifier::hashParams (uint64_t& hash) const
+{
+    hash = hashCombine (2 /* kind */, uint64_t(_direction));
+    return true;
+}
+
 void CropImageModifier::apply (const ImageItemData& input, ImageItemData& output, AnnotationRenderer&)
 {
-    const auto& inIm = (*input.cpuData);
-    const int inW = inIm.width();
-    const int inH = inIm.height();
+    // Make sure cpuData is filled for native images.
+    const auto& inIm = input.srgbaData();
+    Rect rect = _params.validImageRectForSize (inIm.width(), inIm.height());
     
-    Rect rect = _params.validImageRectForSize (inW, inH);
-    
-    output.cpuData = std::make_shared<ImageSRGBA>();
-    *output.cpuData = crop (inIm, rect);
+    // O(1), the output shares the input pixels.
+    output.cpuData = ImageSRGBA::makeView (input.cpuData,
+                                           int(rect.origin.x), int(rect.origin.y),
+                                           int(rect.size.x), int(rect.size.y));
     output.textureData = {};
     output.status = ImageItemData::Status::Ready;
 }
 
+bool CropImageModifier::pixelRemap (int inputWidth, int inputHeight, PixelRemap& remap) const
+{
+    const Rect rect = _params.validImageRectForSize (inputWidth, inputHeight);
+    remap = PixelRemap::crop (int(rect.origin.x), int(rect.origin.y), int(rect.size.x), int(rect.size.y));
+    return true;
+}
+
+bool CropImageModifier::hashParams (uint64_t& hash) const
+{
+    hash = 3 /* kind */;
+    hash = hashCombine (hash, hashDouble(_params.textureRect.origin.x));
+    hash = hashCombine (hash, hashDouble(_params.textureRect.origin.y));
+    hash = hashCombine (hash, hashDouble(_params.textureRect.size.x));
+    hash = hashCombine (hash, hashDouble(_params.textureRect.size.y));
+    return true;
+}
+
 Rect CropImageModifier::Params::imageAlignedTextureRect (int width, int height) const
 {
     Rect rounded;
@@ -220,11 +714,12 @@ Rect CropImageModifier::Params::validImageRectForSize(int width, int height) con
 {
     Rect alignedRect = imageAlignedTextureRect(width, height);
     alignedRect.scale (width, height);
-    alignedRect.origin.x = keepInRange(alignedRect.origin.x, 0., width-2.);
-    alignedRect.origin.y = keepInRange(alignedRect.origin.y, 0., height-2.);
+    alignedRect.origin.x = keepInRange(alignedRect.origin.x, 0., width-1.);
+    alignedRect.origin.y = keepInRange(alignedRect.origin.y, 0., height-1.);
+    // bottomRight is exclusive, it can reach the image size.
     Point br = alignedRect.bottomRight();
-    br.x = keepInRange(br.x, alignedRect.origin.x + 1., width - 1.);
-    br.y = keepInRange(br.y, alignedRect.origin.y + 1., height - 1.);
+    br.x = keepInRange(br.x, alignedRect.origin.x + 1., double(width));
+    br.y = keepInRange(br.y, alignedRect.origin.y + 1., double(height));
     alignedRect.size.x = br.x - alignedRect.origin.x;
     alignedRect.size.y = br.y - alignedRect.origin.y;
     return alignedRect;
@@ -257,22 +752,62 @@ void CropImageModifier::Params::updateControlPoint (int idx, const Point& p, int
 
 void ResizeImageModifier::apply (const ImageItemData& input, ImageItemData& output, AnnotationRenderer&)
 {
-    const auto& inIm = (*input.cpuData);
-    const int inW = inIm.width();
-    const int inH = inIm.height();
+    const auto& inIm = input.srgbaData();
+    applyOnInputRect (inIm, 0, 0, inIm.width(), inIm.height(), output);
+}
+
+bool ResizeImageModifier::applyOnInputRect (const ImageSRGBA& inIm, int x0, int y0, int inW, int inH,
+                                            ImageItemData& output)
+{
+    ResampleGeometry geometry;
+    geometry.inputX0 = x0;
+    geometry.inputY0 = y0;
+    geometry.inputWidth = inW;
+    geometry.inputHeight = inH;
+    geometry.outputWidth = _params.targetWidth;
+    geometry.outputHeight = _params.targetHeight;
 
     output.cpuData = std::make_shared<ImageSRGBA>(_params.targetWidth, _params.targetHeight);
-    auto& outIm = *output.cpuData;
-    const int outW = outIm.width();
-    const int outH = outIm.height();
+    resampleImage (inIm, geometry, _params.filter, *output.cpuData);
+    output.textureData = {};
+    output.status = ImageItemData::Status::Ready;
+    return true;
+}
 
-    // Resize the image using stb
-    stbir_resize_uint8_srgb((const unsigned char*)inIm.rawBytes(), inW, inH, inIm.bytesPerRow(),
-                            (unsigned char*)outIm.data(), outW, outH, outIm.bytesPerRow(),
-                            4, 3, 0);
+bool ResizeImageModifier::outputSize (int, int, int& outputWidth, int& outputHeight) const
+{
+    outputWidth = _params.targetWidth;
+    outputHeight = _params.targetHeight;
+    return true;
+}
 
+bool ResizeImageModifier::hashParams (uint64_t& hash) const
+{
+    hash = hashCombine (4 /* kind */, uint64_t(_params.targetWidth));
+    hash = hashCombine (hash, uint64_t(_params.targetHeight));
+    hash = hashCombine (hash, uint64_t(_params.filter));
+    return true;
+}
+
+bool ResizeImageModifier::applyOnOutputRect (const ImageItemData& input, int x0, int y0, int width, int height,
+                                             ImageItemData& output)
+{
+    const auto& inIm = input.srgbaData();
+
+    // Same weights as the full output, so the rect is exact.
+    ResampleGeometry geometry;
+    geometry.inputWidth = inIm.width();
+    geometry.inputHeight = inIm.height();
+    geometry.outputWidth = _params.targetWidth;
+    geometry.outputHeight = _params.targetHeight;
+    geometry.outputX0 = x0;
+    geometry.outputY0 = y0;
+
+    output.cpuData = std::make_shared<ImageSRGBA>(width, height);
+    resampleImage (inIm, geometry, _params.filter, *output.cpuData);
     output.textureData = {};
     output.status = ImageItemData::Status::Ready;
+    return true;
 }
 
 } // zv
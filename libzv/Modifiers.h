@@ -6,8 +6,11 @@
 
 #pragma once
 
+#include <libzv/BackgroundWorker.h>
 #include <libzv/ImageList.h>
 #include <libzv/MathUtils.h>
+#include <libzv/ImageTransforms.h>
+#include <libzv/Resampler.h>
 
 #include <deque>
 
@@ -35,16 +38,84 @@ public:
 
     void clearTextureData ()
     {
-        _outputData->textureData = {};
+        if (_outputData)
+            _outputData->textureData = {};
     }
 
+    // Lossless geometric modifiers can be expressed as a pixel remap of
+    // their input. Consecutive ones then get evaluated in a single pass.
+    virtual bool pixelRemap (int inputWidth, int inputHeight, PixelRemap& remap) const { return false; }
+
+    // Copy with the same parameters, without the output. Null for the
+    // modifiers that can't be applied to other images, like annotations.
+    virtual std::unique_ptr<ImageModifier> clone () const { return nullptr; }
+
+    // Hash of the parameters, including the kind of modifier. The outputs
+    // of the modifiers that provide one are cached, see ModifierCache.
+    virtual bool hashParams (uint64_t& hash) const { return false; }
+
+    // Size of the output, when it is known without applying the modifier.
+    virtual bool outputSize (int inputWidth, int inputHeight, int& outputWidth, int& outputHeight) const;
+
+    // Computes only the given rectangle of the output. Used to show the
+    // visible region right away when the full output takes a while.
+    virtual bool applyOnOutputRect (const ImageItemData& input, int x0, int y0, int width, int height,
+                                    ImageItemData& output);
+
+    // Resampling modifiers that can read a sub-rectangle of their input
+    // directly, so a crop before them does not need to be materialized.
+    virtual bool applyOnInputRect (const ImageSRGBA& input, int x0, int y0, int width, int height,
+                                   ImageItemData& output) { return false; }
+
 protected:
     virtual void apply (const ImageItemData& input, ImageItemData& output, AnnotationRenderer& annotationRenderer) = 0;
 
 private:
+    friend struct ModifiedImage;
+    // Intermediate outputs of a fused pass are left empty.
     ImageItemDataPtr _outputData;
 };
 
+// Outputs of the modifiers, keyed by a hash of the input contentId and of
+// the modifier parameters. The key is also the contentId of the output,
+// so the keys of a whole pipeline chain up. Shared by all the images, so
+// undoing and re-applying the same operations reuse the results. The
+// least recently used entries get evicted above the memory budget.
+class ModifierCache
+{
+public:
+    struct Stats
+    {
+        int64_t hits = 0;
+        int64_t misses = 0;
+        int64_t evictions = 0;
+        int numEntries = 0;
+        size_t numBytes = 0;
+    };
+
+public:
+    static ModifierCache& instance ();
+
+    static bool computeKey (int64_t inputContentId, const ImageModifier& modifier, uint64_t& key);
+
+public:
+    ModifierCache (size_t maxBytes);
+    ~ModifierCache ();
+
+    // Only the pixels are kept, see ImageItemData::pixelDataCopy. find
+    // returns a new item sharing them.
+    ImageItemDataPtr find (uint64_t key);
+    void insert (uint64_t key, const ImageItemDataPtr& data);
+
+    void setMaxBytes (size_t maxBytes);
+    void clear ();
+    Stats stats () const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
 class ImageAction
 {
 public:
@@ -73,8 +144,9 @@ private:
     UndoFunc _undoFunc;
 };
 
-// Image currently active in the viewer, maybe modified.
-struct ModifiedImage
+// Image currently active in the viewer, maybe modified. Always created
+// with make_shared, the completed saves only hold a weak reference.
+struct ModifiedImage : public std::enable_shared_from_this<ModifiedImage>
 {
     ModifiedImage(AnnotationRenderer& renderer,
                   const ImageItemPtr& item,
@@ -90,8 +162,12 @@ struct ModifiedImage
 
     bool canUndo () const { return !_actions.empty(); }
 
+    // The modifiers added while a full output is pending have no output
+    // yet, data() stays the partial one until then.
     const ImageItemDataPtr& data() const 
     {
+        if (_pendingOutput)
+            return _modifiers[_pendingModifierIdx]->output();
         if (!_modifiers.empty()) 
             return _modifiers.back()->output();
         return _originalData;
@@ -105,12 +181,57 @@ struct ModifiedImage
     void addModifier (std::unique_ptr<ImageModifier> modifier);
     void removeLastModifier();
 
+    // Region of the output currently shown by the window, in uv.
+    void setVisibleRegion (const Rect& uvRect) { _visibleRegion = uvRect; }
+
+    // When only the visible region of the last modifier output is
+    // available, while the full output gets computed in the background.
+    // data() is then the partial output, covering uvRect.
+    struct PartialOutput
+    {
+        Rect uvRect;
+        int fullWidth = 0;
+        int fullHeight = 0;
+    };
+    const PartialOutput* partialOutput () const { return _pendingOutput ? &_partialOutput : nullptr; }
+
+    // Size of the output, also valid with a partial output.
+    int width () const { return _pendingOutput ? _partialOutput.fullWidth : data()->width(); }
+    int height () const { return _pendingOutput ? _partialOutput.fullHeight : data()->height(); }
+
+    // Computes the pending outputs right here, for the saves.
+    void completePendingOutput ();
+
+    // Copies of the current modifiers, to apply them to other images.
+    // Returns false if one of them can't be cloned.
+    bool cloneModifiers (std::deque<std::unique_ptr<ImageModifier>>& modifiers) const;
+
+    // Output of the given modifiers on input, with the same fused passes
+    // as reapplyModifiers but without going through the cache.
+    static ImageItemDataPtr applyModifiers (const ImageItemDataPtr& input,
+                                            std::deque<std::unique_ptr<ImageModifier>>& modifiers,
+                                            AnnotationRenderer& annotationRenderer);
+
+    // The file gets written in the background by the ImageWriter. The
+    // changes are only folded into the original data once the write
+    // succeeded. Returns false if there is nothing to save.
     bool saveChanges (const std::string& outputPath);
     void discardChanges ();
     void undoLastChange ();
 
 private:
     void clearIntermediateModifiersData ();
+    void reapplyModifiers ();
+    bool evaluateModifier (size_t modifierIdx);
+    bool startPartialEvaluation (size_t modifierIdx);
+    const ImageItemDataPtr& modifierInput (size_t modifierIdx) const;
+    static void evaluateModifiers (std::deque<std::unique_ptr<ImageModifier>>& modifiers, size_t firstModifier,
+                                   ImageItemDataPtr input, AnnotationRenderer& annotationRenderer, bool useCache);
+    static void cacheModifierOutput (int64_t inputContentId, ImageModifier& modifier);
+    bool finishPendingOutput ();
+    void dropPendingOutput ();
+    void foldSavedModifiers (const ImageItemDataPtr& savedData, size_t numSavedModifiers,
+                             const ImageModifier* lastSavedModifier);
 
 private:
     ImageItemPtr _item;
@@ -119,6 +240,13 @@ private:
     std::deque<std::unique_ptr<ImageModifier>> _modifiers;
     std::deque<ImageAction> _actions;
     bool _modifiersChangedSinceLastUpdate = false;
+
+    Rect _visibleRegion = Rect::from_x_y_w_h (0, 0, 1, 1);
+    PartialOutput _partialOutput;
+    // Full output of _modifiers[_pendingModifierIdx], the following
+    // modifiers get evaluated once it is there.
+    AsyncResultPtr<ImageItemDataPtr> _pendingOutput;
+    size_t _pendingModifierIdx = 0;
 };
 using ModifiedImagePtr = std::shared_ptr<ModifiedImage>;
 
@@ -136,11 +264,35 @@ public:
 
 public:
     virtual void apply (const ImageItemData& input, ImageItemData& output, AnnotationRenderer&) override;
+    virtual bool pixelRemap (int inputWidth, int inputHeight, PixelRemap& remap) const override;
+    virtual bool hashParams (uint64_t& hash) const override;
+    virtual std::unique_ptr<ImageModifier> clone () const override { return std::make_unique<RotateImageModifier>(_angle); }
 
 private:
     Angle _angle = Angle::Angle_90;
 };
 
+class FlipImageModifier : public ImageModifier
+{
+public:
+    enum class Direction {
+        Horizontal, // mirror around the vertical axis
+        Vertical,
+    };
+
+    FlipImageModifier (Direction direction) : _direction (direction)
+    {}
+
+public:
+    virtual void apply (const ImageItemData& input, ImageItemData& output, AnnotationRenderer&) override;
+    virtual bool pixelRemap (int inputWidth, int inputHeight, PixelRemap& remap) const override;
+    virtual bool hashParams (uint64_t& hash) const override;
+    virtual std::unique_ptr<ImageModifier> clone () const override { return std::make_unique<FlipImageModifier>(_direction); }
+
+private:
+    Direction _direction = Direction::Horizontal;
+};
+
 class CropImageModifier : public ImageModifier
 {
 public:
@@ -167,6 +319,9 @@ public:
 
 public:
     virtual void apply (const ImageItemData& input, ImageItemData& output, AnnotationRenderer&) override;
+    virtual bool pixelRemap (int inputWidth, int inputHeight, PixelRemap& remap) const override;
+    virtual bool hashParams (uint64_t& hash) const override;
+    virtual std::unique_ptr<ImageModifier> clone () const override { return std::make_unique<CropImageModifier>(_params); }
 
 private:
     Params _params;
@@ -180,15 +335,25 @@ public:
     {
         int targetWidth = -1;
         int targetHeight = -1;
+        ResampleFilter filter = ResampleFilter::Lanczos3;
     };
 
-    ResizeImageModifier (int targetWidth, int targetHeight) : _params ({targetWidth, targetHeight})
+    ResizeImageModifier (int targetWidth, int targetHeight, ResampleFilter filter = ResampleFilter::Lanczos3)
+    : _params ({targetWidth, targetHeight, filter})
     {}
 
     const Params& params () const { return _params; }
 
 public:
     virtual void apply (const ImageItemData& input, ImageItemData& output, AnnotationRenderer&) override;
+    virtual bool applyOnInputRect (const ImageSRGBA& input, int x0, int y0, int width, int height,
+                                   ImageItemData& output) override;
+    virtual bool outputSize (int inputWidth, int inputHeight, int& outputWidth, int& outputHeight) const override;
+    virtual bool hashParams (uint64_t& hash) const override;
+    virtual bool applyOnOutputRect (const ImageItemData& input, int x0, int y0, int width, int height,
+                                    ImageItemData& output) override;
+    virtual std::unique_ptr<ImageModifier> clone () const override
+    { return std::make_unique<ResizeImageModifier>(_params.targetWidth, _params.targetHeight, _params.filter); }
 
 private:
     Params _params;
@@ -0,0 +1,170 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "NativeImage.h"
+
+#include <libzv/Utils.h>
+
+#include <cmath>
+#include <limits>
+
+namespace zv
+{
+
+int NativeImage::numChannels (Format format)
+{
+    switch (format)
+    {
+        case Format::Gray8:
+        case Format::Gray16:
+        case Format::GrayFloat:
+            return 1;
+        case Format::RGBA16:
+        case Format::RGBAFloat:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+int NativeImage::bytesPerChannel (Format format)
+{
+    switch (format)
+    {
+        case Format::Gray8:
+            return 1;
+        case Format::Gray16:
+        case Format::RGBA16:
+            return 2;
+        case Format::GrayFloat:
+        case Format::RGBAFloat:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+NativeImage::NativeImage (Format format, const uint8_t* data, int width, int height, int bytesPerRow)
+: _format (format),
+  _width (width),
+  _height (height)
+{
+    zv_assert (format != Format::Invalid, "Invalid format");
+    const int rowSizeInBytes = width * bytesPerPixel();
+    _bytes = Image<uint8_t>(rowSizeInBytes, height);
+    _bytes.copyDataFrom (data, bytesPerRow, rowSizeInBytes, height);
+    computeValueRange ();
+}
+
+void NativeImage::computeValueRange ()
+{
+    if (!isFloat())
+    {
+        _minValue = 0.f;
+        _maxValue = maxIntegerValue();
+        return;
+    }
+
+    // Alpha is not included.
+    const int numColorChannels = std::min(numChannels(), 3);
+    float minV = std::numeric_limits<float>::max();
+    float maxV = std::numeric_limits<float>::lowest();
+    for (int r = 0; r < _height; ++r)
+    {
+        const float* rowPtr = reinterpret_cast<const float*>(atRowPtr(r));
+        for (int c = 0; c < _width; ++c)
+        for (int k = 0; k < numColorChannels; ++k)
+        {
+            const float v = rowPtr[c*numChannels() + k];
+            if (!std::isfinite(v))
+                continue;
+            minV = std::min(minV, v);
+            maxV = std::max(maxV, v);
+        }
+    }
+
+    _minValue = std::min(minV, 0.f);
+    _maxValue = std::max(maxV, 1.f);
+}
+
+void NativeImage::getPixel (int c, int r, float values[4]) const
+{
+    const int n = numChannels();
+    switch (_format)
+    {
+        case Format::Gray8:
+        {
+            values[0] = atRowPtr(r)[c];
+            break;
+        }
+
+        case Format::Gray16:
+        case Format::RGBA16:
+        {
+            const uint16_t* pixelPtr = reinterpret_cast<const uint16_t*>(atRowPtr(r)) + c*n;
+            for (int k = 0; k < n; ++k)
+                values[k] = pixelPtr[k];
+            break;
+        }
+
+        case Format::GrayFloat:
+        case Format::RGBAFloat:
+        {
+            const float* pixelPtr = reinterpret_cast<const float*>(atRowPtr(r)) + c*n;
+            for (int k = 0; k < n; ++k)
+                values[k] = pixelPtr[k];
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+std::string NativeImage::formattedPixel (int c, int r) const
+{
+    float values[4] = {0,0,0,0};
+    getPixel (c, r, values);
+    if (numChannels() == 1)
+        return formatted("%.5g", values[0]);
+    return formatted("%.4g %.4g %.4g %.4g", values[0], values[1], values[2], values[3]);
+}
+
+PixelSRGBA NativeImage::srgbaPixel (int c, int r) const
+{
+    float values[4] = {0,0,0,0};
+    getPixel (c, r, values);
+
+    const float scale = 255.f / std::max(_maxValue - _minValue, 1e-10f);
+    auto toUint8 = [&](float v) -> uint8_t {
+        return uint8_t(keepInRange((v - _minValue) * scale + 0.5f, 0.f, 255.f));
+    };
+
+    if (numChannels() == 1)
+    {
+        const uint8_t v = toUint8(values[0]);
+        return PixelSRGBA(v, v, v, 255);
+    }
+
+    // Alpha is not affected by the value range.
+    const float alphaScale = isFloat() ? 255.f : 255.f / 65535.f;
+    const uint8_t alpha = uint8_t(keepInRange(values[3] * alphaScale + 0.5f, 0.f, 255.f));
+    return PixelSRGBA(toUint8(values[0]), toUint8(values[1]), toUint8(values[2]), alpha);
+}
+
+ImageSRGBA NativeImage::toSRGBA () const
+{
+    ImageSRGBA output (_width, _height);
+    for (int r = 0; r < _height; ++r)
+    {
+        PixelSRGBA* outRowPtr = output.atRowPtr(r);
+        for (int c = 0; c < _width; ++c)
+            outRowPtr[c] = srgbaPixel (c, r);
+    }
+    return output;
+}
+
+} // zv
@@ -0,0 +1,86 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Image.h>
+
+#include <memory>
+#include <cstdint>
+
+namespace zv
+{
+
+// Pixel data kept in its original format, so high bit-depth and float
+// images don't get quantized to 8 bits before display. The GPU does
+// the normalization, the 8-bit sRGB version is only computed for the
+// CPU code paths that need it.
+class NativeImage
+{
+public:
+    enum class Format
+    {
+        Invalid,
+        Gray8,
+        Gray16,
+        GrayFloat,
+        RGBA16,
+        RGBAFloat,
+    };
+
+    static int numChannels (Format format);
+    static int bytesPerChannel (Format format);
+
+public:
+    NativeImage () = default;
+
+    // Copies the data.
+    NativeImage (Format format, const uint8_t* data, int width, int height, int bytesPerRow);
+
+    Format format () const { return _format; }
+    int width () const { return _width; }
+    int height () const { return _height; }
+    bool hasData () const { return _width > 0 && _height > 0; }
+
+    int numChannels () const { return numChannels(_format); }
+    bool isFloat () const { return _format == Format::GrayFloat || _format == Format::RGBAFloat; }
+    int bytesPerPixel () const { return numChannels() * bytesPerChannel(_format); }
+
+    const uint8_t* rawBytes () const { return _bytes.rawBytes(); }
+    size_t bytesPerRow () const { return _bytes.bytesPerRow(); }
+    const uint8_t* atRowPtr (int r) const { return _bytes.atRowPtr(r); }
+
+    // Original values. Gray images only fill the first one.
+    void getPixel (int c, int r, float values[4]) const;
+    std::string formattedPixel (int c, int r) const;
+
+    // Values mapped to [0,1] for display. Integer formats use their full
+    // range, float ones [0,1] extended to the actual min/max of the data.
+    // Integer textures are sampled as normalized values, so the same range
+    // on the GPU is divided by maxIntegerValue.
+    float minValue () const { return _minValue; }
+    float maxValue () const { return _maxValue; }
+    float maxIntegerValue () const { return bytesPerChannel(_format) == 1 ? 255.f : 65535.f; }
+
+    // Only meant for the CPU consumers (modifiers, saving, clipboard).
+    ImageSRGBA toSRGBA () const;
+    PixelSRGBA srgbaPixel (int c, int r) const;
+
+private:
+    void computeValueRange ();
+
+private:
+    Format _format = Format::Invalid;
+    int _width = 0;
+    int _height = 0;
+    // One byte per element, width is in bytes.
+    Image<uint8_t> _bytes;
+    float _minValue = 0.f;
+    float _maxValue = 1.f;
+};
+using NativeImagePtr = std::shared_ptr<NativeImage>;
+
+} // zv
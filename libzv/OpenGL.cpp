@@ -9,13 +9,18 @@
 #include <libzv/Platform.h>
 #include <libzv/Utils.h>
 #include <libzv/OpenGL_Shaders.h>
+#include <libzv/NativeImage.h>
 
 #include <gl3w/GL/gl3w.h>
 #include <GLFW/glfw3.h>
 
+#include "imgui.h"
+
 #include <vector>
 #include <array>
 #include <numeric>
+#include <cmath>
+#include <algorithm>
 
 namespace zv
 {
@@ -179,6 +184,168 @@ void GLShader::disable ()
     impl->prevHandle = 0;
 }
 
+int32_t GLShader::uniformLocation (const char* name) const
+{
+    return glGetUniformLocation(_glHandles.shaderHandle, name);
+}
+
+} // zv
+
+// --------------------------------------------------------------------------------
+// GLDisplayShader
+// --------------------------------------------------------------------------------
+
+namespace zv
+{
+
+void GLDisplayShader::initializeGL ()
+{
+    _shader.initialize (glslVersion(), imguiVertexShader_glsl_130, fragmentShader_Display_glsl_130);
+    _uniforms.projMtx = _shader.uniformLocation ("ProjMtx");
+    _uniforms.inputMin = _shader.uniformLocation ("InputMin");
+    _uniforms.inputMax = _shader.uniformLocation ("InputMax");
+    _uniforms.singleChannelInput = _shader.uniformLocation ("SingleChannelInput");
+    _uniforms.referenceTexture = _shader.uniformLocation ("ReferenceTexture");
+    _uniforms.referenceInputMin = _shader.uniformLocation ("ReferenceInputMin");
+    _uniforms.referenceInputMax = _shader.uniformLocation ("ReferenceInputMax");
+    _uniforms.referenceSingleChannelInput = _shader.uniformLocation ("ReferenceSingleChannelInput");
+    _uniforms.diffMode = _shader.uniformLocation ("DiffMode");
+    _uniforms.minLevel = _shader.uniformLocation ("MinLevel");
+    _uniforms.maxLevel = _shader.uniformLocation ("MaxLevel");
+    _uniforms.exposureScale = _shader.uniformLocation ("ExposureScale");
+    _uniforms.invGamma = _shader.uniformLocation ("InvGamma");
+    _uniforms.channel = _shader.uniformLocation ("Channel");
+    _uniforms.colormap = _shader.uniformLocation ("Colormap");
+    _uniforms.useColormap = _shader.uniformLocation ("UseColormap");
+    _uniforms.cvdMode = _shader.uniformLocation ("CvdMode");
+    _uniforms.cvdRgbFromRgb1 = _shader.uniformLocation ("CvdRgbFromRgb1");
+    _uniforms.cvdRgbFromRgb2 = _shader.uniformLocation ("CvdRgbFromRgb2");
+    _uniforms.cvdSeparationNormal = _shader.uniformLocation ("CvdSeparationNormal");
+    _uniforms.cvdSeverity = _shader.uniformLocation ("CvdSeverity");
+    checkGLError ();
+}
+
+void GLDisplayShader::releaseGL ()
+{
+    for (auto& textureId : _colormapTextures)
+    {
+        if (textureId != 0)
+        {
+            glDeleteTextures(1, &textureId);
+            textureId = 0;
+        }
+    }
+}
+
+uint32_t GLDisplayShader::colormapTexture (Colormap colormap)
+{
+    GLuint& textureId = _colormapTextures[(int)colormap];
+    if (textureId != 0)
+        return textureId;
+
+    GLint prevTexture = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_1D, &prevTexture);
+    
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_1D, textureId);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    const auto& lut = colormapLUT(colormap);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, (GLsizei)lut.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, lut.data());
+    
+    glBindTexture(GL_TEXTURE_1D, prevTexture);
+    return textureId;
+}
+
+void GLDisplayShader::enableFromImguiCallback (const GLDisplayParams& params)
+{
+    if (!isInitialized())
+        initializeGL ();
+
+    // Reuse the projection matrix that ImGui just computed.
+    GLint imguiProgram = 0;
+    glGetIntegerv (GL_CURRENT_PROGRAM, &imguiProgram);
+    float projMtx[16];
+    glGetUniformfv (imguiProgram, glGetUniformLocation(imguiProgram, "ProjMtx"), projMtx);
+
+    glUseProgram (_shader.glHandles().shaderHandle);
+    glUniformMatrix4fv (_uniforms.projMtx, 1, GL_FALSE, projMtx);
+    glUniform1i (_shader.glHandles().textureUniformLocation, 0);
+    glUniform1f (_uniforms.inputMin, params.input.min);
+    glUniform1f (_uniforms.inputMax, params.input.max);
+    glUniform1i (_uniforms.singleChannelInput, params.input.singleChannel);
+    glUniform1f (_uniforms.minLevel, params.minLevel);
+    glUniform1f (_uniforms.maxLevel, params.maxLevel);
+    glUniform1f (_uniforms.exposureScale, std::exp2(params.exposure));
+    glUniform1f (_uniforms.invGamma, 1.f / std::max(params.gamma, 1e-3f));
+    glUniform1i (_uniforms.channel, params.channel);
+
+    // The LUT goes to the texture unit 1, ImGui only uses the unit 0.
+    const bool useColormap = params.colormap != Colormap::None;
+    glUniform1i (_uniforms.useColormap, useColormap);
+    glUniform1i (_uniforms.colormap, 1);
+    if (useColormap)
+    {
+        glActiveTexture (GL_TEXTURE1);
+        glBindTexture (GL_TEXTURE_1D, colormapTexture(params.colormap));
+        glActiveTexture (GL_TEXTURE0);
+    }
+
+    const bool useReference = params.diffMode != GLDisplayParams::DiffMode::None && params.referenceTextureId != 0;
+    glUniform1i (_uniforms.diffMode, useReference ? (int)params.diffMode : 0);
+    glUniform1i (_uniforms.referenceTexture, 2);
+    glUniform1f (_uniforms.referenceInputMin, params.referenceInput.min);
+    glUniform1f (_uniforms.referenceInputMax, params.referenceInput.max);
+    glUniform1i (_uniforms.referenceSingleChannelInput, params.referenceInput.singleChannel);
+    if (useReference)
+    {
+        glActiveTexture (GL_TEXTURE2);
+        glBindTexture (GL_TEXTURE_2D, params.referenceTextureId);
+        glActiveTexture (GL_TEXTURE0);
+    }
+
+    glUniform1i (_uniforms.cvdMode, (int)params.cvdMode);
+    if (params.cvdMode != GLDisplayParams::CvdMode::None)
+    {
+        // Both are column major.
+        const CvdSimulationParams& cvdParams = cvdSimulationParams (params.cvdDeficiency);
+        glUniformMatrix3fv (_uniforms.cvdRgbFromRgb1, 1, GL_FALSE, cvdParams.rgbCvdFromRgb[0].v);
+        glUniformMatrix3fv (_uniforms.cvdRgbFromRgb2, 1, GL_FALSE, cvdParams.rgbCvdFromRgb[1].v);
+        glUniform3fv (_uniforms.cvdSeparationNormal, 1, cvdParams.separationPlaneNormal);
+        glUniform1f (_uniforms.cvdSeverity, keepInRange (params.cvdSeverity, 0.f, 1.f));
+    }
+
+    // The ImGui vertex buffer is still bound, but its attribute locations
+    // are not necessarily the ones we enforce.
+    glEnableVertexAttribArray ((GLuint)GLShader::Attribute::VertexPos);
+    glEnableVertexAttribArray ((GLuint)GLShader::Attribute::VertexUV);
+    glEnableVertexAttribArray ((GLuint)GLShader::Attribute::VertexColor);
+    glVertexAttribPointer ((GLuint)GLShader::Attribute::VertexPos,   2, GL_FLOAT,         GL_FALSE, sizeof(ImDrawVert), (GLvoid*)offsetof(ImDrawVert, pos));
+    glVertexAttribPointer ((GLuint)GLShader::Attribute::VertexUV,    2, GL_FLOAT,         GL_FALSE, sizeof(ImDrawVert), (GLvoid*)offsetof(ImDrawVert, uv));
+    glVertexAttribPointer ((GLuint)GLShader::Attribute::VertexColor, 4, GL_UNSIGNED_BYTE, GL_TRUE,  sizeof(ImDrawVert), (GLvoid*)offsetof(ImDrawVert, col));
+}
+
+void GLDisplayShader::beginImguiFrame ()
+{
+    _drawDataForCurrentFrame.clear ();
+}
+
+void GLDisplayShader::imguiImage (uint32_t textureId, const ImVec2& size, const ImVec2& uv0, const ImVec2& uv1, const GLDisplayParams& params)
+{
+    DrawData& drawData = _drawDataForCurrentFrame.emplace_back();
+    drawData.shader = this;
+    drawData.params = params;
+    ImGui::GetWindowDrawList()->AddCallback([](const ImDrawList *parent_list, const ImDrawCmd *cmd)
+                                            {
+                                                auto* drawData = reinterpret_cast<DrawData*>(cmd->UserCallbackData);
+                                                drawData->shader->enableFromImguiCallback(drawData->params);
+                                            },
+                                            &drawData);
+    ImGui::Image(reinterpret_cast<ImTextureID>(textureId), size, uv0, uv1);
+    ImGui::GetWindowDrawList()->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+}
+
 } // zv
 
 // --------------------------------------------------------------------------------
@@ -260,6 +427,7 @@ void GLTexture::upload(const zv::ImageSRGBA& im)
     GLRestoreStateAfterScope_Texture _;
 
     glBindTexture(GL_TEXTURE_2D, _textureId);
+    // The row length handles the padding and the crop views.
     glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(im.bytesPerRow() / im.bytesPerPixel()));
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, im.width(), im.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, im.rawBytes());
     glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
@@ -284,6 +452,32 @@ void GLTexture::uploadRgba(const uint8_t* rgbaBuffer, int width, int height, int
     _height = height;
 }
 
+void GLTexture::upload (const NativeImage& im)
+{
+    GLRestoreStateAfterScope_Texture _;
+
+    GLint internalFormat = GL_RGBA8;
+    GLenum format = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+    switch (im.format())
+    {
+        case NativeImage::Format::Gray8: internalFormat = GL_R8; format = GL_RED; type = GL_UNSIGNED_BYTE; break;
+        case NativeImage::Format::Gray16: internalFormat = GL_R16; format = GL_RED; type = GL_UNSIGNED_SHORT; break;
+        case NativeImage::Format::GrayFloat: internalFormat = GL_R32F; format = GL_RED; type = GL_FLOAT; break;
+        case NativeImage::Format::RGBA16: internalFormat = GL_RGBA16; format = GL_RGBA; type = GL_UNSIGNED_SHORT; break;
+        case NativeImage::Format::RGBAFloat: internalFormat = GL_RGBA32F; format = GL_RGBA; type = GL_FLOAT; break;
+        default: zv_assert (false, "Invalid format"); return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, _textureId);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(im.bytesPerRow() / im.bytesPerPixel()));
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, im.width(), im.height(), 0, format, type, im.rawBytes());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    _width = im.width();
+    _height = im.height();
+}
+
 void GLTexture::download (zv::ImageSRGBA& im)
 {
     GLRestoreStateAfterScope_Texture _;
@@ -7,13 +7,20 @@
 #pragma once
 
 #include <libzv/Image.h>
+#include <libzv/ColorConversion.h>
 
 #include <memory>
 #include <cstdint>
+#include <deque>
+#include <array>
+
+struct ImVec2;
 
 namespace zv
 {
 
+class NativeImage;
+
 void checkGLError ();
 
 const char* glslVersion();
@@ -49,6 +56,7 @@ public:
     void disable ();
 
     const GLShaderHandles& glHandles () const { return _glHandles; }
+    int32_t uniformLocation (const char* name) const;
 
 private:
     struct Impl;
@@ -58,6 +66,110 @@ private:
     GLShaderHandles _glHandles;
 };
 
+// Display transforms applied on the fly by the fragment shader.
+// The texture is left untouched, so changing them is just a uniform update.
+struct GLDisplayParams
+{
+    // Sampled values mapped to [0,1] before anything else, for the
+    // textures kept in their native format.
+    struct InputRange
+    {
+        float min = 0.f;
+        float max = 1.f;
+        bool singleChannel = false;
+    };
+    InputRange input;
+
+    // Contrast stretch, in normalized [0,1] sRGB values.
+    float minLevel = 0.f;
+    float maxLevel = 1.f;
+    
+    // In stops, applied on linear RGB.
+    float exposure = 0.f;
+    
+    float gamma = 1.f;
+
+    // -1 to show all the channels, 0 to 3 to show R, G, B or A as grayscale.
+    int channel = -1;
+
+    // Only applied when the output is grayscale.
+    Colormap colormap = Colormap::None;
+
+    // Difference with a reference texture sampled at the same UVs.
+    // Absolute goes through the regular levels, Signed maps
+    // [-maxLevel,maxLevel] to the colormap (should be a diverging one).
+    enum class DiffMode { None = 0, Absolute, Signed };
+    DiffMode diffMode = DiffMode::None;
+    uint32_t referenceTextureId = 0;
+    InputRange referenceInput;
+
+    // Applied last, on linear RGB. Same computation as
+    // simulateColorVisionDeficiency and daltonize on the CPU.
+    enum class CvdMode { None = 0, Simulate, Daltonize };
+    CvdMode cvdMode = CvdMode::None;
+    ColorVisionDeficiency cvdDeficiency = ColorVisionDeficiency::Protan;
+    float cvdSeverity = 1.f;
+};
+
+// Takes over the ImGui program for an image draw command. Meant to be
+// enabled from an ImDrawList callback, and the ImGui state should
+// be restored afterwards with ImDrawCallback_ResetRenderState.
+class GLDisplayShader
+{
+public:
+    void initializeGL ();
+    bool isInitialized () const { return _shader.glHandles().shaderHandle != 0; }
+
+    // Deletes the colormap textures, needs the context.
+    void releaseGL ();
+
+    void enableFromImguiCallback (const GLDisplayParams& params);
+
+    // ImGui::Image drawn with this shader. The params are kept until the
+    // next call to beginImguiFrame since the draw data is rendered later.
+    void beginImguiFrame ();
+    void imguiImage (uint32_t textureId, const ImVec2& size, const ImVec2& uv0, const ImVec2& uv1, const GLDisplayParams& params);
+
+private:
+    uint32_t colormapTexture (Colormap colormap);
+
+private:
+    GLShader _shader;
+    std::array<uint32_t, (int)Colormap::NumColormaps> _colormapTextures = {};
+
+    struct DrawData
+    {
+        GLDisplayShader* shader = nullptr;
+        GLDisplayParams params;
+    };
+    // Deque to keep the pointers stable for the draw callbacks.
+    std::deque<DrawData> _drawDataForCurrentFrame;
+    
+    struct {
+        int32_t projMtx = -1;
+        int32_t inputMin = -1;
+        int32_t inputMax = -1;
+        int32_t singleChannelInput = -1;
+        int32_t referenceTexture = -1;
+        int32_t referenceInputMin = -1;
+        int32_t referenceInputMax = -1;
+        int32_t referenceSingleChannelInput = -1;
+        int32_t diffMode = -1;
+        int32_t minLevel = -1;
+        int32_t maxLevel = -1;
+        int32_t exposureScale = -1;
+        int32_t invGamma = -1;
+        int32_t channel = -1;
+        int32_t colormap = -1;
+        int32_t useColormap = -1;
+        int32_t cvdMode = -1;
+        int32_t cvdRgbFromRgb1 = -1;
+        int32_t cvdRgbFromRgb2 = -1;
+        int32_t cvdSeparationNormal = -1;
+        int32_t cvdSeverity = -1;
+    } _uniforms;
+};
+
 struct GLRestoreStateAfterScope_Texture
 {
     GLRestoreStateAfterScope_Texture();
@@ -82,6 +194,8 @@ public:
     void ensureAllocatedForRGBA (int width, int height);
     void upload (const zv::ImageSRGBA& im);
     void uploadRgba(const uint8_t* rgbaBuffer, int width, int height, int bytesPerRow = -1);
+    // R16, R32F, RGBA16 or RGBA32F depending on the format.
+    void upload (const NativeImage& im);
     void download (zv::ImageSRGBA& im);
 
     uint32_t textureId() const { return _textureId; }
@@ -10,6 +10,15 @@ namespace zv
 {
 
 const char* commonFragmentLibrary = R"(
+    vec3 sRGBToLinearRGB(vec3 rgb)
+    {
+        return mix(rgb / 12.92, pow((rgb + 0.055) / 1.055, vec3(2.4)), step(vec3(0.04045), rgb));
+    }
+
+    vec3 linearRGBTosRGB(vec3 rgb)
+    {
+        return mix(rgb * 12.92, 1.055 * pow(rgb, vec3(1.0/2.4)) - 0.055, step(vec3(0.0031308), rgb));
+    }
 )";
 
 const char* defaultVertexShader_glsl_130 =
@@ -42,4 +51,134 @@ const char* fragmentShader_Normal_glsl_130 = R"(
     }
 )";
 
+// Same inputs as the ImGui OpenGL3 backend so it can replace its
+// program for some draw commands.
+const char* imguiVertexShader_glsl_130 = R"(
+    uniform mat4 ProjMtx;
+    in vec2 Position;
+    in vec2 UV;
+    in vec4 Color;
+    out vec2 Frag_UV;
+    out vec4 Frag_Color;
+    void main()
+    {
+        Frag_UV = UV;
+        Frag_Color = Color;
+        gl_Position = ProjMtx * vec4(Position.xy, 0, 1);
+    }
+)";
+
+const char* fragmentShader_Display_glsl_130 = R"(
+    uniform sampler2D Texture;
+    uniform float InputMin;
+    uniform float InputMax;
+    uniform bool SingleChannelInput;
+    uniform sampler2D ReferenceTexture;
+    uniform float ReferenceInputMin;
+    uniform float ReferenceInputMax;
+    uniform bool ReferenceSingleChannelInput;
+    uniform int DiffMode; // 0 = none, 1 = absolute, 2 = signed
+    uniform float MinLevel;
+    uniform float MaxLevel;
+    uniform float ExposureScale;
+    uniform float InvGamma;
+    uniform int Channel;
+    uniform sampler1D Colormap;
+    uniform bool UseColormap;
+    uniform int CvdMode; // 0 = none, 1 = simulate, 2 = daltonize
+    uniform mat3 CvdRgbFromRgb1;
+    uniform mat3 CvdRgbFromRgb2;
+    uniform vec3 CvdSeparationNormal;
+    uniform float CvdSeverity;
+    in vec2 Frag_UV;
+    in vec4 Frag_Color;
+    out vec4 Out_Color;
+
+    vec4 normalizedInput(sampler2D tex, float inputMin, float inputMax, bool singleChannel)
+    {
+        vec4 v = texture(tex, Frag_UV.st);
+        if (singleChannel)
+        {
+            v = vec4(v.r, v.r, v.r, 1.0);
+        }
+        v.rgb = (v.rgb - inputMin) / (inputMax - inputMin);
+        return v;
+    }
+
+    // The 0.5 texel offsets make 0 and 1 hit the center of the first and last entries.
+    vec3 applyColormap(float v)
+    {
+        const float lutSize = 256.0;
+        return texture(Colormap, (v * (lutSize - 1.0) + 0.5) / lutSize).rgb;
+    }
+
+    // Brettel 1997 on linear RGB, then Fidaner 2005 for the daltonization.
+    vec3 applyCvd(vec3 rgb)
+    {
+        vec3 projected = dot(rgb, CvdSeparationNormal) >= 0.0 ? CvdRgbFromRgb1 * rgb : CvdRgbFromRgb2 * rgb;
+        vec3 simulated = mix(rgb, projected, CvdSeverity);
+        if (CvdMode == 1)
+            return simulated;
+        vec3 error = rgb - simulated;
+        return rgb + vec3(0.0, 0.7 * error.r + error.g, 0.7 * error.r + error.b);
+    }
+
+    void main()
+    {
+        vec4 srgba = normalizedInput(Texture, InputMin, InputMax, SingleChannelInput);
+        if (DiffMode != 0)
+        {
+            vec4 delta = srgba - normalizedInput(ReferenceTexture, ReferenceInputMin, ReferenceInputMax, ReferenceSingleChannelInput);
+            if (DiffMode == 2)
+            {
+                // Keep the largest deviation, averaging could cancel it.
+                float d = delta.r;
+                if (Channel >= 0)
+                    d = delta[Channel];
+                else
+                {
+                    if (abs(delta.g) > abs(d)) d = delta.g;
+                    if (abs(delta.b) > abs(d)) d = delta.b;
+                }
+                float t = 0.5 + 0.5 * clamp(d / max(MaxLevel, 1e-5), -1.0, 1.0);
+                Out_Color = vec4(applyColormap(t), 1.0) * Frag_Color;
+                return;
+            }
+            // The alpha difference is only visible in the alpha channel mode.
+            srgba = abs(delta);
+            if (Channel < 0)
+                srgba.a = 1.0;
+        }
+
+        if (Channel >= 0)
+        {
+            float v = srgba[Channel];
+            srgba = vec4(v, v, v, 1.0);
+        }
+
+        // Contrast stretch on the encoded values, like most viewers do.
+        vec3 rgb = clamp((srgba.rgb - MinLevel) / max(MaxLevel - MinLevel, 1e-5), 0.0, 1.0);
+
+        // Exposure needs to be applied on linear values.
+        if (ExposureScale != 1.0)
+        {
+            rgb = clamp(linearRGBTosRGB(sRGBToLinearRGB(rgb) * ExposureScale), 0.0, 1.0);
+        }
+
+        rgb = pow(rgb, vec3(InvGamma));
+
+        if (UseColormap && (SingleChannelInput || Channel >= 0))
+        {
+            rgb = applyColormap(rgb.r);
+        }
+
+        if (CvdMode != 0)
+        {
+            rgb = linearRGBTosRGB(clamp(applyCvd(sRGBToLinearRGB(rgb)), 0.0, 1.0));
+        }
+
+        Out_Color = vec4(rgb, srgba.a) * Frag_Color;
+    }
+)";
+
 } // zv
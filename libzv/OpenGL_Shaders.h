@@ -15,4 +15,8 @@ extern const char* defaultFragmentShader_glsl_130;
 
 extern const char* fragmentShader_Normal_glsl_130;
 
+extern const char* imguiVertexShader_glsl_130;
+
+extern const char* fragmentShader_Display_glsl_130;
+
 } // zv
@@ -0,0 +1,441 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "PerceptualHash.h"
+
+#include <libzv/BackgroundFileJob.h>
+#include <libzv/ThreadPool.h>
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+namespace zv
+{
+
+namespace
+{
+
+constexpr int ReducedSize = 32;
+constexpr int NumFrequencies = 8;
+
+// JPEG files get decoded at a scale that keeps enough pixels for the
+// area average to not alias.
+constexpr int MinDecodedSize = 2 * ReducedSize;
+
+// Luma in [0,255*256], summed over the input pixels of each cell.
+void reducedLuma (const ImageSRGBA& image, float reduced[ReducedSize][ReducedSize])
+{
+    const int width = image.width();
+    const int height = image.height();
+    auto luma = [](const PixelSRGBA& p) { return 54u * p.r + 183u * p.g + 19u * p.b; };
+
+    if (width < ReducedSize || height < ReducedSize)
+    {
+        for (int y = 0; y < ReducedSize; ++y)
+        for (int x = 0; x < ReducedSize; ++x)
+            reduced[y][x] = float(luma (image((x * width) / ReducedSize, (y * height) / ReducedSize)));
+        return;
+    }
+
+    std::vector<int> cellOfColumn (width);
+    std::vector<int> numColumnsOfCell (ReducedSize, 0);
+    for (int c = 0; c < width; ++c)
+    {
+        cellOfColumn[c] = (c * ReducedSize) / width;
+        ++numColumnsOfCell[cellOfColumn[c]];
+    }
+
+    uint64_t sums[ReducedSize][ReducedSize] = {};
+    int numRowsOfCell[ReducedSize] = {};
+    for (int r = 0; r < height; ++r)
+    {
+        const int cellY = (r * ReducedSize) / height;
+        ++numRowsOfCell[cellY];
+        // A row has at most width*65280 in a cell, fine in 64 bits.
+        const PixelSRGBA* rowPtr = image.atRowPtr(r);
+        for (int c = 0; c < width; ++c)
+            sums[cellY][cellOfColumn[c]] += luma (rowPtr[c]);
+    }
+
+    for (int y = 0; y < ReducedSize; ++y)
+    for (int x = 0; x < ReducedSize; ++x)
+        reduced[y][x] = float(double(sums[y][x]) / (double(numRowsOfCell[y]) * numColumnsOfCell[x]));
+}
+
+// cos((2x+1) u pi / 64) for the frequencies 1 to 8, the DC is skipped.
+struct DctBasis
+{
+    DctBasis ()
+    {
+        for (int u = 0; u < NumFrequencies; ++u)
+        for (int x = 0; x < ReducedSize; ++x)
+            values[u][x] = float(std::cos ((2 * x + 1) * (u + 1) * M_PI / (2 * ReducedSize)));
+    }
+
+    float values[NumFrequencies][ReducedSize];
+};
+
+// Calls func on all the values within maxFlips bits of value, once each.
+template <class Func>
+void forEachValueWithin (uint16_t value, int maxFlips, int firstBit, const Func& func)
+{
+    func (value);
+    if (maxFlips == 0)
+        return;
+    for (int bit = firstBit; bit < 16; ++bit)
+        forEachValueWithin (uint16_t(value ^ (1 << bit)), maxFlips - 1, bit + 1, func);
+}
+
+} // anonymous
+
+uint64_t computePerceptualHash (const ImageSRGBA& image)
+{
+    static const DctBasis basis;
+
+    float reduced[ReducedSize][ReducedSize];
+    reducedLuma (image, reduced);
+
+    // Separable DCT, only the needed frequencies.
+    float columns[NumFrequencies][ReducedSize];
+    for (int v = 0; v < NumFrequencies; ++v)
+    for (int x = 0; x < ReducedSize; ++x)
+    {
+        float acc = 0.f;
+        for (int y = 0; y < ReducedSize; ++y)
+            acc += basis.values[v][y] * reduced[y][x];
+        columns[v][x] = acc;
+    }
+
+    float coefficients[NumFrequencies * NumFrequencies];
+    for (int v = 0; v < NumFrequencies; ++v)
+    for (int u = 0; u < NumFrequencies; ++u)
+    {
+        float acc = 0.f;
+        for (int x = 0; x < ReducedSize; ++x)
+            acc += basis.values[u][x] * columns[v][x];
+        coefficients[v * NumFrequencies + u] = acc;
+    }
+
+    float sorted[NumFrequencies * NumFrequencies];
+    std::copy (coefficients, coefficients + NumFrequencies * NumFrequencies, sorted);
+    const int middle = NumFrequencies * NumFrequencies / 2;
+    std::nth_element (sorted, sorted + middle, sorted + NumFrequencies * NumFrequencies);
+    const float median = sorted[middle];
+
+    uint64_t hash = 0;
+    for (int i = 0; i < NumFrequencies * NumFrequencies; ++i)
+        hash |= uint64_t(coefficients[i] > median) << i;
+    return hash;
+}
+
+struct PerceptualHashIndex::Impl
+{
+    static constexpr int NumChunks = 4;
+    static constexpr int ChunkBits = 16;
+
+    // The hash is next to its index so the candidates get checked
+    // without any random access.
+    struct Entry
+    {
+        uint64_t hash;
+        int hashIndex;
+    };
+
+    // Entries of each chunk value, offsets has one entry per value + 1.
+    struct ChunkTable
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<Entry> entries;
+    };
+
+    std::vector<std::string> filePaths;
+    std::vector<uint64_t> hashes;
+    std::vector<uint8_t> hashIsValid;
+    std::unordered_map<std::string, int> fileIndexOfPath;
+
+    // The files with the same hash, e.g. blank frames, are indexed once.
+    // The files of distinctHashes[h] are filesOfHash[filesOfHashOffsets[h]]
+    // up to filesOfHash[filesOfHashOffsets[h+1]], in increasing order.
+    std::vector<uint64_t> distinctHashes;
+    std::vector<uint32_t> filesOfHashOffsets;
+    std::vector<int> filesOfHash;
+    std::vector<int> hashIndexOfFile;
+    ChunkTable tables[NumChunks];
+
+    std::atomic<bool> ready {false};
+
+    // Last, so it gets destroyed first and its runner stops using the rest.
+    BackgroundFileJob job;
+
+    bool hashFile (int fileIndex, std::string& error);
+    void buildTables ();
+
+    static uint16_t chunk (uint64_t hash, int idx) { return uint16_t(hash >> (idx * ChunkBits)); }
+
+    // Calls onMatch(hashIndex, distance) for the distinct hashes within
+    // maxDistance, including the query. A hash can be reported once per chunk.
+    template <class Func>
+    void forEachMatch (uint64_t hash, int maxDistance, const Func& onMatch) const;
+};
+
+bool PerceptualHashIndex::Impl::hashFile (int fileIndex, std::string& error)
+{
+    ImageSRGBA image;
+    if (!readImageFileReduced (filePaths[fileIndex], MinDecodedSize, image) || image.width() == 0 || image.height() == 0)
+    {
+        error = "could not read " + filePaths[fileIndex];
+        zv_dbg ("Could not read %s to hash it", filePaths[fileIndex].c_str());
+        return false;
+    }
+    hashes[fileIndex] = computePerceptualHash (image);
+    hashIsValid[fileIndex] = true;
+    return true;
+}
+
+void PerceptualHashIndex::Impl::buildTables ()
+{
+    const int numFiles = int(filePaths.size());
+    for (int i = 0; i < numFiles; ++i)
+        fileIndexOfPath[filePaths[i]] = i;
+
+    filesOfHash.clear ();
+    for (int i = 0; i < numFiles; ++i)
+        if (hashIsValid[i])
+            filesOfHash.push_back (i);
+    std::sort (filesOfHash.begin(), filesOfHash.end(), [this](int lhs, int rhs) {
+        return hashes[lhs] != hashes[rhs] ? hashes[lhs] < hashes[rhs] : lhs < rhs;
+    });
+
+    distinctHashes.clear ();
+    filesOfHashOffsets.clear ();
+    hashIndexOfFile.assign (numFiles, -1);
+    for (size_t j = 0; j < filesOfHash.size(); ++j)
+    {
+        const int fileIndex = filesOfHash[j];
+        if (distinctHashes.empty() || distinctHashes.back() != hashes[fileIndex])
+        {
+            distinctHashes.push_back (hashes[fileIndex]);
+            filesOfHashOffsets.push_back (uint32_t(j));
+        }
+        hashIndexOfFile[fileIndex] = int(distinctHashes.size()) - 1;
+    }
+    filesOfHashOffsets.push_back (uint32_t(filesOfHash.size()));
+
+    const int numHashes = int(distinctHashes.size());
+    for (int k = 0; k < NumChunks; ++k)
+    {
+        ChunkTable& table = tables[k];
+        table.offsets.assign ((1 << ChunkBits) + 1, 0);
+        for (int h = 0; h < numHashes; ++h)
+            ++table.offsets[chunk (distinctHashes[h], k) + 1];
+        std::partial_sum (table.offsets.begin(), table.offsets.end(), table.offsets.begin());
+
+        table.entries.resize (table.offsets.back());
+        std::vector<uint32_t> next (table.offsets.begin(), table.offsets.end() - 1);
+        for (int h = 0; h < numHashes; ++h)
+            table.entries[next[chunk (distinctHashes[h], k)]++] = { distinctHashes[h], h };
+    }
+}
+
+template <class Func>
+void PerceptualHashIndex::Impl::forEachMatch (uint64_t hash, int maxDistance, const Func& onMatch) const
+{
+    const int chunkDistance = maxDistance / NumChunks;
+    for (int k = 0; k < NumChunks; ++k)
+    {
+        const ChunkTable& table = tables[k];
+        forEachValueWithin (chunk (hash, k), chunkDistance, 0, [&](uint16_t value) {
+            for (uint32_t j = table.offsets[value]; j < table.offsets[value + 1]; ++j)
+            {
+                const Entry& entry = table.entries[j];
+                const int distance = hammingDistance (hash, entry.hash);
+                if (distance <= maxDistance)
+                    onMatch (entry.hashIndex, distance);
+            }
+        });
+    }
+}
+
+PerceptualHashIndex::PerceptualHashIndex ()
+: impl (new Impl ())
+{}
+
+PerceptualHashIndex::~PerceptualHashIndex () = default;
+
+bool PerceptualHashIndex::start (const std::vector<std::string>& filePaths)
+{
+    if (impl->job.isRunning())
+        return false;
+
+    impl->ready = false;
+    impl->filePaths = filePaths;
+    impl->hashes.assign (filePaths.size(), 0);
+    impl->hashIsValid.assign (filePaths.size(), false);
+    impl->fileIndexOfPath.clear ();
+    impl->distinctHashes.clear ();
+    impl->filesOfHashOffsets.clear ();
+    impl->filesOfHash.clear ();
+    impl->hashIndexOfFile.clear ();
+    for (auto& table : impl->tables)
+        table = {};
+
+    Impl* implPtr = impl.get();
+    return impl->job.start (int(filePaths.size()), [implPtr](int i, std::string& error) {
+        return implPtr->hashFile (i, error);
+    }, [implPtr](bool cancelled) {
+        if (cancelled)
+            return;
+        implPtr->buildTables ();
+        implPtr->ready = true;
+    });
+}
+
+void PerceptualHashIndex::cancel ()
+{
+    impl->job.cancel ();
+}
+
+bool PerceptualHashIndex::isRunning () const
+{
+    return impl->job.isRunning ();
+}
+
+PerceptualHashIndex::Progress PerceptualHashIndex::progress () const
+{
+    const BackgroundFileJob::Progress jobProgress = impl->job.progress();
+    Progress progress;
+    progress.running = jobProgress.running;
+    progress.cancelled = jobProgress.cancelled;
+    progress.numFiles = jobProgress.numFiles;
+    progress.numProcessed = jobProgress.numProcessed;
+    progress.numFailed = jobProgress.numFailed;
+    progress.elapsedSeconds = jobProgress.elapsedSeconds;
+    if (progress.numFiles > 0)
+        progress.imagesPerSecond = progress.numProcessed / std::max(progress.elapsedSeconds, 1e-6);
+    return progress;
+}
+
+bool PerceptualHashIndex::isReady () const
+{
+    return impl->ready;
+}
+
+const std::vector<std::string>& PerceptualHashIndex::filePaths () const
+{
+    static const std::vector<std::string> empty;
+    return impl->ready ? impl->filePaths : empty;
+}
+
+int PerceptualHashIndex::fileIndex (const std::string& filePath) const
+{
+    if (!impl->ready)
+        return -1;
+    auto it = impl->fileIndexOfPath.find (filePath);
+    return it != impl->fileIndexOfPath.end() ? it->second : -1;
+}
+
+std::vector<PerceptualHashIndex::Match> PerceptualHashIndex::findNearDuplicates (int fileIndex, int maxDistance) const
+{
+    std::vector<Match> matches;
+    if (!impl->ready || fileIndex < 0 || fileIndex >= int(impl->filePaths.size()) || !impl->hashIsValid[fileIndex])
+        return matches;
+
+    maxDistance = std::min(maxDistance, int(MaxDistance));
+    impl->forEachMatch (impl->hashes[fileIndex], maxDistance, [&](int hashIndex, int distance) {
+        for (uint32_t j = impl->filesOfHashOffsets[hashIndex]; j < impl->filesOfHashOffsets[hashIndex + 1]; ++j)
+            if (impl->filesOfHash[j] != fileIndex)
+                matches.push_back ({impl->filesOfHash[j], distance});
+    });
+
+    std::sort (matches.begin(), matches.end(), [](const Match& lhs, const Match& rhs) {
+        return lhs.distance != rhs.distance ? lhs.distance < rhs.distance : lhs.fileIndex < rhs.fileIndex;
+    });
+    matches.erase (std::unique (matches.begin(), matches.end(), [](const Match& lhs, const Match& rhs) {
+        return lhs.fileIndex == rhs.fileIndex;
+    }), matches.end());
+    return matches;
+}
+
+std::vector<std::vector<int>> PerceptualHashIndex::groupNearDuplicates (int maxDistance) const
+{
+    std::vector<std::vector<int>> groups;
+    if (!impl->ready)
+        return groups;
+
+    maxDistance = std::min(maxDistance, int(MaxDistance));
+    const int numFiles = int(impl->filePaths.size());
+    const int numHashes = int(impl->distinctHashes.size());
+
+    // The files with the same hash are already together, so the pairs are
+    // between distinct hashes, found by bands then merged with a union-find.
+    const int numBands = std::max(1, std::min(numHashes / 256, ThreadPool::instance().numThreads() * 4));
+    std::vector<std::vector<std::pair<int,int>>> bandPairs (numBands);
+    ThreadPool::instance().parallelFor (numBands, [&](int band) {
+        const int first = int((int64_t(numHashes) * band) / numBands);
+        const int last = int((int64_t(numHashes) * (band + 1)) / numBands);
+        for (int h = first; h < last; ++h)
+        {
+            // Each pair is found from both sides, keep one. The pairs found
+            // again from another chunk get skipped by the union-find.
+            impl->forEachMatch (impl->distinctHashes[h], maxDistance, [&](int candidate, int) {
+                if (candidate > h)
+                    bandPairs[band].push_back ({h, candidate});
+            });
+        }
+    });
+
+    std::vector<int> parent (numHashes);
+    std::iota (parent.begin(), parent.end(), 0);
+    auto root = [&](int h) {
+        while (parent[h] != h)
+        {
+            parent[h] = parent[parent[h]];
+            h = parent[h];
+        }
+        return h;
+    };
+    for (const auto& pairs : bandPairs)
+    for (const auto& pair : pairs)
+    {
+        const int rootA = root (pair.first);
+        const int rootB = root (pair.second);
+        if (rootA != rootB)
+            parent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+    }
+
+    std::vector<int> groupSize (numHashes, 0);
+    for (int h = 0; h < numHashes; ++h)
+        groupSize[root (h)] += int(impl->filesOfHashOffsets[h + 1] - impl->filesOfHashOffsets[h]);
+
+    std::unordered_map<int, int> groupOfRoot;
+    for (int i = 0; i < numFiles; ++i)
+    {
+        const int hashIndex = impl->hashIndexOfFile[i];
+        if (hashIndex < 0)
+            continue;
+        const int r = root (hashIndex);
+        if (groupSize[r] < 2)
+            continue;
+        auto it = groupOfRoot.find (r);
+        if (it == groupOfRoot.end())
+        {
+            it = groupOfRoot.emplace (r, int(groups.size())).first;
+            groups.emplace_back ();
+        }
+        groups[it->second].push_back (i);
+    }
+
+    std::stable_sort (groups.begin(), groups.end(), [](const std::vector<int>& lhs, const std::vector<int>& rhs) {
+        return lhs.size() > rhs.size();
+    });
+    return groups;
+}
+
+} // zv
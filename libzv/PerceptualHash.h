@@ -0,0 +1,101 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Image.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if _MSC_VER
+#  include <intrin.h>
+#endif
+
+namespace zv
+{
+
+// DCT hash of the luma: the 8x8 lowest frequencies after the DC of a
+// 32x32 area-averaged version, each bit set when the coefficient is
+// above their median. Robust to resizing, compression and small color
+// changes. Images smaller than 32x32 get upsampled.
+uint64_t computePerceptualHash (const ImageSRGBA& image);
+
+inline int hammingDistance (uint64_t lhs, uint64_t rhs)
+{
+#if _MSC_VER
+    return int(__popcnt64 (lhs ^ rhs));
+#else
+    return __builtin_popcountll (lhs ^ rhs);
+#endif
+}
+
+// Perceptual hashes of many image files, computed in the background by a
+// BackgroundFileJob, then indexed for Hamming radius queries. The 64 bits
+// are split into 4 chunks of 16 bits, each with its own table: two
+// hashes within a distance d have at least one chunk within d/4, so a
+// query only probes the chunk values around its own.
+class PerceptualHashIndex
+{
+public:
+    struct Progress
+    {
+        bool running = false;
+        bool cancelled = false;
+        int numFiles = 0;
+        // Including the failed ones.
+        int numProcessed = 0;
+        int numFailed = 0;
+        double elapsedSeconds = 0.;
+        double imagesPerSecond = 0.;
+    };
+
+    struct Match
+    {
+        int fileIndex = -1;
+        int distance = 0;
+    };
+
+    // Above that the queries probe too many chunk values.
+    static constexpr int MaxDistance = 15;
+
+public:
+    PerceptualHashIndex ();
+    // Cancels the current job and waits for it.
+    ~PerceptualHashIndex ();
+
+    // Replaces the current index. Returns false if a job is already running.
+    bool start (const std::vector<std::string>& filePaths);
+
+    // The files already being decoded still finish, the index stays empty.
+    void cancel ();
+
+    bool isRunning () const;
+    Progress progress () const;
+
+    // The queries need a complete index, they return nothing otherwise.
+    bool isReady () const;
+
+    const std::vector<std::string>& filePaths () const;
+
+    // -1 if the file is not in the ready index.
+    int fileIndex (const std::string& filePath) const;
+
+    // Other files within maxDistance bits, closest first.
+    std::vector<Match> findNearDuplicates (int fileIndex, int maxDistance) const;
+
+    // Connected components of the files within maxDistance of each other,
+    // only the ones with at least 2 files, largest first.
+    std::vector<std::vector<int>> groupNearDuplicates (int maxDistance) const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // zv
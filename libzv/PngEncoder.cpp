@@ -0,0 +1,934 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "PngEncoder.h"
+
+#include <libzv/ThreadPool.h>
+#include <libzv/MathUtils.h>
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+
+#if _MSC_VER
+# include <intrin.h>
+#endif
+
+namespace zv
+{
+
+namespace
+{
+
+// Filtered bytes per band, the bands are compressed independently.
+const size_t BandBytes = size_t(1) << 20;
+
+const int WindowSize = 32768;
+const int MinMatch = 3;
+const int MaxMatch = 258;
+const int HashBits = 15;
+
+// The Huffman tables get recomputed for each block.
+const size_t MaxTokensPerBlock = 1 << 16;
+
+struct LevelParams
+{
+    int maxChain;
+    // Shorter search for the lazy match when the current one is that long.
+    int goodLength;
+    // Stop searching once a match is that long.
+    int niceLength;
+    // Lazy matching for the matches shorter than this, 0 to disable.
+    int maxLazy;
+    // Positions covered by longer matches are not hashed.
+    int maxInsert;
+};
+
+// Same spirit as the zlib ones.
+const LevelParams levelParams[10] = {
+    { 0, 0, 0, 0, 0 }, // stored
+    { 4, 4, 8, 0, 4 },
+    { 8, 4, 16, 0, 5 },
+    { 32, 4, 32, 0, 6 },
+    { 16, 4, 16, 4, MaxMatch },
+    { 32, 8, 32, 16, MaxMatch },
+    { 128, 8, 128, 16, MaxMatch },
+    { 256, 8, 128, 32, MaxMatch },
+    { 1024, 32, MaxMatch, 128, MaxMatch },
+    { 4096, 32, MaxMatch, MaxMatch, MaxMatch },
+};
+
+const uint16_t lengthBase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+const uint8_t lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+const uint16_t distBase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+const uint8_t distExtra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+const uint8_t codeLengthOrder[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+
+const int NumLitLenSymbols = 286;
+// The fixed code also assigns 286 and 287, they shift the canonical codes.
+const int NumFixedLitLenSymbols = 288;
+const int NumDistSymbols = 30;
+const int NumCodeLengthSymbols = 19;
+const int EndOfBlock = 256;
+
+struct Tables
+{
+    Tables ()
+    {
+        for (int code = 0; code < 29; ++code)
+        {
+            const int last = code + 1 < 29 ? lengthBase[code+1] : MaxMatch + 1;
+            for (int len = lengthBase[code]; len < last; ++len)
+                lengthCode[len] = uint8_t(code);
+        }
+
+        for (int code = 0; code < 30; ++code)
+        {
+            const int last = code + 1 < 30 ? distBase[code+1] : WindowSize + 1;
+            for (int d = distBase[code]; d < last; ++d)
+                distCode[d] = uint8_t(code);
+        }
+
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            crc[n] = c;
+        }
+    }
+
+    uint8_t lengthCode[MaxMatch + 1];
+    uint8_t distCode[WindowSize + 1];
+    uint32_t crc[256];
+};
+
+const Tables& tables ()
+{
+    static Tables tables;
+    return tables;
+}
+
+uint32_t updateCrc (uint32_t crc, const uint8_t* data, size_t size)
+{
+    const uint32_t* table = tables().crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+uint32_t adler32 (const uint8_t* data, size_t size)
+{
+    uint32_t s1 = 1, s2 = 0;
+    while (size > 0)
+    {
+        // Largest n such that the sums can't overflow.
+        const size_t n = std::min(size, size_t(5552));
+        for (size_t i = 0; i < n; ++i)
+        {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+        data += n;
+        size -= n;
+    }
+    return (s2 << 16) | s1;
+}
+
+// Checksum of the concatenation, from the zlib adler32_combine.
+uint32_t combineAdler32 (uint32_t adler1, uint32_t adler2, size_t size2)
+{
+    const uint32_t base = 65521;
+    const uint32_t rem = uint32_t(size2 % base);
+    uint32_t sum1 = adler1 & 0xffff;
+    uint32_t sum2 = uint32_t((uint64_t(rem) * sum1) % base);
+    sum1 += (adler2 & 0xffff) + base - 1;
+    sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + base - rem;
+    if (sum1 >= base) sum1 -= base;
+    if (sum1 >= base) sum1 -= base;
+    if (sum2 >= (base << 1)) sum2 -= (base << 1);
+    if (sum2 >= base) sum2 -= base;
+    return (sum2 << 16) | sum1;
+}
+
+inline int countTrailingZeros (uint64_t v)
+{
+#if _MSC_VER
+    unsigned long idx = 0;
+    _BitScanForward64 (&idx, v);
+    return int(idx);
+#else
+    return __builtin_ctzll (v);
+#endif
+}
+
+// Assumes a little-endian machine.
+inline int matchLength (const uint8_t* a, const uint8_t* b, int limit)
+{
+    int len = 0;
+    while (len + 8 <= limit)
+    {
+        uint64_t x, y;
+        memcpy (&x, a + len, 8);
+        memcpy (&y, b + len, 8);
+        if (x != y)
+            return len + (countTrailingZeros (x ^ y) >> 3);
+        len += 8;
+    }
+    while (len < limit && a[len] == b[len])
+        ++len;
+    return len;
+}
+
+class BitWriter
+{
+public:
+    BitWriter (std::vector<uint8_t>& bytes) : _bytes (bytes)
+    {}
+
+    // LSB first, as deflate wants.
+    void put (uint32_t bits, int numBits)
+    {
+        _buffer |= uint64_t(bits) << _numBits;
+        _numBits += numBits;
+        while (_numBits >= 8)
+        {
+            _bytes.push_back (uint8_t(_buffer));
+            _buffer >>= 8;
+            _numBits -= 8;
+        }
+    }
+
+    bool isAligned () const { return _numBits == 0; }
+
+    void alignToByte ()
+    {
+        if (_numBits > 0)
+            put (0, 8 - _numBits);
+    }
+
+    void putAlignedBytes (const uint8_t* data, size_t size)
+    {
+        zv_assert (isAligned(), "Unaligned raw bytes");
+        _bytes.insert (_bytes.end(), data, data + size);
+    }
+
+private:
+    std::vector<uint8_t>& _bytes;
+    uint64_t _buffer = 0;
+    int _numBits = 0;
+};
+
+// Length-limited by halving the frequencies until the tree fits. Always
+// gives at least two codes so the code is complete.
+void buildCodeLengths (const uint32_t* freqs, int numSymbols, int maxBits, uint8_t* lengths)
+{
+    std::fill (lengths, lengths + numSymbols, uint8_t(0));
+
+    std::vector<int> used;
+    std::vector<uint64_t> f (numSymbols);
+    for (int i = 0; i < numSymbols; ++i)
+    {
+        f[i] = freqs[i];
+        if (freqs[i] > 0)
+            used.push_back (i);
+    }
+
+    for (int i = 0; used.size() < 2; ++i)
+    {
+        if (f[i] == 0)
+        {
+            f[i] = 1;
+            used.push_back (i);
+        }
+    }
+    std::sort (used.begin(), used.end());
+
+    struct Node
+    {
+        uint64_t freq;
+        int index;
+        bool operator> (const Node& rhs) const { return freq > rhs.freq || (freq == rhs.freq && index > rhs.index); }
+    };
+
+    const int numLeaves = int(used.size());
+    std::vector<int> parent (numLeaves * 2);
+    std::vector<int> depth (numLeaves * 2);
+    while (true)
+    {
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+        for (int i = 0; i < numLeaves; ++i)
+            heap.push ({ f[used[i]], i });
+
+        // The internal nodes always get a higher index than their children.
+        int nextNode = numLeaves;
+        while (heap.size() > 1)
+        {
+            const Node a = heap.top(); heap.pop();
+            const Node b = heap.top(); heap.pop();
+            parent[a.index] = nextNode;
+            parent[b.index] = nextNode;
+            heap.push ({ a.freq + b.freq, nextNode });
+            ++nextNode;
+        }
+
+        depth[nextNode - 1] = 0;
+        for (int node = nextNode - 2; node >= 0; --node)
+            depth[node] = depth[parent[node]] + 1;
+
+        int maxDepth = 0;
+        for (int i = 0; i < numLeaves; ++i)
+            maxDepth = std::max(maxDepth, depth[i]);
+
+        if (maxDepth <= maxBits)
+        {
+            for (int i = 0; i < numLeaves; ++i)
+                lengths[used[i]] = uint8_t(depth[i]);
+            return;
+        }
+
+        for (int s : used)
+            f[s] = (f[s] >> 1) | 1;
+    }
+}
+
+// Canonical codes, bit-reversed since deflate writes them MSB first.
+void computeCodes (const uint8_t* lengths, int numSymbols, uint16_t* codes)
+{
+    int countPerLength[16] = {};
+    for (int i = 0; i < numSymbols; ++i)
+        ++countPerLength[lengths[i]];
+    countPerLength[0] = 0;
+
+    int nextCode[16] = {};
+    int code = 0;
+    for (int bits = 1; bits < 16; ++bits)
+    {
+        code = (code + countPerLength[bits-1]) << 1;
+        nextCode[bits] = code;
+    }
+
+    for (int i = 0; i < numSymbols; ++i)
+    {
+        const int len = lengths[i];
+        if (len == 0)
+        {
+            codes[i] = 0;
+            continue;
+        }
+        int c = nextCode[len]++;
+        int reversed = 0;
+        for (int k = 0; k < len; ++k)
+        {
+            reversed = (reversed << 1) | (c & 1);
+            c >>= 1;
+        }
+        codes[i] = uint16_t(reversed);
+    }
+}
+
+// Literal when dist is 0.
+struct Token
+{
+    uint16_t litLen;
+    uint16_t dist;
+};
+
+struct CodeLengthSymbol
+{
+    uint8_t symbol;
+    uint8_t extra;
+};
+
+int codeLengthExtraBits (int symbol)
+{
+    switch (symbol)
+    {
+        case 16: return 2;
+        case 17: return 3;
+        case 18: return 7;
+        default: return 0;
+    }
+}
+
+// Run-length encoding of the code lengths with the symbols 16 to 18.
+void encodeCodeLengths (const uint8_t* lengths, int count, std::vector<CodeLengthSymbol>& symbols)
+{
+    int i = 0;
+    while (i < count)
+    {
+        const uint8_t len = lengths[i];
+        int run = 1;
+        while (i + run < count && lengths[i + run] == len)
+            ++run;
+        i += run;
+
+        if (len == 0)
+        {
+            while (run >= 11)
+            {
+                const int n = std::min(run, 138);
+                symbols.push_back ({ 18, uint8_t(n - 11) });
+                run -= n;
+            }
+            if (run >= 3)
+            {
+                symbols.push_back ({ 17, uint8_t(run - 3) });
+                run = 0;
+            }
+        }
+        else
+        {
+            symbols.push_back ({ len, 0 });
+            --run;
+            while (run >= 3)
+            {
+                const int n = std::min(run, 6);
+                symbols.push_back ({ 16, uint8_t(n - 3) });
+                run -= n;
+            }
+        }
+
+        for (; run > 0; --run)
+            symbols.push_back ({ len, 0 });
+    }
+}
+
+void writeStoredBlocks (BitWriter& writer, const uint8_t* data, size_t size, bool isFinal)
+{
+    do
+    {
+        const size_t n = std::min(size, size_t(65535));
+        const bool lastOne = (n == size);
+        writer.put (isFinal && lastOne ? 1 : 0, 1);
+        writer.put (0, 2);
+        writer.alignToByte ();
+        writer.put (uint32_t(n), 16);
+        writer.put (uint32_t(~n) & 0xffff, 16);
+        writer.putAlignedBytes (data, n);
+        data += n;
+        size -= n;
+    } while (size > 0);
+}
+
+void writeTokens (BitWriter& writer, const std::vector<Token>& tokens,
+                  const uint8_t* litLenLengths, const uint16_t* litLenCodes,
+                  const uint8_t* distLengths, const uint16_t* distCodes)
+{
+    const Tables& t = tables();
+    for (const Token& token : tokens)
+    {
+        if (token.dist == 0)
+        {
+            writer.put (litLenCodes[token.litLen], litLenLengths[token.litLen]);
+            continue;
+        }
+
+        const int lc = t.lengthCode[token.litLen];
+        writer.put (litLenCodes[257 + lc], litLenLengths[257 + lc]);
+        if (lengthExtra[lc])
+            writer.put (token.litLen - lengthBase[lc], lengthExtra[lc]);
+
+        const int dc = t.distCode[token.dist];
+        writer.put (distCodes[dc], distLengths[dc]);
+        if (distExtra[dc])
+            writer.put (token.dist - distBase[dc], distExtra[dc]);
+    }
+    writer.put (litLenCodes[EndOfBlock], litLenLengths[EndOfBlock]);
+}
+
+// Picks the smallest of the stored, fixed Huffman and dynamic Huffman
+// encodings of the block.
+void writeBlock (BitWriter& writer, const std::vector<Token>& tokens,
+                 const uint8_t* rawData, size_t rawSize, bool isFinal)
+{
+    const Tables& t = tables();
+
+    uint32_t litLenFreqs[NumLitLenSymbols] = {};
+    uint32_t distFreqs[NumDistSymbols] = {};
+    uint64_t extraBits = 0;
+    for (const Token& token : tokens)
+    {
+        if (token.dist == 0)
+        {
+            ++litLenFreqs[token.litLen];
+            continue;
+        }
+        const int lc = t.lengthCode[token.litLen];
+        const int dc = t.distCode[token.dist];
+        ++litLenFreqs[257 + lc];
+        ++distFreqs[dc];
+        extraBits += lengthExtra[lc] + distExtra[dc];
+    }
+    litLenFreqs[EndOfBlock] = 1;
+
+    uint8_t litLenLengths[NumLitLenSymbols];
+    uint8_t distLengths[NumDistSymbols];
+    buildCodeLengths (litLenFreqs, NumLitLenSymbols, 15, litLenLengths);
+    buildCodeLengths (distFreqs, NumDistSymbols, 15, distLengths);
+
+    int numLitLen = NumLitLenSymbols;
+    while (numLitLen > 257 && litLenLengths[numLitLen - 1] == 0)
+        --numLitLen;
+    int numDist = NumDistSymbols;
+    while (numDist > 1 && distLengths[numDist - 1] == 0)
+        --numDist;
+
+    uint8_t allLengths[NumLitLenSymbols + NumDistSymbols];
+    std::copy (litLenLengths, litLenLengths + numLitLen, allLengths);
+    std::copy (distLengths, distLengths + numDist, allLengths + numLitLen);
+    std::vector<CodeLengthSymbol> codeLengthSymbols;
+    encodeCodeLengths (allLengths, numLitLen + numDist, codeLengthSymbols);
+
+    uint32_t codeLengthFreqs[NumCodeLengthSymbols] = {};
+    for (const auto& s : codeLengthSymbols)
+        ++codeLengthFreqs[s.symbol];
+    uint8_t codeLengthLengths[NumCodeLengthSymbols];
+    buildCodeLengths (codeLengthFreqs, NumCodeLengthSymbols, 7, codeLengthLengths);
+    int numCodeLengths = NumCodeLengthSymbols;
+    while (numCodeLengths > 4 && codeLengthLengths[codeLengthOrder[numCodeLengths - 1]] == 0)
+        --numCodeLengths;
+
+    uint8_t fixedLitLenLengths[NumFixedLitLenSymbols];
+    for (int i = 0; i < NumFixedLitLenSymbols; ++i)
+        fixedLitLenLengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    uint8_t fixedDistLengths[NumDistSymbols];
+    std::fill (fixedDistLengths, fixedDistLengths + NumDistSymbols, uint8_t(5));
+
+    uint64_t dynamicBits = 3 + 5 + 5 + 4 + 3 * numCodeLengths + extraBits;
+    uint64_t fixedBits = 3 + extraBits;
+    for (int i = 0; i < NumLitLenSymbols; ++i)
+    {
+        dynamicBits += uint64_t(litLenFreqs[i]) * litLenLengths[i];
+        fixedBits += uint64_t(litLenFreqs[i]) * fixedLitLenLengths[i];
+    }
+    for (int i = 0; i < NumDistSymbols; ++i)
+    {
+        dynamicBits += uint64_t(distFreqs[i]) * distLengths[i];
+        fixedBits += uint64_t(distFreqs[i]) * fixedDistLengths[i];
+    }
+    for (const auto& s : codeLengthSymbols)
+        dynamicBits += codeLengthLengths[s.symbol] + codeLengthExtraBits (s.symbol);
+
+    const uint64_t storedBits = (rawSize + 5 * std::max(size_t(1), (rawSize + 65534) / 65535)) * 8 + 7;
+
+    if (storedBits <= std::min(dynamicBits, fixedBits))
+    {
+        writeStoredBlocks (writer, rawData, rawSize, isFinal);
+        return;
+    }
+
+    uint16_t litLenCodes[NumFixedLitLenSymbols];
+    uint16_t distCodes[NumDistSymbols];
+    writer.put (isFinal ? 1 : 0, 1);
+    if (fixedBits <= dynamicBits)
+    {
+        writer.put (1, 2);
+        computeCodes (fixedLitLenLengths, NumFixedLitLenSymbols, litLenCodes);
+        computeCodes (fixedDistLengths, NumDistSymbols, distCodes);
+        writeTokens (writer, tokens, fixedLitLenLengths, litLenCodes, fixedDistLengths, distCodes);
+        return;
+    }
+
+    writer.put (2, 2);
+    writer.put (numLitLen - 257, 5);
+    writer.put (numDist - 1, 5);
+    writer.put (numCodeLengths - 4, 4);
+    for (int i = 0; i < numCodeLengths; ++i)
+        writer.put (codeLengthLengths[codeLengthOrder[i]], 3);
+
+    uint16_t codeLengthCodes[NumCodeLengthSymbols];
+    computeCodes (codeLengthLengths, NumCodeLengthSymbols, codeLengthCodes);
+    for (const auto& s : codeLengthSymbols)
+    {
+        writer.put (codeLengthCodes[s.symbol], codeLengthLengths[s.symbol]);
+        if (codeLengthExtraBits (s.symbol))
+            writer.put (s.extra, codeLengthExtraBits (s.symbol));
+    }
+
+    computeCodes (litLenLengths, NumLitLenSymbols, litLenCodes);
+    computeCodes (distLengths, NumDistSymbols, distCodes);
+    writeTokens (writer, tokens, litLenLengths, litLenCodes, distLengths, distCodes);
+}
+
+// Raw deflate of [begin,end). The bytes from dictStart can be referenced
+// by the matches, the decoder already has them. Unless it's the last
+// band, the output ends on a byte boundary with a non-final block so the
+// bands can be concatenated.
+void compressBand (const uint8_t* data, size_t dictStart, size_t begin, size_t end,
+                   const LevelParams& params, bool isLastBand, std::vector<uint8_t>& output)
+{
+    BitWriter writer (output);
+
+    if (params.maxChain == 0)
+    {
+        writeStoredBlocks (writer, data + begin, end - begin, isLastBand);
+        return;
+    }
+
+    // Positions are relative to dictStart from here.
+    const uint8_t* base = data + dictStart;
+    const int start = int(begin - dictStart);
+    const int n = int(end - dictStart);
+
+    std::vector<int32_t> head (1 << HashBits, -1);
+    std::vector<int32_t> prev (WindowSize, -1);
+
+    auto hashAt = [base](int p) {
+        const uint32_t v = base[p] | (uint32_t(base[p+1]) << 8) | (uint32_t(base[p+2]) << 16);
+        return (v * 2654435761u) >> (32 - HashBits);
+    };
+
+    auto insert = [&](int p) {
+        if (p + MinMatch > n)
+            return;
+        const uint32_t h = hashAt (p);
+        prev[p & (WindowSize - 1)] = head[h];
+        head[h] = p;
+    };
+
+    // The chain only goes back to positions inside the window, their
+    // prev entries can't have been overwritten yet.
+    auto findMatch = [&](int p, int& matchDist, int previousLen) {
+        const int limit = std::min(MaxMatch, n - p);
+        if (limit < MinMatch)
+            return 0;
+        const int minPos = std::max(0, p - WindowSize);
+        // Only the matches longer than previousLen are interesting.
+        int bestLen = std::max(previousLen, MinMatch - 1);
+        int foundLen = 0;
+        int chain = previousLen >= params.goodLength ? params.maxChain / 4 : params.maxChain;
+        for (int cand = head[hashAt (p)]; cand >= minPos && chain > 0; cand = prev[cand & (WindowSize - 1)], --chain)
+        {
+            if (base[cand + bestLen] != base[p + bestLen])
+                continue;
+            const int len = matchLength (base + cand, base + p, limit);
+            if (len > bestLen)
+            {
+                bestLen = len;
+                foundLen = len;
+                matchDist = p - cand;
+                if (len >= params.niceLength)
+                    break;
+            }
+        }
+        return foundLen;
+    };
+
+    for (int p = 0; p < start; ++p)
+        insert (p);
+
+    std::vector<Token> tokens;
+    tokens.reserve (MaxTokensPerBlock);
+    int blockStart = start;
+
+    // Match at p already found by the lazy evaluation.
+    bool hasPendingMatch = false;
+    int pendingLen = 0, pendingDist = 0;
+
+    int p = start;
+    while (p < n)
+    {
+        int len = 0, dist = 0;
+        if (hasPendingMatch)
+        {
+            len = pendingLen;
+            dist = pendingDist;
+            hasPendingMatch = false;
+        }
+        else
+        {
+            len = findMatch (p, dist, 0);
+        }
+        insert (p);
+
+        if (len > 0 && len < params.maxLazy && p + 1 < n)
+        {
+            int nextDist = 0;
+            const int nextLen = findMatch (p + 1, nextDist, len);
+            if (nextLen > len)
+            {
+                tokens.push_back ({ base[p], 0 });
+                ++p;
+                hasPendingMatch = true;
+                pendingLen = nextLen;
+                pendingDist = nextDist;
+                continue;
+            }
+        }
+
+        if (len > 0)
+        {
+            tokens.push_back ({ uint16_t(len), uint16_t(dist) });
+            if (len <= params.maxInsert)
+            {
+                for (int k = 1; k < len; ++k)
+                    insert (p + k);
+            }
+            p += len;
+        }
+        else
+        {
+            tokens.push_back ({ base[p], 0 });
+            ++p;
+        }
+
+        if (tokens.size() >= MaxTokensPerBlock)
+        {
+            writeBlock (writer, tokens, base + blockStart, p - blockStart, false);
+            tokens.clear ();
+            blockStart = p;
+        }
+    }
+
+    writeBlock (writer, tokens, base + blockStart, n - blockStart, isLastBand);
+
+    if (isLastBand)
+    {
+        writer.alignToByte ();
+    }
+    else if (!writer.isAligned ())
+    {
+        // Empty stored block, like a zlib sync flush.
+        writer.put (0, 3);
+        writer.alignToByte ();
+        writer.put (0x0000, 16);
+        writer.put (0xffff, 16);
+    }
+}
+
+// Filter with the minimum sum of absolute differences, the heuristic
+// recommended by the PNG spec. bpp is 3 or 4.
+void filterRows (const ImageSRGBA& image, int bpp, bool filtersEnabled, std::vector<uint8_t>& filtered)
+{
+    const int w = image.width();
+    const size_t rowBytes = size_t(w) * bpp;
+    const size_t stride = rowBytes + 1;
+    filtered.resize (stride * image.height());
+
+    auto packRow = [&](int r, uint8_t* out) {
+        const PixelSRGBA* inRow = image.atRowPtr (r);
+        if (bpp == 4)
+        {
+            memcpy (out, inRow, rowBytes);
+            return;
+        }
+        for (int c = 0; c < w; ++c)
+        {
+            out[c*3 + 0] = inRow[c].r;
+            out[c*3 + 1] = inRow[c].g;
+            out[c*3 + 2] = inRow[c].b;
+        }
+    };
+
+    parallel_for_rows (image.height(), [&](int firstRow, int lastRow) {
+        std::vector<uint8_t> current (rowBytes);
+        std::vector<uint8_t> above (rowBytes, 0);
+        std::vector<uint8_t> candidates (rowBytes * 5);
+        if (firstRow > 0)
+            packRow (firstRow - 1, above.data());
+
+        for (int r = firstRow; r < lastRow; ++r)
+        {
+            packRow (r, current.data());
+            uint8_t* outRow = filtered.data() + r * stride;
+
+            if (!filtersEnabled)
+            {
+                outRow[0] = 0;
+                memcpy (outRow + 1, current.data(), rowBytes);
+                std::swap (current, above);
+                continue;
+            }
+
+            const uint8_t* x = current.data();
+            const uint8_t* b = above.data();
+            uint8_t* none = candidates.data();
+            uint8_t* sub = none + rowBytes;
+            uint8_t* up = sub + rowBytes;
+            uint8_t* avg = up + rowBytes;
+            uint8_t* paeth = avg + rowBytes;
+
+            for (int i = 0; i < bpp; ++i)
+            {
+                none[i] = x[i];
+                sub[i] = x[i];
+                up[i] = uint8_t(x[i] - b[i]);
+                avg[i] = uint8_t(x[i] - (b[i] >> 1));
+                paeth[i] = uint8_t(x[i] - b[i]);
+            }
+
+            for (size_t i = bpp; i < rowBytes; ++i)
+            {
+                const int a = x[i - bpp];
+                const int c = b[i - bpp];
+                none[i] = x[i];
+                sub[i] = uint8_t(x[i] - a);
+                up[i] = uint8_t(x[i] - b[i]);
+                avg[i] = uint8_t(x[i] - ((a + b[i]) >> 1));
+
+                const int pred = a + b[i] - c;
+                const int pa = std::abs(pred - a);
+                const int pb = std::abs(pred - b[i]);
+                const int pc = std::abs(pred - c);
+                const int predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b[i] : c);
+                paeth[i] = uint8_t(x[i] - predictor);
+            }
+
+            int bestFilter = 0;
+            uint64_t bestSum = UINT64_MAX;
+            for (int f = 0; f < 5; ++f)
+            {
+                const int8_t* values = reinterpret_cast<const int8_t*>(candidates.data() + f * rowBytes);
+                uint64_t sum = 0;
+                for (size_t i = 0; i < rowBytes; ++i)
+                    sum += std::abs(int(values[i]));
+                if (sum < bestSum)
+                {
+                    bestSum = sum;
+                    bestFilter = f;
+                }
+            }
+
+            outRow[0] = uint8_t(bestFilter);
+            memcpy (outRow + 1, candidates.data() + bestFilter * rowBytes, rowBytes);
+            std::swap (current, above);
+        }
+    }, 32);
+}
+
+void appendUint32BE (std::vector<uint8_t>& output, uint32_t v)
+{
+    output.push_back (uint8_t(v >> 24));
+    output.push_back (uint8_t(v >> 16));
+    output.push_back (uint8_t(v >> 8));
+    output.push_back (uint8_t(v));
+}
+
+void appendChunk (std::vector<uint8_t>& output, const char type[4], const uint8_t* data, size_t size)
+{
+    appendUint32BE (output, uint32_t(size));
+    const size_t typeOffset = output.size();
+    output.insert (output.end(), type, type + 4);
+    if (size > 0)
+        output.insert (output.end(), data, data + size);
+    const uint32_t crc = updateCrc (0xffffffffu, output.data() + typeOffset, size + 4) ^ 0xffffffffu;
+    appendUint32BE (output, crc);
+}
+
+} // anonymous
+
+bool encodePng (const ImageSRGBA& image, int compressionLevel, std::vector<uint8_t>& output)
+{
+    const int w = image.width();
+    const int h = image.height();
+    if (w <= 0 || h <= 0)
+        return false;
+
+    const int level = keepInRange (compressionLevel, 0, 9);
+
+    std::atomic<bool> hasAlpha (false);
+    parallel_for_rows (h, [&](int firstRow, int lastRow) {
+        for (int r = firstRow; r < lastRow && !hasAlpha; ++r)
+        {
+            const PixelSRGBA* row = image.atRowPtr (r);
+            for (int c = 0; c < w; ++c)
+            {
+                if (row[c].a != 255)
+                {
+                    hasAlpha = true;
+                    break;
+                }
+            }
+        }
+    }, 64);
+    const int bpp = hasAlpha ? 4 : 3;
+
+    std::vector<uint8_t> filtered;
+    filterRows (image, bpp, level > 0, filtered);
+
+    const size_t stride = size_t(w) * bpp + 1;
+    const int rowsPerBand = int(std::max(size_t(1), BandBytes / stride));
+    const int numBands = (h + rowsPerBand - 1) / rowsPerBand;
+
+    // One IDAT chunk per band, so the CRCs get computed in parallel too.
+    struct Band
+    {
+        std::vector<uint8_t> idat;
+        size_t rawSize = 0;
+        uint32_t adler = 1;
+        uint32_t crc = 0;
+    };
+    std::vector<Band> bands (numBands);
+
+    ThreadPool::instance().parallelFor (numBands, [&](int i) {
+        Band& band = bands[i];
+        const size_t begin = size_t(i) * rowsPerBand * stride;
+        const size_t end = std::min(size_t(h), size_t(i + 1) * rowsPerBand) * stride;
+        const size_t dictStart = begin > size_t(WindowSize) ? begin - WindowSize : 0;
+
+        band.idat.reserve ((end - begin) / 2);
+        if (i == 0)
+        {
+            // zlib header, 32K window, with the compression level hint.
+            const uint8_t flags = level < 2 ? 0x01 : level < 6 ? 0x5e : level == 6 ? 0x9c : 0xda;
+            band.idat.push_back (0x78);
+            band.idat.push_back (flags);
+        }
+        compressBand (filtered.data(), dictStart, begin, end, levelParams[level], i == numBands - 1, band.idat);
+
+        band.rawSize = end - begin;
+        band.adler = adler32 (filtered.data() + begin, band.rawSize);
+        band.crc = updateCrc (0xffffffffu, reinterpret_cast<const uint8_t*>("IDAT"), 4);
+        band.crc = updateCrc (band.crc, band.idat.data(), band.idat.size());
+    });
+
+    uint32_t adler = bands[0].adler;
+    for (int i = 1; i < numBands; ++i)
+        adler = combineAdler32 (adler, bands[i].adler, bands[i].rawSize);
+
+    Band& lastBand = bands.back();
+    const size_t adlerOffset = lastBand.idat.size();
+    appendUint32BE (lastBand.idat, adler);
+    lastBand.crc = updateCrc (lastBand.crc, lastBand.idat.data() + adlerOffset, 4);
+
+    size_t totalSize = 8 + 25 + 12;
+    for (const auto& band : bands)
+        totalSize += band.idat.size() + 12;
+
+    output.clear ();
+    output.reserve (totalSize);
+    const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    output.insert (output.end(), signature, signature + 8);
+
+    uint8_t ihdr[13];
+    ihdr[0] = uint8_t(w >> 24); ihdr[1] = uint8_t(w >> 16); ihdr[2] = uint8_t(w >> 8); ihdr[3] = uint8_t(w);
+    ihdr[4] = uint8_t(h >> 24); ihdr[5] = uint8_t(h >> 16); ihdr[6] = uint8_t(h >> 8); ihdr[7] = uint8_t(h);
+    ihdr[8] = 8; // bit depth
+    ihdr[9] = hasAlpha ? 6 : 2; // RGBA or RGB
+    ihdr[10] = 0; // deflate
+    ihdr[11] = 0; // adaptive filtering
+    ihdr[12] = 0; // no interlace
+    appendChunk (output, "IHDR", ihdr, sizeof(ihdr));
+
+    for (const auto& band : bands)
+    {
+        appendUint32BE (output, uint32_t(band.idat.size()));
+        output.insert (output.end(), { 'I', 'D', 'A', 'T' });
+        output.insert (output.end(), band.idat.begin(), band.idat.end());
+        appendUint32BE (output, band.crc ^ 0xffffffffu);
+    }
+
+    appendChunk (output, "IEND", nullptr, 0);
+    return true;
+}
+
+} // zv
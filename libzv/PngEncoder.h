@@ -0,0 +1,26 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Image.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace zv
+{
+
+// PNG encoder with parallel filtering and deflate. The rows are split in
+// bands of about 1 MB that get compressed independently, each one still
+// matching against the end of the previous band, so the ratio stays
+// close to a single stream. The output does not depend on the number of
+// threads. Opaque images are written as RGB.
+//
+// compressionLevel goes from 0 (stored) to 9, like zlib.
+bool encodePng (const ImageSRGBA& image, int compressionLevel, std::vector<uint8_t>& output);
+
+} // zv
@@ -0,0 +1,341 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "Resampler.h"
+
+#include <libzv/ColorConversion.h>
+#include <libzv/ThreadPool.h>
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  include <emmintrin.h>
+#  define ZV_RESAMPLER_SSE2 1
+#else
+#  define ZV_RESAMPLER_SSE2 0
+#endif
+
+namespace zv
+{
+
+namespace
+{
+
+// Output rows computed together, bounds the size of the intermediate rows.
+constexpr int RowsPerChunk = 64;
+
+double sinc (double x)
+{
+    if (std::abs(x) < 1e-8)
+        return 1.0;
+    x *= M_PI;
+    return std::sin(x) / x;
+}
+
+double filterSupport (ResampleFilter filter)
+{
+    switch (filter)
+    {
+        case ResampleFilter::Box: return 0.5;
+        case ResampleFilter::Bilinear: return 1.0;
+        case ResampleFilter::Lanczos3: return 3.0;
+        default: return 0.0;
+    }
+}
+
+double filterValue (ResampleFilter filter, double x)
+{
+    switch (filter)
+    {
+        case ResampleFilter::Box: return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+        case ResampleFilter::Bilinear: return std::max(1.0 - std::abs(x), 0.0);
+        case ResampleFilter::Lanczos3: return std::abs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+        default: return 0.0;
+    }
+}
+
+// Contributions of the input pixels to each output pixel along one axis.
+// The weights of an output pixel are stored at index*stride and cover
+// the input pixels [first, first+count).
+struct WeightTable
+{
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<float> weights;
+    int stride = 0;
+
+    const float* weightsOf (int i) const { return weights.data() + i*stride; }
+};
+
+// Output pixels [outFirst, outFirst+numOut) of an output of size outSize
+// mapped on the input pixels [0, inSize). Out of range contributions go
+// to the border pixels.
+WeightTable computeWeightTable (ResampleFilter filter, int inSize, int outSize, int outFirst, int numOut)
+{
+    const double scale = inSize / double(outSize);
+
+    std::vector<std::vector<double>> allWeights (numOut);
+    WeightTable table;
+    table.first.resize (numOut);
+    table.count.resize (numOut);
+
+    for (int i = 0; i < numOut; ++i)
+    {
+        const int o = outFirst + i;
+        std::vector<double>& w = allWeights[i];
+        int first = 0;
+
+        if (filter == ResampleFilter::Area)
+        {
+            // Exact coverage of [o*scale, (o+1)*scale) by the input pixels.
+            const double x0 = o * scale;
+            const double x1 = (o + 1) * scale;
+            first = int(std::floor(x0));
+            const int last = std::max(int(std::ceil(x1)) - 1, first);
+            for (int k = first; k <= last; ++k)
+                w.push_back (std::max(std::min(x1, k + 1.0) - std::max(x0, double(k)), 0.0));
+        }
+        else
+        {
+            // The filter gets stretched when downscaling.
+            const double filterScale = std::max(scale, 1.0);
+            const double center = (o + 0.5) * scale - 0.5;
+            const double radius = filterSupport(filter) * filterScale;
+            first = int(std::floor(center - radius));
+            const int last = int(std::ceil(center + radius));
+            for (int k = first; k <= last; ++k)
+                w.push_back (filterValue(filter, (k - center) / filterScale));
+        }
+
+        // Replicate the borders.
+        const int clampedFirst = keepInRange (first, 0, inSize - 1);
+        const int clampedLast = keepInRange (first + int(w.size()) - 1, 0, inSize - 1);
+        std::vector<double> clamped (clampedLast - clampedFirst + 1, 0.0);
+        for (int k = 0; k < int(w.size()); ++k)
+            clamped[keepInRange(first + k, clampedFirst, clampedLast) - clampedFirst] += w[k];
+
+        // Trim the zero weights at both ends.
+        int begin = 0;
+        int end = int(clamped.size());
+        while (begin < end - 1 && clamped[begin] == 0.0) ++begin;
+        while (end > begin + 1 && clamped[end-1] == 0.0) --end;
+
+        double sum = 0.0;
+        for (int k = begin; k < end; ++k)
+            sum += clamped[k];
+
+        w.assign (clamped.begin() + begin, clamped.begin() + end);
+        if (std::abs(sum) < 1e-8)
+        {
+            // Can't happen with sensible filters, fall back to the nearest pixel.
+            w.assign (1, 1.0);
+            first = keepInRange (int(std::floor((o + 0.5) * scale)), 0, inSize - 1);
+        }
+        else
+        {
+            for (double& v : w)
+                v /= sum;
+            first = clampedFirst + begin;
+        }
+
+        table.first[i] = first;
+        table.count[i] = int(w.size());
+        table.stride = std::max(table.stride, int(w.size()));
+    }
+
+    table.weights.assign (size_t(numOut) * table.stride, 0.f);
+    for (int i = 0; i < numOut; ++i)
+        for (int k = 0; k < table.count[i]; ++k)
+            table.weights[i*table.stride + k] = float(allWeights[i][k]);
+    return table;
+}
+
+// Linear light, premultiplied alpha, 4 floats per pixel.
+void convertRowToLinear (const PixelSRGBA* inRowPtr, int width, float* outRowPtr)
+{
+    const auto& toLinear = srgbTables().toLinear;
+    for (int c = 0; c < width; ++c)
+    {
+        const PixelSRGBA& p = inRowPtr[c];
+        const float alpha = p.a * (1.f / 255.f);
+        outRowPtr[4*c+0] = toLinear[p.r] * alpha;
+        outRowPtr[4*c+1] = toLinear[p.g] * alpha;
+        outRowPtr[4*c+2] = toLinear[p.b] * alpha;
+        outRowPtr[4*c+3] = alpha;
+    }
+}
+
+void convertRowToSrgb (const float* inRowPtr, int width, PixelSRGBA* outRowPtr)
+{
+    const auto& tables = srgbTables();
+    auto srgbValue = [&](float v) { return tables.linearToSrgb8 (v); };
+
+    for (int c = 0; c < width; ++c)
+    {
+        const float* p = inRowPtr + 4*c;
+        const float alpha = keepInRange(p[3], 0.f, 1.f);
+        const float invAlpha = alpha > 0.f ? 1.f / alpha : 0.f;
+        outRowPtr[c] = PixelSRGBA(srgbValue(p[0] * invAlpha),
+                                  srgbValue(p[1] * invAlpha),
+                                  srgbValue(p[2] * invAlpha),
+                                  uint8_t(alpha * 255.f + 0.5f));
+    }
+}
+
+void filterRowHorizontally (const float* inRowPtr, const WeightTable& table, float* outRowPtr)
+{
+    const int numOut = int(table.first.size());
+    for (int o = 0; o < numOut; ++o)
+    {
+        const float* inPtr = inRowPtr + 4*table.first[o];
+        const float* w = table.weightsOf(o);
+        const int count = table.count[o];
+#if ZV_RESAMPLER_SSE2
+        __m128 acc = _mm_setzero_ps ();
+        for (int k = 0; k < count; ++k)
+            acc = _mm_add_ps (acc, _mm_mul_ps (_mm_set1_ps (w[k]), _mm_loadu_ps (inPtr + 4*k)));
+        _mm_storeu_ps (outRowPtr + 4*o, acc);
+#else
+        float acc[4] = {0,0,0,0};
+        for (int k = 0; k < count; ++k)
+            for (int j = 0; j < 4; ++j)
+                acc[j] += w[k] * inPtr[4*k+j];
+        for (int j = 0; j < 4; ++j)
+            outRowPtr[4*o+j] = acc[j];
+#endif
+    }
+}
+
+// Sum of weights[k] * rows[k], numFloats per row.
+void blendRows (const float* const* rows, const float* weights, int count, int numFloats, float* outRowPtr)
+{
+    int i = 0;
+#if ZV_RESAMPLER_SSE2
+    for (; i + 8 <= numFloats; i += 8)
+    {
+        __m128 acc0 = _mm_setzero_ps ();
+        __m128 acc1 = _mm_setzero_ps ();
+        for (int k = 0; k < count; ++k)
+        {
+            const __m128 w = _mm_set1_ps (weights[k]);
+            acc0 = _mm_add_ps (acc0, _mm_mul_ps (w, _mm_loadu_ps (rows[k] + i)));
+            acc1 = _mm_add_ps (acc1, _mm_mul_ps (w, _mm_loadu_ps (rows[k] + i + 4)));
+        }
+        _mm_storeu_ps (outRowPtr + i, acc0);
+        _mm_storeu_ps (outRowPtr + i + 4, acc1);
+    }
+#endif
+    for (; i < numFloats; ++i)
+    {
+        float acc = 0.f;
+        for (int k = 0; k < count; ++k)
+            acc += weights[k] * rows[k][i];
+        outRowPtr[i] = acc;
+    }
+}
+
+// Horizontally filtered input rows, computed on demand. The vertical
+// windows only move forward, so a ring as large as the widest window
+// never recomputes a row.
+class FilteredRowsRing
+{
+public:
+    FilteredRowsRing (const ImageSRGBA& input, const ResampleGeometry& geometry,
+                      const WeightTable& horizontal, int ringSize)
+    : _input (input), _geometry (geometry), _horizontal (horizontal),
+      _ringSize (ringSize), _rowFloats (4 * int(horizontal.first.size())),
+      _rows (size_t(ringSize) * _rowFloats), _rowIndices (ringSize, -1),
+      _linearRow (4 * size_t(geometry.inputWidth))
+    {}
+
+    // Row index relative to the input region.
+    const float* row (int inRow)
+    {
+        const int slot = inRow % _ringSize;
+        float* rowPtr = _rows.data() + size_t(slot) * _rowFloats;
+        if (_rowIndices[slot] != inRow)
+        {
+            const PixelSRGBA* inRowPtr = _input.atRowPtr(_geometry.inputY0 + inRow) + _geometry.inputX0;
+            convertRowToLinear (inRowPtr, _geometry.inputWidth, _linearRow.data());
+            filterRowHorizontally (_linearRow.data(), _horizontal, rowPtr);
+            _rowIndices[slot] = inRow;
+        }
+        return rowPtr;
+    }
+
+    int rowFloats () const { return _rowFloats; }
+
+private:
+    const ImageSRGBA& _input;
+    const ResampleGeometry& _geometry;
+    const WeightTable& _horizontal;
+    const int _ringSize;
+    const int _rowFloats;
+    std::vector<float> _rows;
+    std::vector<int> _rowIndices;
+    std::vector<float> _linearRow;
+};
+
+} // anonymous
+
+const char* resampleFilterName (ResampleFilter filter)
+{
+    switch (filter)
+    {
+        case ResampleFilter::Box: return "Box";
+        case ResampleFilter::Bilinear: return "Bilinear";
+        case ResampleFilter::Lanczos3: return "Lanczos3";
+        case ResampleFilter::Area: return "Area";
+        default: return "Invalid";
+    }
+}
+
+void resampleImage (const ImageSRGBA& input, const ResampleGeometry& geometry,
+                    ResampleFilter filter, ImageSRGBA& output)
+{
+    zv_assert (geometry.inputWidth > 0 && geometry.inputHeight > 0, "Empty input region");
+    zv_assert (geometry.outputX0 + output.width() <= geometry.outputWidth
+               && geometry.outputY0 + output.height() <= geometry.outputHeight,
+               "The output is larger than the output region");
+
+    const WeightTable horizontal = computeWeightTable (filter, geometry.inputWidth, geometry.outputWidth,
+                                                       geometry.outputX0, output.width());
+    const WeightTable vertical = computeWeightTable (filter, geometry.inputHeight, geometry.outputHeight,
+                                                     geometry.outputY0, output.height());
+
+    const int numChunks = (output.height() + RowsPerChunk - 1) / RowsPerChunk;
+    ThreadPool::instance().parallelFor (numChunks, [&](int chunk) {
+        const int firstRow = chunk * RowsPerChunk;
+        const int lastRow = std::min(firstRow + RowsPerChunk, output.height());
+
+        FilteredRowsRing ring (input, geometry, horizontal, vertical.stride + 1);
+        std::vector<const float*> rows (vertical.stride);
+        std::vector<float> outRow (ring.rowFloats());
+        for (int r = firstRow; r < lastRow; ++r)
+        {
+            const int count = vertical.count[r];
+            for (int k = 0; k < count; ++k)
+                rows[k] = ring.row (vertical.first[r] + k);
+            blendRows (rows.data(), vertical.weightsOf(r), count, ring.rowFloats(), outRow.data());
+            convertRowToSrgb (outRow.data(), output.width(), output.atRowPtr(r));
+        }
+    });
+}
+
+void resampleImage (const ImageSRGBA& input, ImageSRGBA& output, ResampleFilter filter)
+{
+    ResampleGeometry geometry;
+    geometry.inputWidth = input.width();
+    geometry.inputHeight = input.height();
+    geometry.outputWidth = output.width();
+    geometry.outputHeight = output.height();
+    resampleImage (input, geometry, filter, output);
+}
+
+} // zv
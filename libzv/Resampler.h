@@ -0,0 +1,56 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/Image.h>
+
+namespace zv
+{
+
+enum class ResampleFilter
+{
+    Box,
+    Bilinear,
+    Lanczos3,
+    // Exact average of the covered input pixels, best for downscaling.
+    Area,
+
+    NumFilters,
+};
+
+const char* resampleFilterName (ResampleFilter filter);
+
+struct ResampleGeometry
+{
+    // Region of the input that gets resampled. Pixels outside of it are
+    // never read, the borders get replicated.
+    int inputX0 = 0;
+    int inputY0 = 0;
+    int inputWidth = 0;
+    int inputHeight = 0;
+
+    // Size of the full output.
+    int outputWidth = 0;
+    int outputHeight = 0;
+
+    // Region of the full output that gets computed. Its size is the size
+    // of the output image.
+    int outputX0 = 0;
+    int outputY0 = 0;
+};
+
+// Separable resampling in linear light with premultiplied alpha. The
+// filter weights are precomputed once per output row and column, and the
+// bands of output rows are processed by the shared ThreadPool. The output
+// must already be allocated.
+void resampleImage (const ImageSRGBA& input, const ResampleGeometry& geometry,
+                    ResampleFilter filter, ImageSRGBA& output);
+
+// Whole input to the whole output.
+void resampleImage (const ImageSRGBA& input, ImageSRGBA& output, ResampleFilter filter);
+
+} // zv
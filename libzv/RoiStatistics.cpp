@@ -0,0 +1,283 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "RoiStatistics.h"
+
+#include <libzv/ImageList.h>
+#include <libzv/ThreadPool.h>
+#include <libzv/Utils.h>
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+
+namespace zv
+{
+
+RoiStatisticsIndex::BlockRange RoiStatisticsIndex::mergedRange (const BlockRange& lhs, const BlockRange& rhs)
+{
+    BlockRange merged;
+    for (int k = 0; k < 3; ++k)
+    {
+        merged.minValue[k] = std::min(lhs.minValue[k], rhs.minValue[k]);
+        merged.maxValue[k] = std::max(lhs.maxValue[k], rhs.maxValue[k]);
+    }
+    return merged;
+}
+
+RoiStatisticsIndex::RoiStatisticsIndex (const std::shared_ptr<const ImageSRGBA>& image)
+: _image (image)
+, _width (image->width())
+, _height (image->height())
+, _sums (new Sums[size_t(image->width() + 1) * (image->height() + 1)])
+{
+    const ImageSRGBA& im = *_image;
+    std::fill (sumsRowPtr(0), sumsRowPtr(0) + _width + 1, Sums {});
+
+    // Prefix sums along the rows first, the rows are independent.
+    parallel_for_rows (_height, [&](int firstRow, int lastRow) {
+        for (int r = firstRow; r < lastRow; ++r)
+        {
+            const PixelSRGBA* inPtr = im.atRowPtr(r);
+            Sums* outPtr = sumsRowPtr(r + 1);
+            Sums acc = {};
+            outPtr[0] = acc;
+            for (int c = 0; c < _width; ++c)
+            {
+                const uint32_t v[3] = { inPtr[c].r, inPtr[c].g, inPtr[c].b };
+                for (int k = 0; k < 3; ++k)
+                {
+                    acc.sum[k] += v[k];
+                    acc.sumSq[k] += v[k] * v[k];
+                }
+                outPtr[c + 1] = acc;
+            }
+        }
+    });
+
+    // Then down the columns, with bands of columns in parallel so each
+    // thread reads and writes contiguous segments of the rows.
+    parallel_for_rows (_width + 1, [&](int firstCol, int lastCol) {
+        for (int r = 2; r <= _height; ++r)
+        {
+            const Sums* abovePtr = sumsRowPtr(r - 1);
+            Sums* rowPtr = sumsRowPtr(r);
+            for (int c = firstCol; c < lastCol; ++c)
+            for (int k = 0; k < 3; ++k)
+            {
+                rowPtr[c].sum[k] += abovePtr[c].sum[k];
+                rowPtr[c].sumSq[k] += abovePtr[c].sumSq[k];
+            }
+        }
+    }, 64 /* min columns per band */);
+
+    _numBlocksX = (_width + BlockSize - 1) / BlockSize;
+    _numBlocksY = (_height + BlockSize - 1) / BlockSize;
+    std::vector<BlockRange> blocks (size_t(_numBlocksX) * _numBlocksY);
+    parallel_for_rows (_numBlocksY, [&](int firstBlockRow, int lastBlockRow) {
+        for (int by = firstBlockRow; by < lastBlockRow; ++by)
+        for (int bx = 0; bx < _numBlocksX; ++bx)
+        {
+            RoiStats blockStats;
+            for (int k = 0; k < 3; ++k)
+            {
+                blockStats.minValue[k] = 255;
+                blockStats.maxValue[k] = 0;
+            }
+            scanMinMax (bx * BlockSize,
+                        by * BlockSize,
+                        std::min((bx + 1) * BlockSize, _width),
+                        std::min((by + 1) * BlockSize, _height),
+                        blockStats);
+            BlockRange& block = blocks[size_t(by) * _numBlocksX + bx];
+            for (int k = 0; k < 3; ++k)
+            {
+                block.minValue[k] = blockStats.minValue[k];
+                block.maxValue[k] = blockStats.maxValue[k];
+            }
+        }
+    }, 1 /* min block rows per band */);
+
+    _blockLevels.push_back (std::move(blocks));
+    for (int span = 2; span <= _numBlocksX; span *= 2)
+    {
+        const std::vector<BlockRange>& previous = _blockLevels.back();
+        std::vector<BlockRange> level (previous.size());
+        const int halfSpan = span / 2;
+        for (int by = 0; by < _numBlocksY; ++by)
+        for (int bx = 0; bx + span <= _numBlocksX; ++bx)
+        {
+            const size_t idx = size_t(by) * _numBlocksX + bx;
+            level[idx] = mergedRange (previous[idx], previous[idx + halfSpan]);
+        }
+        _blockLevels.push_back (std::move(level));
+    }
+}
+
+void RoiStatisticsIndex::scanMinMax (int x0, int y0, int x1, int y1, RoiStats& stats) const
+{
+    for (int r = y0; r < y1; ++r)
+    {
+        const PixelSRGBA* rowPtr = _image->atRowPtr(r);
+        for (int c = x0; c < x1; ++c)
+        {
+            const int v[3] = { rowPtr[c].r, rowPtr[c].g, rowPtr[c].b };
+            for (int k = 0; k < 3; ++k)
+            {
+                stats.minValue[k] = std::min(stats.minValue[k], v[k]);
+                stats.maxValue[k] = std::max(stats.maxValue[k], v[k]);
+            }
+        }
+    }
+}
+
+RoiStats RoiStatisticsIndex::query (int x0, int y0, int width, int height) const
+{
+    RoiStats stats;
+    const int x1 = std::min(x0 + width, _width);
+    const int y1 = std::min(y0 + height, _height);
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    if (x1 <= x0 || y1 <= y0)
+        return stats;
+
+    stats.numPixels = int64_t(x1 - x0) * (y1 - y0);
+    const Sums& topLeft = sumsAt (x0, y0);
+    const Sums& topRight = sumsAt (x1, y0);
+    const Sums& bottomLeft = sumsAt (x0, y1);
+    const Sums& bottomRight = sumsAt (x1, y1);
+    for (int k = 0; k < 3; ++k)
+    {
+        const uint64_t sum = bottomRight.sum[k] - topRight.sum[k] - bottomLeft.sum[k] + topLeft.sum[k];
+        const uint64_t sumSq = bottomRight.sumSq[k] - topRight.sumSq[k] - bottomLeft.sumSq[k] + topLeft.sumSq[k];
+        stats.mean[k] = double(sum) / stats.numPixels;
+        stats.stddev[k] = std::sqrt (std::max(double(sumSq) / stats.numPixels - stats.mean[k] * stats.mean[k], 0.));
+        stats.minValue[k] = 255;
+        stats.maxValue[k] = 0;
+    }
+
+    // Blocks fully inside the rect, and the pixels around them.
+    const int bx0 = (x0 + BlockSize - 1) / BlockSize;
+    const int by0 = (y0 + BlockSize - 1) / BlockSize;
+    const int bx1 = x1 / BlockSize;
+    const int by1 = y1 / BlockSize;
+    if (bx0 >= bx1 || by0 >= by1)
+    {
+        scanMinMax (x0, y0, x1, y1, stats);
+        return stats;
+    }
+
+    // Two overlapping spans of 2^level blocks cover each row of blocks.
+    int level = 0;
+    while ((2 << level) <= bx1 - bx0)
+        ++level;
+    const std::vector<BlockRange>& levelBlocks = _blockLevels[level];
+    for (int by = by0; by < by1; ++by)
+    {
+        const BlockRange* blockPtr = &levelBlocks[size_t(by) * _numBlocksX];
+        const BlockRange range = mergedRange (blockPtr[bx0], blockPtr[bx1 - (1 << level)]);
+        for (int k = 0; k < 3; ++k)
+        {
+            stats.minValue[k] = std::min(stats.minValue[k], int(range.minValue[k]));
+            stats.maxValue[k] = std::max(stats.maxValue[k], int(range.maxValue[k]));
+        }
+    }
+
+    const int innerX0 = bx0 * BlockSize;
+    const int innerY0 = by0 * BlockSize;
+    const int innerX1 = bx1 * BlockSize;
+    const int innerY1 = by1 * BlockSize;
+    scanMinMax (x0, y0, x1, innerY0, stats);
+    scanMinMax (x0, innerY1, x1, y1, stats);
+    scanMinMax (x0, innerY0, innerX0, innerY1, stats);
+    scanMinMax (innerX1, innerY0, x1, innerY1, stats);
+    return stats;
+}
+
+const RoiStatisticsCache::Entry* RoiStatisticsCache::findEntry (const ImageItemData& data) const
+{
+    for (const auto& entry : _entries)
+    {
+        if (entry.data.lock().get() == &data && entry.contentId == data.contentId)
+            return &entry;
+    }
+    return nullptr;
+}
+
+RoiStatisticsIndexPtr RoiStatisticsCache::index (const std::shared_ptr<ImageItemData>& data)
+{
+    // Forget the images that are gone or changed.
+    _entries.erase (std::remove_if (_entries.begin(), _entries.end(), [&](const Entry& entry) {
+        const auto entryData = entry.data.lock();
+        return !entryData || (entryData == data && entry.contentId != data->contentId);
+    }), _entries.end());
+
+    auto entryIt = std::find_if (_entries.begin(), _entries.end(), [&](const Entry& entry) {
+        return entry.data.lock() == data;
+    });
+    if (entryIt != _entries.end())
+    {
+        entryIt->requested = true;
+    }
+    else
+    {
+        Entry newEntry;
+        newEntry.data = data;
+        newEntry.contentId = data->contentId;
+        // Only locked for the conversion, the item and its GL texture
+        // should go away on this thread.
+        std::weak_ptr<ImageItemData> weakData = data;
+        newEntry.index = _worker.compute<RoiStatisticsIndexPtr> ([weakData]() -> RoiStatisticsIndexPtr {
+            std::shared_ptr<const ImageSRGBA> image;
+            if (auto data = weakData.lock())
+                image = data->srgbaDataPtr ();
+            if (!image)
+                return nullptr;
+            try
+            {
+                return std::make_shared<const RoiStatisticsIndex>(image);
+            }
+            catch (const std::bad_alloc&)
+            {
+                zv_dbg ("Not enough memory for the summed-area tables of a %dx%d image", image->width(), image->height());
+                return nullptr;
+            }
+        });
+        _entries.push_back (std::move(newEntry));
+    }
+
+    return readyIndex (*data);
+}
+
+RoiStatisticsIndexPtr RoiStatisticsCache::readyIndex (const ImageItemData& data) const
+{
+    const Entry* entry = findEntry (data);
+    if (!entry || !entry->index->isReady())
+        return nullptr;
+    return entry->index->value();
+}
+
+bool RoiStatisticsCache::isPending (const ImageItemData& data) const
+{
+    const Entry* entry = findEntry (data);
+    return entry && !entry->index->isReady();
+}
+
+void RoiStatisticsCache::releaseUnused ()
+{
+    _entries.erase (std::remove_if (_entries.begin(), _entries.end(), [](const Entry& entry) {
+        return !entry.requested;
+    }), _entries.end());
+    for (auto& entry : _entries)
+        entry.requested = false;
+}
+
+void RoiStatisticsCache::clear ()
+{
+    _entries.clear ();
+}
+
+} // zv
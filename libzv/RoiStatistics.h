@@ -0,0 +1,123 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <libzv/BackgroundWorker.h>
+#include <libzv/Image.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace zv
+{
+
+struct ImageItemData;
+
+// Statistics of a rectangle, on the 8 bits values. Alpha is ignored.
+struct RoiStats
+{
+    int64_t numPixels = 0;
+    double mean[3] = {};
+    double stddev[3] = {};
+    int minValue[3] = {};
+    int maxValue[3] = {};
+};
+
+// Summed-area tables of the RGB values and of their squares, in 64 bits,
+// so the mean and the standard deviation of any rectangle take 4 lookups.
+// The min and max come from the 16x16 blocks inside the rectangle, with
+// a sparse table per row of blocks so each row takes 2 lookups, plus the
+// pixels of the partial blocks on the borders. Takes 48 bytes per pixel.
+class RoiStatisticsIndex
+{
+public:
+    // Rows are processed in parallel, then columns.
+    RoiStatisticsIndex (const std::shared_ptr<const ImageSRGBA>& image);
+
+    int width () const { return _width; }
+    int height () const { return _height; }
+
+    // The rect gets clipped to the image.
+    RoiStats query (int x0, int y0, int width, int height) const;
+
+private:
+    static constexpr int BlockSize = 16;
+
+    struct Sums
+    {
+        uint64_t sum[3];
+        uint64_t sumSq[3];
+    };
+
+    Sums* sumsRowPtr (int y) const { return _sums.get() + size_t(y) * (_width + 1); }
+    const Sums& sumsAt (int x, int y) const { return sumsRowPtr(y)[x]; }
+
+    struct BlockRange
+    {
+        uint8_t minValue[3];
+        uint8_t maxValue[3];
+    };
+
+    static BlockRange mergedRange (const BlockRange& lhs, const BlockRange& rhs);
+    void scanMinMax (int x0, int y0, int x1, int y1, RoiStats& stats) const;
+
+private:
+    // Kept for the min/max of the border pixels.
+    std::shared_ptr<const ImageSRGBA> _image;
+    int _width = 0;
+    int _height = 0;
+
+    // (width+1) x (height+1), the first row and column are zero. Not a
+    // vector to skip the zero initialization of a huge buffer.
+    std::unique_ptr<Sums[]> _sums;
+
+    int _numBlocksX = 0;
+    int _numBlocksY = 0;
+    // Level i covers 2^i consecutive blocks of a row, starting at each block.
+    std::vector<std::vector<BlockRange>> _blockLevels;
+};
+using RoiStatisticsIndexPtr = std::shared_ptr<const RoiStatisticsIndex>;
+
+// Indices of the images currently measured, built in the background on
+// the first request. Images showing the same data share their index.
+class RoiStatisticsCache
+{
+public:
+    // Starts building the index on the first call. Null until it is
+    // ready, or if it could not be allocated.
+    RoiStatisticsIndexPtr index (const std::shared_ptr<ImageItemData>& data);
+
+    // Null if it was never requested, or if it is not ready yet.
+    RoiStatisticsIndexPtr readyIndex (const ImageItemData& data) const;
+    bool isPending (const ImageItemData& data) const;
+
+    // Forgets the indices that were not requested since the previous
+    // call, so only the images on screen keep theirs. Meant to be called
+    // once per frame, before the requests.
+    void releaseUnused ();
+
+    // Never waits, a running build completes in the background and its
+    // result gets dropped.
+    void clear ();
+
+private:
+    struct Entry
+    {
+        std::weak_ptr<ImageItemData> data;
+        int64_t contentId = -1;
+        AsyncResultPtr<RoiStatisticsIndexPtr> index;
+        bool requested = true;
+    };
+    const Entry* findEntry (const ImageItemData& data) const;
+
+private:
+    BackgroundWorker _worker;
+    std::vector<Entry> _entries;
+};
+
+} // zv
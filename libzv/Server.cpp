@@ -11,6 +11,7 @@
 
 #include <libzv/Utils.h>
 #include <libzv/ImageList.h>
+#include <libzv/ImageBufferPool.h>
 
 #include <stb_image.h>
 
@@ -236,9 +237,9 @@ private:
             if (imageContent.hasData())
             {
                 imageItem->source = ImageItem::Source::Data;                
-                imageItem->sourceData = std::make_shared<ImageSRGBA>(std::move(imageContent));
-                imageItem->metadata.width = imageContent.width();
-                imageItem->metadata.height = imageContent.height();
+                imageItem->sourceData = ImageBufferPool::instance().share (std::move(imageContent));
+                imageItem->metadata.width = imageItem->sourceData->width();
+                imageItem->metadata.height = imageItem->sourceData->height();
             }
             else
             {
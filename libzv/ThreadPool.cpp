@@ -0,0 +1,231 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace zv
+{
+
+namespace
+{
+
+struct Job
+{
+    const std::function<void(int)>* func = nullptr;
+    std::atomic<int> remainingTasks {0};
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+};
+
+// A range of indices of a job.
+struct Task
+{
+    Job* job = nullptr;
+    int begin = 0;
+    int end = 0;
+};
+
+struct TaskQueue
+{
+    std::mutex mutex;
+    std::deque<Task> tasks;
+};
+
+thread_local bool insidePoolTask = false;
+
+} // anonymous
+
+struct ThreadPool::Impl
+{
+    std::vector<std::thread> workers;
+    // One per worker, plus one for the calling threads.
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+    std::atomic<int> numQueuedTasks {0};
+    bool stopRequested = false;
+
+    // The owner pops from the front, thieves from the back.
+    bool popTask (int queueIdx, Task& task)
+    {
+        TaskQueue& q = *queues[queueIdx];
+        std::lock_guard<std::mutex> lock (q.mutex);
+        if (q.tasks.empty())
+            return false;
+        task = q.tasks.front();
+        q.tasks.pop_front();
+        return true;
+    }
+
+    bool stealTask (int thiefIdx, Task& task)
+    {
+        const int numQueues = int(queues.size());
+        for (int i = 1; i <= numQueues; ++i)
+        {
+            TaskQueue& q = *queues[(thiefIdx + i) % numQueues];
+            std::lock_guard<std::mutex> lock (q.mutex);
+            if (q.tasks.empty())
+                continue;
+            task = q.tasks.back();
+            q.tasks.pop_back();
+            return true;
+        }
+        return false;
+    }
+
+    bool findTask (int queueIdx, Task& task)
+    {
+        if (!popTask (queueIdx, task) && !stealTask (queueIdx, task))
+            return false;
+        --numQueuedTasks;
+        return true;
+    }
+
+    void runTask (const Task& task)
+    {
+        const bool wasInsidePoolTask = insidePoolTask;
+        insidePoolTask = true;
+        for (int i = task.begin; i < task.end; ++i)
+            (*task.job->func) (i);
+        insidePoolTask = wasInsidePoolTask;
+
+        // Under the lock so the caller can't return and destroy the job
+        // before we're done with it.
+        std::lock_guard<std::mutex> lock (task.job->doneMutex);
+        if (--task.job->remainingTasks == 0)
+            task.job->doneCondition.notify_all ();
+    }
+
+    void workerLoop (int queueIdx)
+    {
+        while (true)
+        {
+            Task task;
+            if (findTask (queueIdx, task))
+            {
+                runTask (task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock (wakeMutex);
+            wakeCondition.wait (lock, [this]() { return stopRequested || numQueuedTasks > 0; });
+            if (stopRequested)
+                return;
+        }
+    }
+};
+
+ThreadPool& ThreadPool::instance ()
+{
+    static ThreadPool pool (std::max(int(std::thread::hardware_concurrency()) - 1, 0));
+    return pool;
+}
+
+ThreadPool::ThreadPool (int numWorkers)
+: impl (new Impl())
+{
+    for (int i = 0; i < numWorkers + 1; ++i)
+        impl->queues.push_back (std::make_unique<TaskQueue>());
+
+    for (int i = 0; i < numWorkers; ++i)
+        impl->workers.emplace_back ([this, i]() { impl->workerLoop (i); });
+}
+
+ThreadPool::~ThreadPool ()
+{
+    {
+        std::lock_guard<std::mutex> lock (impl->wakeMutex);
+        impl->stopRequested = true;
+    }
+    impl->wakeCondition.notify_all ();
+    for (auto& t : impl->workers)
+        t.join ();
+}
+
+int ThreadPool::numThreads () const
+{
+    return int(impl->workers.size()) + 1;
+}
+
+void ThreadPool::parallelFor (int numTasks, const std::function<void(int)>& func)
+{
+    if (numTasks <= 0)
+        return;
+
+    if (impl->workers.empty() || numTasks == 1 || insidePoolTask)
+    {
+        for (int i = 0; i < numTasks; ++i)
+            func (i);
+        return;
+    }
+
+    // A few chunks per thread so the stealing can balance uneven tasks.
+    const int numQueues = int(impl->queues.size());
+    const int numChunks = std::min(numTasks, numQueues * 4);
+    Job job;
+    job.func = &func;
+    job.remainingTasks = numChunks;
+    for (int chunk = 0; chunk < numChunks; ++chunk)
+    {
+        Task task;
+        task.job = &job;
+        task.begin = int((int64_t(numTasks) * chunk) / numChunks);
+        task.end = int((int64_t(numTasks) * (chunk + 1)) / numChunks);
+        TaskQueue& q = *impl->queues[chunk % numQueues];
+        std::lock_guard<std::mutex> lock (q.mutex);
+        q.tasks.push_back (task);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock (impl->wakeMutex);
+        impl->numQueuedTasks += numChunks;
+    }
+    impl->wakeCondition.notify_all ();
+
+    // Help until our own job is done. This may run tasks of other
+    // jobs too, that's fine.
+    const int callerQueueIdx = numQueues - 1;
+    while (job.remainingTasks > 0)
+    {
+        Task task;
+        if (impl->findTask (callerQueueIdx, task))
+        {
+            impl->runTask (task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock (job.doneMutex);
+        job.doneCondition.wait (lock, [&job]() { return job.remainingTasks == 0; });
+    }
+
+    // Wait for the last task to release the lock.
+    std::lock_guard<std::mutex> lock (job.doneMutex);
+}
+
+void parallel_for_rows (int numRows,
+                        const std::function<void(int firstRow, int lastRow)>& func,
+                        int minRowsPerBand)
+{
+    ThreadPool& pool = ThreadPool::instance();
+    const int numBands = std::max(1, std::min(numRows / std::max(minRowsPerBand, 1), pool.numThreads() * 4));
+    pool.parallelFor (numBands, [&](int band) {
+        const int firstRow = int((int64_t(numRows) * band) / numBands);
+        const int lastRow = int((int64_t(numRows) * (band + 1)) / numBands);
+        if (firstRow < lastRow)
+            func (firstRow, lastRow);
+    });
+}
+
+} // zv
@@ -0,0 +1,53 @@
+//
+// Copyright (c) 2017, Nicolas Burrus
+// This software may be modified and distributed under the terms
+// of the BSD license.  See the LICENSE file for details.
+//
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+namespace zv
+{
+
+// Small work-stealing pool shared by the CPU image kernels. Each worker
+// has its own queue of tasks and steals from the others once it's empty.
+// The calling thread also executes tasks while it waits, and calls from
+// inside a task run serially so nested loops can't deadlock.
+class ThreadPool
+{
+public:
+    static ThreadPool& instance ();
+
+public:
+    ThreadPool (int numWorkers);
+    ~ThreadPool ();
+
+    // Including the calling thread.
+    int numThreads () const;
+
+    // Runs func(i) for i in [0, numTasks) and returns once they are all done.
+    void parallelFor (int numTasks, const std::function<void(int)>& func);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+// Calls func(firstRow, lastRow) on bands of at least minRowsPerBand rows,
+// in parallel.
+void parallel_for_rows (int numRows,
+                        const std::function<void(int firstRow, int lastRow)>& func,
+                        int minRowsPerBand = 16);
+
+template <class ImageT>
+void parallel_for_rows (const ImageT& image,
+                        const std::function<void(int firstRow, int lastRow)>& func,
+                        int minRowsPerBand = 16)
+{
+    parallel_for_rows (image.height(), func, minRowsPerBand);
+}
+
+} // zv
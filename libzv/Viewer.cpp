@@ -11,6 +11,7 @@
 #include <libzv/Utils.h>
 
 #include <libzv/ImageList.h>
+#include <libzv/ImageWriter.h>
 #include <libzv/ImageWindow.h>
 #include <libzv/ControlsWindow.h>
 #include <libzv/HelpWindow.h>
@@ -56,6 +57,9 @@ struct Viewer::Impl
     
     void renderFrame ()
     {
+        // The saved images only point to their new file from here.
+        ImageWriter::instance().processCompletedWrites ();
+
         if (state.helpRequested)
         {
             if (!helpWindow.isInitialized())
@@ -185,7 +189,8 @@ bool Viewer::initialize ()
     //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);            // 3.0+ only
 #endif
         
-    impl->imageWindow.initialize (nullptr, this);
+    if (!impl->imageWindow.initialize (nullptr, this))
+        return false;
     p.lap ("imageWindow");
     
     if (Prefs::showHelpOnStartup())
@@ -206,6 +211,9 @@ void Viewer::shutdown ()
     if (!impl->mainContextWindow())
         return;
 
+    // Don't leave truncated files behind.
+    ImageWriter::instance().waitForAll ();
+
     // Make sure a context is set for the textures.
     glfwMakeContextCurrent(impl->mainContextWindow());
     impl->imageList.releaseGL();
@@ -317,6 +325,11 @@ ImageId Viewer::addImageData (const ImageSRGBA& image, const std::string& imageN
     return impl->imageList.addImage (imageItemFromData (image, imageName), insertPos, replaceExisting);
 }
 
+ImageId Viewer::addImageData (const NativeImagePtr& image, const std::string& imageName, int insertPos, bool replaceExisting)
+{    
+    return impl->imageList.addImage (imageItemFromData (image, imageName), insertPos, replaceExisting);
+}
+
 ImageId Viewer::addImageItem (ImageItemUniquePtr imageItem, int insertPos, bool replaceExisting)
 {
     return impl->imageList.addImage (std::move(imageItem), insertPos, replaceExisting);
@@ -459,6 +472,24 @@ void Viewer::runAction (ImageWindowAction action)
     impl->imageWindow.addCommand (ImageWindow::actionCommand(action));
 }
 
+void Viewer::setViewerMode (ViewerMode mode)
+{
+    impl->imageWindow.mutableState().activeMode = mode;
+}
+
+void Viewer::setNameFilter (const std::string& text)
+{
+    if (text.empty())
+        impl->imageList.setFilter (nullptr);
+    else
+        impl->imageList.setFilter ([text](const std::string& name) { return name.find(text) != std::string::npos; });
+}
+
+int Viewer::numImages () const
+{
+    return impl->imageList.numImages();
+}
+
 void Viewer::runAfterConfirmingPendingChanges (std::function<void(void)>&& func)
 {
     // Already a pending confirmation, skip.
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <libzv/Image.h>
+#include <libzv/NativeImage.h>
 #include <libzv/ImageWindowActions.h>
 
 #include <memory>
@@ -22,6 +23,8 @@ class ControlsWindow;
 class ImageList;
 using ImageId = int64_t;
 
+enum class ViewerMode;
+
 struct ImageItem;
 using ImageItemPtr = std::shared_ptr<ImageItem>;
 using ImageItemUniquePtr = std::unique_ptr<ImageItem>;
@@ -56,6 +59,7 @@ public:
 public:
     ImageId addImageFromFile (const std::string& imagePath, bool replaceExisting = true);
     ImageId addImageData (const ImageSRGBA& image, const std::string& imageName, int insertPos = -1, bool replaceExisting = true);
+    ImageId addImageData (const NativeImagePtr& image, const std::string& imageName, int insertPos = -1, bool replaceExisting = true);
     ImageId addPastedImage ();
     ImageId selectedImage () const;
     void selectImageIndex (int index);
@@ -72,6 +76,12 @@ public:
 
     void setLayout (int nrows, int ncols);
     void runAction (ImageWindowAction action);
+    void setViewerMode (ViewerMode mode);
+
+    // Only the images whose name contains the text stay enabled, all of
+    // them when it is empty.
+    void setNameFilter (const std::string& text);
+    int numImages () const;
 
     void refreshPrettyFileNames ();    
         
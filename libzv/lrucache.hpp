@@ -52,6 +52,19 @@ public:
 		}
 	}
 
+	// Removes the least recently used item, returns false if empty.
+	bool pop_back (value_t* value = nullptr) {
+		if (_cache_items_list.empty())
+			return false;
+		auto last = _cache_items_list.end();
+		last--;
+		if (value)
+			*value = last->second;
+		_cache_items_map.erase(last->first);
+		_cache_items_list.pop_back();
+		return true;
+	}
+
 	const value_t* get(const key_t& key) {
 		auto it = _cache_items_map.find(key);
 		if (it == _cache_items_map.end()) {
@@ -142,6 +142,77 @@ ImageSRGBA imageFromPythonArray (py::array buffer)
     return image;
 }
 
+// uint16, float32 and uint8 grayscale arrays are kept in their native
+// format, the normalization is done by the GPU. Returns null for 8-bit
+// color arrays.
+NativeImagePtr nativeImageFromPythonArray (py::array buffer)
+{
+    py::buffer_info info = buffer.request();
+
+    if (info.ndim != 2 && info.ndim != 3)
+        throw std::runtime_error("Image dimension must be 2 (grayscale) or 3 (color)");
+
+    const bool isUint8 = info.format == py::format_descriptor<uint8_t>::format();
+    const bool isUint16 = info.format == py::format_descriptor<uint16_t>::format();
+    const bool isFloat = info.format == py::format_descriptor<float>::format();
+    const bool isGray = info.ndim == 2 || info.shape[2] == 1;
+    
+    // 8-bit gray images are stored as a single channel too, 8-bit color
+    // ones are already in the display format.
+    if (!isUint16 && !isFloat && !(isUint8 && isGray))
+        return nullptr;
+
+    if (!(buffer.flags() & py::array::c_style))
+    {
+        throw std::runtime_error("Input image must be contiguous and c_style. You might want to use np.ascontiguousarray().");
+    }
+
+    const int numRows = info.shape[0];
+    const int numCols = info.shape[1];
+    const int numChannels = info.ndim == 3 ? info.shape[2] : 1;
+    
+    switch (numChannels)
+    {
+        case 1:
+        {
+            const auto format = isFloat ? NativeImage::Format::GrayFloat : (isUint8 ? NativeImage::Format::Gray8 : NativeImage::Format::Gray16);
+            return std::make_shared<NativeImage>(format, (uint8_t*)info.ptr, numCols, numRows, info.strides[0]);
+        }
+
+        case 4:
+        {
+            const auto format = isFloat ? NativeImage::Format::RGBAFloat : NativeImage::Format::RGBA16;
+            return std::make_shared<NativeImage>(format, (uint8_t*)info.ptr, numCols, numRows, info.strides[0]);
+        }
+
+        case 3:
+        {
+            // Add an opaque alpha channel.
+            const int bytesPerChannel = isFloat ? 4 : 2;
+            const int outBytesPerRow = numCols * 4 * bytesPerChannel;
+            std::vector<uint8_t> rgba (outBytesPerRow * numRows);
+            uint8_t opaque[4];
+            if (isFloat) { float v = 1.f; memcpy (opaque, &v, 4); }
+            else { uint16_t v = 65535; memcpy (opaque, &v, 2); }
+            for (int r = 0; r < numRows; ++r)
+            {
+                const uint8_t* inRowPtr = (const uint8_t*)info.ptr + r*info.strides[0];
+                uint8_t* outRowPtr = rgba.data() + r*outBytesPerRow;
+                for (int c = 0; c < numCols; ++c)
+                {
+                    memcpy (outRowPtr + c*4*bytesPerChannel, inRowPtr + c*3*bytesPerChannel, 3*bytesPerChannel);
+                    memcpy (outRowPtr + (c*4 + 3)*bytesPerChannel, opaque, bytesPerChannel);
+                }
+            }
+            const auto format = isFloat ? NativeImage::Format::RGBAFloat : NativeImage::Format::RGBA16;
+            return std::make_shared<NativeImage>(format, rgba.data(), numCols, numRows, outBytesPerRow);
+        }
+
+        default:
+            throw std::runtime_error("Channel size must be 1 (grayscale), 3 (RGB) or 4 (RGBA)");
+    }
+}
+
 void register_Viewer (py::module& m)
 {
     py::class_<ImageItem, ImageItemPtr>(m, "ImageItem")
@@ -154,6 +225,10 @@ void register_Viewer (py::module& m)
         .def("addImageFromFile", &Viewer::addImageFromFile)
 
         .def("addImage", [](Viewer& viewer, const std::string& name, py::array buffer, int position, bool replace) {
+            NativeImagePtr nativeIm = nativeImageFromPythonArray (buffer);
+            if (nativeIm)
+                return nativeIm->hasData() ? viewer.addImageData (nativeIm, name, position, replace) : int64_t(-1);
+
             ImageSRGBA im = imageFromPythonArray (buffer);
             if (im.hasData())
                 return viewer.addImageData (im, name, position, replace);
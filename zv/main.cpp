@@ -23,6 +23,6 @@ int main (int argc, char* argv[])
     }
     p.lap ("init");
     
-    app.run ();    
-    return 0;
+    const bool succeeded = app.run ();
+    return succeeded ? 0 : 1;
 }